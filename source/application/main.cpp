@@ -19,21 +19,169 @@
  *
  *-------------------------------------------------*/
 
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QTimer>
 #include <QtSingleApplication>
+#include <qtlocalpeer.h>
 
-#include <MainWindow>
+#include <StartupTracer>
 #include <Version>
+#include <WindowManager>
+
+/*
+    Tracing has to start before the application object exists, so the
+    option is looked up in argv directly. --trace-startup writes to
+    startup-trace.json, --trace-startup=FILE to FILE. The environment
+    variable ORBITSWRITER_TRACE_STARTUP names the file as well.
+*/
+static void enableStartupTracing(int argc, char **argv)
+{
+    static const char OPTION[] = "--trace-startup";
+    QString fileName = QString::fromLocal8Bit(qgetenv("ORBITSWRITER_TRACE_STARTUP"));
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], OPTION) == 0) {
+            fileName = QLatin1String("startup-trace.json");
+        } else if (qstrncmp(argv[i], OPTION, sizeof(OPTION) - 1) == 0 && argv[i][sizeof(OPTION) - 1] == '=') {
+            fileName = QString::fromLocal8Bit(argv[i] + sizeof(OPTION));
+        }
+    }
+    if (!fileName.isEmpty()) {
+        GOW::StartupTracer::enable(fileName);
+    }
+}
+
+using Extern::QtLocalPayload;
+
+// Sent along with the files of a later launch; no file argument starts with "--".
+static const char LAUNCHED_AT[] = "--launched-at=";
+
+/*
+    Opens what later launches hand over. Piped in posts are parsed where
+    they lie, which may be the shared memory segment they came in. Every
+    launch tells when its main() started, so with --report-launches the
+    time until its window is painted is printed, in milliseconds; the
+    first line is the launch of this process.
+*/
+class LaunchReceiver : public QObject
+{
+    Q_OBJECT
+public:
+    LaunchReceiver(GOW::WindowManager *windowManager, qint64 launchedAt, bool report) :
+        windowManager(windowManager), launchedAt(launchedAt), report(report)
+    {
+        connect(windowManager, SIGNAL(windowPainted()), this, SLOT(windowPainted()));
+    }
+
+private slots:
+    void messagesReceived(const QStringList &messages)
+    {
+        QStringList files;
+        foreach (const QString &message, messages) {
+            if (message.startsWith(QLatin1String(LAUNCHED_AT))) {
+                launchedAt = message.mid(sizeof(LAUNCHED_AT) - 1).toLongLong();
+            } else {
+                files << message;
+            }
+        }
+        windowManager->openFiles(files);
+    }
+
+    void payloadReceived(const QtLocalPayload &payload)
+    {
+        windowManager->openHtml(payload.data());
+    }
+
+    void windowPainted()
+    {
+        if (launchedAt == 0) {
+            return;
+        }
+        if (report) {
+            QTextStream out(stdout);
+            out << "window painted " << QDateTime::currentMSecsSinceEpoch() - launchedAt << " ms\n";
+            out.flush();
+        }
+        launchedAt = 0;
+    }
+
+private:
+    GOW::WindowManager *windowManager;
+    qint64 launchedAt;
+    bool report;
+};
 
 int main(int argc, char** argv)
 {
+    const qint64 launchedAt = QDateTime::currentMSecsSinceEpoch();
+    enableStartupTracing(argc, argv);
+    GOW::StartupTracer::instant("main");
+
+    GOW::StartupTracer::begin("QtSingleApplication");
     Extern::QtSingleApplication app(QLatin1String(Application::NAME), argc, argv);
+    GOW::StartupTracer::end("QtSingleApplication");
     app.setOrganizationName(QLatin1String(Application::ORGANIZATION));
     app.setOrganizationDomain(QLatin1String(Application::ORGANIZATION_DOMAIN));
     app.setApplicationName(QLatin1String(Application::NAME));
     app.setApplicationVersion(QLatin1String(Application::VERSION_LONG));
 
-    GOW::MainWindow win;
-    win.showMaximized();
+    // The running instance has a working directory of its own, so file
+    // arguments are made absolute before they are handed over. A "-"
+    // stands for an HTML post piped in on the standard input.
+    QStringList files;
+    QByteArray html;
+    bool readInput = false;
+    foreach (const QString &argument, app.arguments().mid(1)) {
+        if (argument == QLatin1String("-")) {
+            readInput = true;
+        } else if (!argument.startsWith(QLatin1String("--"))) {
+            files << QFileInfo(argument).absoluteFilePath();
+        }
+    }
+    if (readInput) {
+        QFile input;
+        if (input.open(stdin, QIODevice::ReadOnly)) {
+            html = input.readAll();
+        }
+    }
+    // A second launch hands all its file arguments over to the running
+    // instance in a single message and quits. The running instance opens
+    // a new window for each file, or an empty one if there is none. Piped
+    // in posts go as a payload, which is passed in shared memory when it
+    // is large.
+    if (app.isRunning()) {
+        bool ok = true;
+        if (!files.isEmpty() || !readInput) {
+            ok = app.sendMessages(QStringList(QLatin1String(LAUNCHED_AT) + QString::number(launchedAt)) + files);
+        }
+        if (ok && readInput) {
+            ok = app.sendPayload(html);
+        }
+        return ok ? 0 : 1;
+    }
+
+    // Unless --no-resident is given, the process keeps running after its
+    // last window has been closed so later launches come up at once.
+    GOW::WindowManager *windowManager = GOW::WindowManager::instance();
+    windowManager->setResident(!app.arguments().contains(QLatin1String("--no-resident")));
+    LaunchReceiver launchReceiver(windowManager, launchedAt,
+                                  app.arguments().contains(QLatin1String("--report-launches")));
+    QObject::connect(&app, SIGNAL(messagesReceived(QStringList)), &launchReceiver, SLOT(messagesReceived(QStringList)));
+    QObject::connect(&app, SIGNAL(payloadReceived(QtLocalPayload)), &launchReceiver, SLOT(payloadReceived(QtLocalPayload)));
+    if (!files.isEmpty() || !readInput) {
+        windowManager->openFiles(files);
+    }
+    if (readInput) {
+        windowManager->openHtml(html);
+    }
+    // Posts left behind by a crash come back once the first window is up.
+    QTimer::singleShot(0, windowManager, SLOT(recoverSessions()));
 
-    return app.exec();
+    const int result = app.exec();
+    GOW::StartupTracer::finish();
+    return result;
 }
+
+#include "main.moc"
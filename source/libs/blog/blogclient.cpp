@@ -0,0 +1,377 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QFileInfo>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+
+#include <HtmlWriter>
+
+#include "blogclient.h"
+#include "xmlrpc.h"
+
+namespace GOW
+{
+
+static const int DEFAULT_MAX_UPLOADS = 4;
+static const char * const TOKEN_FIELD = "orbitswriter_token";
+
+/*
+    Points the images of \a content at their uploaded variants. HtmlWriter
+    writes the resource name as the first attribute of every image, so a
+    plain replacement finds them all.
+ */
+static QString rewriteImages(QString content, const QList<MediaItem> &media,
+                             const QVector<QStringList> &urls)
+{
+    for (int i = 0; i < media.count(); ++i) {
+        if (urls.at(i).isEmpty()) {
+            continue;
+        }
+        const QString from = QLatin1String("<img src=\"") + HtmlWriter::escape(media.at(i).name)
+                + QLatin1Char('"');
+        const QString to = QLatin1String("<img src=\"") + HtmlWriter::escape(urls.at(i).last())
+                + QLatin1String("\" srcset=\"")
+                + HtmlWriter::escape(MediaPipeline::srcset(media.at(i), urls.at(i)))
+                + QLatin1Char('"');
+        content.replace(from, to);
+    }
+    return content;
+}
+
+/*!
+  \class GOW::BlogClient
+
+  Publishes posts to a blog through the MetaWeblog XML-RPC API.
+
+  All calls go through one QNetworkAccessManager, which keeps the HTTP
+  connections to the blog open between calls. The variants of the images
+  of a post are uploaded first, at most maxConcurrentUploads() at a time,
+  and the post is sent once they all are there, with its images pointing
+  at the uploaded variants. Request bodies are streamed: media files are
+  read and encoded while they are sent. A variant uploaded once is not
+  uploaded again for a later post.
+ */
+
+/*!
+  Constructs a client with \a parent.
+ */
+BlogClient::BlogClient(QObject *parent) :
+    QObject(parent),
+    m_manager(new QNetworkAccessManager(this)),
+    m_maxUploads(DEFAULT_MAX_UPLOADS),
+    m_runningUploads(0),
+    m_nextJob(1)
+{
+    qRegisterMetaType<XmlRpcFile>();
+}
+
+/*!
+  Destructs the client. Unfinished jobs are dropped.
+ */
+BlogClient::~BlogClient()
+{
+}
+
+/*!
+  Sets the \a account to publish to. Uploads remembered for the previous
+  account are forgotten.
+ */
+void BlogClient::setAccount(const BlogAccount &account)
+{
+    if (account.endpoint != m_account.endpoint || account.blogId != m_account.blogId) {
+        m_uploaded.clear();
+    }
+    m_account = account;
+}
+
+/*!
+  Sets the number of media uploads running at the same time to \a count.
+  QNetworkAccessManager opens at most six connections to a host, so more
+  than that only queues there instead of here.
+ */
+void BlogClient::setMaxConcurrentUploads(int count)
+{
+    m_maxUploads = qMax(1, count);
+    startUploads();
+}
+
+/*!
+  Publishes \a post with the processed images \a media, and returns the
+  job, which is reported by published() or failed(). Images of the post
+  which are not in \a media are sent as they are. Failures which may go
+  away on a retry, like network errors, are reported as transient.
+ */
+int BlogClient::publish(const BlogPost &post, const QList<MediaItem> &media)
+{
+    const int id = m_nextJob++;
+    Job job;
+    job.post = post;
+    job.media = media;
+    job.urls.resize(media.count());
+    job.uploaded = 0;
+    job.total = 0;
+    for (int i = 0; i < media.count(); ++i) {
+        const MediaItem &item = media.at(i);
+        for (int j = 0; j < item.variants.count(); ++j) {
+            const QString url = m_uploaded.value(item.variants.at(j).fileName);
+            job.urls[i] << url;
+            if (url.isEmpty()) {
+                Upload upload;
+                upload.job = id;
+                upload.item = i;
+                upload.variant = j;
+                m_uploads.enqueue(upload);
+                ++job.total;
+            }
+        }
+    }
+    m_jobs.insert(id, job);
+    if (job.total == 0) {
+        sendPost(id);
+    } else {
+        startUploads();
+    }
+    return id;
+}
+
+/*!
+  Looks for the post published with \a token among the \a recentCount
+  most recent posts of the blog, and returns the job, which is reported
+  by postFound() with the ID of the post, or an empty one if it is not
+  there, or by failed(). This tells whether a publish which was cut off
+  reached the blog.
+ */
+int BlogClient::findPost(const QString &token, int recentCount)
+{
+    const int id = m_nextJob++;
+    QVariantList params = credentials(m_account.blogId);
+    params << recentCount;
+    QNetworkReply *reply = call(QLatin1String("metaWeblog.getRecentPosts"), params);
+    Call pending;
+    pending.kind = FindCall;
+    pending.job = id;
+    pending.token = token;
+    m_calls.insert(reply, pending);
+    connect(reply, SIGNAL(finished()), this, SLOT(replyFinished()));
+    return id;
+}
+
+/*!
+  Calls XML-RPC \a method with \a params on the blog. The reply is owned
+  by the caller; XmlRpcResponse::parse() reads it.
+
+  If \a etag is given, it is sent as If-None-Match, and a blog which
+  supports that answers with status 304 and no body if the response has
+  not changed since it was tagged so.
+ */
+QNetworkReply *BlogClient::call(const QString &method, const QVariantList &params,
+                                const QByteArray &etag)
+{
+    XmlRpcRequest *body = new XmlRpcRequest(method, params);
+    QNetworkRequest request(m_account.endpoint);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, QLatin1String("text/xml"));
+    request.setHeader(QNetworkRequest::ContentLengthHeader, body->size());
+    if (!etag.isEmpty()) {
+        request.setRawHeader("If-None-Match", etag);
+    }
+    QNetworkReply *reply = m_manager->post(request, body);
+    body->setParent(reply);
+    return reply;
+}
+
+void BlogClient::replyFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    if (!reply || !m_calls.contains(reply)) {
+        return;
+    }
+    const Call call = m_calls.take(reply);
+    reply->deleteLater();
+    XmlRpcResponse response;
+    // Faults are answers of the blog and do not change on a retry; anything
+    // which did not get an answer through might.
+    bool transient = false;
+    if (reply->error() != QNetworkReply::NoError) {
+        const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        transient = status == 0 || status >= 500 || status == 408 || status == 429;
+        response.errorString = reply->errorString();
+    } else {
+        response = XmlRpcResponse::parse(reply);
+        transient = !response.ok && response.faultCode == 0;
+    }
+
+    if (call.kind == FindCall) {
+        if (response.ok) {
+            finishFind(call, response);
+        } else {
+            emit failed(call.job, tr("Looking up the post failed: %1").arg(response.errorString),
+                        transient);
+        }
+        return;
+    }
+
+    if (call.kind == UploadCall) {
+        --m_runningUploads;
+        if (!m_jobs.contains(call.job)) {
+            // The job has failed already.
+        } else if (!response.ok) {
+            fail(call.job, tr("Uploading %1 failed: %2")
+                 .arg(QFileInfo(m_jobs.value(call.job).media.at(call.upload.item).name).fileName())
+                 .arg(response.errorString), transient);
+        } else {
+            uploadFinished(call.upload, response.value.toMap().value(QLatin1String("url")).toString());
+        }
+        startUploads();
+        return;
+    }
+
+    if (!m_jobs.contains(call.job)) {
+        return;
+    }
+    if (!response.ok) {
+        fail(call.job, tr("Publishing failed: %1").arg(response.errorString), transient);
+        return;
+    }
+    const Job job = m_jobs.take(call.job);
+    emit published(call.job, job.post.postId.isEmpty() ? response.value.toString() : job.post.postId);
+}
+
+void BlogClient::startUploads()
+{
+    while (m_runningUploads < m_maxUploads && !m_uploads.isEmpty()) {
+        const Upload upload = m_uploads.dequeue();
+        if (!m_jobs.contains(upload.job)) {
+            continue;
+        }
+        const MediaVariant variant = m_jobs.value(upload.job).media.at(upload.item)
+                .variants.at(upload.variant);
+        QVariantMap file;
+        // Cached variants are named by content, so the name identifies the file on the blog.
+        file.insert(QLatin1String("name"), QFileInfo(variant.fileName).fileName());
+        file.insert(QLatin1String("type"), variant.mimeType);
+        file.insert(QLatin1String("bits"), QVariant::fromValue(XmlRpcFile(variant.fileName)));
+        QVariantList params = credentials(m_account.blogId);
+        params << file;
+        QNetworkReply *reply = call(QLatin1String("metaWeblog.newMediaObject"), params);
+        Call pending;
+        pending.kind = UploadCall;
+        pending.job = upload.job;
+        pending.upload = upload;
+        m_calls.insert(reply, pending);
+        connect(reply, SIGNAL(finished()), this, SLOT(replyFinished()));
+        ++m_runningUploads;
+    }
+}
+
+void BlogClient::uploadFinished(const Upload &upload, const QString &url)
+{
+    Job &job = m_jobs[upload.job];
+    m_uploaded.insert(job.media.at(upload.item).variants.at(upload.variant).fileName, url);
+    job.urls[upload.item][upload.variant] = url;
+    ++job.uploaded;
+    emit uploadProgress(upload.job, job.uploaded, job.total);
+    if (job.uploaded == job.total) {
+        sendPost(upload.job);
+    }
+}
+
+void BlogClient::sendPost(int id)
+{
+    const Job &job = m_jobs[id];
+    QVariantMap content;
+    content.insert(QLatin1String("title"), job.post.title);
+    content.insert(QLatin1String("description"), rewriteImages(job.post.content, job.media, job.urls));
+    if (!job.post.categories.isEmpty()) {
+        content.insert(QLatin1String("categories"), job.post.categories);
+    }
+    if (job.post.dateCreated.isValid()) {
+        content.insert(QLatin1String("dateCreated"), job.post.dateCreated);
+    }
+    if (!job.post.token.isEmpty()) {
+        QVariantMap field;
+        field.insert(QLatin1String("key"), QLatin1String(TOKEN_FIELD));
+        field.insert(QLatin1String("value"), job.post.token);
+        content.insert(QLatin1String("custom_fields"), QVariantList() << field);
+    }
+    QVariantList params;
+    QString method;
+    if (job.post.postId.isEmpty()) {
+        method = QLatin1String("metaWeblog.newPost");
+        params = credentials(m_account.blogId);
+    } else {
+        method = QLatin1String("metaWeblog.editPost");
+        params = credentials(job.post.postId);
+    }
+    params << content << job.post.publish;
+    QNetworkReply *reply = call(method, params);
+    Call pending;
+    pending.kind = PostCall;
+    pending.job = id;
+    m_calls.insert(reply, pending);
+    connect(reply, SIGNAL(finished()), this, SLOT(replyFinished()));
+}
+
+/*
+    Looks for the token among the custom fields of the recent posts. A
+    blog which returns no custom fields at all cannot tell whether the
+    post is there.
+ */
+void BlogClient::finishFind(const Call &call, const XmlRpcResponse &response)
+{
+    const QVariantList posts = response.value.toList();
+    bool hasFields = false;
+    foreach (const QVariant &post, posts) {
+        const QVariantMap map = post.toMap();
+        if (!map.contains(QLatin1String("custom_fields"))) {
+            continue;
+        }
+        hasFields = true;
+        foreach (const QVariant &field, map.value(QLatin1String("custom_fields")).toList()) {
+            const QVariantMap fieldMap = field.toMap();
+            if (fieldMap.value(QLatin1String("key")).toString() == QLatin1String(TOKEN_FIELD)
+                    && fieldMap.value(QLatin1String("value")).toString() == call.token) {
+                emit postFound(call.job, map.value(QLatin1String("postid")).toString());
+                return;
+            }
+        }
+    }
+    if (!posts.isEmpty() && !hasFields) {
+        emit failed(call.job, tr("The blog does not report custom fields, so it cannot be "
+                                 "checked whether the post was published already."), false);
+        return;
+    }
+    emit postFound(call.job, QString());
+}
+
+void BlogClient::fail(int id, const QString &message, bool transient)
+{
+    m_jobs.remove(id);
+    emit failed(id, message, transient);
+}
+
+QVariantList BlogClient::credentials(const QString &id) const
+{
+    return QVariantList() << id << m_account.userName << m_account.password;
+}
+
+}
@@ -0,0 +1,151 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef BLOGCLIENT_H
+#define BLOGCLIENT_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QQueue>
+#include <QStringList>
+#include <QUrl>
+#include <QVariant>
+#include <QVector>
+
+#include <MediaPipeline>
+
+#include "blog_global.h"
+
+QT_FORWARD_DECLARE_CLASS(QNetworkAccessManager)
+QT_FORWARD_DECLARE_CLASS(QNetworkReply)
+
+namespace GOW
+{
+
+struct XmlRpcResponse;
+
+struct BlogAccount
+{
+    BlogAccount() : rememberPassword(false) {}
+
+    bool isValid() const { return endpoint.isValid() && !userName.isEmpty(); }
+
+    QUrl endpoint; // the XML-RPC URL, e.g. http://example.com/xmlrpc.php
+    QString blogId;
+    QString userName;
+    QString password;
+    bool rememberPassword; // kept in the settings, which are not encrypted
+};
+
+struct BlogPost
+{
+    BlogPost() : publish(true) {}
+
+    QString postId; // empty for a new post
+    QString title;
+    QString content; // HTML as written by HtmlWriter
+    QStringList categories;
+    QDateTime dateCreated;
+    bool publish; // false to keep it as a draft on the blog
+    QString token; // sent as a custom field, see BlogClient::findPost()
+};
+
+class BLOG_EXPORT BlogClient : public QObject
+{
+    Q_OBJECT
+public:
+    explicit BlogClient(QObject *parent = 0);
+    ~BlogClient();
+
+    void setAccount(const BlogAccount &account);
+    BlogAccount account() const { return m_account; }
+
+    void setMaxConcurrentUploads(int count);
+    int maxConcurrentUploads() const { return m_maxUploads; }
+
+    int publish(const BlogPost &post, const QList<MediaItem> &media = QList<MediaItem>());
+    int findPost(const QString &token, int recentCount = 50);
+    int pendingCount() const { return m_jobs.count(); }
+
+    QNetworkReply *call(const QString &method, const QVariantList &params,
+                        const QByteArray &etag = QByteArray());
+
+signals:
+    void published(int job, const QString &postId);
+    void postFound(int job, const QString &postId);
+    void failed(int job, const QString &message, bool transient);
+    void uploadProgress(int job, int uploaded, int total);
+
+private slots:
+    void replyFinished();
+
+private:
+    Q_DISABLE_COPY(BlogClient)
+
+    struct Job
+    {
+        BlogPost post;
+        QList<MediaItem> media;
+        QVector<QStringList> urls; // per item, per variant
+        int uploaded;
+        int total;
+    };
+
+    struct Upload
+    {
+        int job;
+        int item;
+        int variant;
+    };
+
+    enum CallKind { UploadCall, PostCall, FindCall };
+
+    struct Call
+    {
+        CallKind kind;
+        int job;
+        Upload upload;
+        QString token;
+    };
+
+    void startUploads();
+    void uploadFinished(const Upload &upload, const QString &url);
+    void sendPost(int id);
+    void finishFind(const Call &call, const XmlRpcResponse &response);
+    void fail(int id, const QString &message, bool transient);
+    QVariantList credentials(const QString &id) const;
+
+    BlogAccount m_account;
+    QNetworkAccessManager *m_manager;
+    int m_maxUploads;
+    int m_runningUploads;
+    int m_nextJob;
+    QMap<int, Job> m_jobs;
+    QQueue<Upload> m_uploads;
+    QHash<QNetworkReply *, Call> m_calls;
+    QHash<QString, QString> m_uploaded; // variant file -> URL
+}; // end of class GOW::BlogClient
+
+} // end of namespace GOW
+
+#endif // BLOGCLIENT_H
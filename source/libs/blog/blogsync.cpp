@@ -0,0 +1,511 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QPair>
+#include <QStringList>
+#include <QTextDocument>
+
+#if defined(Q_OS_UNIX)
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <io.h>
+#endif
+
+#include <DraftLibrary>
+#include <SearchIndex>
+
+#include "blogclient.h"
+#include "blogsync.h"
+#include "xmlrpc.h"
+
+namespace GOW
+{
+
+static const quint32 CACHE_MAGIC = 0x4f575343; // "OWSC"
+static const quint32 FORMAT_VERSION = 1;
+static const QDataStream::Version STREAM_VERSION = QDataStream::Qt_4_8;
+
+static const int DEFAULT_PAGE_SIZE = 50;
+static const int MAX_PAGE_SIZE = 500;
+static const int HTTP_NOT_MODIFIED = 304;
+
+static const char * const NEW_SUFFIX = ".new";
+
+static bool syncFile(QFile *file)
+{
+    if (!file->flush()) {
+        return false;
+    }
+#if defined(Q_OS_UNIX)
+    return ::fsync(file->handle()) == 0;
+#elif defined(Q_OS_WIN)
+    return ::_commit(file->handle()) == 0;
+#else
+    return true;
+#endif
+}
+
+/*
+    Identifies the content of a post, so a post which was only touched on
+    the blog is not merged again.
+ */
+static QByteArray postHash(const QString &title, const QString &content, const QStringList &tags)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(title.toUtf8());
+    hash.addData("\0", 1);
+    hash.addData(content.toUtf8());
+    hash.addData("\0", 1);
+    hash.addData(tags.join(QLatin1String("\n")).toUtf8());
+    return hash.result();
+}
+
+static QStringList categories(const QVariant &terms)
+{
+    QStringList result;
+    foreach (const QVariant &term, terms.toList()) {
+        const QVariantMap map = term.toMap();
+        if (map.value(QLatin1String("taxonomy")).toString() == QLatin1String("category")) {
+            result << map.value(QLatin1String("name")).toString();
+        }
+    }
+    return result;
+}
+
+QDataStream &operator<<(QDataStream &ds, const BlogSync::Entry &entry)
+{
+    return ds << entry.draftId << entry.hash << entry.localModified;
+}
+
+QDataStream &operator>>(QDataStream &ds, BlogSync::Entry &entry)
+{
+    return ds >> entry.draftId >> entry.hash >> entry.localModified;
+}
+
+/*!
+  \class GOW::BlogSync
+
+  Brings the posts of the blog into the draft library.
+
+  Only what changed since the last sync is downloaded. Posts are fetched
+  through wp.getPosts, most recently modified first, a page at a time,
+  until a post older than the newest one of the last sync shows up. The
+  first page is sent with the ETag it had last time, so a blog which
+  supports conditional requests answers an unchanged blog with a single
+  empty 304.
+
+  A cache file remembers which draft every post went to, the hash of the
+  post and the time of the draft when the two matched. A post whose hash
+  did not change is skipped. A changed post replaces its draft, unless
+  the draft was edited since; then the post goes into a new draft next
+  to it and conflict() is emitted, so no local edit is ever overwritten.
+  Posts published from drafts of this library, as given by
+  setKnownPosts() and linkDraft(), are taken as matching their drafts.
+
+  Every page is merged as one batch of the library, and the cache is
+  written only once the batch is committed, so it never names a draft
+  which is not in the library. Every draft a sync creates records its
+  post in the library; a post whose cache entry was lost, because a sync
+  was cut off in between, is found by that and not created twice. Posts
+  removed from the blog are not removed from the library.
+ */
+
+/*!
+  Constructs a sync of the posts of the account of \a client into
+  \a library.
+ */
+BlogSync::BlogSync(BlogClient *client, DraftLibrary *library, QObject *parent) :
+    QObject(parent),
+    m_client(client),
+    m_library(library),
+    m_index(0),
+    m_pageSize(DEFAULT_PAGE_SIZE),
+    m_reply(0),
+    m_page(0)
+{
+}
+
+/*!
+  Destructs the sync. A running sync is cancelled; it continues where it
+  stopped the next time.
+ */
+BlogSync::~BlogSync()
+{
+    delete m_reply;
+}
+
+/*!
+  Reads the cache of the last sync from \a fileName, which is created by
+  the first sync if it does not exist. Returns false if it cannot be read.
+ */
+bool BlogSync::open(const QString &fileName)
+{
+    const QString pending = fileName + QLatin1String(NEW_SUFFIX);
+    if (QFile::exists(pending)) {
+        // A new file is complete once the old one is gone.
+        if (QFile::exists(fileName)) {
+            QFile::remove(pending);
+        } else {
+            QFile::rename(pending, fileName);
+        }
+    }
+    m_fileName.clear();
+    m_endpoint.clear();
+    m_blogId.clear();
+    m_etag.clear();
+    m_highWater = QDateTime();
+    m_entries.clear();
+
+    QFile file(fileName);
+    if (file.exists()) {
+        if (!file.open(QIODevice::ReadOnly)) {
+            return fail(file.errorString());
+        }
+        QDataStream ds(&file);
+        ds.setVersion(STREAM_VERSION);
+        quint32 magic = 0;
+        quint32 version = 0;
+        ds >> magic >> version;
+        if (magic != CACHE_MAGIC || version > FORMAT_VERSION) {
+            return fail(tr("%1 is not a sync cache").arg(QDir::toNativeSeparators(fileName)));
+        }
+        ds >> m_endpoint >> m_blogId >> m_etag >> m_highWater >> m_entries;
+        if (ds.status() != QDataStream::Ok) {
+            m_entries.clear();
+            return fail(tr("%1 is damaged").arg(QDir::toNativeSeparators(fileName)));
+        }
+    }
+    m_fileName = QFileInfo(fileName).absoluteFilePath();
+    return true;
+}
+
+/*!
+  Sets the number of posts fetched with one request to \a size.
+ */
+void BlogSync::setPageSize(int size)
+{
+    m_pageSize = qBound(1, size, MAX_PAGE_SIZE);
+}
+
+/*!
+  Sets the \a posts published from drafts of the library, by draft. A
+  post without an entry in the cache is taken as matching its draft.
+ */
+void BlogSync::setKnownPosts(const QHash<quint32, QString> &posts)
+{
+    m_knownPosts.clear();
+    for (QHash<quint32, QString>::const_iterator it = posts.constBegin(); it != posts.constEnd(); ++it) {
+        m_knownPosts.insert(it.value(), it.key());
+    }
+}
+
+/*!
+  Records that post \a postId was just published from draft \a draftId.
+  The next change of the post on the blog is compared with the draft as
+  it is now, so the publish itself is not taken as a change.
+ */
+void BlogSync::linkDraft(quint32 draftId, const QString &postId)
+{
+    m_knownPosts.insert(postId, draftId);
+    if (m_entries.contains(postId)) {
+        m_entries.remove(postId);
+        if (!m_reply) {
+            writeCache(m_entries);
+        }
+    }
+}
+
+/*!
+  Starts a sync with the blog of the client, unless one is running. Its
+  end is reported by finished().
+ */
+void BlogSync::sync()
+{
+    if (m_reply) {
+        return;
+    }
+    m_stats = SyncStats();
+    m_timer.start();
+    if (!isOpen()) {
+        finish(false, m_errorString.isEmpty() ? tr("The sync cache is not open.") : m_errorString);
+        return;
+    }
+    if (!m_library->isOpen()) {
+        finish(false, tr("The draft library is not open."));
+        return;
+    }
+    const BlogAccount account = m_client->account();
+    if (!account.isValid()) {
+        finish(false, tr("No blog account is set up."));
+        return;
+    }
+    if (account.endpoint.toString() != m_endpoint || account.blogId != m_blogId) {
+        // Another blog; nothing of the cache applies.
+        m_endpoint = account.endpoint.toString();
+        m_blogId = account.blogId;
+        m_etag.clear();
+        m_highWater = QDateTime();
+        m_entries.clear();
+    }
+    m_page = 0;
+    m_newEtag.clear();
+    m_newHighWater = m_highWater;
+    requestPage();
+}
+
+void BlogSync::requestPage()
+{
+    const BlogAccount account = m_client->account();
+    QVariantMap filter;
+    filter.insert(QLatin1String("number"), m_pageSize);
+    filter.insert(QLatin1String("offset"), m_page * m_pageSize);
+    filter.insert(QLatin1String("orderby"), QLatin1String("post_modified"));
+    filter.insert(QLatin1String("order"), QLatin1String("DESC"));
+    const QStringList fields = QStringList() << QLatin1String("post_id")
+                                             << QLatin1String("post_title")
+                                             << QLatin1String("post_content")
+                                             << QLatin1String("post_modified_gmt")
+                                             << QLatin1String("terms");
+    QVariantList params;
+    params << account.blogId << account.userName << account.password << filter << fields;
+    // Only the first page tells whether anything changed; the later ones
+    // move whenever it did.
+    m_reply = m_client->call(QLatin1String("wp.getPosts"), params,
+                             m_page == 0 ? m_etag : QByteArray());
+    connect(m_reply, SIGNAL(finished()), this, SLOT(pageFinished()));
+}
+
+void BlogSync::pageFinished()
+{
+    QNetworkReply *reply = m_reply;
+    m_reply = 0;
+    reply->deleteLater();
+    ++m_stats.pages;
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status == HTTP_NOT_MODIFIED) {
+        ++m_stats.notModified;
+        finish(true);
+        return;
+    }
+    if (reply->error() != QNetworkReply::NoError) {
+        finish(false, tr("Fetching the posts failed: %1").arg(reply->errorString()));
+        return;
+    }
+    QByteArray body = reply->readAll();
+    m_stats.bytes += body.size();
+    QBuffer buffer(&body);
+    buffer.open(QIODevice::ReadOnly);
+    const XmlRpcResponse response = XmlRpcResponse::parse(&buffer);
+    if (!response.ok) {
+        finish(false, tr("Fetching the posts failed: %1").arg(response.errorString));
+        return;
+    }
+    if (m_page == 0) {
+        m_newEtag = reply->rawHeader("ETag");
+    }
+
+    const QVariantList posts = response.value.toList();
+    bool reachedKnown = false;
+    if (!merge(posts, &reachedKnown)) {
+        finish(false, tr("Merging the posts failed: %1").arg(m_errorString));
+        return;
+    }
+    if (!reachedKnown && posts.count() == m_pageSize) {
+        ++m_page;
+        requestPage();
+        return;
+    }
+    // Complete; the next sync stops where this one started.
+    m_etag = m_newEtag;
+    m_highWater = m_newHighWater;
+    if (!writeCache(m_entries)) {
+        finish(false, m_errorString);
+        return;
+    }
+    finish(true);
+}
+
+/*
+    Merges one page of posts as one batch of the library. Sets
+    reachedKnown if a post older than the last sync was on the page.
+ */
+bool BlogSync::merge(const QVariantList &posts, bool *reachedKnown)
+{
+    QHash<QString, Entry> entries = m_entries;
+    QList<quint32> changed;
+    QList<QPair<quint32, quint32> > conflicts;
+    QTextDocument document;
+    QHash<quint32, QString> texts;
+
+    m_library->beginBatch();
+    foreach (const QVariant &value, posts) {
+        const QVariantMap post = value.toMap();
+        QDateTime modified = post.value(QLatin1String("post_modified_gmt")).toDateTime();
+        modified.setTimeSpec(Qt::UTC);
+        // Posts modified in the same second as the newest one of the last
+        // sync are looked at again; the hash skips them if they are known.
+        if (m_highWater.isValid() && modified < m_highWater) {
+            *reachedKnown = true;
+            break;
+        }
+        if (!m_newHighWater.isValid() || modified > m_newHighWater) {
+            m_newHighWater = modified;
+        }
+        ++m_stats.received;
+
+        const QString postId = post.value(QLatin1String("post_id")).toString();
+        const QString title = post.value(QLatin1String("post_title")).toString();
+        const QString content = post.value(QLatin1String("post_content")).toString();
+        const QStringList tags = categories(post.value(QLatin1String("terms")));
+        const QByteArray hash = postHash(title, content, tags);
+        const bool cached = entries.contains(postId);
+        Entry entry = entries.value(postId);
+        quint32 knownDraft = 0;
+        if (!cached) {
+            // Published from this draft, or imported into it by a sync
+            // which did not get to write the cache; the draft is the
+            // original either way.
+            knownDraft = m_knownPosts.contains(postId) ? m_knownPosts.value(postId)
+                                                       : m_library->draftForPost(postId);
+        }
+        if (knownDraft != 0) {
+            const DraftInfo draft = m_library->draft(knownDraft);
+            if (draft.id != 0) {
+                entry.draftId = draft.id;
+                entry.hash = hash;
+                entry.localModified = draft.modified.toMSecsSinceEpoch();
+                entries.insert(postId, entry);
+                continue;
+            }
+        }
+        if (cached && entry.hash == hash) {
+            continue;
+        }
+
+        document.setHtml(content);
+        const DraftInfo draft = cached ? m_library->draft(entry.draftId) : DraftInfo();
+        quint32 id = 0;
+        if (draft.id != 0 && draft.modified.toMSecsSinceEpoch() != entry.localModified) {
+            // Edited on both sides; the draft stays as it is.
+            id = m_library->save(0, &document, tr("%1 (from blog)").arg(title), tags);
+            if (id != 0) {
+                conflicts << qMakePair(draft.id, id);
+                ++m_stats.conflicts;
+            }
+        } else {
+            // A draft removed here comes back with the next change on the blog.
+            id = m_library->save(draft.id, &document, title, tags);
+            if (id != 0 && draft.id == 0 && !m_library->setPostId(id, postId)) {
+                id = 0;
+            }
+            if (id != 0) {
+                entry.draftId = id;
+                entry.localModified = m_library->draft(id).modified.toMSecsSinceEpoch();
+                if (draft.id != 0) {
+                    ++m_stats.updated;
+                } else {
+                    ++m_stats.created;
+                }
+            }
+        }
+        if (id == 0) {
+            m_errorString = m_library->errorString();
+            m_library->abortBatch();
+            return false;
+        }
+        entry.hash = hash;
+        entries.insert(postId, entry);
+        changed << id;
+        if (m_index) {
+            texts.insert(id, title + QLatin1Char('\n') + document.toPlainText());
+        }
+    }
+
+    if (!m_library->commitBatch()) {
+        m_errorString = m_library->errorString();
+        return false;
+    }
+    m_entries = entries;
+
+    if (m_index && m_index->isOpen() && !texts.isEmpty()) {
+        for (QHash<quint32, QString>::const_iterator it = texts.constBegin(); it != texts.constEnd(); ++it) {
+            m_index->update(it.key(), it.value());
+        }
+        m_index->commit();
+    }
+    if (!changed.isEmpty()) {
+        emit draftsChanged(changed);
+    }
+    for (int i = 0; i < conflicts.count(); ++i) {
+        emit conflict(conflicts.at(i).first, conflicts.at(i).second);
+    }
+    // Only committed drafts make it into the cache; if it is not written,
+    // the next sync finds the new drafts by their posts.
+    return changed.isEmpty() || writeCache(m_entries);
+}
+
+/*
+    Replaces the cache file by \a entries and the state of the last
+    complete sync. The new content is on disk before the old one goes
+    away; if that is cut off, open() finishes the rename.
+ */
+bool BlogSync::writeCache(const QHash<QString, Entry> &entries)
+{
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    ds.setVersion(STREAM_VERSION);
+    ds << CACHE_MAGIC << FORMAT_VERSION << m_endpoint << m_blogId << m_etag << m_highWater << entries;
+
+    QFile file(m_fileName + QLatin1String(NEW_SUFFIX));
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !syncFile(&file)) {
+        return fail(tr("Cannot write %1: %2").arg(QDir::toNativeSeparators(m_fileName))
+                    .arg(file.errorString()));
+    }
+    file.close();
+    QFile::remove(m_fileName);
+    if (!file.rename(m_fileName)) {
+        return fail(tr("Cannot write %1: %2").arg(QDir::toNativeSeparators(m_fileName))
+                    .arg(file.errorString()));
+    }
+    return true;
+}
+
+void BlogSync::finish(bool ok, const QString &message)
+{
+    m_stats.elapsed = m_timer.elapsed();
+    emit finished(ok, message);
+}
+
+bool BlogSync::fail(const QString &message)
+{
+    m_errorString = message;
+    return false;
+}
+
+}
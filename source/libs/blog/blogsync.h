@@ -0,0 +1,139 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef BLOGSYNC_H
+#define BLOGSYNC_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QVariant>
+
+#include "blog_global.h"
+
+QT_FORWARD_DECLARE_CLASS(QDataStream)
+QT_FORWARD_DECLARE_CLASS(QNetworkReply)
+
+namespace GOW
+{
+
+class BlogClient;
+class DraftLibrary;
+class SearchIndex;
+
+struct SyncStats
+{
+    SyncStats() : pages(0), notModified(0), received(0), created(0), updated(0), conflicts(0),
+        bytes(0), elapsed(0) {}
+
+    int pages;
+    int notModified; // pages answered with 304
+    int received; // posts newer than the last sync
+    int created;
+    int updated;
+    int conflicts;
+    qint64 bytes; // response bodies
+    qint64 elapsed; // msecs
+};
+
+class BLOG_EXPORT BlogSync : public QObject
+{
+    Q_OBJECT
+public:
+    BlogSync(BlogClient *client, DraftLibrary *library, QObject *parent = 0);
+    ~BlogSync();
+
+    bool open(const QString &fileName);
+    bool isOpen() const { return !m_fileName.isEmpty(); }
+    QString errorString() const { return m_errorString; }
+
+    void setSearchIndex(SearchIndex *index) { m_index = index; }
+    void setPageSize(int size);
+    int pageSize() const { return m_pageSize; }
+    void setKnownPosts(const QHash<quint32, QString> &posts);
+
+    bool isRunning() const { return m_reply != 0; }
+    SyncStats stats() const { return m_stats; }
+    int postCount() const { return m_entries.count(); }
+
+signals:
+    void draftsChanged(const QList<quint32> &ids);
+    void conflict(quint32 draftId, quint32 copyId);
+    void finished(bool ok, const QString &message);
+
+public slots:
+    void sync();
+    void linkDraft(quint32 draftId, const QString &postId);
+
+private slots:
+    void pageFinished();
+
+private:
+    Q_DISABLE_COPY(BlogSync)
+
+    struct Entry
+    {
+        Entry() : draftId(0), localModified(0) {}
+
+        quint32 draftId;
+        QByteArray hash; // of the post as last merged
+        qint64 localModified; // msecs of the draft when it last matched the post
+    };
+
+    friend QDataStream &operator<<(QDataStream &ds, const Entry &entry);
+    friend QDataStream &operator>>(QDataStream &ds, Entry &entry);
+
+    void requestPage();
+    bool merge(const QVariantList &posts, bool *reachedKnown);
+    bool writeCache(const QHash<QString, Entry> &entries);
+    void finish(bool ok, const QString &message = QString());
+    bool fail(const QString &message);
+
+    BlogClient *m_client;
+    DraftLibrary *m_library;
+    SearchIndex *m_index;
+    QString m_fileName;
+    QString m_errorString;
+    int m_pageSize;
+    QHash<QString, quint32> m_knownPosts; // post -> draft published from it
+
+    // The cache of the last sync.
+    QString m_endpoint;
+    QString m_blogId;
+    QByteArray m_etag; // of the first page
+    QDateTime m_highWater; // UTC; the newest modification merged
+    QHash<QString, Entry> m_entries; // post -> draft
+
+    // The running sync.
+    QNetworkReply *m_reply;
+    int m_page;
+    QByteArray m_newEtag;
+    QDateTime m_newHighWater;
+    QElapsedTimer m_timer;
+    SyncStats m_stats;
+}; // end of class GOW::BlogSync
+
+} // end of namespace GOW
+
+#endif // BLOGSYNC_H
@@ -0,0 +1,611 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QRunnable>
+#include <QStringList>
+#include <QUuid>
+
+#if defined(Q_OS_UNIX)
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <io.h>
+#endif
+
+#include "outbox.h"
+
+namespace GOW
+{
+
+static const quint32 ITEM_MAGIC = 0x4f574f42; // "OWOB"
+static const quint32 MEDIA_MAGIC = 0x4f574f4d; // "OWOM"
+static const quint32 POSTS_MAGIC = 0x4f574f50; // "OWOP"
+static const quint32 FORMAT_VERSION = 1;
+static const QDataStream::Version STREAM_VERSION = QDataStream::Qt_4_8;
+
+static const int MAX_ATTEMPTS = 12;
+static const qint64 INITIAL_RETRY_DELAY = 10 * 1000;
+static const qint64 MAX_RETRY_DELAY = 30 * 60 * 1000;
+// Wakes up at least this often, so a changed system clock is noticed.
+static const qint64 MAX_TIMER_INTERVAL = 60 * 60 * 1000;
+
+static const char * const ITEM_SUFFIX = ".item";
+static const char * const MEDIA_SUFFIX = ".media";
+static const char * const NEW_SUFFIX = ".new";
+static const char * const POSTS_FILE = "posts";
+
+static QStringList nameFilter(const char *suffix)
+{
+    return QStringList() << QLatin1Char('*') + QString::fromLatin1(suffix);
+}
+
+static bool syncFile(QFile *file)
+{
+    if (!file->flush()) {
+        return false;
+    }
+#if defined(Q_OS_UNIX)
+    return ::fsync(file->handle()) == 0;
+#elif defined(Q_OS_WIN)
+    return ::_commit(file->handle()) == 0;
+#else
+    return true;
+#endif
+}
+
+/*
+    Replaces \a fileName by \a data. The new content is on disk before the
+    old one goes away; if that is cut off, open() finishes the rename.
+ */
+static bool replaceFile(const QString &fileName, const QByteArray &data, QString *error)
+{
+    QFile file(fileName + QLatin1String(NEW_SUFFIX));
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !syncFile(&file)) {
+        *error = file.errorString();
+        return false;
+    }
+    file.close();
+    QFile::remove(fileName);
+    if (!file.rename(fileName)) {
+        *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+static bool readMedia(const QString &fileName, QList<MediaSource> *sources, QString *error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = file.errorString();
+        return false;
+    }
+    QDataStream ds(&file);
+    ds.setVersion(STREAM_VERSION);
+    quint32 magic = 0;
+    quint32 version = 0;
+    ds >> magic >> version >> *sources;
+    if (magic != MEDIA_MAGIC || version > FORMAT_VERSION || ds.status() != QDataStream::Ok) {
+        *error = QString::fromLatin1("%1 is damaged").arg(QDir::toNativeSeparators(fileName));
+        return false;
+    }
+    return true;
+}
+
+static qint64 retryDelay(int attempts)
+{
+    qint64 delay = INITIAL_RETRY_DELAY << qBound(0, attempts - 1, 16);
+    delay = qMin(delay, MAX_RETRY_DELAY);
+    // Spreads out the retries of items which failed together.
+    return delay + qrand() % (delay / 5 + 1);
+}
+
+/*
+    Reads the images of the item and processes them on a worker thread.
+ */
+class MediaTask : public QRunnable
+{
+public:
+    MediaTask(QObject *receiver, MediaPipeline *pipeline, const QString &fileName,
+              QList<MediaItem> *media, QString *error) :
+        m_receiver(receiver),
+        m_pipeline(pipeline),
+        m_fileName(fileName),
+        m_media(media),
+        m_error(error)
+    {
+    }
+
+    void run()
+    {
+        QList<MediaSource> sources;
+        if (QFile::exists(m_fileName) && !readMedia(m_fileName, &sources, m_error)) {
+            *m_media = QList<MediaItem>();
+        } else {
+            *m_media = m_pipeline->process(sources);
+        }
+        QMetaObject::invokeMethod(m_receiver, "mediaReady", Qt::QueuedConnection);
+    }
+
+private:
+    QObject *m_receiver;
+    MediaPipeline *m_pipeline;
+    QString m_fileName;
+    QList<MediaItem> *m_media;
+    QString *m_error;
+};
+
+/*!
+  \class GOW::Outbox
+
+  Posts waiting to be published.
+
+  Publishing never has to wait for the network. A post goes into the
+  outbox, which is a directory next to the draft library, and is sent in
+  the background whenever it is due: at once, or at its scheduled time.
+  If sending fails for a reason which may go away, like being offline,
+  it is tried again later, with the delay doubling on every attempt. All
+  due times are kept in one ordered map with a single timer for the
+  earliest, so a long outbox costs nothing while it waits.
+
+  Every item is a small state file, written and synced before anything
+  is sent, and a file with its images. Queued items therefore survive a
+  restart. Before a new post is sent, the item is marked as sending and
+  gets a token which goes to the blog with the post. An item found in
+  that state later, after a crash or a failure which may have happened
+  after the blog got the post, is first looked up on the blog by its
+  token, so it is never published twice.
+ */
+
+/*!
+  Constructs an outbox which publishes through \a client.
+ */
+Outbox::Outbox(BlogClient *client, QObject *parent) :
+    QObject(parent),
+    m_client(client),
+    m_pipeline(0),
+    m_nextId(1),
+    m_current(0),
+    m_job(0),
+    m_checking(false)
+{
+    m_pool.setMaxThreadCount(1);
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(drain()));
+    connect(client, SIGNAL(published(int,QString)), this, SLOT(clientPublished(int,QString)));
+    connect(client, SIGNAL(postFound(int,QString)), this, SLOT(clientPostFound(int,QString)));
+    connect(client, SIGNAL(failed(int,QString,bool)), this, SLOT(clientFailed(int,QString,bool)));
+    connect(client, SIGNAL(uploadProgress(int,int,int)),
+            this, SLOT(clientUploadProgress(int,int,int)));
+}
+
+/*!
+  Destructs the outbox. A publish which is under way is finished on the
+  next start.
+ */
+Outbox::~Outbox()
+{
+    m_pool.waitForDone();
+    delete m_pipeline;
+}
+
+/*!
+  Opens the outbox in the directory \a path and starts sending the items
+  which are due. Images are processed into \a mediaCache. Returns false
+  if the directory cannot be used.
+ */
+bool Outbox::open(const QString &path, const QString &mediaCache)
+{
+    QDir dir(path);
+    if (!dir.mkpath(QLatin1String("."))) {
+        return fail(tr("Cannot create %1").arg(QDir::toNativeSeparators(path)));
+    }
+    // Finish replacements cut off by a crash; a new file is complete once
+    // the old one is gone.
+    const QStringList pending = dir.entryList(nameFilter(NEW_SUFFIX), QDir::Files);
+    foreach (const QString &name, pending) {
+        const QString target = name.left(name.length() - qstrlen(NEW_SUFFIX));
+        if (dir.exists(target)) {
+            dir.remove(name);
+        } else {
+            dir.rename(name, target);
+        }
+    }
+
+    m_path = dir.absolutePath();
+    delete m_pipeline;
+    m_pipeline = new MediaPipeline(mediaCache);
+    m_items.clear();
+    m_due.clear();
+    m_remotePosts.clear();
+
+    QFile posts(dir.filePath(QLatin1String(POSTS_FILE)));
+    if (posts.open(QIODevice::ReadOnly)) {
+        QDataStream ds(&posts);
+        ds.setVersion(STREAM_VERSION);
+        quint32 magic = 0;
+        quint32 version = 0;
+        ds >> magic >> version;
+        if (magic == POSTS_MAGIC && version <= FORMAT_VERSION) {
+            ds >> m_remotePosts;
+        }
+    }
+
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    const QStringList names = dir.entryList(nameFilter(ITEM_SUFFIX), QDir::Files);
+    foreach (const QString &name, names) {
+        OutboxItem item;
+        if (!readItem(dir.filePath(name), &item)) {
+            continue;
+        }
+        m_nextId = qMax(m_nextId, item.id + 1);
+        if (item.state == OutboxItem::Sending) {
+            // Cut off; attempts is not 0, so it is looked up on the blog first.
+            item.state = OutboxItem::Queued;
+            item.nextAttempt = now;
+        }
+        m_items.insert(item.id, item);
+        if (item.state == OutboxItem::Queued) {
+            schedule(item);
+        }
+    }
+    foreach (const QString &name, dir.entryList(nameFilter(MEDIA_SUFFIX), QDir::Files)) {
+        if (!m_items.contains(name.left(name.indexOf(QLatin1Char('.'))).toUInt(0, 16))) {
+            dir.remove(name);
+        }
+    }
+    emit itemsChanged();
+    return true;
+}
+
+/*!
+  Adds \a post with its \a images to the outbox, and returns the new item,
+  or 0 if it cannot be stored. If \a draftId was published before, the
+  post on the blog is updated. It is sent at once, or at \a scheduled.
+ */
+quint32 Outbox::enqueue(const BlogPost &post, const QList<MediaSource> &images, quint32 draftId,
+                        const QDateTime &scheduled)
+{
+    if (!isOpen()) {
+        fail(tr("The outbox is not open"));
+        return 0;
+    }
+    // An older version of the draft which was never tried is replaced.
+    if (draftId != 0) {
+        foreach (const OutboxItem &item, m_items) {
+            if (item.draftId == draftId && item.attempts == 0 && item.id != m_current
+                    && item.state == OutboxItem::Queued) {
+                remove(item.id);
+            }
+        }
+    }
+
+    OutboxItem item;
+    item.id = m_nextId++;
+    item.draftId = draftId;
+    item.post = post;
+    item.post.token = QUuid::createUuid().toString().remove(QLatin1Char('{')).remove(QLatin1Char('}'));
+    item.scheduled = scheduled.toUTC();
+    item.nextAttempt = scheduled.isValid() ? item.scheduled : QDateTime::currentDateTimeUtc();
+
+    if (!images.isEmpty()) {
+        QByteArray data;
+        QDataStream ds(&data, QIODevice::WriteOnly);
+        ds.setVersion(STREAM_VERSION);
+        ds << MEDIA_MAGIC << FORMAT_VERSION << images;
+        if (!replaceFile(mediaPath(item.id), data, &m_errorString)) {
+            return 0;
+        }
+    }
+    if (!writeItem(item)) {
+        QFile::remove(mediaPath(item.id));
+        return 0;
+    }
+    m_items.insert(item.id, item);
+    schedule(item);
+    emit itemsChanged();
+    return item.id;
+}
+
+/*!
+  Removes item \a id from the outbox. The item being sent cannot be
+  removed.
+ */
+bool Outbox::remove(quint32 id)
+{
+    if (!m_items.contains(id) || id == m_current) {
+        return false;
+    }
+    unschedule(id);
+    m_items.remove(id);
+    QFile::remove(itemPath(id));
+    QFile::remove(mediaPath(id));
+    emit itemsChanged();
+    return true;
+}
+
+/*!
+  Queues the failed item \a id again. An item which may have reached the
+  blog before is still looked up there first.
+ */
+bool Outbox::retry(quint32 id)
+{
+    if (!m_items.contains(id) || m_items.value(id).state != OutboxItem::Failed) {
+        return false;
+    }
+    OutboxItem item = m_items.value(id);
+    item.state = OutboxItem::Queued;
+    item.nextAttempt = QDateTime::currentDateTimeUtc();
+    item.errorString.clear();
+    if (!writeItem(item)) {
+        return false;
+    }
+    m_items.insert(id, item);
+    schedule(item);
+    emit itemsChanged();
+    return true;
+}
+
+/*!
+  Returns the number of items which are still to be sent.
+ */
+int Outbox::pendingCount() const
+{
+    int count = 0;
+    foreach (const OutboxItem &item, m_items) {
+        if (item.state != OutboxItem::Failed) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+/*
+    Sends the earliest due item unless one is being sent already.
+ */
+void Outbox::drain()
+{
+    if (m_current != 0 || m_due.isEmpty()) {
+        return;
+    }
+    if (m_due.begin().key() > QDateTime::currentDateTimeUtc()) {
+        armTimer();
+        return;
+    }
+    const quint32 id = m_due.begin().value();
+    m_due.erase(m_due.begin());
+    send(id);
+}
+
+void Outbox::send(quint32 id)
+{
+    OutboxItem &item = m_items[id];
+    m_current = id;
+    if (item.post.postId.isEmpty() && item.draftId != 0) {
+        // The draft was published by an earlier item meanwhile.
+        item.post.postId = m_remotePosts.value(item.draftId);
+    }
+    emit sending(id, item.post.title);
+    if (item.attempts > 0 && item.post.postId.isEmpty()) {
+        m_checking = true;
+        m_job = m_client->findPost(item.post.token);
+        return;
+    }
+    m_checking = false;
+    m_job = 0;
+    m_mediaError.clear();
+    m_pool.start(new MediaTask(this, m_pipeline, mediaPath(id), &m_media, &m_mediaError));
+}
+
+void Outbox::mediaReady()
+{
+    if (m_current == 0) {
+        return;
+    }
+    OutboxItem &item = m_items[m_current];
+    if (!m_mediaError.isEmpty()) {
+        clientFailed(0, m_mediaError, false);
+        return;
+    }
+    // The marker is on disk before the blog can get the post.
+    item.state = OutboxItem::Sending;
+    ++item.attempts;
+    if (!writeItem(item)) {
+        --item.attempts;
+        clientFailed(0, m_errorString, true);
+        return;
+    }
+    m_job = m_client->publish(item.post, m_media);
+    m_media.clear();
+}
+
+void Outbox::clientPublished(int job, const QString &postId)
+{
+    if (job == m_job && m_current != 0) {
+        finish(postId);
+    }
+}
+
+void Outbox::clientPostFound(int job, const QString &postId)
+{
+    if (job != m_job || m_current == 0) {
+        return;
+    }
+    if (!postId.isEmpty()) {
+        finish(postId);
+        return;
+    }
+    m_checking = false;
+    m_job = 0;
+    m_mediaError.clear();
+    m_pool.start(new MediaTask(this, m_pipeline, mediaPath(m_current), &m_media, &m_mediaError));
+}
+
+/*
+    Also called with job 0 for failures before anything was sent.
+ */
+void Outbox::clientFailed(int job, const QString &message, bool transient)
+{
+    if (job != m_job || m_current == 0) {
+        return;
+    }
+    const quint32 id = m_current;
+    OutboxItem &item = m_items[id];
+    if (m_checking) {
+        ++item.attempts;
+    }
+    item.errorString = message;
+    if (transient && item.attempts < MAX_ATTEMPTS) {
+        item.state = OutboxItem::Queued;
+        item.nextAttempt = QDateTime::currentDateTimeUtc().addMSecs(retryDelay(item.attempts));
+    } else {
+        item.state = OutboxItem::Failed;
+    }
+    writeItem(item);
+    m_current = 0;
+    m_job = 0;
+    m_checking = false;
+    if (item.state == OutboxItem::Queued) {
+        schedule(item);
+        emit retryScheduled(id, item.nextAttempt.toLocalTime(), message);
+    } else {
+        armTimer();
+        emit failed(id, message);
+        emit itemsChanged();
+    }
+}
+
+void Outbox::clientUploadProgress(int job, int uploaded, int total)
+{
+    if (job == m_job && m_current != 0) {
+        emit uploadProgress(m_current, uploaded, total);
+    }
+}
+
+void Outbox::finish(const QString &postId)
+{
+    const OutboxItem item = m_items.take(m_current);
+    QFile::remove(itemPath(item.id));
+    QFile::remove(mediaPath(item.id));
+    if (item.draftId != 0 && !postId.isEmpty() && m_remotePosts.value(item.draftId) != postId) {
+        m_remotePosts.insert(item.draftId, postId);
+        writeRemotePosts();
+    }
+    m_current = 0;
+    m_job = 0;
+    m_checking = false;
+    armTimer();
+    emit published(item.id, postId);
+    if (item.draftId != 0 && !postId.isEmpty()) {
+        emit postLinked(item.draftId, postId);
+    }
+    emit itemsChanged();
+}
+
+QString Outbox::itemPath(quint32 id) const
+{
+    return m_path + QString::fromLatin1("/%1").arg(id, 8, 16, QLatin1Char('0')) + QLatin1String(ITEM_SUFFIX);
+}
+
+QString Outbox::mediaPath(quint32 id) const
+{
+    return m_path + QString::fromLatin1("/%1").arg(id, 8, 16, QLatin1Char('0')) + QLatin1String(MEDIA_SUFFIX);
+}
+
+bool Outbox::readItem(const QString &fileName, OutboxItem *item) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream ds(&file);
+    ds.setVersion(STREAM_VERSION);
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint8 state = 0;
+    qint32 attempts = 0;
+    ds >> magic >> version;
+    if (magic != ITEM_MAGIC || version > FORMAT_VERSION) {
+        return false;
+    }
+    ds >> item->id >> item->draftId >> state
+       >> item->post.postId >> item->post.title >> item->post.content >> item->post.categories
+       >> item->post.dateCreated >> item->post.publish >> item->post.token
+       >> item->scheduled >> item->nextAttempt >> attempts >> item->errorString;
+    item->state = OutboxItem::State(qMin(state, quint8(OutboxItem::Failed)));
+    item->attempts = attempts;
+    return ds.status() == QDataStream::Ok && item->id != 0;
+}
+
+bool Outbox::writeItem(const OutboxItem &item)
+{
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    ds.setVersion(STREAM_VERSION);
+    ds << ITEM_MAGIC << FORMAT_VERSION << item.id << item.draftId << quint8(item.state)
+       << item.post.postId << item.post.title << item.post.content << item.post.categories
+       << item.post.dateCreated << item.post.publish << item.post.token
+       << item.scheduled << item.nextAttempt << qint32(item.attempts) << item.errorString;
+    return replaceFile(itemPath(item.id), data, &m_errorString);
+}
+
+bool Outbox::writeRemotePosts()
+{
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    ds.setVersion(STREAM_VERSION);
+    ds << POSTS_MAGIC << FORMAT_VERSION << m_remotePosts;
+    return replaceFile(m_path + QLatin1Char('/') + QLatin1String(POSTS_FILE), data, &m_errorString);
+}
+
+void Outbox::schedule(const OutboxItem &item)
+{
+    unschedule(item.id);
+    m_due.insert(item.nextAttempt, item.id);
+    armTimer();
+}
+
+void Outbox::unschedule(quint32 id)
+{
+    if (m_items.contains(id)) {
+        m_due.remove(m_items.value(id).nextAttempt, id);
+    }
+}
+
+void Outbox::armTimer()
+{
+    if (m_current != 0 || m_due.isEmpty()) {
+        m_timer.stop();
+        return;
+    }
+    const qint64 wait = QDateTime::currentDateTimeUtc().msecsTo(m_due.begin().key());
+    m_timer.start(int(qBound(qint64(0), wait, MAX_TIMER_INTERVAL)));
+}
+
+bool Outbox::fail(const QString &message)
+{
+    m_errorString = message;
+    return false;
+}
+
+}
@@ -0,0 +1,136 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <MediaPipeline>
+
+#include "blog_global.h"
+#include "blogclient.h"
+
+namespace GOW
+{
+
+struct OutboxItem
+{
+    enum State
+    {
+        Queued,
+        Sending, // also left behind by a crash during the publish
+        Failed   // given up; needs retry() or remove()
+    };
+
+    OutboxItem() : id(0), draftId(0), state(Queued), attempts(0) {}
+
+    quint32 id;
+    quint32 draftId;
+    State state;
+    BlogPost post; // post.token identifies the item on the blog
+    QDateTime scheduled; // UTC, invalid to publish at once
+    QDateTime nextAttempt; // UTC
+    int attempts;
+    QString errorString;
+};
+
+class BLOG_EXPORT Outbox : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Outbox(BlogClient *client, QObject *parent = 0);
+    ~Outbox();
+
+    bool open(const QString &path, const QString &mediaCache);
+    bool isOpen() const { return !m_path.isEmpty(); }
+    QString errorString() const { return m_errorString; }
+
+    quint32 enqueue(const BlogPost &post, const QList<MediaSource> &images, quint32 draftId = 0,
+                    const QDateTime &scheduled = QDateTime());
+    bool remove(quint32 id);
+    bool retry(quint32 id);
+
+    QList<OutboxItem> items() const { return m_items.values(); }
+    OutboxItem item(quint32 id) const { return m_items.value(id); }
+    int pendingCount() const;
+    QString remotePostId(quint32 draftId) const { return m_remotePosts.value(draftId); }
+    QHash<quint32, QString> remotePosts() const { return m_remotePosts; }
+
+signals:
+    void itemsChanged();
+    void sending(quint32 id, const QString &title);
+    void uploadProgress(quint32 id, int uploaded, int total);
+    void published(quint32 id, const QString &postId);
+    void postLinked(quint32 draftId, const QString &postId);
+    void retryScheduled(quint32 id, const QDateTime &when, const QString &message);
+    void failed(quint32 id, const QString &message);
+
+private slots:
+    void drain();
+    void mediaReady();
+    void clientPublished(int job, const QString &postId);
+    void clientPostFound(int job, const QString &postId);
+    void clientFailed(int job, const QString &message, bool transient);
+    void clientUploadProgress(int job, int uploaded, int total);
+
+private:
+    Q_DISABLE_COPY(Outbox)
+
+    QString itemPath(quint32 id) const;
+    QString mediaPath(quint32 id) const;
+    bool readItem(const QString &fileName, OutboxItem *item) const;
+    bool writeItem(const OutboxItem &item);
+    bool writeRemotePosts();
+    void schedule(const OutboxItem &item);
+    void unschedule(quint32 id);
+    void armTimer();
+    void send(quint32 id);
+    void finish(const QString &postId);
+    bool fail(const QString &message);
+
+    BlogClient *m_client;
+    MediaPipeline *m_pipeline;
+    QString m_path;
+    QString m_errorString;
+    quint32 m_nextId;
+    QMap<quint32, OutboxItem> m_items;
+    QMultiMap<QDateTime, quint32> m_due; // the next attempt of every queued item
+    QTimer m_timer;
+    QHash<quint32, QString> m_remotePosts; // draft -> post on the blog
+
+    // The item being published, one at a time.
+    quint32 m_current;
+    int m_job;
+    bool m_checking; // m_job looks the item up on the blog
+    QThreadPool m_pool;
+    QList<MediaItem> m_media;
+    QString m_mediaError;
+}; // end of class GOW::Outbox
+
+} // end of namespace GOW
+
+#endif // OUTBOX_H
@@ -0,0 +1,454 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QStringList>
+#include <QXmlStreamReader>
+
+#include "xmlrpc.h"
+
+namespace GOW
+{
+
+// A multiple of 3, so chunks encode to base64 without padding.
+static const qint64 FILE_CHUNK_SIZE = 3 * 16 * 1024;
+static const char * const DATE_TIME_FORMAT = "yyyyMMddTHH:mm:ss";
+
+static qint64 base64Size(qint64 size)
+{
+    return (size + 2) / 3 * 4;
+}
+
+static QByteArray escape(const QString &text)
+{
+    QString result;
+    result.reserve(text.length());
+    for (int i = 0; i < text.length(); ++i) {
+        const QChar ch = text.at(i);
+        if (ch == QLatin1Char('&')) {
+            result += QLatin1String("&amp;");
+        } else if (ch == QLatin1Char('<')) {
+            result += QLatin1String("&lt;");
+        } else if (ch == QLatin1Char('>')) {
+            result += QLatin1String("&gt;");
+        } else {
+            result += ch;
+        }
+    }
+    return result.toUtf8();
+}
+
+/*!
+  \class GOW::XmlRpcRequest
+
+  The body of an XML-RPC method call, as a device which can be passed to
+  QNetworkAccessManager::post().
+
+  The body is produced while it is read. Only the XML of the scalar
+  parameters is held in memory; XmlRpcFile parameters are read from disk
+  and encoded in chunks as the network asks for them, so uploading large
+  media does not need the file, or its base64 form, in memory. The size
+  is known up front, so the upload can be sent with a Content-Length
+  instead of being buffered, and the device can seek back if the request
+  has to be sent again.
+ */
+
+/*!
+  Constructs a call of \a method with \a params. Parameters can be
+  strings, numbers, booleans, date times, byte arrays (sent as base64),
+  lists, maps (sent as structs) and XmlRpcFile.
+ */
+XmlRpcRequest::XmlRpcRequest(const QString &method, const QVariantList &params, QObject *parent) :
+    QIODevice(parent),
+    m_size(0),
+    m_part(0),
+    m_partOffset(0),
+    m_encodedOffset(0)
+{
+    appendText("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<methodCall><methodName>"
+               + escape(method) + "</methodName><params>");
+    foreach (const QVariant &param, params) {
+        appendText("<param><value>");
+        appendValue(param);
+        appendText("</value></param>");
+    }
+    appendText("</params></methodCall>\n");
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+/*!
+  Destructs the request.
+ */
+XmlRpcRequest::~XmlRpcRequest()
+{
+}
+
+/*!
+  \internal
+ */
+bool XmlRpcRequest::isSequential() const
+{
+    return false;
+}
+
+/*!
+  Returns the size of the whole body in bytes.
+ */
+qint64 XmlRpcRequest::size() const
+{
+    return m_size;
+}
+
+/*!
+  \internal
+ */
+bool XmlRpcRequest::seek(qint64 pos)
+{
+    if (pos < 0 || pos > m_size || !QIODevice::seek(pos)) {
+        return false;
+    }
+    m_file.close();
+    m_encoded.clear();
+    m_encodedOffset = 0;
+    m_part = 0;
+    m_partOffset = pos;
+    while (m_part < m_parts.size() && m_partOffset >= m_parts.at(m_part).size) {
+        m_partOffset -= m_parts.at(m_part).size;
+        ++m_part;
+    }
+    return true;
+}
+
+/*!
+  \internal
+ */
+qint64 XmlRpcRequest::readData(char *data, qint64 maxSize)
+{
+    qint64 done = 0;
+    while (done < maxSize && m_part < m_parts.size()) {
+        const Part &part = m_parts.at(m_part);
+        if (m_partOffset >= part.size) {
+            m_file.close();
+            m_encoded.clear();
+            m_encodedOffset = 0;
+            m_partOffset = 0;
+            ++m_part;
+            continue;
+        }
+        qint64 count = 0;
+        if (part.fileName.isEmpty()) {
+            count = qMin(maxSize - done, part.size - m_partOffset);
+            memcpy(data + done, part.text.constData() + m_partOffset, count);
+        } else {
+            if (m_encodedOffset >= m_encoded.size() && !readFile(part)) {
+                return done > 0 ? done : -1;
+            }
+            count = qMin(maxSize - done, qint64(m_encoded.size() - m_encodedOffset));
+            memcpy(data + done, m_encoded.constData() + m_encodedOffset, count);
+            m_encodedOffset += count;
+        }
+        done += count;
+        m_partOffset += count;
+    }
+    return done;
+}
+
+/*!
+  \internal
+ */
+qint64 XmlRpcRequest::writeData(const char *, qint64)
+{
+    return -1;
+}
+
+void XmlRpcRequest::appendValue(const QVariant &value)
+{
+    if (value.userType() == qMetaTypeId<XmlRpcFile>()) {
+        appendText("<base64>");
+        appendFile(value.value<XmlRpcFile>().fileName);
+        appendText("</base64>");
+        return;
+    }
+    switch (value.type()) {
+    case QVariant::Bool:
+        appendText(value.toBool() ? "<boolean>1</boolean>" : "<boolean>0</boolean>");
+        break;
+    case QVariant::Int:
+    case QVariant::UInt:
+    case QVariant::LongLong:
+    case QVariant::ULongLong:
+        appendText("<int>" + QByteArray::number(value.toLongLong()) + "</int>");
+        break;
+    case QVariant::Double:
+        appendText("<double>" + QByteArray::number(value.toDouble(), 'g', 17) + "</double>");
+        break;
+    case QVariant::DateTime:
+        appendText("<dateTime.iso8601>"
+                   + value.toDateTime().toString(QLatin1String(DATE_TIME_FORMAT)).toLatin1()
+                   + "</dateTime.iso8601>");
+        break;
+    case QVariant::ByteArray:
+        appendText("<base64>" + value.toByteArray().toBase64() + "</base64>");
+        break;
+    case QVariant::List:
+    case QVariant::StringList:
+        appendText("<array><data>");
+        foreach (const QVariant &item, value.toList()) {
+            appendText("<value>");
+            appendValue(item);
+            appendText("</value>");
+        }
+        appendText("</data></array>");
+        break;
+    case QVariant::Map: {
+        appendText("<struct>");
+        const QVariantMap map = value.toMap();
+        for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it) {
+            appendText("<member><name>" + escape(it.key()) + "</name><value>");
+            appendValue(it.value());
+            appendText("</value></member>");
+        }
+        appendText("</struct>");
+        break;
+    }
+    default:
+        appendText("<string>" + escape(value.toString()) + "</string>");
+        break;
+    }
+}
+
+void XmlRpcRequest::appendText(const QByteArray &text)
+{
+    if (m_parts.isEmpty() || !m_parts.last().fileName.isEmpty()) {
+        Part part;
+        part.size = 0;
+        m_parts << part;
+    }
+    Part &part = m_parts.last();
+    part.text += text;
+    part.size += text.size();
+    m_size += text.size();
+}
+
+void XmlRpcRequest::appendFile(const QString &fileName)
+{
+    Part part;
+    part.fileName = fileName;
+    part.size = base64Size(QFileInfo(fileName).size());
+    m_parts << part;
+    m_size += part.size;
+}
+
+/*
+    Encodes the next chunk of the file of \a part, starting at the current
+    offset; after a seek this may be in the middle of a base64 quantum.
+ */
+bool XmlRpcRequest::readFile(const Part &part)
+{
+    qint64 skip = 0;
+    if (!m_file.isOpen()) {
+        m_file.setFileName(part.fileName);
+        if (!m_file.open(QIODevice::ReadOnly) || !m_file.seek(m_partOffset / 4 * 3)) {
+            setErrorString(m_file.errorString());
+            return false;
+        }
+        skip = m_partOffset % 4;
+    }
+    const QByteArray chunk = m_file.read(FILE_CHUNK_SIZE);
+    if (chunk.isEmpty()) {
+        setErrorString(tr("%1 changed while it was sent").arg(part.fileName));
+        return false;
+    }
+    m_encoded = chunk.toBase64();
+    m_encodedOffset = int(skip);
+    return true;
+}
+
+static QVariant readValue(QXmlStreamReader &xml);
+
+static QVariant readStruct(QXmlStreamReader &xml)
+{
+    QVariantMap map;
+    while (xml.readNextStartElement()) {
+        if (xml.name() != QLatin1String("member")) {
+            xml.skipCurrentElement();
+            continue;
+        }
+        QString name;
+        QVariant value;
+        while (xml.readNextStartElement()) {
+            if (xml.name() == QLatin1String("name")) {
+                name = xml.readElementText();
+            } else if (xml.name() == QLatin1String("value")) {
+                value = readValue(xml);
+            } else {
+                xml.skipCurrentElement();
+            }
+        }
+        map.insert(name, value);
+    }
+    return map;
+}
+
+static QVariant readArray(QXmlStreamReader &xml)
+{
+    QVariantList list;
+    while (xml.readNextStartElement()) {
+        if (xml.name() != QLatin1String("data")) {
+            xml.skipCurrentElement();
+            continue;
+        }
+        while (xml.readNextStartElement()) {
+            if (xml.name() == QLatin1String("value")) {
+                list << readValue(xml);
+            } else {
+                xml.skipCurrentElement();
+            }
+        }
+    }
+    return list;
+}
+
+static QVariant readScalar(const QString &type, const QString &text)
+{
+    if (type == QLatin1String("int") || type == QLatin1String("i4")) {
+        return text.trimmed().toInt();
+    } else if (type == QLatin1String("i8")) {
+        return text.trimmed().toLongLong();
+    } else if (type == QLatin1String("boolean")) {
+        return text.trimmed() == QLatin1String("1");
+    } else if (type == QLatin1String("double")) {
+        return text.trimmed().toDouble();
+    } else if (type == QLatin1String("dateTime.iso8601")) {
+        QDateTime dateTime = QDateTime::fromString(text.trimmed(), QLatin1String(DATE_TIME_FORMAT));
+        if (!dateTime.isValid()) {
+            dateTime = QDateTime::fromString(text.trimmed(), Qt::ISODate);
+        }
+        return dateTime;
+    } else if (type == QLatin1String("base64")) {
+        return QByteArray::fromBase64(text.toLatin1());
+    } else if (type == QLatin1String("nil")) {
+        return QVariant();
+    }
+    return text;
+}
+
+/*
+    Reads the content of the current <value> element, which is a string
+    if it has no type element.
+ */
+static QVariant readValue(QXmlStreamReader &xml)
+{
+    QString text;
+    while (!xml.atEnd()) {
+        xml.readNext();
+        if (xml.isCharacters()) {
+            text += xml.text();
+        } else if (xml.isEndElement()) {
+            return text;
+        } else if (xml.isStartElement()) {
+            QVariant value;
+            if (xml.name() == QLatin1String("struct")) {
+                value = readStruct(xml);
+            } else if (xml.name() == QLatin1String("array")) {
+                value = readArray(xml);
+            } else {
+                const QString type = xml.name().toString();
+                value = readScalar(type, xml.readElementText());
+            }
+            xml.skipCurrentElement();
+            return value;
+        }
+    }
+    return QVariant();
+}
+
+/*!
+  Reads the method response from \a device. The response is parsed while
+  it is read, so large results do not need an extra copy.
+ */
+XmlRpcResponse XmlRpcResponse::parse(QIODevice *device)
+{
+    XmlRpcResponse response;
+    QXmlStreamReader xml(device);
+    bool fault = false;
+    bool found = false;
+    while (!xml.atEnd() && !found) {
+        xml.readNext();
+        if (!xml.isStartElement()) {
+            continue;
+        }
+        if (xml.name() == QLatin1String("fault")) {
+            fault = true;
+        } else if (xml.name() == QLatin1String("value")) {
+            response.value = readValue(xml);
+            found = true;
+        }
+    }
+    if (xml.hasError() || !found) {
+        response.errorString = xml.hasError() ? xml.errorString()
+                                              : QString::fromLatin1("Empty XML-RPC response");
+        return response;
+    }
+    if (fault) {
+        const QVariantMap map = response.value.toMap();
+        response.faultCode = map.value(QLatin1String("faultCode")).toInt();
+        response.errorString = map.value(QLatin1String("faultString")).toString();
+        response.value = QVariant();
+        if (response.faultCode == 0) {
+            response.faultCode = -1;
+        }
+        return response;
+    }
+    response.ok = true;
+    return response;
+}
+
+/*!
+  Reads a method call from \a device; this is the server side of
+  XmlRpcRequest.
+ */
+XmlRpcCall XmlRpcCall::parse(QIODevice *device)
+{
+    XmlRpcCall call;
+    QXmlStreamReader xml(device);
+    while (!xml.atEnd()) {
+        xml.readNext();
+        if (!xml.isStartElement()) {
+            continue;
+        }
+        if (xml.name() == QLatin1String("methodName")) {
+            call.method = xml.readElementText().trimmed();
+        } else if (xml.name() == QLatin1String("value")) {
+            call.params << readValue(xml);
+        }
+    }
+    if (xml.hasError() || call.method.isEmpty()) {
+        call.errorString = xml.hasError() ? xml.errorString()
+                                          : QString::fromLatin1("No method name in XML-RPC call");
+        return call;
+    }
+    call.ok = true;
+    return call;
+}
+
+}
@@ -0,0 +1,114 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef XMLRPC_H
+#define XMLRPC_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QIODevice>
+#include <QList>
+#include <QMetaType>
+#include <QVariant>
+
+#include "blog_global.h"
+
+namespace GOW
+{
+
+/*!
+  A file parameter of an XmlRpcRequest, sent as base64. The file is read
+  while the request is sent, so it is never loaded into memory at once.
+ */
+struct XmlRpcFile
+{
+    XmlRpcFile() {}
+    explicit XmlRpcFile(const QString &name) : fileName(name) {}
+
+    QString fileName;
+};
+
+class BLOG_EXPORT XmlRpcRequest : public QIODevice
+{
+    Q_OBJECT
+public:
+    XmlRpcRequest(const QString &method, const QVariantList &params, QObject *parent = 0);
+    ~XmlRpcRequest();
+
+    bool isSequential() const;
+    qint64 size() const;
+    bool seek(qint64 pos);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    struct Part
+    {
+        QByteArray text;
+        QString fileName; // set for file parts, whose size is the base64 size
+        qint64 size;
+    };
+
+    void appendValue(const QVariant &value);
+    void appendText(const QByteArray &text);
+    void appendFile(const QString &fileName);
+    bool readFile(const Part &part);
+
+    QList<Part> m_parts;
+    qint64 m_size;
+    int m_part;
+    qint64 m_partOffset;
+    QFile m_file;
+    QByteArray m_encoded;
+    int m_encodedOffset;
+}; // end of class GOW::XmlRpcRequest
+
+struct BLOG_EXPORT XmlRpcResponse
+{
+    XmlRpcResponse() : ok(false), faultCode(0) {}
+
+    static XmlRpcResponse parse(QIODevice *device);
+
+    bool ok;
+    QVariant value;
+    int faultCode; // 0 if the response could not be read at all
+    QString errorString;
+};
+
+struct BLOG_EXPORT XmlRpcCall
+{
+    XmlRpcCall() : ok(false) {}
+
+    static XmlRpcCall parse(QIODevice *device);
+
+    bool ok;
+    QString method;
+    QVariantList params;
+    QString errorString;
+};
+
+} // end of namespace GOW
+
+Q_DECLARE_METATYPE(GOW::XmlRpcFile)
+
+#endif // XMLRPC_H
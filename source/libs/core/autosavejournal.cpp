@@ -0,0 +1,888 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QPointer>
+#include <QSet>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextList>
+#include <QTimer>
+#include <QtConcurrentRun>
+#include <QtEndian>
+#if QT_VERSION >= 0x050000
+#include <QSaveFile>
+#include <QStandardPaths>
+#else
+#include <QDesktopServices>
+#endif
+
+#include <DraftFormat>
+
+#include "autosavejournal.h"
+
+namespace GOW
+{
+
+static const quint32 JOURNAL_MAGIC = 0x4f574a4e; // "OWJN"
+static const quint32 SNAPSHOT_MAGIC = 0x4f57534e; // "OWSN"
+// Version 1 journals only hold the formats of inserted blocks.
+static const quint32 JOURNAL_VERSION = 2;
+// Version 1 snapshots hold HTML, version 2 ones the draft format.
+static const quint32 SNAPSHOT_VERSION = 2;
+static const QDataStream::Version STREAM_VERSION = QDataStream::Qt_4_8;
+
+static const int FLUSH_INTERVAL = 1000;
+static const qint64 COMPACT_SIZE = 1024 * 1024;
+// Marks a block which is in no list.
+static const quint32 NO_LIST = 0xffffffff;
+
+enum RecordType {
+    BaseRecord = 1,
+    FormatRecord = 2,
+    ChangeRecord = 3,
+    TitleRecord = 4
+};
+
+static QString sessionRoot()
+{
+#if QT_VERSION >= 0x050000
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::DataLocation);
+#else
+    const QString dir = QDesktopServices::storageLocation(QDesktopServices::DataLocation);
+#endif
+    return dir + QLatin1String("/autosave");
+}
+
+static QString journalName(quint64 firstSequence)
+{
+    return QString::fromLatin1("journal-%1").arg(firstSequence, 16, 16, QLatin1Char('0'));
+}
+
+/*
+    Journal files of a session, oldest first.
+ */
+static QStringList journalFiles(const QString &session)
+{
+    return QDir(session).entryList(QStringList() << QLatin1String("journal-*"),
+                                   QDir::Files, QDir::Name);
+}
+
+struct Snapshot
+{
+    Snapshot() : sequence(0), until(0) {}
+
+    QString session;
+    QByteArray draft;
+    QByteArray html;
+    QString source;
+    quint64 sequence;
+    quint64 until;
+    QString fileName;
+    QString title;
+};
+
+static bool replaySession(const QString &session, quint64 until, QTextDocument *document,
+                          QString *fileName, QString *title);
+
+/*
+    Runs on a worker thread. The snapshot is either the draft given, or
+    it is built in a document of its own: from the HTML given, or by
+    replaying the source session up to the until sequence number.
+ */
+static bool writeSnapshot(Snapshot snapshot)
+{
+    QByteArray draft = snapshot.draft;
+    if (draft.isEmpty()) {
+        QTextDocument document;
+        document.setUndoRedoEnabled(false);
+        if (!snapshot.html.isEmpty()) {
+            document.setHtml(QString::fromUtf8(snapshot.html.constData(), snapshot.html.size()));
+        } else {
+            QString fileName;
+            QString title;
+            if (!replaySession(snapshot.source, snapshot.until, &document, &fileName, &title)) {
+                return false;
+            }
+        }
+        QBuffer buffer(&draft);
+        buffer.open(QIODevice::WriteOnly);
+        if (!DraftFormat::write(&buffer, &document, snapshot.title)) {
+            return false;
+        }
+    }
+
+    const QString path = snapshot.session + QLatin1String("/snapshot");
+#if QT_VERSION >= 0x050000
+    QSaveFile file(path);
+#else
+    QFile file(path + QLatin1String(".new"));
+#endif
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QDataStream ds(&file);
+    ds.setVersion(STREAM_VERSION);
+    ds << SNAPSHOT_MAGIC << SNAPSHOT_VERSION << snapshot.sequence << snapshot.fileName << snapshot.title
+       << draft;
+    if (ds.status() != QDataStream::Ok) {
+        return false;
+    }
+#if QT_VERSION >= 0x050000
+    return file.commit();
+#else
+    // Recovery falls back to snapshot.new while there is no snapshot.
+    file.close();
+    QFile::remove(path);
+    return QFile::rename(path + QLatin1String(".new"), path);
+#endif
+}
+
+static bool readSnapshot(const QString &session, QTextDocument *document, quint64 *sequence,
+                         QString *fileName, QString *title)
+{
+    QFile file(session + QLatin1String("/snapshot"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        file.setFileName(session + QLatin1String("/snapshot.new"));
+        if (!file.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+    }
+    QDataStream ds(&file);
+    ds.setVersion(STREAM_VERSION);
+    quint32 magic = 0;
+    quint32 version = 0;
+    ds >> magic >> version;
+    if (magic != SNAPSHOT_MAGIC || version > SNAPSHOT_VERSION) {
+        return false;
+    }
+    ds >> *sequence >> *fileName >> *title;
+    if (version < 2) {
+        QString html;
+        ds >> html;
+        if (ds.status() != QDataStream::Ok) {
+            return false;
+        }
+        document->setHtml(html);
+        return true;
+    }
+    QByteArray draft;
+    ds >> draft;
+    if (ds.status() != QDataStream::Ok) {
+        return false;
+    }
+    QBuffer buffer(&draft);
+    buffer.open(QIODevice::ReadOnly);
+    return DraftFormat::read(&buffer, document, 0);
+}
+
+typedef QHash<quint32, QPointer<QTextList> > ReplayedLists;
+
+/*
+    Gives the block at \a cursor its format and puts it into the list
+    journaled as \a key. Lists are journaled by their object index in the
+    edited document; the first block seen of a list which is not known
+    yet stays in the list it is in here, if that one looks the same.
+ */
+static void replayBlockFormat(QTextCursor &cursor, const QTextBlockFormat &format,
+                              quint32 key, const QTextListFormat &listFormat, ReplayedLists *lists)
+{
+    QTextBlockFormat blockFormat = format;
+    QTextList *list = 0;
+    if (key != NO_LIST) {
+        list = lists->value(key);
+        QTextList *current = cursor.block().textList();
+        if (!list && current && current->format() == listFormat) {
+            list = current;
+        }
+        if (list) {
+            blockFormat.setObjectIndex(list->objectIndex());
+        }
+    }
+    cursor.setBlockFormat(blockFormat);
+    if (key != NO_LIST) {
+        if (!list) {
+            list = cursor.createList(listFormat);
+        }
+        lists->insert(key, list);
+    }
+}
+
+static void replayChange(QDataStream &ds, quint32 version, QTextDocument *document,
+                         const QHash<quint32, QTextFormat> &formats, ReplayedLists *lists)
+{
+    qint32 position = 0;
+    qint32 removed = 0;
+    QString text;
+    QVector<quint32> runs;
+    QVector<quint32> blockFormats;
+    QVector<quint32> blocks;
+    ds >> position >> removed >> text >> runs;
+    if (version < 2) {
+        ds >> blockFormats;
+    } else {
+        ds >> blocks;
+    }
+    if (ds.status() != QDataStream::Ok) {
+        return;
+    }
+
+    const int last = document->characterCount() - 1;
+    position = qBound(0, int(position), last);
+    QTextCursor cursor(document);
+    cursor.setPosition(position);
+    cursor.setPosition(qMin(position + removed, last), QTextCursor::KeepAnchor);
+    cursor.removeSelectedText();
+    int offset = 0;
+    int block = 0;
+    for (int i = 0; i + 1 < runs.size(); i += 2) {
+        const QString part = text.mid(offset, runs.at(i));
+        const QTextCharFormat format = formats.value(runs.at(i + 1)).toCharFormat();
+        if (part.length() == 1 && part.at(0) == QChar::ParagraphSeparator) {
+            // Version 2 gives the blocks their formats below.
+            cursor.insertBlock(formats.value(blockFormats.value(block++)).toBlockFormat(), format);
+        } else {
+            cursor.insertText(part, format);
+        }
+        offset += part.length();
+    }
+
+    // Each block touched comes with its block format, list format and list.
+    QTextBlock block = document->findBlock(position);
+    for (int i = 0; i + 2 < blocks.size() && block.isValid(); i += 3) {
+        QTextCursor blockCursor(block);
+        replayBlockFormat(blockCursor, formats.value(blocks.at(i)).toBlockFormat(), blocks.at(i + 2),
+                          formats.value(blocks.at(i + 1)).toListFormat(), lists);
+        block = block.next();
+    }
+}
+
+/*
+    Replays the records of one journal file which come after \a sequence,
+    up to \a until. A record cut short by a crash ends the replay.
+ */
+static bool replayJournal(const QString &path, quint64 sequence, quint64 until, QTextDocument *document,
+                          QHash<quint32, QTextFormat> *formats, ReplayedLists *lists, QString *title)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    QDataStream header(data);
+    quint32 magic = 0;
+    quint32 version = 0;
+    header >> magic >> version;
+    if (magic != JOURNAL_MAGIC || version > JOURNAL_VERSION) {
+        return false;
+    }
+
+    int pos = 8;
+    while (data.size() - pos >= 4) {
+        const quint32 size = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data.constData() + pos));
+        pos += 4;
+        if (quint32(data.size() - pos) < size) {
+            return false;
+        }
+        QDataStream ds(QByteArray::fromRawData(data.constData() + pos, size));
+        ds.setVersion(STREAM_VERSION);
+        pos += size;
+
+        quint8 type = 0;
+        quint64 recordSequence = 0;
+        ds >> type >> recordSequence;
+        if (recordSequence > until) {
+            break;
+        }
+        if (type == FormatRecord) {
+            quint32 id = 0;
+            QTextFormat format;
+            ds >> id >> format;
+            formats->insert(id, format);
+        } else if (type == BaseRecord || recordSequence <= sequence) {
+            continue;
+        } else if (type == ChangeRecord) {
+            replayChange(ds, version, document, *formats, lists);
+        } else if (type == TitleRecord) {
+            ds >> *title;
+        }
+    }
+    return true;
+}
+
+/*
+    Loads the post a journal started from, which is named by the base
+    record at the start of its first file.
+ */
+static bool readBase(const QString &path, QTextDocument *document, QString *fileName, QString *title)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream ds(&file);
+    ds.setVersion(STREAM_VERSION);
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 size = 0;
+    quint8 type = 0;
+    quint64 sequence = 0;
+    bool saved = false;
+    ds >> magic >> version >> size >> type >> sequence;
+    if (magic != JOURNAL_MAGIC || version > JOURNAL_VERSION || type != BaseRecord) {
+        return false;
+    }
+    ds >> *fileName >> *title >> saved;
+    if (ds.status() != QDataStream::Ok) {
+        return false;
+    }
+    QFile base(*fileName);
+    if (!saved || !base.open(QIODevice::ReadOnly) || !DraftFormat::read(&base, document, 0)) {
+        document->clear();
+    }
+    return true;
+}
+
+/*
+    Loads the snapshot or the base of \a session and replays the records
+    after it, up to \a until. Also runs on worker threads, for compaction.
+ */
+static bool replaySession(const QString &session, quint64 until, QTextDocument *document,
+                          QString *fileName, QString *title)
+{
+    quint64 sequence = 0;
+    const QStringList journals = journalFiles(session);
+    bool ok = readSnapshot(session, document, &sequence, fileName, title);
+    if (!ok && !journals.isEmpty()) {
+        ok = readBase(session + QLatin1Char('/') + journals.first(), document, fileName, title);
+    }
+    if (!ok) {
+        return false;
+    }
+    // All changes are replayed as a single edit.
+    QHash<quint32, QTextFormat> formats;
+    ReplayedLists lists;
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+    foreach (const QString &name, journals) {
+        if (name.mid(8).toULongLong(0, 16) > until) {
+            break;
+        }
+        replayJournal(session + QLatin1Char('/') + name, sequence, until, document, &formats, &lists, title);
+    }
+    cursor.endEditBlock();
+    return true;
+}
+
+class AutosaveJournal::Private : public QObject
+{
+    Q_OBJECT
+    Q_POINTER(AutosaveJournal)
+public:
+    Private(AutosaveJournal *q_ptr, QTextDocument *document);
+    ~Private();
+
+    void appendRecord(RecordType type, const QByteArray &data);
+    quint32 formatId(int index);
+    void startCompaction(const QByteArray &draft, const QByteArray &html, const QString &source);
+    void waitForCompaction();
+
+    QTextDocument *document;
+    QString session;
+    QString fileName;
+    QString title;
+    bool saved;
+    bool recording;
+    bool changed;
+
+    QByteArray pending;
+    QFile journal;
+    quint64 sequence;
+    quint64 journalStart;
+    QSet<int> writtenFormats;
+    QTimer flushTimer;
+    QFutureWatcher<bool> watcher;
+    quint64 snapshotSequence;
+    QString adoptedSession;
+    bool compacting;
+
+public slots:
+    void contentsChange(int position, int charsRemoved, int charsAdded);
+    void compactionFinished();
+}; // end of class GOW::AutosaveJournal::Private
+
+AutosaveJournal::Private::Private(AutosaveJournal *q_ptr, QTextDocument *document) :
+    QObject(q_ptr),
+    q(q_ptr),
+    document(document),
+    saved(false),
+    recording(false),
+    changed(false),
+    sequence(0),
+    journalStart(1),
+    snapshotSequence(0),
+    compacting(false)
+{
+    static int serial = 0;
+    session = sessionRoot() + QString::fromLatin1("/%1-%2-%3")
+            .arg(QCoreApplication::applicationPid())
+            .arg(QDateTime::currentMSecsSinceEpoch())
+            .arg(++serial);
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(FLUSH_INTERVAL);
+    connect(&flushTimer, SIGNAL(timeout()), q, SLOT(flush()));
+    connect(&watcher, SIGNAL(finished()), this, SLOT(compactionFinished()));
+    connect(document, SIGNAL(contentsChange(int,int,int)),
+            this, SLOT(contentsChange(int,int,int)));
+}
+
+AutosaveJournal::Private::~Private()
+{
+    watcher.waitForFinished();
+}
+
+/*
+    Records are a quint32 size followed by the type, the sequence number
+    and the data, so a record cut short by a crash can be told apart.
+ */
+void AutosaveJournal::Private::appendRecord(RecordType type, const QByteArray &data)
+{
+    QByteArray record;
+    QDataStream ds(&record, QIODevice::WriteOnly);
+    ds.setVersion(STREAM_VERSION);
+    ds << quint32(0) << quint8(type) << quint64(++sequence);
+    record += data;
+    qToBigEndian<quint32>(record.size() - 4, reinterpret_cast<uchar *>(record.data()));
+    pending += record;
+    if (!flushTimer.isActive()) {
+        flushTimer.start();
+    }
+}
+
+/*
+    Formats are journaled by their index in the document, each once per
+    journal file.
+ */
+quint32 AutosaveJournal::Private::formatId(int index)
+{
+    if (!writtenFormats.contains(index)) {
+        writtenFormats.insert(index);
+        QTextFormat format = document->allFormats().value(index);
+        format.clearProperty(QTextFormat::ObjectIndex);
+        QByteArray data;
+        QDataStream ds(&data, QIODevice::WriteOnly);
+        ds.setVersion(STREAM_VERSION);
+        ds << quint32(index) << format;
+        appendRecord(FormatRecord, data);
+    }
+    return index;
+}
+
+/*
+    Journals the inserted content as its text and the runs of equally
+    formatted characters, followed by the block format, the list format
+    and the list of every block the change touched, the first one
+    included. Block separators are runs of their own. Only the changed
+    range is visited, so this costs the same for any document size.
+ */
+void AutosaveJournal::Private::contentsChange(int position, int charsRemoved, int charsAdded)
+{
+    if (!recording) {
+        return;
+    }
+    const int end = qMin(position + charsAdded, document->characterCount() - 1);
+    QString text;
+    QVector<quint32> runs;
+    QVector<quint32> blocks;
+    int pos = position;
+    for (QTextBlock block = document->findBlock(position); block.isValid() && pos < end; ) {
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment fragment = it.fragment();
+            const int from = qMax(fragment.position(), pos);
+            const int to = qMin(fragment.position() + fragment.length(), end);
+            if (from < to) {
+                text += fragment.text().mid(from - fragment.position(), to - from);
+                runs << quint32(to - from) << formatId(fragment.charFormatIndex());
+            }
+        }
+        const int separator = block.position() + block.length() - 1;
+        const QTextBlock next = block.next();
+        if (separator >= pos && separator < end && next.isValid()) {
+            text += QChar(QChar::ParagraphSeparator);
+            runs << 1 << formatId(next.charFormatIndex());
+        }
+        pos = separator + 1;
+        block = next;
+    }
+    for (QTextBlock block = document->findBlock(position); block.isValid(); block = block.next()) {
+        const QTextList *list = block.textList();
+        blocks << formatId(block.blockFormatIndex())
+               << (list ? formatId(list->formatIndex()) : NO_LIST)
+               << (list ? quint32(list->objectIndex()) : NO_LIST);
+        if (block.position() + block.length() > end) {
+            break;
+        }
+    }
+
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    ds.setVersion(STREAM_VERSION);
+    ds << qint32(position) << qint32(charsRemoved) << text << runs << blocks;
+    appendRecord(ChangeRecord, data);
+    changed = true;
+}
+
+/*
+    The journal written so far is dropped once the snapshot is in place.
+    Nothing of the document is touched here: without a draft or HTML, the
+    snapshot is built on a worker thread by replaying the source session,
+    which is this one up to the last record written, or one to take over.
+    The document can be edited meanwhile.
+ */
+void AutosaveJournal::Private::startCompaction(const QByteArray &draft, const QByteArray &html,
+                                               const QString &source)
+{
+    waitForCompaction();
+    // Set first, so flush() does not start another compaction.
+    compacting = true;
+    changed = true;
+    q->flush();
+    journal.close();
+    snapshotSequence = sequence;
+    journalStart = sequence + 1;
+    writtenFormats.clear();
+    QDir().mkpath(session);
+    adoptedSession = source;
+    Snapshot snapshot;
+    snapshot.session = session;
+    snapshot.draft = draft;
+    snapshot.html = html;
+    snapshot.source = source.isEmpty() ? session : source;
+    snapshot.until = source.isEmpty() ? snapshotSequence : Q_UINT64_C(0xffffffffffffffff);
+    snapshot.sequence = snapshotSequence;
+    snapshot.fileName = fileName;
+    snapshot.title = title;
+    watcher.setFuture(QtConcurrent::run(writeSnapshot, snapshot));
+}
+
+/*
+    Finishes a compaction still running or not cleaned up after yet;
+    setting a new future drops the finished() signal of the old one.
+ */
+void AutosaveJournal::Private::waitForCompaction()
+{
+    watcher.waitForFinished();
+    compactionFinished();
+}
+
+void AutosaveJournal::Private::compactionFinished()
+{
+    if (!compacting) {
+        return;
+    }
+    compacting = false;
+    if (!watcher.result()) {
+        qWarning() << "AutosaveJournal: cannot write snapshot to" << session;
+        return;
+    }
+    foreach (const QString &name, journalFiles(session)) {
+        if (name.mid(8).toULongLong(0, 16) <= snapshotSequence) {
+            QFile::remove(session + QLatin1Char('/') + name);
+        }
+    }
+    if (!adoptedSession.isEmpty()) {
+        AutosaveJournal::removeSession(adoptedSession);
+        adoptedSession.clear();
+    }
+}
+
+/*!
+  \class GOW::AutosaveJournal
+
+  Keeps a crash-safe record of all edits of a document.
+
+  Saving a large post in full on a timer would stall the editor, so every
+  change the document reports is appended to a journal instead: the
+  position, the number of removed characters and the inserted text with
+  its formats. Recording a change only visits the changed range, and the
+  journal is written out in batches at most once a second.
+
+  Once the journal has grown large, it is compacted: a worker thread
+  replays the last snapshot and the journal into a document of its own,
+  the way recover() does, and writes the result in the draft format as
+  the new snapshot. The edited document is not touched for that. Right
+  after a draft was loaded or saved, the draft itself is the snapshot
+  and nothing is serialized at all. New records
+  go to a new journal file meanwhile; the older files are removed when
+  the snapshot is in place.
+
+  Each journal has its own session directory, which is removed when the
+  post is closed. Sessions which are still there on startup belong to a
+  crash and can be replayed by recover().
+ */
+
+/*!
+  Constructs a journal of the changes to \a document.
+ */
+AutosaveJournal::AutosaveJournal(QTextDocument *document, QObject *parent) :
+    QObject(parent),
+    d(this, document)
+{
+}
+
+/*!
+  Destructs the journal. Pending records are written out.
+ */
+AutosaveJournal::~AutosaveJournal()
+{
+    if (d->recording) {
+        flush();
+    }
+}
+
+/*!
+  Starts a new journal for the document, which is the post \a fileName
+  with \a title. If \a saved is true the document equals the file, so
+  the file is the base for replaying the journal. Any earlier journal of
+  this session is removed.
+ */
+void AutosaveJournal::start(const QString &fileName, const QString &title, bool saved)
+{
+    d->recording = false;
+    d->pending.clear();
+    d->flushTimer.stop();
+    d->journal.close();
+    d->waitForCompaction();
+    removeSession(d->session);
+    d->fileName = fileName;
+    d->title = title;
+    d->saved = saved;
+    d->journalStart = d->sequence + 1;
+    d->writtenFormats.clear();
+    d->changed = false;
+    d->recording = true;
+
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    ds.setVersion(STREAM_VERSION);
+    ds << fileName << title << saved;
+    d->appendRecord(BaseRecord, data);
+}
+
+/*!
+  Writes pending records and stops recording. Used while the document
+  might be replaced as a whole; if it was not, recording can resume(),
+  otherwise a new journal must be start()ed.
+ */
+void AutosaveJournal::pause()
+{
+    flush();
+    d->recording = false;
+    d->flushTimer.stop();
+}
+
+/*!
+  Continues recording after pause().
+ */
+void AutosaveJournal::resume()
+{
+    d->recording = true;
+}
+
+/*!
+  Stops recording and removes the journal.
+ */
+void AutosaveJournal::discard()
+{
+    d->recording = false;
+    d->pending.clear();
+    d->flushTimer.stop();
+    d->journal.close();
+    d->waitForCompaction();
+    removeSession(d->session);
+}
+
+/*!
+  Records \a title as the new post title.
+ */
+void AutosaveJournal::setTitle(const QString &title)
+{
+    d->title = title;
+    if (d->recording) {
+        QByteArray data;
+        QDataStream ds(&data, QIODevice::WriteOnly);
+        ds.setVersion(STREAM_VERSION);
+        ds << title;
+        d->appendRecord(TitleRecord, data);
+    }
+}
+
+/*!
+  Appends pending records to the journal file. Nothing is written before
+  the document has been changed.
+ */
+void AutosaveJournal::flush()
+{
+    if (!d->recording || !d->changed || d->pending.isEmpty()) {
+        return;
+    }
+    if (!d->journal.isOpen()) {
+        QDir().mkpath(d->session);
+        d->journal.setFileName(d->session + QLatin1Char('/') + journalName(d->journalStart));
+        if (!d->journal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            qWarning() << "AutosaveJournal: cannot open" << d->journal.fileName();
+            return;
+        }
+        if (d->journal.size() == 0) {
+            QDataStream ds(&d->journal);
+            ds << JOURNAL_MAGIC << JOURNAL_VERSION;
+        }
+    }
+    d->journal.write(d->pending);
+    d->journal.flush();
+    d->pending.clear();
+    if (d->journal.size() > COMPACT_SIZE && !d->compacting) {
+        compact();
+    }
+}
+
+/*!
+  Writes a snapshot of the document in the background, after which the
+  journal written so far is dropped. Does nothing while a snapshot is
+  being written.
+ */
+void AutosaveJournal::compact()
+{
+    if (!d->recording || d->watcher.isRunning()) {
+        return;
+    }
+    d->startCompaction(QByteArray(), QByteArray(), QString());
+}
+
+/*!
+  Like compact(), but takes \a draft, the document in the draft format,
+  as the snapshot. Meant for right after the document was loaded from or
+  saved as a draft, when the draft is at hand anyway.
+ */
+void AutosaveJournal::compact(const QByteArray &draft)
+{
+    if (!d->recording) {
+        return;
+    }
+    // The draft is newer than any snapshot still being written, which
+    // startCompaction() waits for.
+    d->startCompaction(draft, QByteArray(), QString());
+}
+
+/*!
+  Like compact(), but builds the snapshot from \a html, the document as
+  it was just loaded, on a worker thread.
+ */
+void AutosaveJournal::compactHtml(const QByteArray &html)
+{
+    if (!d->recording) {
+        return;
+    }
+    // The data may wrap memory which is gone once the caller returns.
+    d->startCompaction(QByteArray(), QByteArray(html.constData(), html.size()), QString());
+}
+
+/*!
+  Like compact(), but builds the snapshot from the recorded \a session,
+  which the document was just recovered from, and removes \a session
+  once the snapshot is in place.
+ */
+void AutosaveJournal::compactSession(const QString &session)
+{
+    if (!d->recording) {
+        return;
+    }
+    d->startCompaction(QByteArray(), QByteArray(), session);
+}
+
+/*!
+  Returns the session directory of this journal.
+ */
+QString AutosaveJournal::session() const
+{
+    return d->session;
+}
+
+/*!
+  Returns the session directories left over by instances which did not
+  close their posts. Only meaningful while no other instance runs.
+ */
+QStringList AutosaveJournal::pendingSessions()
+{
+    const QString ownPrefix = QString::number(QCoreApplication::applicationPid()) + QLatin1Char('-');
+    QStringList sessions;
+    const QDir root(sessionRoot());
+    foreach (const QString &name, root.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name)) {
+        if (!name.startsWith(ownPrefix)) {
+            sessions << root.filePath(name);
+        }
+    }
+    return sessions;
+}
+
+/*!
+  Replaces the content of \a document with the post recorded in
+  \a session: the snapshot or the saved file the journal started from,
+  with all later changes replayed. The post file name and title are
+  stored in \a fileName and \a title. Returns false if nothing could be
+  recovered.
+ */
+bool AutosaveJournal::recover(const QString &session, QTextDocument *document,
+                              QString *fileName, QString *title)
+{
+    const bool undoRedo = document->isUndoRedoEnabled();
+    document->setUndoRedoEnabled(false);
+    const bool ok = replaySession(session, Q_UINT64_C(0xffffffffffffffff), document, fileName, title);
+    document->setUndoRedoEnabled(undoRedo);
+    return ok;
+}
+
+/*!
+  Removes the \a session directory with all its files.
+ */
+void AutosaveJournal::removeSession(const QString &session)
+{
+    QDir dir(session);
+    if (!dir.exists()) {
+        return;
+    }
+    foreach (const QString &name, dir.entryList(QDir::Files | QDir::Hidden)) {
+        dir.remove(name);
+    }
+    QDir().rmdir(session);
+}
+
+}
+
+#include "autosavejournal.moc"
@@ -0,0 +1,69 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef AUTOSAVEJOURNAL_H
+#define AUTOSAVEJOURNAL_H
+
+#include <QObject>
+#include <QStringList>
+
+#include <DPointer>
+
+#include <Global>
+
+QT_FORWARD_DECLARE_CLASS(QTextDocument)
+
+namespace GOW
+{
+
+class LIBRARY_EXPORT AutosaveJournal : public QObject
+{
+    Q_OBJECT
+public:
+    explicit AutosaveJournal(QTextDocument *document, QObject *parent = 0);
+    ~AutosaveJournal();
+
+    void start(const QString &fileName, const QString &title, bool saved);
+    void pause();
+    void resume();
+    void discard();
+    void compact(const QByteArray &draft);
+    void compactHtml(const QByteArray &html);
+    void compactSession(const QString &session);
+    QString session() const;
+
+    static QStringList pendingSessions();
+    static bool recover(const QString &session, QTextDocument *document,
+                        QString *fileName, QString *title);
+    static void removeSession(const QString &session);
+
+public slots:
+    void setTitle(const QString &title);
+    void flush();
+    void compact();
+
+private:
+    D_POINTER
+}; // end of class GOW::AutosaveJournal
+
+} // end of namespace GOW
+
+#endif // AUTOSAVEJOURNAL_H
@@ -23,91 +23,32 @@
 #include <QColorDialog>
 #include <QDebug>
 #include <QDesktopWidget>
-#include <QEventLoop>
 #include <QFrame>
-#include <QGridLayout>
+#include <QHash>
+#include <QHelpEvent>
 #include <QKeyEvent>
-#include <QMap>
 #include <qmath.h>
 #include <QMouseEvent>
 #include <QPainter>
 #include <QPen>
 #include <QStyle>
+#include <QToolTip>
+#include <QVector>
 
 #include "colorbutton.h"
 
 namespace GOW
 {
 
-static const char * ClassName_ColorPickerItem = "GOW::ColorPickerItem";
+static const int CELL_WIDTH = 24;
+static const int CELL_HEIGHT = 21;
+static const int GRID_MARGIN = 1;
 
 /*
-    A class  that acts very much  like a QPushButton. It's not styled,
-    so we  can  expect  the  exact  same    look,  feel and   geometry
-    everywhere.     Also,  this  button     always emits   clicked  on
-    mouseRelease, even if the mouse button was  not pressed inside the
-    widget.
-*/
-class ColorPickerButton : public QFrame
-{
-    Q_OBJECT
-public:
-    ColorPickerButton(QWidget *parent);
-
-signals:
-    void clicked();
-
-protected:
-    void mousePressEvent(QMouseEvent *e);
-    void mouseMoveEvent(QMouseEvent *e);
-    void mouseReleaseEvent(QMouseEvent *e);
-    void keyPressEvent(QKeyEvent *e);
-    void keyReleaseEvent(QKeyEvent *e);
-    void paintEvent(QPaintEvent *e);
-    void focusInEvent(QFocusEvent *e);
-    void focusOutEvent(QFocusEvent *e);
-};
-
-/*
-    This class represents each "color" or item in the color grid.
-*/
-class ColorPickerItem : public QFrame
-{
-    Q_OBJECT
-
-public:
-    ColorPickerItem(const QColor &color = Qt::white,
-                    const QString &text = QString::null,
-                    QWidget *parent = 0);
-    ~ColorPickerItem();
-
-    QColor color() const;
-    QString text() const;
-
-    void setSelected(bool);
-    bool isSelected() const;
-
-signals:
-    void clicked();
-    void selected();
-
-public slots:
-    void setColor(const QColor &color, const QString &text = QString());
-
-protected:
-    void mousePressEvent(QMouseEvent *e);
-    void mouseReleaseEvent(QMouseEvent *e);
-    void mouseMoveEvent(QMouseEvent *e);
-    void paintEvent(QPaintEvent *e);
-
-private:
-    QColor c;
-    QString t;
-    bool sel;
-};
-
-/*
-
+    The color grid. All swatches and the optional "more" cell at the end
+    are painted by this one widget. A cell is found from a position by
+    arithmetic and a color is found by a hash lookup, so palettes with
+    thousands of custom colors stay cheap to build, show and search.
 */
 class ColorPickerPopup : public QFrame
 {
@@ -118,14 +59,17 @@ public:
     ~ColorPickerPopup();
 
     void insertColor(const QColor &col, const QString &text, int index);
-    void exec();
 
-    void setExecFlag();
+    int find(const QColor &col) const;
+    QColor color(int index) const;
+    QString text(int index) const;
 
+    void setSelected(int index);
     QColor lastSelected() const;
 
-    ColorPickerItem *find(const QColor &col) const;
-    QColor color(int index) const;
+    void setDeleteWhenDone(bool enabled);
+
+    QSize sizeHint() const;
 
 signals:
     void selected(const QColor &);
@@ -134,26 +78,41 @@ signals:
 public slots:
     void getColorFromDialog();
 
-protected slots:
-    void updateSelected();
+private slots:
+    void dialogColorSelected(const QColor &col);
+    void dialogFinished();
 
 protected:
+    bool event(QEvent *e);
+    void paintEvent(QPaintEvent *e);
     void keyPressEvent(QKeyEvent *e);
     void showEvent(QShowEvent *e);
     void hideEvent(QHideEvent *e);
+    void mouseMoveEvent(QMouseEvent *e);
     void mouseReleaseEvent(QMouseEvent *e);
 
-    void regenerateGrid();
-
 private:
-    QMap<int, QMap<int, QWidget *> > widgetAt;
-    QList<ColorPickerItem *> items;
-    QGridLayout *grid;
-    ColorPickerButton *moreButton;
-    QEventLoop *eventLoop;
-
-    int lastPos;
+    struct Swatch
+    {
+        QColor color;
+        QString text;
+    };
+
+    int columnCount() const;
+    int cellCount() const;
+    int cellAt(const QPoint &pos) const;
+    QRect cellRect(int index) const;
+    void setFocusIndex(int index);
+    void activate(int index);
+
+    QVector<Swatch> swatches;
+    QHash<QRgb, int> indexes;
+    bool withColorDialog;
+    bool deleteWhenDone;
+    bool dialogOpen;
     int cols;
+    int focusIndex;
+    int selectedIndex;
     QColor lastSel;
 };
 
@@ -164,28 +123,20 @@ private:
 ColorPickerPopup::ColorPickerPopup(int width,
                                    bool withColorDialog,
                                    QWidget *parent)
-    : QFrame(parent, Qt::Popup)
+    : QFrame(parent, Qt::Popup),
+      withColorDialog(withColorDialog),
+      deleteWhenDone(false),
+      dialogOpen(false),
+      cols(width),
+      focusIndex(-1),
+      selectedIndex(-1)
 {
     setFrameStyle(QFrame::StyledPanel);
     setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Minimum);
 
     setFocusPolicy(Qt::StrongFocus);
     setMouseTracking(true);
-    cols = width;
-
-    if (withColorDialog) {
-        moreButton = new ColorPickerButton(this);
-        moreButton->setFixedWidth(24);
-        moreButton->setFixedHeight(21);
-        moreButton->setFrameRect(QRect(2, 2, 20, 17));
-        connect(moreButton, SIGNAL(clicked()), SLOT(getColorFromDialog()));
-    } else {
-        moreButton = 0;
-    }
-
-    eventLoop = 0;
-    grid = 0;
-    regenerateGrid();
+    resize(sizeHint());
 }
 
 
@@ -195,264 +146,105 @@ ColorPickerPopup::ColorPickerPopup(int width,
 */
 ColorPickerPopup::~ColorPickerPopup()
 {
-    if (eventLoop) {
-        eventLoop->exit();
-    }
 }
 
 /*! \internal
 
-    If there is an item whole color is equal to \a col, returns a
-    pointer to this item; otherwise returns 0.
+    If there is a color equal to \a col, returns its index; otherwise
+    returns -1.
 */
-ColorPickerItem *ColorPickerPopup::find(const QColor &col) const
+int ColorPickerPopup::find(const QColor &col) const
 {
-    for (int i = 0; i < items.size(); ++i) {
-        if (items.at(i) && items.at(i)->color() == col) {
-            return items.at(i);
-        }
-    }
-
-    return 0;
+    return indexes.value(col.rgba(), -1);
 }
 
 /*! \internal
 
-    Adds \a item to the grid. The items are added from top-left to
-    bottom-right.
+    Adds \a col named \a text to the grid at \a index. The colors are laid
+    out from top-left to bottom-right; an \a index of -1 appends.
 */
 void ColorPickerPopup::insertColor(const QColor &col, const QString &text, int index)
 {
     // Don't add colors that we have already.
-    ColorPickerItem *existingItem = find(col);
-    ColorPickerItem *lastSelectedItem = find(lastSelected());
-
-    if (existingItem) {
-        if (lastSelectedItem && existingItem != lastSelectedItem) {
-            lastSelectedItem->setSelected(false);
-        }
-        existingItem->setFocus();
-        existingItem->setSelected(true);
+    const int existing = find(col);
+    if (existing != -1) {
+        setSelected(existing);
+        setFocusIndex(existing);
         return;
     }
 
-    ColorPickerItem *item = new ColorPickerItem(col, text, this);
-
-    if (lastSelectedItem) {
-        lastSelectedItem->setSelected(false);
+    Swatch swatch;
+    swatch.color = col;
+    swatch.text = text;
+    if (index < 0 || index >= swatches.count()) {
+        index = swatches.count();
+        swatches.append(swatch);
     } else {
-        item->setSelected(true);
-        lastSel = col;
+        swatches.insert(index, swatch);
+        // Everything behind the new swatch moves by one.
+        for (QHash<QRgb, int>::iterator it = indexes.begin(); it != indexes.end(); ++it) {
+            if (it.value() >= index) {
+                ++it.value();
+            }
+        }
+        if (selectedIndex >= index) {
+            ++selectedIndex;
+        }
+        if (focusIndex >= index) {
+            ++focusIndex;
+        }
     }
-    item->setFocus();
-
-    connect(item, SIGNAL(selected()), SLOT(updateSelected()));
+    indexes.insert(col.rgba(), index);
 
-    if (index == -1) {
-        index = items.count();
+    if (selectedIndex == -1) {
+        selectedIndex = index;
+        lastSel = col;
     }
 
-    items.insert((unsigned int)index, item);
-    regenerateGrid();
-
+    resize(sizeHint());
     update();
 }
 
 /*! \internal
 
+    Returns the color at \a index, or an invalid color if there is none.
 */
 QColor ColorPickerPopup::color(int index) const
 {
-    if (index < 0 || index > (int) items.count() - 1) {
+    if (index < 0 || index >= swatches.count()) {
         return QColor();
     }
-
-    ColorPickerPopup *that = (ColorPickerPopup *)this;
-    return that->items.at(index)->color();
-}
-
-/*! \internal
-
-*/
-void ColorPickerPopup::exec()
-{
-    show();
-
-    QEventLoop e;
-    eventLoop = &e;
-    (void) e.exec();
-    eventLoop = 0;
-}
-
-/*! \internal
-
-*/
-void ColorPickerPopup::updateSelected()
-{
-    QLayoutItem *layoutItem;
-    int i = 0;
-    while ((layoutItem = grid->itemAt(i)) != 0) {
-        QWidget *w = layoutItem->widget();
-        if (w && w->inherits(ClassName_ColorPickerItem)) {
-            ColorPickerItem *litem = reinterpret_cast<ColorPickerItem *>(layoutItem->widget());
-            if (litem != sender())
-            litem->setSelected(false);
-        }
-        ++i;
-    }
-
-    if (sender() && sender()->inherits(ClassName_ColorPickerItem)) {
-        ColorPickerItem *item = (ColorPickerItem *)sender();
-        lastSel = item->color();
-        emit selected(item->color());
-    }
-
-    hide();
+    return swatches.at(index).color;
 }
 
 /*! \internal
 
+    Returns the name of the color at \a index.
 */
-void ColorPickerPopup::mouseReleaseEvent(QMouseEvent *e)
+QString ColorPickerPopup::text(int index) const
 {
-    if (!rect().contains(e->pos())) {
-        hide();
+    if (index < 0 || index >= swatches.count()) {
+        return QString();
     }
+    return swatches.at(index).text;
 }
 
 /*! \internal
 
-    Controls keyboard navigation and selection on the color grid.
+    Marks the color at \a index as the selected one.
 */
-void ColorPickerPopup::keyPressEvent(QKeyEvent *e)
+void ColorPickerPopup::setSelected(int index)
 {
-    int curRow = 0;
-    int curCol = 0;
-
-    bool foundFocus = false;
-    for (int j = 0; !foundFocus && j < grid->rowCount(); ++j) {
-        for (int i = 0; !foundFocus && i < grid->columnCount(); ++i) {
-            if (widgetAt[j][i] && widgetAt[j][i]->hasFocus()) {
-                curRow = j;
-                curCol = i;
-                foundFocus = true;
-                break;
-            }
-        }
-    }
-
-    switch (e->key()) {
-    case Qt::Key_Left:
-        if (curCol > 0) {
-            --curCol;
-        } else if (curRow > 0) {
-            --curRow;
-            curCol = grid->columnCount() - 1;
-        }
-        break;
-    case Qt::Key_Right:
-        if (curCol < grid->columnCount() - 1 && widgetAt[curRow][curCol + 1]) {
-            ++curCol;
-        } else if (curRow < grid->rowCount() - 1) {
-            ++curRow;
-            curCol = 0;
-        }
-        break;
-    case Qt::Key_Up:
-        if (curRow > 0) {
-            --curRow;
-        } else {
-            curCol = 0;
-        }
-        break;
-    case Qt::Key_Down:
-        if (curRow < grid->rowCount() - 1) {
-            QWidget *w = widgetAt[curRow + 1][curCol];
-            if (w) {
-                ++curRow;
-            } else {
-                for (int i = 1; i < grid->columnCount(); ++i) {
-                    if (!widgetAt[curRow + 1][i]) {
-                        curCol = i - 1;
-                        ++curRow;
-                        break;
-                    }
-                }
-            }
-        }
-        break;
-    case Qt::Key_Space:
-    case Qt::Key_Return:
-    case Qt::Key_Enter:
-    {
-        QWidget *w = widgetAt[curRow][curCol];
-        if (w && w->inherits(ClassName_ColorPickerItem)) {
-            ColorPickerItem *wi = reinterpret_cast<ColorPickerItem *>(w);
-            wi->setSelected(true);
-
-            QLayoutItem *layoutItem;
-            int i = 0;
-            while ((layoutItem = grid->itemAt(i)) != 0) {
-                QWidget *w = layoutItem->widget();
-                if (w && w->inherits(ClassName_ColorPickerItem)) {
-                    ColorPickerItem *litem  = reinterpret_cast<ColorPickerItem *>(layoutItem->widget());
-                    if (litem != wi) {
-                        litem->setSelected(false);
-                    }
-                }
-                ++i;
-            }
-
-            lastSel = wi->color();
-            emit selected(wi->color());
-            hide();
-        } else if (w && w->inherits("QPushButton")) {
-            ColorPickerItem *wi = reinterpret_cast<ColorPickerItem *>(w);
-            wi->setSelected(true);
-
-            QLayoutItem *layoutItem;
-            int i = 0;
-            while ((layoutItem = grid->itemAt(i)) != 0) {
-                QWidget *w = layoutItem->widget();
-                if (w && w->inherits(ClassName_ColorPickerItem)) {
-                    ColorPickerItem *litem = reinterpret_cast<ColorPickerItem *>(layoutItem->widget());
-                    if (litem != wi) {
-                        litem->setSelected(false);
-                    }
-                }
-                ++i;
-            }
-
-            lastSel = wi->color();
-            emit selected(wi->color());
-            hide();
-        }
+    if (index == selectedIndex) {
+        return;
     }
-        break;
-    case Qt::Key_Escape:
-        hide();
-        break;
-    default:
-        e->ignore();
-        break;
+    if (selectedIndex != -1) {
+        update(cellRect(selectedIndex));
     }
-
-    widgetAt[curRow][curCol]->setFocus();
-}
-
-/*! \internal
-
-*/
-void ColorPickerPopup::hideEvent(QHideEvent *e)
-{
-    if (eventLoop) {
-        eventLoop->exit();
+    selectedIndex = index;
+    if (selectedIndex != -1) {
+        update(cellRect(selectedIndex));
     }
-
-    setFocus();
-
-    emit hid();
-    QFrame::hideEvent(e);
 }
 
 /*! \internal
@@ -465,336 +257,327 @@ QColor ColorPickerPopup::lastSelected() const
 
 /*! \internal
 
-    Sets focus on the popup to enable keyboard navigation. Draws
-    focusRect and selection rect.
+    If \a enabled, the popup deletes itself once it is hidden and a color
+    dialog opened from it, if any, is closed.
 */
-void ColorPickerPopup::showEvent(QShowEvent *)
+void ColorPickerPopup::setDeleteWhenDone(bool enabled)
 {
-    bool foundSelected = false;
-    for (int i = 0; i < grid->columnCount(); ++i) {
-        for (int j = 0; j < grid->rowCount(); ++j) {
-            QWidget *w = widgetAt[j][i];
-            if (w && w->inherits(ClassName_ColorPickerItem)) {
-                if (((ColorPickerItem *)w)->isSelected()) {
-                    w->setFocus();
-                    foundSelected = true;
-                    break;
-                }
-            }
-        }
-    }
-
-    if (!foundSelected) {
-        if (items.count() == 0) {
-            setFocus();
-        } else {
-            widgetAt[0][0]->setFocus();
-        }
-    }
+    deleteWhenDone = enabled;
 }
 
-/*!
+/*! \internal
 
 */
-void ColorPickerPopup::regenerateGrid()
+QSize ColorPickerPopup::sizeHint() const
 {
-    widgetAt.clear();
-
-    int columns = cols;
-    if (columns == -1) {
-        columns = qCeil(qSqrt((qreal) items.count()));
-    }
-
-    // When the number of columns grows, the number of rows will
-    // fall. There's no way to shrink a grid, so we create a new
-    // one.
-    if (grid) {
-        delete grid;
-    }
-    grid = new QGridLayout(this);
-    grid->setMargin(1);
-    grid->setSpacing(0);
-
-    int ccol = 0, crow = 0;
-    for (int i = 0; i < items.size(); ++i) {
-        if (items.at(i)) {
-            widgetAt[crow][ccol] = items.at(i);
-            grid->addWidget(items.at(i), crow, ccol++);
-            if (ccol == columns) {
-                ++crow;
-                ccol = 0;
-            }
-        }
-    }
-
-    if (moreButton) {
-        grid->addWidget(moreButton, crow, ccol);
-        widgetAt[crow][ccol] = moreButton;
-    }
-    updateGeometry();
+    const int columns = columnCount();
+    const int rows = (cellCount() + columns - 1) / columns;
+    const int margin = 2 * (frameWidth() + GRID_MARGIN);
+    return QSize(columns * CELL_WIDTH + margin, rows * CELL_HEIGHT + margin);
 }
 
 /*! \internal
 
-    Copies the color dialog's currently selected item and emits
-    itemSelected().
+    Returns the number of columns. If no width was given, the grid is made
+    as square as possible.
 */
-void ColorPickerPopup::getColorFromDialog()
+int ColorPickerPopup::columnCount() const
 {
-    bool ok;
-    QRgb rgb = QColorDialog::getRgba(lastSel.rgba(), &ok, parentWidget());
-    if (!ok) {
-        return;
+    if (cols > 0) {
+        return cols;
     }
-
-    QColor col = QColor::fromRgba(rgb);
-    insertColor(col, tr("Custom"), -1);
-    lastSel = col;
-    emit selected(col);
-}
-
-/*!
-    Constructs a ColorPickerItem whose color is set to \a color, and
-    whose name is set to \a text.
-*/
-ColorPickerItem::ColorPickerItem(const QColor &color, const QString &text,
-                     QWidget *parent)
-    : QFrame(parent), c(color), t(text), sel(false)
-{
-    setToolTip(t);
-    setFixedWidth(24);
-    setFixedHeight(21);
-}
-
-/*!
-    Destructs a ColorPickerItem.
- */
-ColorPickerItem::~ColorPickerItem()
-{
+    return qMax(1, qCeil(qSqrt((qreal) swatches.count())));
 }
 
-/*!
-    Returns the item's color.
+/*! \internal
 
-    \sa text()
+    Returns the number of cells including the "more" cell.
 */
-QColor ColorPickerItem::color() const
+int ColorPickerPopup::cellCount() const
 {
-    return c;
+    return swatches.count() + (withColorDialog ? 1 : 0);
 }
 
-/*!
-    Returns the item's text.
+/*! \internal
 
-    \sa color()
+    Returns the index of the cell at \a pos, or -1 if there is none.
 */
-QString ColorPickerItem::text() const
+int ColorPickerPopup::cellAt(const QPoint &pos) const
 {
-    return t;
+    const int offset = frameWidth() + GRID_MARGIN;
+    const int x = pos.x() - offset;
+    const int y = pos.y() - offset;
+    if (x < 0 || y < 0) {
+        return -1;
+    }
+    const int columns = columnCount();
+    const int column = x / CELL_WIDTH;
+    if (column >= columns) {
+        return -1;
+    }
+    const int index = (y / CELL_HEIGHT) * columns + column;
+    return index < cellCount() ? index : -1;
 }
 
-/*!
+/*! \internal
 
 */
-bool ColorPickerItem::isSelected() const
+QRect ColorPickerPopup::cellRect(int index) const
 {
-    return sel;
+    const int offset = frameWidth() + GRID_MARGIN;
+    const int columns = columnCount();
+    return QRect(offset + (index % columns) * CELL_WIDTH,
+                 offset + (index / columns) * CELL_HEIGHT,
+                 CELL_WIDTH, CELL_HEIGHT);
 }
 
-/*!
-
-*/
-void ColorPickerItem::setSelected(bool selected)
-{
-    sel = selected;
-    update();
-}
+/*! \internal
 
-/*!
-    Sets the item's color to \a color, and its name to \a text.
+    Moves the keyboard focus rect to the cell at \a index.
 */
-void ColorPickerItem::setColor(const QColor &color, const QString &text)
+void ColorPickerPopup::setFocusIndex(int index)
 {
-    c = color;
-    t = text;
-    setToolTip(t);
-    update();
+    if (index == focusIndex) {
+        return;
+    }
+    if (focusIndex != -1) {
+        update(cellRect(focusIndex));
+    }
+    focusIndex = index;
+    if (focusIndex != -1) {
+        update(cellRect(focusIndex));
+    }
 }
 
-/*!
+/*! \internal
 
+    Selects the color at \a index, or opens the color dialog for the
+    "more" cell.
 */
-void ColorPickerItem::mouseMoveEvent(QMouseEvent *)
+void ColorPickerPopup::activate(int index)
 {
-    setFocus();
-    update();
+    if (index < 0) {
+        return;
+    }
+    if (index >= swatches.count()) {
+        getColorFromDialog();
+        return;
+    }
+    setSelected(index);
+    lastSel = swatches.at(index).color;
+    emit selected(lastSel);
+    hide();
 }
 
-/*!
+/*! \internal
 
+    Shows the name of the color under the mouse.
 */
-void ColorPickerItem::mouseReleaseEvent(QMouseEvent *)
+bool ColorPickerPopup::event(QEvent *e)
 {
-    sel = true;
-    emit selected();
+    if (e->type() == QEvent::ToolTip) {
+        QHelpEvent *he = static_cast<QHelpEvent *>(e);
+        const int index = cellAt(he->pos());
+        if (index != -1 && index < swatches.count()) {
+            QToolTip::showText(he->globalPos(), swatches.at(index).text, this, cellRect(index));
+        } else {
+            QToolTip::hideText();
+            e->ignore();
+        }
+        return true;
+    }
+    return QFrame::event(e);
 }
 
-/*!
+/*! \internal
 
+    Paints the cells intersecting the exposed area only.
 */
-void ColorPickerItem::mousePressEvent(QMouseEvent *)
+void ColorPickerPopup::paintEvent(QPaintEvent *e)
 {
-    setFocus();
-    update();
-}
-
-/*!
+    QFrame::paintEvent(e);
 
-*/
-void ColorPickerItem::paintEvent(QPaintEvent *)
-{
     QPainter p(this);
-    int w = width();			// width of cell in pixels
-    int h = height();			// height of cell in pixels
-
-    p.setPen( QPen( Qt::gray, 0, Qt::SolidLine ) );
-
-    if (sel)
-    p.drawRect(1, 1, w - 3, h - 3);
-
-    p.setPen( QPen( Qt::black, 0, Qt::SolidLine ) );
-    p.drawRect(3, 3, w - 7, h - 7);
-    p.fillRect(QRect(4, 4, w - 8, h - 8), QBrush(c));
-
-    if (hasFocus())
-    p.drawRect(0, 0, w - 1, h - 1);
+    const int columns = columnCount();
+    const int offset = frameWidth() + GRID_MARGIN;
+    const int firstRow = qMax(0, (e->rect().top() - offset) / CELL_HEIGHT);
+    const int lastRow = qMax(0, (e->rect().bottom() - offset) / CELL_HEIGHT);
+    const int last = qMin(cellCount() - 1, (lastRow + 1) * columns - 1);
+    const int w = CELL_WIDTH;
+    const int h = CELL_HEIGHT;
+
+    for (int i = firstRow * columns; i <= last; ++i) {
+        const QRect r = cellRect(i);
+        if (!r.intersects(e->rect())) {
+            continue;
+        }
+        const int x = r.x();
+        const int y = r.y();
+        if (i < swatches.count()) {
+            if (i == selectedIndex) {
+                p.setPen(QPen(Qt::gray, 0, Qt::SolidLine));
+                p.drawRect(x + 1, y + 1, w - 3, h - 3);
+            }
+            p.setPen(QPen(Qt::black, 0, Qt::SolidLine));
+            p.drawRect(x + 3, y + 3, w - 7, h - 7);
+            p.fillRect(QRect(x + 4, y + 4, w - 8, h - 8), QBrush(swatches.at(i).color));
+        } else {
+            // The "more" cell: an ellipsis on a button face.
+            p.fillRect(r.adjusted(2, 2, -2, -2), palette().button());
+            p.setPen(QPen(palette().buttonText(), 1));
+            const QPoint c = r.center();
+            p.drawRect(c.x() - 4, c.y(), 1, 1);
+            p.drawRect(c.x(), c.y(), 1, 1);
+            p.drawRect(c.x() + 4, c.y(), 1, 1);
+        }
+        if (i == focusIndex) {
+            p.setPen(QPen(Qt::black, 0, Qt::SolidLine));
+            p.drawRect(x, y, w - 1, h - 1);
+        }
+    }
 }
 
-/*!
+/*! \internal
 
 */
-ColorPickerButton::ColorPickerButton(QWidget *parent)
-    : QFrame(parent)
+void ColorPickerPopup::mouseMoveEvent(QMouseEvent *e)
 {
-    setFrameStyle(StyledPanel);
+    const int index = cellAt(e->pos());
+    if (index != -1) {
+        setFocusIndex(index);
+    }
 }
 
-/*!
+/*! \internal
 
 */
-void ColorPickerButton::mousePressEvent(QMouseEvent *)
+void ColorPickerPopup::mouseReleaseEvent(QMouseEvent *e)
 {
-    setFrameShadow(Sunken);
-    update();
+    if (!rect().contains(e->pos())) {
+        hide();
+        return;
+    }
+    activate(cellAt(e->pos()));
 }
 
-/*!
+/*! \internal
 
+    Controls keyboard navigation and selection on the color grid.
 */
-void ColorPickerButton::mouseMoveEvent(QMouseEvent *)
+void ColorPickerPopup::keyPressEvent(QKeyEvent *e)
 {
-    setFocus();
-    update();
-}
+    const int columns = columnCount();
+    const int count = cellCount();
+    int index = qMax(0, focusIndex);
 
-/*!
+    switch (e->key()) {
+    case Qt::Key_Left:
+        if (index > 0) {
+            --index;
+        }
+        break;
+    case Qt::Key_Right:
+        if (index < count - 1) {
+            ++index;
+        }
+        break;
+    case Qt::Key_Up:
+        index = index >= columns ? index - columns : 0;
+        break;
+    case Qt::Key_Down:
+        if (index + columns < count) {
+            index += columns;
+        } else if (index / columns < (count - 1) / columns) {
+            index = count - 1;
+        }
+        break;
+    case Qt::Key_Space:
+    case Qt::Key_Return:
+    case Qt::Key_Enter:
+        activate(count > 0 ? index : -1);
+        return;
+    case Qt::Key_Escape:
+        hide();
+        return;
+    default:
+        e->ignore();
+        return;
+    }
 
-*/
-void ColorPickerButton::mouseReleaseEvent(QMouseEvent *)
-{
-    setFrameShadow(Raised);
-    repaint();
-    emit clicked();
+    if (count > 0) {
+        setFocusIndex(index);
+    }
 }
 
-/*!
+/*! \internal
 
+    Sets focus on the popup to enable keyboard navigation, starting at the
+    selected color.
 */
-void ColorPickerButton::keyPressEvent(QKeyEvent *e)
+void ColorPickerPopup::showEvent(QShowEvent *e)
 {
-    if (e->key() == Qt::Key_Up
-            || e->key() == Qt::Key_Down
-            || e->key() == Qt::Key_Left
-            || e->key() == Qt::Key_Right) {
-        qApp->sendEvent(parent(), e);
-    } else if (e->key() == Qt::Key_Enter
-               || e->key() == Qt::Key_Space
-               || e->key() == Qt::Key_Return) {
-        setFrameShadow(Sunken);
-        update();
+    QFrame::showEvent(e);
+    if (selectedIndex != -1) {
+        setFocusIndex(selectedIndex);
     } else {
-        QFrame::keyPressEvent(e);
+        setFocusIndex(cellCount() > 0 ? 0 : -1);
     }
+    setFocus();
 }
 
-/*!
+/*! \internal
 
 */
-void ColorPickerButton::keyReleaseEvent(QKeyEvent *e)
+void ColorPickerPopup::hideEvent(QHideEvent *e)
 {
-    if (e->key() == Qt::Key_Up
-            || e->key() == Qt::Key_Down
-            || e->key() == Qt::Key_Left
-            || e->key() == Qt::Key_Right) {
-        qApp->sendEvent(parent(), e);
-    } else if (e->key() == Qt::Key_Enter
-               || e->key() == Qt::Key_Space
-               || e->key() == Qt::Key_Return) {
-        setFrameShadow(Raised);
-        repaint();
-        emit clicked();
-    } else {
-        QFrame::keyReleaseEvent(e);
+    QFrame::hideEvent(e);
+    emit hid();
+    if (deleteWhenDone && !dialogOpen) {
+        deleteLater();
     }
 }
 
-/*!
+/*! \internal
 
+    Opens a color dialog without blocking. A color picked there is added to
+    the grid and selected().
 */
-void ColorPickerButton::focusInEvent(QFocusEvent *e)
+void ColorPickerPopup::getColorFromDialog()
 {
-    setFrameShadow(Raised);
-    update();
-    QFrame::focusOutEvent(e);
+    if (dialogOpen) {
+        return;
+    }
+    dialogOpen = true;
+    hide();
+
+    QColorDialog *dialog = new QColorDialog(lastSel, parentWidget());
+    dialog->setOption(QColorDialog::ShowAlphaChannel);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    connect(dialog, SIGNAL(colorSelected(QColor)), SLOT(dialogColorSelected(QColor)));
+    connect(dialog, SIGNAL(finished(int)), SLOT(dialogFinished()));
+    dialog->open();
 }
 
-/*!
+/*! \internal
 
 */
-void ColorPickerButton::focusOutEvent(QFocusEvent *e)
+void ColorPickerPopup::dialogColorSelected(const QColor &col)
 {
-    setFrameShadow(Raised);
-    update();
-    QFrame::focusOutEvent(e);
+    insertColor(col, tr("Custom"), -1);
+    setSelected(find(col));
+    lastSel = col;
+    emit selected(col);
 }
 
-/*!
+/*! \internal
 
 */
-void ColorPickerButton::paintEvent(QPaintEvent *e)
+void ColorPickerPopup::dialogFinished()
 {
-    QFrame::paintEvent(e);
-
-    QPainter p(this);
-    p.fillRect(contentsRect(), palette().button());
-
-    QRect r = rect();
-
-    int offset = frameShadow() == Sunken ? 1 : 0;
-
-    QPen pen(palette().buttonText(), 1);
-    p.setPen(pen);
-
-    p.drawRect(r.center().x() + offset - 4, r.center().y() + offset, 1, 1);
-    p.drawRect(r.center().x() + offset    , r.center().y() + offset, 1, 1);
-    p.drawRect(r.center().x() + offset + 4, r.center().y() + offset, 1, 1);
-    if (hasFocus()) {
-        p.setPen( QPen( Qt::black, 0, Qt::SolidLine ) );
-        p.drawRect(0, 0, width() - 1, height() - 1);
+    dialogOpen = false;
+    if (deleteWhenDone) {
+        deleteLater();
     }
-
-    p.end();
-
 }
 
 class ColorButton::Private
@@ -1015,42 +798,48 @@ void ColorButton::setStandardColors()
     global coordinates. If \a allowCustomColors is true, there will
     also be a button on the popup that invokes QColorDialog.
 
+    The function returns at once. When a color is picked, \a member of
+    \a receiver is called with it; the popup deletes itself once it is
+    closed.
+
     For example:
 
     \code
         void Drawer::mouseReleaseEvent(QMouseEvent *e)
         {
-        if (e->button() & RightButton) {
-                QColor color = QtColorPicker::getColor(mapToGlobal(e->pos()));
+            if (e->button() & RightButton) {
+                ColorButton::getColor(mapToGlobal(e->pos()), this, SLOT(setPenColor(QColor)));
             }
         }
     \endcode
 */
-QColor ColorButton::getColor(const QPoint &point, bool allowCustomColors)
-{
-    ColorPickerPopup popup(-1, allowCustomColors);
-
-    popup.insertColor(Qt::black, tr("Black"), 0);
-    popup.insertColor(Qt::white, tr("White"), 1);
-    popup.insertColor(Qt::red, tr("Red"), 2);
-    popup.insertColor(Qt::darkRed, tr("Dark red"), 3);
-    popup.insertColor(Qt::green, tr("Green"), 4);
-    popup.insertColor(Qt::darkGreen, tr("Dark green"), 5);
-    popup.insertColor(Qt::blue, tr("Blue"), 6);
-    popup.insertColor(Qt::darkBlue, tr("Dark blue"), 7);
-    popup.insertColor(Qt::cyan, tr("Cyan"), 8);
-    popup.insertColor(Qt::darkCyan, tr("Dark cyan"), 9);
-    popup.insertColor(Qt::magenta, tr("Magenta"), 10);
-    popup.insertColor(Qt::darkMagenta, tr("Dark magenta"), 11);
-    popup.insertColor(Qt::yellow, tr("Yellow"), 12);
-    popup.insertColor(Qt::darkYellow, tr("Dark yellow"), 13);
-    popup.insertColor(Qt::gray, tr("Gray"), 14);
-    popup.insertColor(Qt::darkGray, tr("Dark gray"), 15);
-    popup.insertColor(Qt::lightGray, tr("Light gray"), 16);
-
-    popup.move(point);
-    popup.exec();
-    return popup.lastSelected();
+void ColorButton::getColor(const QPoint &point, QObject *receiver, const char *member,
+                           bool allowCustomColors)
+{
+    ColorPickerPopup *popup = new ColorPickerPopup(-1, allowCustomColors);
+    popup->setDeleteWhenDone(true);
+
+    popup->insertColor(Qt::black, tr("Black"), 0);
+    popup->insertColor(Qt::white, tr("White"), 1);
+    popup->insertColor(Qt::red, tr("Red"), 2);
+    popup->insertColor(Qt::darkRed, tr("Dark red"), 3);
+    popup->insertColor(Qt::green, tr("Green"), 4);
+    popup->insertColor(Qt::darkGreen, tr("Dark green"), 5);
+    popup->insertColor(Qt::blue, tr("Blue"), 6);
+    popup->insertColor(Qt::darkBlue, tr("Dark blue"), 7);
+    popup->insertColor(Qt::cyan, tr("Cyan"), 8);
+    popup->insertColor(Qt::darkCyan, tr("Dark cyan"), 9);
+    popup->insertColor(Qt::magenta, tr("Magenta"), 10);
+    popup->insertColor(Qt::darkMagenta, tr("Dark magenta"), 11);
+    popup->insertColor(Qt::yellow, tr("Yellow"), 12);
+    popup->insertColor(Qt::darkYellow, tr("Dark yellow"), 13);
+    popup->insertColor(Qt::gray, tr("Gray"), 14);
+    popup->insertColor(Qt::darkGray, tr("Dark gray"), 15);
+    popup->insertColor(Qt::lightGray, tr("Light gray"), 16);
+
+    connect(popup, SIGNAL(selected(QColor)), receiver, member);
+    popup->move(point);
+    popup->show();
 }
 
 void ColorButton::setTipIcon(const QIcon &icon)
@@ -1071,21 +860,21 @@ void ColorButton::setCurrentColor(const QColor &color)
         return;
     }
 
-    ColorPickerItem *item = d->popup->find(color);
-    if (!item) {
+    int index = d->popup->find(color);
+    if (index == -1) {
         insertColor(color, tr("Custom"));
-        item = d->popup->find(color);
+        index = d->popup->find(color);
     }
 
     d->col = color;
-    setText(item->text());
+    setText(d->popup->text(index));
 
     d->dirty = true;
 
     d->popup->hide();
     repaint();
 
-    item->setSelected(true);
+    d->popup->setSelected(index);
     emit colorChanged(color);
 }
 
@@ -1142,9 +931,7 @@ void ColorButton::buttonPressed(bool toggled)
     }
     d->popup->move(pos);
 
-    if (ColorPickerItem *item = d->popup->find(d->col)) {
-        item->setSelected(true);
-    }
+    d->popup->setSelected(d->popup->find(d->col));
 
     // Remove focus from this widget, preventing the focus rect
     // from showing when the popup is shown. Order an update to
@@ -1155,7 +942,7 @@ void ColorButton::buttonPressed(bool toggled)
     // Allow keyboard navigation as soon as the popup shows.
     d->popup->setFocus();
 
-    // Execute the popup. The popup will enter the event loop.
+    // Show the popup and return; a selection arrives through selected().
     d->popup->show();
 }
 
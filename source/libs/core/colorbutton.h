@@ -25,11 +25,12 @@
 #include <QPushButton>
 
 #include <DPointer>
+#include <Global>
 
 namespace GOW
 {
 
-class ColorButton : public QPushButton
+class LIBRARY_EXPORT ColorButton : public QPushButton
 {
     Q_OBJECT
     Q_PROPERTY(bool colorDialog READ colorDialogEnabled WRITE setColorDialogEnabled)
@@ -48,7 +49,8 @@ public:
 
     void setStandardColors();
 
-    static QColor getColor(const QPoint &point, bool allowCustomColors = true);
+    static void getColor(const QPoint &point, QObject *receiver, const char *member,
+                         bool allowCustomColors = true);
 
     void setTipIcon(const QIcon &icon);
 
@@ -24,6 +24,8 @@ TARGET   = core
 include(../../library.pri)
 include(core_dependencies.pri)
 
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
+
 HEADERS += \
     global.h \
     mainwindow.h \
@@ -34,7 +36,19 @@ HEADERS += \
     fontsizechooser.h \
     colorbutton.h \
     dpointer.h \
-    editor.h
+    editor.h \
+    htmlsynchronizer.h \
+    fontcache.h \
+    glyphpreviewcache.h \
+    startuptracer.h \
+    iconprovider.h \
+    windowmanager.h \
+    autosavejournal.h \
+    librarydialog.h \
+    librarymodel.h \
+    librarydock.h \
+    imagecache.h \
+    publishdialog.h
 
 SOURCES += \
     mainwindow.cpp \
@@ -45,7 +59,19 @@ SOURCES += \
     fontsizechooser.cpp \
     colorbutton.cpp \
     dpointer.cpp \
-    editor.cpp
+    editor.cpp \
+    htmlsynchronizer.cpp \
+    fontcache.cpp \
+    glyphpreviewcache.cpp \
+    startuptracer.cpp \
+    iconprovider.cpp \
+    windowmanager.cpp \
+    autosavejournal.cpp \
+    librarydialog.cpp \
+    librarymodel.cpp \
+    librarydock.cpp \
+    imagecache.cpp \
+    publishdialog.cpp
 
 RESOURCES += \
     resources.qrc
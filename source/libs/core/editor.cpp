@@ -84,3 +84,34 @@
 
   Sets text alignment to \a alignment.
  */
+
+/*!
+  \class GOW::FormatChanges
+
+  A set of format changes to be applied by an editor at once.
+
+  Only the attributes which have been set are changed, for example:
+  \code
+  editor->applyFormat(FormatChanges().setBold(true).setFontSize(16));
+  \endcode
+ */
+
+/*!
+  \fn void GOW::Editor::textFontFamily(const QString &family)
+
+  Sets font family of text to \a family.
+ */
+
+/*!
+  \fn void GOW::Editor::textFontSize(int size)
+
+  Sets font size of text to \a size.
+ */
+
+/*!
+  \fn void GOW::Editor::applyFormat(const FormatChanges &changes)
+
+  Applies all of \a changes to the selection, or to the word under the
+  cursor, as one edit: there is a single undo step and the document is
+  laid out again only once however many attributes change.
+ */
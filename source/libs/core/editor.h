@@ -22,7 +22,7 @@
 #ifndef EDITOR_H
 #define EDITOR_H
 
-QT_FORWARD_DECLARE_CLASS(QString);
+#include <QString>
 
 namespace GOW
 {
@@ -35,6 +35,56 @@ enum TextAlignment
     AlignCenter
 };
 
+class FormatChanges
+{
+public:
+    enum Change
+    {
+        Bold       = 0x01,
+        Italic     = 0x02,
+        Underline  = 0x04,
+        StrikeOut  = 0x08,
+        FontFamily = 0x10,
+        FontSize   = 0x20,
+        Alignment  = 0x40
+    };
+    Q_DECLARE_FLAGS(Changes, Change)
+
+    FormatChanges() :
+        m_bold(false), m_italic(false), m_underline(false), m_strikeOut(false),
+        m_fontSize(0), m_alignment(AlignJustify) {}
+
+    Changes changes() const { return m_changes; }
+    bool has(Change change) const { return m_changes.testFlag(change); }
+    bool isEmpty() const { return !m_changes; }
+
+    FormatChanges &setBold(bool bold) { m_changes |= Bold; m_bold = bold; return *this; }
+    FormatChanges &setItalic(bool italic) { m_changes |= Italic; m_italic = italic; return *this; }
+    FormatChanges &setUnderline(bool underline) { m_changes |= Underline; m_underline = underline; return *this; }
+    FormatChanges &setStrikeOut(bool strike) { m_changes |= StrikeOut; m_strikeOut = strike; return *this; }
+    FormatChanges &setFontFamily(const QString &family) { m_changes |= FontFamily; m_fontFamily = family; return *this; }
+    FormatChanges &setFontSize(int size) { m_changes |= FontSize; m_fontSize = size; return *this; }
+    FormatChanges &setAlignment(TextAlignment alignment) { m_changes |= Alignment; m_alignment = alignment; return *this; }
+
+    bool bold() const { return m_bold; }
+    bool italic() const { return m_italic; }
+    bool underline() const { return m_underline; }
+    bool strikeOut() const { return m_strikeOut; }
+    QString fontFamily() const { return m_fontFamily; }
+    int fontSize() const { return m_fontSize; }
+    TextAlignment alignment() const { return m_alignment; }
+
+private:
+    Changes m_changes;
+    bool m_bold;
+    bool m_italic;
+    bool m_underline;
+    bool m_strikeOut;
+    QString m_fontFamily;
+    int m_fontSize;
+    TextAlignment m_alignment;
+}; // end of class GOW::FormatChanges
+
 class Editor
 {
 public:
@@ -46,7 +96,11 @@ public:
     virtual void textAlign(TextAlignment alignment) = 0;
     virtual void textFontFamily(const QString &family) = 0;
     virtual void textFontSize(int size) = 0;
+
+    virtual void applyFormat(const FormatChanges &changes) = 0;
 }; // end of class GOW::Editor
 } // end of namespace GOW
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(GOW::FormatChanges::Changes)
+
 #endif // EDITOR_H
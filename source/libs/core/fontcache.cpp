@@ -0,0 +1,356 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QFontDatabase>
+#include <QFontMetrics>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QMutex>
+#include <QRegExp>
+#include <QtConcurrentRun>
+#if QT_VERSION >= 0x050000
+#include <QStandardPaths>
+#else
+#include <QDesktopServices>
+#endif
+
+#include "fontcache.h"
+#include "startuptracer.h"
+
+namespace GOW
+{
+
+static const quint32 CACHE_MAGIC = 0x4f57464e; // "OWFN"
+static const quint32 CACHE_VERSION = 1;
+
+struct FontFamilies
+{
+    QByteArray fingerprint;
+    QStringList families;
+    QHash<QString, int> heights;
+};
+
+static QString cacheFilePath()
+{
+#if QT_VERSION >= 0x050000
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+#else
+    const QString dir = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+#endif
+    return dir + QLatin1String("/fontfamilies.cache");
+}
+
+#if !defined(Q_OS_WIN) && !defined(Q_OS_MAC)
+static QString environmentPath(const char *name, const QString &fallback)
+{
+    const QString path = QString::fromLocal8Bit(qgetenv(name));
+    return path.isEmpty() ? fallback : path;
+}
+
+/*
+    The <dir> entries of the fontconfig configuration, which may add any
+    directory to the system and user defaults.
+*/
+static QStringList fontconfigDirectories()
+{
+    const QString configHome = environmentPath("XDG_CONFIG_HOME", QDir::homePath() + QLatin1String("/.config"));
+    const QString dataHome = environmentPath("XDG_DATA_HOME", QDir::homePath() + QLatin1String("/.local/share"));
+    QStringList files;
+    files << QLatin1String("/etc/fonts/fonts.conf") << configHome + QLatin1String("/fontconfig/fonts.conf");
+    foreach (const QString &dir, QStringList() << QLatin1String("/etc/fonts/conf.d")
+                                               << configHome + QLatin1String("/fontconfig/conf.d")) {
+        foreach (const QFileInfo &info, QDir(dir).entryInfoList(QStringList() << QLatin1String("*.conf"),
+                                                                QDir::Files, QDir::Name)) {
+            files << info.filePath();
+        }
+    }
+    QStringList dirs;
+    QRegExp entry(QLatin1String("<dir([^>]*)>\\s*([^<]+)</dir>"));
+    foreach (const QString &fileName, files) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        const QString config = QString::fromUtf8(file.readAll());
+        for (int pos = entry.indexIn(config); pos >= 0; pos = entry.indexIn(config, pos + entry.matchedLength())) {
+            QString dir = entry.cap(2).trimmed();
+            if (entry.cap(1).contains(QLatin1String("\"xdg\""))) {
+                dir = dataHome + QLatin1Char('/') + dir;
+            } else if (dir.startsWith(QLatin1Char('~'))) {
+                dir = QDir::homePath() + dir.mid(1);
+            }
+            dirs << dir;
+        }
+    }
+    return dirs;
+}
+#endif
+
+static QStringList systemFontDirectories()
+{
+    QStringList dirs;
+#if defined(Q_OS_WIN)
+    dirs << QString::fromLocal8Bit(qgetenv("WINDIR")) + QLatin1String("/Fonts")
+         << QString::fromLocal8Bit(qgetenv("LOCALAPPDATA")) + QLatin1String("/Microsoft/Windows/Fonts");
+#elif defined(Q_OS_MAC)
+    dirs << QLatin1String("/System/Library/Fonts")
+         << QLatin1String("/Library/Fonts")
+         << QDir::homePath() + QLatin1String("/Library/Fonts");
+#else
+    dirs << QLatin1String("/usr/share/fonts")
+         << QLatin1String("/usr/local/share/fonts")
+         << QDir::homePath() + QLatin1String("/.fonts")
+         << environmentPath("XDG_DATA_HOME", QDir::homePath() + QLatin1String("/.local/share"))
+            + QLatin1String("/fonts")
+         << fontconfigDirectories();
+    dirs.removeDuplicates();
+#endif
+    return dirs;
+}
+
+/*
+    Installing or removing a font touches the directory it lives in, so the
+    modification times of all font directories identify the installed set.
+    Only directories are visited, besides the small fontconfig files on X11;
+    this is a few hundred stat calls at most.
+*/
+static QByteArray fontSetFingerprint()
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray(QT_VERSION_STR));
+    foreach (const QString &path, systemFontDirectories()) {
+        QFileInfo root(path);
+        if (!root.isDir()) {
+            continue;
+        }
+        hash.addData(path.toUtf8());
+        hash.addData(QByteArray::number(root.lastModified().toMSecsSinceEpoch()));
+        QDirIterator it(path, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            it.next();
+            hash.addData(it.filePath().toUtf8());
+            hash.addData(QByteArray::number(it.fileInfo().lastModified().toMSecsSinceEpoch()));
+        }
+    }
+    return hash.result();
+}
+
+static bool readCache(FontFamilies *cache)
+{
+    QFile file(cacheFilePath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    in >> magic >> version;
+    if (magic != CACHE_MAGIC || version != CACHE_VERSION) {
+        return false;
+    }
+    qint32 count = 0;
+    in >> cache->fingerprint >> count;
+    for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString family;
+        qint32 height = 0;
+        in >> family >> height;
+        cache->families.append(family);
+        cache->heights.insert(family, height);
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+static void writeCache(const FontFamilies &cache)
+{
+    const QString path = cacheFilePath();
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return;
+    }
+    QDataStream out(&file);
+    out << CACHE_MAGIC << CACHE_VERSION << cache.fingerprint << qint32(cache.families.count());
+    foreach (const QString &family, cache.families) {
+        out << family << qint32(cache.heights.value(family));
+    }
+}
+
+/*
+    Lists all families with their preview heights and rewrites the cache
+    file.
+*/
+static void listFamilies(FontFamilies *result)
+{
+    TRACE_SCOPE("FontCache: enumerate families");
+    QFontDatabase database;
+    foreach (const QString &family, database.families()) {
+        QFont font(family);
+        font.setPointSize(FontCache::PREVIEW_POINT_SIZE);
+        result->families.append(family);
+        result->heights.insert(family, QFontMetrics(font).height());
+    }
+    writeCache(*result);
+}
+
+/*
+    Runs on a worker thread. Returns an empty result when the fingerprint
+    still matches \a knownFingerprint, otherwise enumerates all families.
+    Qt 4 does not support the font database outside the GUI thread, so
+    there only the fingerprint is taken here.
+*/
+static FontFamilies enumerateFamilies(QByteArray knownFingerprint)
+{
+    TRACE_SCOPE("FontCache: check font set");
+    FontFamilies result;
+    result.fingerprint = fontSetFingerprint();
+#if QT_VERSION >= 0x050000
+    if (result.fingerprint != knownFingerprint) {
+        listFamilies(&result);
+    }
+#else
+    Q_UNUSED(knownFingerprint);
+#endif
+    return result;
+}
+
+class FontCache::Private : public QObject
+{
+    Q_OBJECT
+    Q_POINTER(FontCache)
+public:
+    Private(FontCache *q_ptr);
+    ~Private();
+
+    FontFamilies cache;
+    QFutureWatcher<FontFamilies> watcher;
+    bool upToDate;
+
+public slots:
+    void enumerationFinished();
+}; // end of class GOW::FontCache::Private
+
+FontCache::Private::Private(FontCache *q_ptr) :
+    QObject(q_ptr),
+    q(q_ptr),
+    upToDate(false)
+{
+    connect(&watcher, SIGNAL(finished()), this, SLOT(enumerationFinished()));
+}
+
+FontCache::Private::~Private()
+{
+    watcher.waitForFinished();
+}
+
+void FontCache::Private::enumerationFinished()
+{
+    FontFamilies result = watcher.result();
+    upToDate = true;
+    if (result.fingerprint == cache.fingerprint) {
+        return;
+    }
+#if QT_VERSION < 0x050000
+    listFamilies(&result);
+#endif
+    cache = result;
+    emit q->familiesChanged();
+}
+
+/*!
+  \class GOW::FontCache
+
+  Installed font families, shared by all font choosers.
+
+  Resolving families through the font database is slow on a cold start, so
+  the list is kept in a cache file. The file is read when the cache is
+  first used, which makes families() available right away. The installed
+  font set is then checked on a worker thread; if it has changed since the
+  file was written, all families are enumerated again, the file is
+  rewritten and familiesChanged() is emitted. With Qt 4, which cannot use
+  the font database on other threads, the families are enumerated from
+  the event loop once the check has found a change.
+ */
+
+GET_INSTANCE(FontCache)
+
+FontCache::FontCache() :
+    QObject(0),
+    d(this)
+{
+    TRACE_SCOPE("FontCache: read cache");
+    readCache(&d->cache);
+    refresh();
+}
+
+FontCache::~FontCache()
+{
+}
+
+/*!
+  Returns all known font families. The list is empty until the first
+  enumeration has finished if there is no cache file yet.
+ */
+QStringList FontCache::families() const
+{
+    return d->cache.families;
+}
+
+/*!
+  Returns the line height of \a family at PREVIEW_POINT_SIZE, or 0 if it is
+  not known.
+ */
+int FontCache::previewHeight(const QString &family) const
+{
+    return d->cache.heights.value(family);
+}
+
+/*!
+  Returns true if the installed font set has been checked against the
+  cache in this session.
+ */
+bool FontCache::isUpToDate() const
+{
+    return d->upToDate;
+}
+
+/*!
+  Checks the installed font set in the background. Does nothing if a check
+  is running already.
+ */
+void FontCache::refresh()
+{
+    if (d->watcher.isRunning()) {
+        return;
+    }
+    d->upToDate = false;
+    d->watcher.setFuture(QtConcurrent::run(enumerateFamilies, d->cache.fingerprint));
+}
+
+}
+
+#include "fontcache.moc"
@@ -0,0 +1,61 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef FONTCACHE_H
+#define FONTCACHE_H
+
+#include <QObject>
+#include <QStringList>
+
+#include <DPointer>
+#include <Global>
+
+namespace GOW
+{
+
+class FontCache : public QObject
+{
+    Q_OBJECT
+    DECLARE_SINGLETON(FontCache)
+public:
+    ~FontCache();
+
+    static const int PREVIEW_POINT_SIZE = 16;
+
+    QStringList families() const;
+    int previewHeight(const QString &family) const;
+    bool isUpToDate() const;
+
+public slots:
+    void refresh();
+
+signals:
+    void familiesChanged();
+
+private:
+    FontCache();
+
+    D_POINTER
+}; // end of class GOW::FontCache
+
+} // end of namespace GOW
+
+#endif // FONTCACHE_H
@@ -20,9 +20,13 @@
  *-------------------------------------------------*/
 
 #include <QAbstractItemView>
+#include <QHash>
 #include <QPainter>
 
+#include "fontcache.h"
 #include "fontchooser.h"
+#include "startuptracer.h"
+#include "glyphpreviewcache.h"
 
 namespace GOW
 {
@@ -33,8 +37,21 @@ class FontChooser::Private : public QObject
 public:
     Private(FontChooser *q_ptr): QObject(q_ptr), q(q_ptr) {}
 
-    QStringList fontFamilies;
+    QHash<QString, int> familyIndex;
 public slots:
+    void loadFamilies()
+    {
+        GlyphPreviewCache::instance()->clear();
+        const QString current = q->currentText();
+        q->clear();
+        familyIndex.clear();
+        foreach (const QString &family, FontCache::instance()->families()) {
+            familyIndex.insert(family, q->count());
+            q->addItem(family, family);
+        }
+        q->setCurrentIndex(familyIndex.value(current, -1));
+    }
+
     void itemActivated(int index)
     {
         emit q->fontFamilyActivated(QFontInfo(q->itemData(index).value<QFont>()).family());
@@ -55,8 +72,22 @@ protected:
                const QModelIndex &index) const;
     QSize sizeHint(const QStyleOptionViewItem &,
                    const QModelIndex &index) const;
+
+private:
+    int dpi() const;
+    int previewPixelSize() const;
 }; // end of class GOW::FontChooserItemDelegate
 
+int FontChooserItemDelegate::dpi() const
+{
+    return qobject_cast<QWidget *>(parent())->logicalDpiY();
+}
+
+int FontChooserItemDelegate::previewPixelSize() const
+{
+    return qRound(FontCache::PREVIEW_POINT_SIZE * dpi() / 72.0);
+}
+
 void FontChooserItemDelegate::paint(QPainter *painter,
                                     const QStyleOptionViewItem &option,
                                     const QModelIndex &index) const
@@ -64,27 +95,33 @@ void FontChooserItemDelegate::paint(QPainter *painter,
     QPalette palette = qobject_cast<QComboBox *>(this->parent())->palette();
     const QAbstractItemModel *model = index.model();
     QString displayText = model->data(index, Qt::DisplayRole).toString();
-    painter->save();
+    QColor color = palette.text().color();
     if (option.state.testFlag(QStyle::State_MouseOver)) {
         painter->fillRect(option.rect, palette.highlight());
-        painter->setPen(palette.highlightedText().color());
+        color = palette.highlightedText().color();
     }
-    QFont font = index.model()->data(index, Qt::UserRole).value<QFont>();
-    font.setPointSize(16);
-    painter->setFont(font);
-    painter->drawText(option.rect.adjusted(3, 0, 0, 0), Qt::AlignVCenter, displayText);
-    painter->restore();
+    const QString family = model->data(index, Qt::UserRole).toString();
+    const QPixmap pixmap = GlyphPreviewCache::instance()->pixmap(
+                family, previewPixelSize(), GlyphPreviewCache::devicePixelRatio(painter->device()),
+                displayText, color);
+    const QSize size = GlyphPreviewCache::instance()->textSize(family, previewPixelSize(), displayText);
+    painter->drawPixmap(option.rect.x() + 3,
+                        option.rect.y() + (option.rect.height() - size.height()) / 2,
+                        pixmap);
 }
 
 QSize FontChooserItemDelegate::sizeHint(const QStyleOptionViewItem &,
                                         const QModelIndex &index) const
 {
-    QSize size;
-    QFont font = index.model()->data(index, Qt::UserRole).value<QFont>();
-    QFontMetrics m(font);
-    size.setWidth(m.width(index.model()->data(index).toString()));
-    size.setHeight(m.height() + 6);
-    return size;
+    const QString family = index.model()->data(index, Qt::UserRole).toString();
+    // The popup has a fixed width; known heights avoid a font match for every row.
+    const int height = FontCache::instance()->previewHeight(family);
+    if (height > 0) {
+        return QSize(qobject_cast<QComboBox *>(parent())->view()->width(), height + 6);
+    }
+    const QSize size = GlyphPreviewCache::instance()->textSize(
+                family, previewPixelSize(), index.model()->data(index).toString());
+    return QSize(size.width(), size.height() + 6);
 }
 
 
@@ -92,22 +129,11 @@ FontChooser::FontChooser(QWidget *parent) :
     QComboBox(parent),
     d(this)
 {
-    d->fontFamilies.append(QFontInfo(QFont(QLatin1String("SimSun"))).family());
-    d->fontFamilies.append(QFontInfo(QFont(QLatin1String("NSimSun"))).family());
-    d->fontFamilies.append(QFontInfo(QFont(QLatin1String("FangSong_GB2312"))).family());
-    d->fontFamilies.append(QFontInfo(QFont(QLatin1String("KaiTi_GB2312"))).family());
-    d->fontFamilies.append(QFontInfo(QFont(QLatin1String("SimHei"))).family());
-    d->fontFamilies.append(QFontInfo(QFont(QLatin1String("Microsoft YaHei"))).family());
-    d->fontFamilies.append(QFontInfo(QFont(QLatin1String("Arial"))).family());
-    d->fontFamilies.append(QFontInfo(QFont(QLatin1String("Arial Black"))).family());
-    d->fontFamilies.append(QFontInfo(QFont(QLatin1String("Times New Roman"))).family());
-    d->fontFamilies.append(QFontInfo(QFont(QLatin1String("Courier New"))).family());
-    d->fontFamilies.append(QFontInfo(QFont(QLatin1String("Tahoma"))).family());
-    d->fontFamilies.append(QFontInfo(QFont(QLatin1String("Verdana"))).family());
-
-    foreach (QString family, d->fontFamilies) {
-        addItem(family, family);
-    }
+    TRACE_SCOPE("FontChooser");
+    // Families come from the shared cache, which fills in the background.
+    d->loadFamilies();
+    connect(FontCache::instance(), SIGNAL(familiesChanged()),
+            d.get(), SLOT(loadFamilies()));
 
     setItemDelegate(new FontChooserItemDelegate(this));
 
@@ -119,6 +145,15 @@ FontChooser::~FontChooser()
 {
 }
 
+/*!
+  Returns index of the item for \a family, or -1 if there is none.
+  Unlike findData(), this is a hash lookup.
+ */
+int FontChooser::indexOfFamily(const QString &family) const
+{
+    return d->familyIndex.value(family, -1);
+}
+
 void FontChooser::showPopup()
 {
     view()->setFixedWidth(200);
@@ -26,17 +26,20 @@
 #include <QStyledItemDelegate>
 
 #include <DPointer>
+#include <Global>
 
 namespace GOW
 {
 
-class FontChooser : public QComboBox
+class LIBRARY_EXPORT FontChooser : public QComboBox
 {
     Q_OBJECT
 public:
     explicit FontChooser(QWidget *parent = 0);
     ~FontChooser();
 
+    int indexOfFamily(const QString &family) const;
+
 signals:
     void fontFamilyActivated(const QString &family);
 
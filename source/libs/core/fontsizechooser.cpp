@@ -20,9 +20,11 @@
  *-------------------------------------------------*/
 
 #include <QAbstractItemView>
+#include <QHash>
 #include <QPainter>
 
 #include "fontsizechooser.h"
+#include "glyphpreviewcache.h"
 
 namespace GOW
 {
@@ -32,6 +34,8 @@ class FontSizeChooser::Private : public QObject
     Q_OBJECT
 public:
     Private(FontSizeChooser *q_ptr) : QObject(q_ptr), q(q_ptr) {}
+
+    QHash<int, int> sizeIndex;
 public slots:
     void itemActivated(int index)
     {
@@ -62,30 +66,27 @@ void FontSizeChooserItemDelegate::paint(QPainter *painter,
     QPalette palette = qobject_cast<QComboBox *>(this->parent())->palette();
     const QAbstractItemModel *model = index.model();
     QString displayText = model->data(index, Qt::DisplayRole).toString();
-    painter->save();
+    QColor color = palette.text().color();
     if (option.state.testFlag(QStyle::State_MouseOver)) {
         painter->fillRect(option.rect, palette.highlight());
-        painter->setPen(palette.highlightedText().color());
+        color = palette.highlightedText().color();
     }
     int px = index.model()->data(index, Qt::UserRole).value<int>();
-    QFont font;
-    font.setPixelSize(px);
-    painter->setFont(font);
-    painter->drawText(option.rect.adjusted(3, 0, 0, 0), Qt::AlignVCenter, displayText);
-    painter->restore();
+    const QPixmap pixmap = GlyphPreviewCache::instance()->pixmap(
+                QString(), px, GlyphPreviewCache::devicePixelRatio(painter->device()), displayText, color);
+    const QSize size = GlyphPreviewCache::instance()->textSize(QString(), px, displayText);
+    painter->drawPixmap(option.rect.x() + 3,
+                        option.rect.y() + (option.rect.height() - size.height()) / 2,
+                        pixmap);
 }
 
 QSize FontSizeChooserItemDelegate::sizeHint(const QStyleOptionViewItem &,
                                             const QModelIndex &index) const
 {
-    QSize size;
     int px = index.model()->data(index, Qt::UserRole).value<int>();
-    QFont font;
-    font.setPixelSize(px);
-    QFontMetrics m(font);
-    size.setWidth(m.width(index.model()->data(index).toString()));
-    size.setHeight(m.height() + 10);
-    return size;
+    const QSize size = GlyphPreviewCache::instance()->textSize(
+                QString(), px, index.model()->data(index).toString());
+    return QSize(size.width(), size.height() + 10);
 }
 
 
@@ -117,6 +118,10 @@ FontSizeChooser::FontSizeChooser(QWidget *parent) :
     addItem(tr("xx-large"), 54);
     setCurrentIndex(3);
 
+    for (int i = 0; i < count(); ++i) {
+        d->sizeIndex.insert(itemData(i).toInt(), i);
+    }
+
     setItemDelegate(new FontSizeChooserItemDelegate(this));
     connect(this, SIGNAL(activated(int)),
             d.get(), SLOT(itemActivated(int)));
@@ -126,6 +131,15 @@ FontSizeChooser::~FontSizeChooser()
 {
 }
 
+/*!
+  Returns index of the item for \a size in pixel, or -1 if there is none.
+  Unlike findData(), this is a hash lookup.
+ */
+int FontSizeChooser::indexOfSize(int size) const
+{
+    return d->sizeIndex.value(size, -1);
+}
+
 void FontSizeChooser::showPopup()
 {
     view()->setFixedWidth(220);
@@ -37,6 +37,8 @@ public:
     explicit FontSizeChooser(QWidget *parent = 0);
     ~FontSizeChooser();
 
+    int indexOfSize(int size) const;
+
 signals:
     void fontSizeActivated(int size);
     
@@ -0,0 +1,184 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QCache>
+#include <QFontMetrics>
+#include <QHash>
+#include <QMutex>
+#include <qmath.h>
+#include <QPainter>
+
+#include "glyphpreviewcache.h"
+
+namespace GOW
+{
+
+// About a hundred popup rows of pre-rendered text.
+static const int DEFAULT_MAX_COST = 4096;
+
+static QString previewKey(const QString &family, int pixelSize, const QString &text)
+{
+    return family + QLatin1Char('\x1f') + QString::number(pixelSize)
+            + QLatin1Char('\x1f') + text;
+}
+
+static QFont previewFont(const QString &family, int pixelSize)
+{
+    QFont font;
+    if (!family.isEmpty()) {
+        font.setFamily(family);
+    }
+    font.setPixelSize(pixelSize);
+    return font;
+}
+
+class GlyphPreviewCache::Private
+{
+public:
+    Private(GlyphPreviewCache *q_ptr) : q(q_ptr) {}
+
+    QHash<QString, QSize> sizes;
+    QCache<QString, QPixmap> pixmaps;
+private:
+    Q_POINTER(GlyphPreviewCache)
+}; // end of class GOW::GlyphPreviewCache::Private
+
+/*!
+  \class GOW::GlyphPreviewCache
+
+  Pre-rendered sample text for the font and font size choosers.
+
+  Drawing a row of a chooser popup means matching a font and shaping its
+  sample text. With hundreds of families this makes opening the popup lag,
+  so both the size of a sample and the rendered sample are cached, keyed
+  by font family and pixel size; rendered samples also by the device pixel
+  ratio they are drawn for, so they stay sharp on high DPI screens. Entries are only created when a row
+  is asked for, which is the case for visible rows only. Sizes are small
+  and kept for the whole session; pixmaps are kept up to maxCost()
+  kilobytes and the least recently used ones are dropped first.
+ */
+
+GET_INSTANCE(GlyphPreviewCache)
+
+GlyphPreviewCache::GlyphPreviewCache() :
+    d(this)
+{
+    d->pixmaps.setMaxCost(DEFAULT_MAX_COST);
+}
+
+GlyphPreviewCache::~GlyphPreviewCache()
+{
+}
+
+/*!
+  Returns the size of \a text drawn with \a family at \a pixelSize, in
+  device independent pixels. An empty \a family means the default font.
+ */
+QSize GlyphPreviewCache::textSize(const QString &family, int pixelSize, const QString &text)
+{
+    const QString key = previewKey(family, pixelSize, text);
+    QHash<QString, QSize>::const_iterator it = d->sizes.constFind(key);
+    if (it != d->sizes.constEnd()) {
+        return it.value();
+    }
+    QFontMetrics metrics(previewFont(family, pixelSize));
+    const QSize size(metrics.width(text), metrics.height());
+    d->sizes.insert(key, size);
+    return size;
+}
+
+/*!
+  Returns \a text drawn with \a family at \a pixelSize in \a color on a
+  transparent background, for a device with \a devicePixelRatio. The
+  pixmap has the size given by textSize() in device independent pixels.
+ */
+QPixmap GlyphPreviewCache::pixmap(const QString &family, int pixelSize, qreal devicePixelRatio,
+                                  const QString &text, const QColor &color)
+{
+#if QT_VERSION < 0x050000
+    devicePixelRatio = 1;
+#endif
+    const QString key = previewKey(family, pixelSize, text)
+            + QLatin1Char('\x1f') + QString::number(devicePixelRatio)
+            + QLatin1Char('\x1f') + QString::number(color.rgba(), 16);
+    if (QPixmap *cached = d->pixmaps.object(key)) {
+        return *cached;
+    }
+    const QSize size = textSize(family, pixelSize, text).expandedTo(QSize(1, 1));
+    QPixmap *pixmap = new QPixmap(qCeil(size.width() * devicePixelRatio),
+                                  qCeil(size.height() * devicePixelRatio));
+#if QT_VERSION >= 0x050000
+    pixmap->setDevicePixelRatio(devicePixelRatio);
+#endif
+    pixmap->fill(Qt::transparent);
+    QPainter painter(pixmap);
+    painter.setFont(previewFont(family, pixelSize));
+    painter.setPen(color);
+    painter.drawText(QRect(QPoint(0, 0), size), Qt::AlignLeft | Qt::AlignVCenter, text);
+    painter.end();
+    const QPixmap result = *pixmap;
+    d->pixmaps.insert(key, pixmap, qMax(1, pixmap->width() * pixmap->height() * 4 / 1024));
+    return result;
+}
+
+/*!
+  Returns the ratio between physical and device independent pixels of
+  \a device, which is always 1 with Qt 4.
+ */
+qreal GlyphPreviewCache::devicePixelRatio(const QPaintDevice *device)
+{
+#if QT_VERSION >= 0x050600
+    return device->devicePixelRatioF();
+#elif QT_VERSION >= 0x050000
+    return device->devicePixelRatio();
+#else
+    Q_UNUSED(device);
+    return 1;
+#endif
+}
+
+/*!
+  Sets the memory budget for rendered pixmaps to \a kbytes kilobytes.
+ */
+void GlyphPreviewCache::setMaxCost(int kbytes)
+{
+    d->pixmaps.setMaxCost(kbytes);
+}
+
+/*!
+  Returns the memory budget for rendered pixmaps in kilobytes.
+ */
+int GlyphPreviewCache::maxCost() const
+{
+    return d->pixmaps.maxCost();
+}
+
+/*!
+  Drops all cached sizes and pixmaps, e.g. after the installed fonts have
+  changed.
+ */
+void GlyphPreviewCache::clear()
+{
+    d->sizes.clear();
+    d->pixmaps.clear();
+}
+
+}
@@ -0,0 +1,63 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef GLYPHPREVIEWCACHE_H
+#define GLYPHPREVIEWCACHE_H
+
+#include <QColor>
+#include <QPixmap>
+#include <QSize>
+#include <QString>
+
+#include <DPointer>
+#include <Global>
+
+QT_FORWARD_DECLARE_CLASS(QPaintDevice)
+
+namespace GOW
+{
+
+class GlyphPreviewCache
+{
+    DECLARE_SINGLETON(GlyphPreviewCache)
+public:
+    ~GlyphPreviewCache();
+
+    QSize textSize(const QString &family, int pixelSize, const QString &text);
+    QPixmap pixmap(const QString &family, int pixelSize, qreal devicePixelRatio,
+                   const QString &text, const QColor &color);
+
+    static qreal devicePixelRatio(const QPaintDevice *device);
+
+    void setMaxCost(int kbytes);
+    int maxCost() const;
+
+    void clear();
+
+private:
+    GlyphPreviewCache();
+
+    D_POINTER
+}; // end of class GOW::GlyphPreviewCache
+
+} // end of namespace GOW
+
+#endif // GLYPHPREVIEWCACHE_H
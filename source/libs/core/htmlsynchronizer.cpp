@@ -0,0 +1,507 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextDocumentFragment>
+#include <QTextList>
+#include <QVector>
+
+#include <HtmlWriter>
+
+#include "htmlsynchronizer.h"
+
+namespace GOW
+{
+
+/*
+    HTML of one block of the visual document, and how many characters
+    of the source document it occupies at present.
+*/
+struct HtmlSegment
+{
+    HtmlSegment() : sourceLength(0), dirty(true), pending(true), stale(false) {}
+
+    QString html;
+    int sourceLength;
+    bool dirty;     // html is out of date with the visual block
+    bool pending;   // source document is out of date with html
+    bool stale;     // visual block is out of date with the edited source
+};
+
+static void uniteRange(int &from, int &to, int first, int last)
+{
+    if (from < 0) {
+        from = first;
+        to = last;
+    } else {
+        from = qMin(from, first);
+        to = qMax(to, last);
+    }
+}
+
+static void shiftRange(int &from, int &to, int start, int removed, int added)
+{
+    if (from < 0) {
+        return;
+    }
+    const int delta = added - removed;
+    if (from >= start + removed) {
+        from += delta;
+    } else if (from > start) {
+        from = start;
+    }
+    if (to >= start + removed) {
+        to += delta;
+    } else if (to >= start) {
+        to = start + added - 1;
+    }
+}
+
+class HtmlSynchronizer::Private : public QObject
+{
+    Q_OBJECT
+    Q_POINTER(HtmlSynchronizer)
+public:
+    Private(HtmlSynchronizer *q_ptr, QTextDocument *visualDocument);
+
+    void markDirty(int from, int to);
+    void refresh();
+    int segmentAt(int position) const;
+    void reconcile(int first, int last);
+    void removeBlocks(const QTextBlock &first, const QTextBlock &last);
+
+    QTextDocument *visual;
+    QTextDocument *source;
+    QVector<HtmlSegment> segments;
+    int dirtyFrom;
+    int dirtyTo;
+    int pendingFrom;
+    int pendingTo;
+    int staleFrom;
+    int staleTo;
+    bool syncing;
+
+public slots:
+    void visualContentsChange(int position, int charsRemoved, int charsAdded);
+    void sourceContentsChange(int position, int charsRemoved, int charsAdded);
+}; // end of class GOW::HtmlSynchronizer::Private
+
+HtmlSynchronizer::Private::Private(HtmlSynchronizer *q_ptr, QTextDocument *visualDocument) :
+    QObject(q_ptr),
+    q(q_ptr),
+    visual(visualDocument),
+    source(0),
+    segments(visualDocument->blockCount()),
+    dirtyFrom(0),
+    dirtyTo(visualDocument->blockCount() - 1),
+    pendingFrom(-1),
+    pendingTo(-1),
+    staleFrom(-1),
+    staleTo(-1),
+    syncing(false)
+{
+    connect(visual, SIGNAL(contentsChange(int,int,int)),
+            this, SLOT(visualContentsChange(int,int,int)));
+}
+
+void HtmlSynchronizer::Private::markDirty(int from, int to)
+{
+    from = qMax(from, 0);
+    to = qMin(to, segments.size() - 1);
+    if (from > to) {
+        return;
+    }
+    for (int i = from; i <= to; ++i) {
+        segments[i].dirty = true;
+    }
+    uniteRange(dirtyFrom, dirtyTo, from, to);
+}
+
+/*
+    Serializes every dirty block again. Only the blocks between the first
+    and the last dirty one are visited.
+*/
+void HtmlSynchronizer::Private::refresh()
+{
+    if (dirtyFrom < 0) {
+        return;
+    }
+    QTextBlock block = visual->findBlockByNumber(dirtyFrom);
+    for (int i = dirtyFrom; i <= dirtyTo && block.isValid(); ++i, block = block.next()) {
+        HtmlSegment &segment = segments[i];
+        if (segment.dirty) {
+            segment.html = HtmlWriter::blockHtml(block);
+            segment.html += QLatin1Char('\n');
+            segment.dirty = false;
+            segment.pending = true;
+        }
+    }
+    uniteRange(pendingFrom, pendingTo, dirtyFrom, dirtyTo);
+    dirtyFrom = dirtyTo = -1;
+}
+
+/*
+    Returns index of the segment which holds the source character at
+    position, or the last segment if position is at the end.
+*/
+int HtmlSynchronizer::Private::segmentAt(int position) const
+{
+    int offset = 0;
+    for (int i = 0; i < segments.size(); ++i) {
+        offset += segments.at(i).sourceLength;
+        if (position < offset) {
+            return i;
+        }
+    }
+    return segments.size() - 1;
+}
+
+/*
+    Parses the source of segments first to last again and replaces the
+    corresponding visual blocks with the result in one edit block.
+    Blocks outside of the range, and their layout, are left untouched.
+    Elements deleted from the source take their blocks with them.
+*/
+void HtmlSynchronizer::Private::reconcile(int first, int last)
+{
+    int offset = 0;
+    for (int i = 0; i < first; ++i) {
+        offset += segments.at(i).sourceLength;
+    }
+    int length = 0;
+    for (int i = first; i <= last; ++i) {
+        length += segments.at(i).sourceLength;
+    }
+
+    QTextCursor sourceCursor(source);
+    sourceCursor.setPosition(offset);
+    sourceCursor.setPosition(qMin(offset + length, source->characterCount() - 1), QTextCursor::KeepAnchor);
+    const QString text = sourceCursor.selection().toPlainText();
+
+    const QTextBlock firstBlock = visual->findBlockByNumber(first);
+    const QTextBlock lastBlock = visual->findBlockByNumber(last);
+    if (text.trimmed().isEmpty()) {
+        removeBlocks(firstBlock, lastBlock);
+        return;
+    }
+
+    QTextDocument parsed;
+    parsed.setHtml(text);
+    QTextCursor parsedCursor(&parsed);
+    parsedCursor.select(QTextCursor::Document);
+    const QTextDocumentFragment fragment = parsedCursor.selection();
+
+    const int start = firstBlock.position();
+    QTextCursor cursor(visual);
+    cursor.beginEditBlock();
+    cursor.setPosition(start);
+    cursor.setPosition(lastBlock.position() + lastBlock.length() - 1, QTextCursor::KeepAnchor);
+    cursor.insertFragment(fragment);
+    // The first parsed block is merged into an existing block,
+    // which would keep its old paragraph format otherwise.
+    if (!parsed.begin().textList()) {
+        cursor.setPosition(start);
+        cursor.setBlockFormat(parsed.begin().blockFormat());
+    }
+    cursor.endEditBlock();
+}
+
+/*
+    Removes the blocks first to last together with one block separator, so
+    no empty paragraph is left behind. Only the last block of a document
+    cannot go; it is emptied instead.
+*/
+void HtmlSynchronizer::Private::removeBlocks(const QTextBlock &first, const QTextBlock &last)
+{
+    QTextCursor cursor(visual);
+    cursor.beginEditBlock();
+    if (last.next().isValid()) {
+        cursor.setPosition(first.position());
+        cursor.setPosition(last.next().position(), QTextCursor::KeepAnchor);
+    } else if (first.previous().isValid()) {
+        cursor.setPosition(first.position() - 1);
+        cursor.setPosition(last.position() + last.length() - 1, QTextCursor::KeepAnchor);
+    } else {
+        cursor.select(QTextCursor::Document);
+    }
+    cursor.removeSelectedText();
+    if (visual->blockCount() == 1 && visual->isEmpty()) {
+        cursor.setBlockFormat(QTextBlockFormat());
+        cursor.setCharFormat(QTextCharFormat());
+    }
+    cursor.endEditBlock();
+}
+
+/*
+    Replaces the segments of the blocks touched by the change with new dirty
+    ones. The source text of the replaced segments is still in the source
+    document, so its length is carried by the first new segment and gets
+    overwritten on the next sync.
+*/
+void HtmlSynchronizer::Private::visualContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+
+    QTextBlock first = visual->findBlock(position);
+    if (!first.isValid()) {
+        first = visual->lastBlock();
+    }
+    QTextBlock last = visual->findBlock(position + charsAdded);
+    if (!last.isValid()) {
+        last = visual->lastBlock();
+    }
+
+    const int blockCount = visual->blockCount();
+    int start = qMin(first.blockNumber(), segments.size());
+    int added = qMax(last.blockNumber() - first.blockNumber() + 1, 1);
+    int removed = segments.size() - blockCount + added;
+    if (removed < 0 || start + removed > segments.size()) {
+        // Should not happen, but never lose track of the document.
+        start = 0;
+        removed = segments.size();
+        added = blockCount;
+    }
+
+    int staleLength = 0;
+    for (int i = start; i < start + removed; ++i) {
+        staleLength += segments.at(i).sourceLength;
+    }
+    segments.remove(start, removed);
+    segments.insert(start, added, HtmlSegment());
+    segments[start].sourceLength = staleLength;
+
+    shiftRange(dirtyFrom, dirtyTo, start, removed, added);
+    shiftRange(pendingFrom, pendingTo, start, removed, added);
+    shiftRange(staleFrom, staleTo, start, removed, added);
+    uniteRange(pendingFrom, pendingTo, start, start + added - 1);
+    // Neighbours may open or close the same list.
+    markDirty(start - 1, start + added);
+}
+
+/*
+    Folds the source edit into the segments it touches. All of them are
+    merged into the first one, which now holds the whole edited text, and
+    marked stale until the visual document is reconciled.
+*/
+void HtmlSynchronizer::Private::sourceContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    if (syncing || segments.isEmpty()) {
+        return;
+    }
+
+    const int first = segmentAt(position);
+    const int last = charsRemoved > 0 ? qMax(segmentAt(position + charsRemoved - 1), first) : first;
+    int length = charsAdded - charsRemoved;
+    for (int i = first; i <= last; ++i) {
+        length += segments.at(i).sourceLength;
+        segments[i].sourceLength = 0;
+        segments[i].stale = true;
+    }
+    segments[first].sourceLength = qMax(length, 0);
+    uniteRange(staleFrom, staleTo, first, last);
+}
+
+/*!
+  \class GOW::HtmlSynchronizer
+
+  Keeps the HTML source of a post in step with the visual document.
+
+  The synchronizer caches the HTML of every block of the visual document
+  and listens to QTextDocument::contentsChange(). Only the blocks touched by
+  an edit are marked dirty, so bringing the source up to date after a small
+  edit costs the same on a short post as on a long one. The source document
+  is spliced at the changed ranges rather than replaced.
+
+  The other way round works the same: each block maps to the range of source
+  text holding its top-level element. Editing the source only marks the
+  elements containing the edit stale, and syncVisual() parses just those
+  elements and splices them into the visual document, so the layout, undo
+  history and cursor of the rest of the document survive.
+ */
+
+/*!
+  Constructs a synchronizer for \a visualDocument with \a parent.
+ */
+HtmlSynchronizer::HtmlSynchronizer(QTextDocument *visualDocument, QObject *parent) :
+    QObject(parent),
+    d(this, visualDocument)
+{
+}
+
+/*!
+  Destructs the synchronizer.
+ */
+HtmlSynchronizer::~HtmlSynchronizer()
+{
+}
+
+/*!
+  Sets \a sourceDocument as the document holding the HTML source.
+  Its current content is replaced on the next syncSource().
+ */
+void HtmlSynchronizer::setSourceDocument(QTextDocument *sourceDocument)
+{
+    if (d->source) {
+        disconnect(d->source, 0, d.get(), 0);
+    }
+    d->source = sourceDocument;
+    for (int i = 0; i < d->segments.size(); ++i) {
+        d->segments[i].sourceLength = 0;
+        d->segments[i].pending = true;
+        d->segments[i].stale = false;
+    }
+    uniteRange(d->pendingFrom, d->pendingTo, 0, d->segments.size() - 1);
+    d->staleFrom = d->staleTo = -1;
+    if (d->source) {
+        d->syncing = true;
+        d->source->clear();
+        d->syncing = false;
+        connect(d->source, SIGNAL(contentsChange(int,int,int)),
+                d.get(), SLOT(sourceContentsChange(int,int,int)));
+    }
+}
+
+/*!
+  Returns the document holding the HTML source.
+ */
+QTextDocument *HtmlSynchronizer::sourceDocument() const
+{
+    return d->source;
+}
+
+/*!
+  Returns HTML of the whole visual document. Only dirty blocks are
+  serialized again.
+ */
+QString HtmlSynchronizer::html()
+{
+    d->refresh();
+    int length = 0;
+    for (int i = 0; i < d->segments.size(); ++i) {
+        length += d->segments.at(i).html.length();
+    }
+    QString result;
+    result.reserve(length);
+    for (int i = 0; i < d->segments.size(); ++i) {
+        result += d->segments.at(i).html;
+    }
+    return result;
+}
+
+/*!
+  Brings the source document up to date. Runs of changed blocks are
+  written as one splice each, wrapped in a single undo step.
+ */
+void HtmlSynchronizer::syncSource()
+{
+    d->refresh();
+    if (!d->source || d->pendingFrom < 0) {
+        return;
+    }
+
+    int offset = 0;
+    for (int i = 0; i < d->pendingFrom; ++i) {
+        offset += d->segments.at(i).sourceLength;
+    }
+
+    d->syncing = true;
+    QTextCursor cursor(d->source);
+    cursor.beginEditBlock();
+    int i = d->pendingFrom;
+    while (i <= d->pendingTo) {
+        if (!d->segments.at(i).pending) {
+            offset += d->segments.at(i).sourceLength;
+            ++i;
+            continue;
+        }
+        int staleLength = 0;
+        QString text;
+        for (; i <= d->pendingTo && d->segments.at(i).pending; ++i) {
+            HtmlSegment &segment = d->segments[i];
+            staleLength += segment.sourceLength;
+            text += segment.html;
+            segment.sourceLength = segment.html.length();
+            segment.pending = false;
+        }
+        cursor.setPosition(offset);
+        cursor.setPosition(offset + staleLength, QTextCursor::KeepAnchor);
+        if (text.isEmpty()) {
+            cursor.removeSelectedText();
+        } else {
+            cursor.insertText(text);
+        }
+        offset += text.length();
+    }
+    cursor.endEditBlock();
+    d->syncing = false;
+    d->pendingFrom = d->pendingTo = -1;
+}
+
+/*!
+  Brings the visual document up to date with edits made to the source.
+  Stale elements are parsed again from the last to the first one; a list
+  is always parsed as a whole since its items share the list tags.
+ */
+void HtmlSynchronizer::syncVisual()
+{
+    if (!d->source || d->staleFrom < 0) {
+        return;
+    }
+
+    const int from = d->staleFrom;
+    const int to = qMin(d->staleTo, d->segments.size() - 1);
+    d->staleFrom = d->staleTo = -1;
+
+    int last = to;
+    while (last >= from) {
+        if (!d->segments.at(last).stale) {
+            --last;
+            continue;
+        }
+        int first = last;
+        while (first > from && d->segments.at(first - 1).stale) {
+            --first;
+        }
+        QTextBlock block = d->visual->findBlockByNumber(first);
+        QTextList *list = block.textList();
+        while (list && first > 0 && block.previous().textList() == list) {
+            block = block.previous();
+            --first;
+        }
+        block = d->visual->findBlockByNumber(last);
+        list = block.textList();
+        while (list && last < d->segments.size() - 1 && block.next().textList() == list) {
+            block = block.next();
+            ++last;
+        }
+        for (int i = first; i <= last; ++i) {
+            d->segments[i].stale = false;
+        }
+        d->reconcile(first, last);
+        last = first - 1;
+    }
+}
+
+}
+
+#include "htmlsynchronizer.moc"
@@ -0,0 +1,58 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef HTMLSYNCHRONIZER_H
+#define HTMLSYNCHRONIZER_H
+
+#include <QObject>
+#include <QVector>
+
+#include <DPointer>
+#include <Global>
+
+QT_FORWARD_DECLARE_CLASS(QTextDocument)
+
+namespace GOW
+{
+
+class LIBRARY_EXPORT HtmlSynchronizer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit HtmlSynchronizer(QTextDocument *visualDocument, QObject *parent = 0);
+    ~HtmlSynchronizer();
+
+    void setSourceDocument(QTextDocument *sourceDocument);
+    QTextDocument *sourceDocument() const;
+
+    QString html();
+
+public slots:
+    void syncSource();
+    void syncVisual();
+
+private:
+    D_POINTER
+}; // end of class GOW::HtmlSynchronizer
+
+} // end of namespace GOW
+
+#endif // HTMLSYNCHRONIZER_H
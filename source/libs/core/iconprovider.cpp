@@ -0,0 +1,172 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QHash>
+#include <QIconEngine>
+#include <QImage>
+#include <QPainter>
+
+#include "iconprovider.h"
+#include "startuptracer.h"
+
+namespace GOW
+{
+
+static const int ATLAS_CELL = 32;
+static const int ATLAS_COLUMNS = 8;
+
+// Cell order of resources/icons.png, see resources/makeatlas.py.
+static const char * const ICON_ATLAS[] = {
+    "about", "align_center", "align_fill", "align_left", "align_right",
+    "app_exit", "bold", "copy", "cut", "doc_close", "doc_new", "doc_open",
+    "doc_save", "doc_save_as", "font", "help", "italic", "paste", "plugins",
+    "redo", "settings", "strike", "text_background_color", "text_color",
+    "underline", "undo"
+};
+
+#if QT_VERSION >= 0x050000
+typedef QIconEngine IconEngineBase;
+#else
+typedef QIconEngineV2 IconEngineBase;
+#endif
+
+/*
+    Defers theme lookup and image decoding until the icon is drawn for the
+    first time. Sizes are answered without resolving, as all our icons are
+    square and laying out a toolbar must not decode anything.
+*/
+class LazyIconEngine : public IconEngineBase
+{
+public:
+    LazyIconEngine(const QString &themeName, const QString &fallback) :
+        themeName(themeName),
+        fallback(fallback),
+        resolved(false)
+    {
+    }
+
+    void paint(QPainter *painter, const QRect &rect, QIcon::Mode mode, QIcon::State state)
+    {
+        resolve().paint(painter, rect, Qt::AlignCenter, mode, state);
+    }
+
+    QPixmap pixmap(const QSize &size, QIcon::Mode mode, QIcon::State state)
+    {
+        return resolve().pixmap(size, mode, state);
+    }
+
+    QSize actualSize(const QSize &size, QIcon::Mode mode, QIcon::State state)
+    {
+        if (resolved) {
+            return icon.actualSize(size, mode, state);
+        }
+        return size.boundedTo(QSize(ATLAS_CELL, ATLAS_CELL));
+    }
+
+    QString key() const
+    {
+        return QLatin1String("GOW::LazyIconEngine");
+    }
+
+    IconEngineBase *clone() const
+    {
+        LazyIconEngine *engine = new LazyIconEngine(themeName, fallback);
+        engine->icon = icon;
+        engine->resolved = resolved;
+        return engine;
+    }
+
+private:
+    const QIcon &resolve()
+    {
+        if (!resolved) {
+            TRACE_SCOPE("resolve icon");
+            if (!themeName.isEmpty() && QIcon::hasThemeIcon(themeName)) {
+                icon = QIcon::fromTheme(themeName);
+            } else {
+                icon = QIcon(IconProvider::atlasPixmap(fallback));
+            }
+            resolved = true;
+        }
+        return icon;
+    }
+
+    QString themeName;
+    QString fallback;
+    QIcon icon;
+    bool resolved;
+}; // end of class GOW::LazyIconEngine
+
+/*!
+  \class GOW::IconProvider
+
+  Icons for actions and buttons.
+
+  Resolving a theme icon and decoding its fallback is work the first frame
+  does not need for most actions, e.g. those only shown in menus. Icons
+  returned here are resolved when they are drawn for the first time. The
+  fallback icons are packed into a single atlas image, which is decoded
+  once when the first of them is needed.
+ */
+
+/*!
+  Returns an icon named \a themeName in the current icon theme, or the
+  atlas icon \a fallback if the theme does not have one.
+ */
+QIcon IconProvider::icon(const QString &themeName, const QString &fallback)
+{
+    return QIcon(new LazyIconEngine(themeName, fallback));
+}
+
+/*!
+  Returns the atlas icon \a fallback.
+ */
+QIcon IconProvider::icon(const QString &fallback)
+{
+    return QIcon(new LazyIconEngine(QString(), fallback));
+}
+
+/*!
+  Returns the atlas image \a name, or a null pixmap if there is none.
+ */
+QPixmap IconProvider::atlasPixmap(const QString &name)
+{
+    // A QImage, unlike a QPixmap, may outlive the application object.
+    static QImage atlas;
+    static QHash<QString, int> cells;
+    if (atlas.isNull()) {
+        TRACE_SCOPE("load icon atlas");
+        atlas.load(QLatin1String(":/image/icons"));
+        const int count = int(sizeof(ICON_ATLAS) / sizeof(ICON_ATLAS[0]));
+        for (int i = 0; i < count; ++i) {
+            cells.insert(QLatin1String(ICON_ATLAS[i]), i);
+        }
+    }
+    const int cell = cells.value(name, -1);
+    if (cell < 0) {
+        return QPixmap();
+    }
+    return QPixmap::fromImage(atlas.copy((cell % ATLAS_COLUMNS) * ATLAS_CELL,
+                                         (cell / ATLAS_COLUMNS) * ATLAS_CELL,
+                                         ATLAS_CELL, ATLAS_CELL));
+}
+
+}
@@ -0,0 +1,43 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef ICONPROVIDER_H
+#define ICONPROVIDER_H
+
+#include <QIcon>
+#include <QPixmap>
+#include <QString>
+
+namespace GOW
+{
+
+class IconProvider
+{
+public:
+    static QIcon icon(const QString &themeName, const QString &fallback);
+    static QIcon icon(const QString &fallback);
+
+    static QPixmap atlasPixmap(const QString &name);
+}; // end of class GOW::IconProvider
+
+} // end of namespace GOW
+
+#endif // ICONPROVIDER_H
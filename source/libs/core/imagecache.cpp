@@ -0,0 +1,252 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QBuffer>
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QImageReader>
+#include <QMutex>
+#include <QRunnable>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+#include <qmath.h>
+
+#include "imagecache.h"
+
+namespace GOW
+{
+
+// Enough for the visible images of a few windows on large screens.
+static const int DEFAULT_MAX_COST = 64 * 1024;
+// No image takes more than this part of the budget, so the visible ones
+// do not keep evicting each other.
+static const int MAX_SHARE = 4;
+
+static int pixmapCost(const QSize &size)
+{
+    return qMax(1, int(qint64(size.width()) * size.height() * 4 / 1024));
+}
+
+/*
+    The size a pixmap shown at size can be kept at within kbytes. Larger
+    ones are scaled down and drawn scaled up again.
+ */
+static QSize fittingSize(const QSize &size, int kbytes)
+{
+    const int budget = kbytes / MAX_SHARE;
+    const int cost = pixmapCost(size);
+    if (cost <= budget) {
+        return size;
+    }
+    const qreal factor = qSqrt(qreal(qMax(1, budget)) / cost);
+    return QSize(qMax(1, int(size.width() * factor)), qMax(1, int(size.height() * factor)));
+}
+
+static QString variantKey(const QString &key, const QSize &size)
+{
+    return key + QLatin1Char('\x1f') + QString::number(size.width())
+            + QLatin1Char('x') + QString::number(size.height());
+}
+
+/*
+    Decodes an image straight to the display size. Readers which support
+    it, like JPEG, then never build the full size image at all.
+ */
+class DecodeTask : public QRunnable
+{
+public:
+    DecodeTask(QObject *receiver, const QString &key, const QString &variant,
+               const QByteArray &data, const QSize &size, int maxCost) :
+        m_receiver(receiver), m_key(key), m_variant(variant), m_data(data),
+        m_size(fittingSize(size, maxCost)) {}
+
+    void run()
+    {
+        QBuffer buffer(&m_data);
+        buffer.open(QIODevice::ReadOnly);
+        QImageReader reader(&buffer);
+        const QSize size = reader.size();
+        if (size.isValid() && (size.width() > m_size.width() || size.height() > m_size.height())) {
+            reader.setScaledSize(m_size);
+        }
+        QImage image = reader.read();
+        if (!image.isNull() && image.size() != m_size) {
+            image = image.scaled(m_size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        }
+        QMetaObject::invokeMethod(m_receiver, "decoded", Qt::QueuedConnection,
+                                  Q_ARG(QString, m_key), Q_ARG(QString, m_variant),
+                                  Q_ARG(QImage, image));
+    }
+
+private:
+    QObject *m_receiver;
+    QString m_key;
+    QString m_variant;
+    QByteArray m_data;
+    QSize m_size;
+};
+
+class ImageCache::Private : public QObject
+{
+    Q_OBJECT
+    Q_POINTER(ImageCache)
+public:
+    Private(ImageCache *q_ptr);
+    ~Private();
+
+    QThreadPool pool;
+    QCache<QString, QPixmap> pixmaps;
+    QHash<QString, QString> latestVariants;
+    QSet<QString> pending;
+    // Variants which cannot be decoded or kept; they are not requested again.
+    QSet<QString> unusable;
+
+public slots:
+    void decoded(const QString &key, const QString &variant, const QImage &image);
+}; // end of class GOW::ImageCache::Private
+
+ImageCache::Private::Private(ImageCache *q_ptr) :
+    QObject(q_ptr),
+    q(q_ptr)
+{
+    // Leave a core to the GUI thread.
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+    pixmaps.setMaxCost(DEFAULT_MAX_COST);
+}
+
+ImageCache::Private::~Private()
+{
+    pool.waitForDone();
+}
+
+void ImageCache::Private::decoded(const QString &key, const QString &variant, const QImage &image)
+{
+    pending.remove(variant);
+    if (image.isNull()) {
+        unusable.insert(variant);
+        return;
+    }
+    // The budget may have shrunk since decoding started. QCache deletes
+    // what it does not take.
+    if (!pixmaps.insert(variant, new QPixmap(QPixmap::fromImage(image)), pixmapCost(image.size()))) {
+        unusable.insert(variant);
+        return;
+    }
+    latestVariants.insert(key, variant);
+    emit q->imageReady(key);
+}
+
+/*!
+  \class GOW::ImageCache
+
+  Display sized images for the visual editor.
+
+  Decoding a photo at full size on the GUI thread takes long and needs a
+  lot of memory, and the editor only shows it at the width of its
+  viewport anyway. Images are therefore decoded on a pool of worker
+  threads, directly to the size they are shown at, and kept up to
+  maxCost() kilobytes; the least recently used ones are dropped first.
+  An image which would take more than a quarter of that is decoded
+  smaller, to be drawn scaled up. pixmap() never blocks: until the
+  variant is ready it returns an earlier variant of the same image or a
+  null pixmap, and imageReady() is emitted once it is. A variant which
+  cannot be decoded or kept is not tried again until the budget
+  changes. The encoded data is never replaced, so the full
+  resolution image is still there for publishing.
+ */
+
+GET_INSTANCE(ImageCache)
+
+ImageCache::ImageCache() :
+    QObject(0),
+    d(this)
+{
+}
+
+ImageCache::~ImageCache()
+{
+}
+
+/*!
+  Returns the size of the encoded image \a data. Only the image header
+  is read.
+ */
+QSize ImageCache::imageSize(const QByteArray &data)
+{
+    QByteArray bytes = data;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::ReadOnly);
+    return QImageReader(&buffer).size();
+}
+
+/*!
+  Returns the image \a data identified by \a key at \a size. If it has
+  not been decoded at that size yet, this starts decoding it and returns
+  a variant of another size, or a null pixmap if there is none.
+ */
+QPixmap ImageCache::pixmap(const QString &key, const QByteArray &data, const QSize &size)
+{
+    const QString variant = variantKey(key, size);
+    if (QPixmap *cached = d->pixmaps.object(variant)) {
+        return *cached;
+    }
+    if (!d->pending.contains(variant) && !d->unusable.contains(variant) && !size.isEmpty()) {
+        d->pending.insert(variant);
+        d->pool.start(new DecodeTask(d.get(), key, variant, data, size, d->pixmaps.maxCost()));
+    }
+    if (QPixmap *other = d->pixmaps.object(d->latestVariants.value(key))) {
+        return *other;
+    }
+    return QPixmap();
+}
+
+/*!
+  Sets the memory budget for decoded images to \a kbytes kilobytes.
+ */
+void ImageCache::setMaxCost(int kbytes)
+{
+    d->pixmaps.setMaxCost(kbytes);
+    d->unusable.clear();
+}
+
+/*!
+  Returns the memory budget for decoded images in kilobytes.
+ */
+int ImageCache::maxCost() const
+{
+    return d->pixmaps.maxCost();
+}
+
+/*!
+  Drops all decoded images.
+ */
+void ImageCache::clear()
+{
+    d->pixmaps.clear();
+    d->latestVariants.clear();
+    d->unusable.clear();
+}
+
+}
+
+#include "imagecache.moc"
@@ -0,0 +1,62 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include <QObject>
+#include <QPixmap>
+#include <QSize>
+
+#include <DPointer>
+#include <Global>
+
+namespace GOW
+{
+
+class LIBRARY_EXPORT ImageCache : public QObject
+{
+    Q_OBJECT
+    DECLARE_SINGLETON(ImageCache)
+public:
+    ~ImageCache();
+
+    static QSize imageSize(const QByteArray &data);
+
+    QPixmap pixmap(const QString &key, const QByteArray &data, const QSize &size);
+
+    void setMaxCost(int kbytes);
+    int maxCost() const;
+
+    void clear();
+
+signals:
+    void imageReady(const QString &key);
+
+private:
+    ImageCache();
+
+    D_POINTER
+}; // end of class GOW::ImageCache
+
+} // end of namespace GOW
+
+#endif // IMAGECACHE_H
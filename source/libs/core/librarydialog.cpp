@@ -0,0 +1,131 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QDialogButtonBox>
+#include <QListView>
+#include <QPushButton>
+#include <QVBoxLayout>
+
+#include "librarydialog.h"
+#include "librarymodel.h"
+
+namespace GOW
+{
+
+class LibraryDialog::Private : public QObject
+{
+    Q_OBJECT
+    Q_POINTER(LibraryDialog)
+public:
+    Private(LibraryDialog *q_ptr, DraftLibrary *library);
+
+    LibraryModel *model;
+    QListView *draftList;
+    QPushButton *openButton;
+    bool fileRequested;
+
+public slots:
+    void requestFile();
+    void selectionChanged();
+}; // end of class GOW::LibraryDialog::Private
+
+LibraryDialog::Private::Private(LibraryDialog *q_ptr, DraftLibrary *library) :
+    QObject(q_ptr),
+    q(q_ptr),
+    fileRequested(false)
+{
+    model = new LibraryModel(library, this);
+    draftList = new QListView(q);
+    draftList->setModel(model);
+    draftList->setUniformItemSizes(true);
+    draftList->setIconSize(QSize(48, 48));
+    draftList->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Open | QDialogButtonBox::Cancel,
+                                                     Qt::Horizontal, q);
+    openButton = buttons->button(QDialogButtonBox::Open);
+    openButton->setEnabled(false);
+    QPushButton *fileButton = buttons->addButton(tr("Open &File..."), QDialogButtonBox::ActionRole);
+
+    QVBoxLayout *layout = new QVBoxLayout(q);
+    layout->addWidget(draftList);
+    layout->addWidget(buttons);
+
+    connect(buttons, SIGNAL(accepted()), q, SLOT(accept()));
+    connect(buttons, SIGNAL(rejected()), q, SLOT(reject()));
+    connect(fileButton, SIGNAL(clicked()), this, SLOT(requestFile()));
+    connect(draftList->selectionModel(), SIGNAL(currentChanged(QModelIndex,QModelIndex)),
+            this, SLOT(selectionChanged()));
+    connect(draftList, SIGNAL(activated(QModelIndex)), q, SLOT(accept()));
+}
+
+void LibraryDialog::Private::requestFile()
+{
+    fileRequested = true;
+    q->accept();
+}
+
+void LibraryDialog::Private::selectionChanged()
+{
+    openButton->setEnabled(draftList->currentIndex().isValid());
+}
+
+/*!
+  \class GOW::LibraryDialog
+
+  Lets the user pick a draft of the draft library, latest first, or ask
+  for a draft file outside of the library instead.
+ */
+
+/*!
+  Constructs a dialog listing the drafts of \a library with \a parent.
+ */
+LibraryDialog::LibraryDialog(DraftLibrary *library, QWidget *parent) :
+    QDialog(parent),
+    d(this, library)
+{
+    setWindowTitle(tr("Open Post"));
+    resize(560, 400);
+}
+
+LibraryDialog::~LibraryDialog()
+{
+}
+
+/*!
+  Returns the id of the selected draft, or 0 if none is selected.
+ */
+quint32 LibraryDialog::selectedDraft() const
+{
+    return d->fileRequested ? 0 : d->model->draftId(d->draftList->currentIndex());
+}
+
+/*!
+  Returns true if the dialog was left to open a draft file instead.
+ */
+bool LibraryDialog::isFileRequested() const
+{
+    return d->fileRequested;
+}
+
+}
+
+#include "librarydialog.moc"
@@ -0,0 +1,50 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef LIBRARYDIALOG_H
+#define LIBRARYDIALOG_H
+
+#include <QDialog>
+
+#include <DPointer>
+
+namespace GOW
+{
+
+class DraftLibrary;
+
+class LibraryDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit LibraryDialog(DraftLibrary *library, QWidget *parent = 0);
+    ~LibraryDialog();
+
+    quint32 selectedDraft() const;
+    bool isFileRequested() const;
+
+private:
+    D_POINTER
+}; // end of class GOW::LibraryDialog
+
+} // end of namespace GOW
+
+#endif // LIBRARYDIALOG_H
@@ -0,0 +1,142 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QComboBox>
+#include <QLineEdit>
+#include <QListView>
+#include <QTimer>
+#include <QVBoxLayout>
+
+#include "librarydock.h"
+#include "librarymodel.h"
+
+namespace GOW
+{
+
+static const int FILTER_DELAY = 200;
+
+class LibraryDock::Private : public QObject
+{
+    Q_OBJECT
+    Q_POINTER(LibraryDock)
+public:
+    Private(LibraryDock *q_ptr, DraftLibrary *library);
+
+    LibraryModel *model;
+    QLineEdit *filterEditor;
+    QComboBox *orderChooser;
+    QListView *draftList;
+    QTimer filterTimer;
+
+public slots:
+    void applyFilter();
+    void orderActivated(int index);
+    void itemActivated(const QModelIndex &index);
+}; // end of class GOW::LibraryDock::Private
+
+LibraryDock::Private::Private(LibraryDock *q_ptr, DraftLibrary *library) :
+    QObject(q_ptr),
+    q(q_ptr)
+{
+    QWidget *contents = new QWidget(q);
+    model = new LibraryModel(library, this);
+
+    filterEditor = new QLineEdit(contents);
+    filterEditor->setPlaceholderText(tr("Search, #tag"));
+    orderChooser = new QComboBox(contents);
+    orderChooser->addItem(tr("Latest First"), int(DraftLibrary::ByModified));
+    orderChooser->addItem(tr("By Title"), int(DraftLibrary::ByTitle));
+
+    draftList = new QListView(contents);
+    draftList->setModel(model);
+    // All rows are as high as the first, so the view never measures the others.
+    draftList->setUniformItemSizes(true);
+    draftList->setIconSize(QSize(48, 48));
+    draftList->setTextElideMode(Qt::ElideRight);
+    draftList->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+    QVBoxLayout *layout = new QVBoxLayout(contents);
+    layout->setContentsMargins(4, 4, 4, 4);
+    layout->addWidget(filterEditor);
+    layout->addWidget(orderChooser);
+    layout->addWidget(draftList);
+    q->setWidget(contents);
+
+    filterTimer.setSingleShot(true);
+    filterTimer.setInterval(FILTER_DELAY);
+    connect(&filterTimer, SIGNAL(timeout()), this, SLOT(applyFilter()));
+    connect(filterEditor, SIGNAL(textChanged(QString)), &filterTimer, SLOT(start()));
+    connect(orderChooser, SIGNAL(activated(int)), this, SLOT(orderActivated(int)));
+    connect(draftList, SIGNAL(activated(QModelIndex)), this, SLOT(itemActivated(QModelIndex)));
+}
+
+void LibraryDock::Private::applyFilter()
+{
+    model->setFilter(filterEditor->text());
+}
+
+void LibraryDock::Private::orderActivated(int index)
+{
+    model->setSortOrder(DraftLibrary::SortOrder(orderChooser->itemData(index).toInt()));
+}
+
+void LibraryDock::Private::itemActivated(const QModelIndex &index)
+{
+    const quint32 id = model->draftId(index);
+    if (id != 0) {
+        emit q->draftActivated(id);
+    }
+}
+
+/*!
+  \class GOW::LibraryDock
+
+  Browses the drafts of the draft library next to the editor.
+
+  The list is backed by a LibraryModel, so it only holds the rows that
+  have been scrolled to and the excerpts of those recently shown.
+ */
+
+/*!
+  Constructs a dock for the drafts of \a library with \a parent.
+ */
+LibraryDock::LibraryDock(DraftLibrary *library, QWidget *parent) :
+    QDockWidget(tr("Library"), parent),
+    d(this, library)
+{
+    setObjectName(QLatin1String("LibraryDock"));
+}
+
+LibraryDock::~LibraryDock()
+{
+}
+
+/*!
+  Returns the model of the shown drafts.
+ */
+LibraryModel *LibraryDock::model() const
+{
+    return d->model;
+}
+
+}
+
+#include "librarydock.moc"
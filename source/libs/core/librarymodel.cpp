@@ -0,0 +1,512 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QBuffer>
+#include <QCache>
+#include <QFutureWatcher>
+#include <QImage>
+#include <QImageReader>
+#include <QSet>
+#include <QStringList>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTimer>
+#include <QUrl>
+#include <QtConcurrentRun>
+
+#include <DraftFormat>
+#include <SearchIndex>
+
+#include "librarymodel.h"
+
+namespace GOW
+{
+
+static const int FETCH_SIZE = 200;
+static const int PREVIEW_CACHE_SIZE = 500;
+static const int PREVIEW_QUEUE_LIMIT = 64;
+static const int PREVIEW_BATCH_SIZE = 16;
+static const int EXCERPT_LENGTH = 160;
+static const int THUMBNAIL_SIZE = 48;
+
+struct PreviewRequest
+{
+    PreviewRequest() : id(0), row(-1) {}
+    PreviewRequest(quint32 id, int row) : id(id), row(row) {}
+
+    quint32 id;
+    int row;
+};
+
+struct PreviewResult
+{
+    PreviewResult() : id(0), row(-1) {}
+
+    quint32 id;
+    int row;
+    QString excerpt;
+    QImage thumbnail;
+};
+
+struct Preview
+{
+    QString excerpt;
+    QImage thumbnail;
+};
+
+/*
+    Decodes the first image of the document, at thumbnail size only.
+ */
+static QImage firstImage(const QTextDocument &document)
+{
+    for (QTextBlock block = document.begin(); block.isValid(); block = block.next()) {
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextCharFormat format = it.fragment().charFormat();
+            if (!format.isImageFormat()) {
+                continue;
+            }
+            const QUrl name(format.toImageFormat().name());
+            QByteArray data = document.resource(QTextDocument::ImageResource, name).toByteArray();
+            QBuffer buffer(&data);
+            QImageReader reader(&buffer);
+            const QSize size = reader.size();
+            if (size.width() > THUMBNAIL_SIZE || size.height() > THUMBNAIL_SIZE) {
+                reader.setScaledSize(size.scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio));
+            }
+            const QImage image = reader.read();
+            if (!image.isNull()) {
+                return image;
+            }
+        }
+    }
+    return QImage();
+}
+
+/*
+    Runs on a worker thread, which reads the drafts as well.
+ */
+static QList<PreviewResult> buildPreviews(DraftReader reader, QList<PreviewRequest> requests)
+{
+    QList<PreviewResult> results;
+    foreach (const PreviewRequest &request, requests) {
+        PreviewResult result;
+        result.id = request.id;
+        result.row = request.row;
+        QByteArray data = reader.draftData(request.id);
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+        QTextDocument document;
+        if (DraftFormat::read(&buffer, &document, 0)) {
+            result.excerpt = document.toPlainText().simplified().left(EXCERPT_LENGTH);
+            result.thumbnail = firstImage(document);
+        }
+        results << result;
+    }
+    return results;
+}
+
+class LibraryModel::Private : public QObject
+{
+    Q_OBJECT
+    Q_POINTER(LibraryModel)
+public:
+    Private(LibraryModel *q_ptr, DraftLibrary *library);
+    ~Private();
+
+    QVector<quint32> filteredIds() const;
+    void requestPreview(quint32 id, int row);
+
+    DraftLibrary *library;
+    SearchIndex *searchIndex;
+    DraftLibrary::SortOrder order;
+    QString filter;
+    QVector<quint32> ids;
+    int fetched;
+
+    QCache<quint32, Preview> previews;
+    QSet<quint32> pending;
+    QList<PreviewRequest> queue;
+    QFutureWatcher<QList<PreviewResult> > watcher;
+    int generation;
+    int runningGeneration;
+    bool startScheduled;
+
+public slots:
+    void startPreviews();
+    void previewsFinished();
+}; // end of class GOW::LibraryModel::Private
+
+LibraryModel::Private::Private(LibraryModel *q_ptr, DraftLibrary *library) :
+    QObject(q_ptr),
+    q(q_ptr),
+    library(library),
+    searchIndex(0),
+    order(DraftLibrary::ByModified),
+    fetched(0),
+    previews(PREVIEW_CACHE_SIZE),
+    generation(0),
+    runningGeneration(0),
+    startScheduled(false)
+{
+    connect(&watcher, SIGNAL(finished()), this, SLOT(previewsFinished()));
+}
+
+LibraryModel::Private::~Private()
+{
+    if (watcher.isRunning()) {
+        watcher.waitForFinished();
+        library->endRead();
+    }
+}
+
+/*
+    Words of the filter starting with '#' are tags the draft must have. The
+    other words are a query for the search index, or must all occur in the
+    title; drafts which are not indexed yet are still found by their title.
+    Only ids are copied, never entries.
+ */
+QVector<quint32> LibraryModel::Private::filteredIds() const
+{
+    const QVector<quint32> all = library->draftIds(order);
+    const QStringList words = filter.split(QLatin1Char(' '), QString::SkipEmptyParts);
+    if (words.isEmpty()) {
+        return all;
+    }
+    QStringList titleWords;
+    QList<QSet<quint32> > required;
+    foreach (const QString &word, words) {
+        if (word.startsWith(QLatin1Char('#')) && word.length() > 1) {
+            QSet<quint32> set;
+            foreach (const DraftInfo &info, library->draftsWithTag(word.mid(1))) {
+                set.insert(info.id);
+            }
+            required << set;
+        } else {
+            titleWords << word;
+        }
+    }
+    QSet<quint32> hits;
+    if (searchIndex && searchIndex->isOpen() && !titleWords.isEmpty()) {
+        hits = searchIndex->search(titleWords.join(QLatin1String(" "))).toSet();
+    }
+    QVector<quint32> result;
+    foreach (quint32 id, all) {
+        bool match = true;
+        for (int i = 0; match && i < required.size(); ++i) {
+            match = required.at(i).contains(id);
+        }
+        if (match && !titleWords.isEmpty() && !hits.contains(id)) {
+            const QString title = library->draft(id).title;
+            for (int i = 0; match && i < titleWords.size(); ++i) {
+                match = title.contains(titleWords.at(i), Qt::CaseInsensitive);
+            }
+        }
+        if (match) {
+            result << id;
+        }
+    }
+    return result;
+}
+
+/*
+    Requests come from data(), that is from the rows being painted. The
+    latest ones are served first and the oldest are dropped, so scrolling
+    quickly never builds up a backlog.
+ */
+void LibraryModel::Private::requestPreview(quint32 id, int row)
+{
+    if (pending.contains(id)) {
+        return;
+    }
+    pending.insert(id);
+    queue << PreviewRequest(id, row);
+    while (queue.size() > PREVIEW_QUEUE_LIMIT) {
+        pending.remove(queue.takeFirst().id);
+    }
+    if (!startScheduled && !watcher.isRunning()) {
+        startScheduled = true;
+        QTimer::singleShot(0, this, SLOT(startPreviews()));
+    }
+}
+
+void LibraryModel::Private::startPreviews()
+{
+    startScheduled = false;
+    if (watcher.isRunning() || queue.isEmpty()) {
+        return;
+    }
+    QList<PreviewRequest> batch;
+    QList<quint32> batchIds;
+    while (!queue.isEmpty() && batch.size() < PREVIEW_BATCH_SIZE) {
+        batch << queue.takeLast();
+        batchIds << batch.last().id;
+    }
+    runningGeneration = generation;
+    watcher.setFuture(QtConcurrent::run(buildPreviews, library->beginRead(batchIds), batch));
+}
+
+void LibraryModel::Private::previewsFinished()
+{
+    library->endRead();
+    const QList<PreviewResult> results = watcher.result();
+    foreach (const PreviewResult &result, results) {
+        pending.remove(result.id);
+        if (runningGeneration != generation) {
+            continue;
+        }
+        Preview *preview = new Preview;
+        preview->excerpt = result.excerpt;
+        preview->thumbnail = result.thumbnail;
+        previews.insert(result.id, preview);
+        if (result.row < fetched && ids.at(result.row) == result.id) {
+            const QModelIndex index = q->index(result.row);
+            emit q->dataChanged(index, index);
+        }
+    }
+    startPreviews();
+}
+
+/*!
+  \class GOW::LibraryModel
+
+  Lists the drafts of a DraftLibrary for views.
+
+  Sorting and filtering work on the ids from the library index, so the
+  model never holds more than one id per draft. Rows are handed to the
+  view a page at a time through fetchMore(), and entries are looked up in
+  the index when a row is shown. Excerpts and thumbnails need the draft
+  itself; they are decoded on a worker thread for the rows being shown
+  and kept in a cache of bounded size.
+ */
+
+/*!
+  Constructs a model listing the drafts of \a library with \a parent,
+  latest first.
+ */
+LibraryModel::LibraryModel(DraftLibrary *library, QObject *parent) :
+    QAbstractListModel(parent),
+    d(this, library)
+{
+    refresh();
+}
+
+/*!
+  Destructs the model. Waits for running decodes to finish.
+ */
+LibraryModel::~LibraryModel()
+{
+}
+
+/*!
+  \reimp
+ */
+int LibraryModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : d->fetched;
+}
+
+/*!
+  \reimp
+ */
+QVariant LibraryModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= d->fetched) {
+        return QVariant();
+    }
+    const quint32 id = d->ids.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+    case ExcerptRole: {
+        const Preview *preview = d->previews.object(id);
+        if (!preview) {
+            d->requestPreview(id, index.row());
+        }
+        const QString excerpt = preview ? preview->excerpt : QString(QChar(0x2026));
+        if (role == ExcerptRole) {
+            return excerpt;
+        }
+        const QString title = d->library->draft(id).title;
+        return (title.isEmpty() ? tr("(Untitled)") : title) + QLatin1Char('\n') + excerpt;
+    }
+    case Qt::DecorationRole: {
+        const Preview *preview = d->previews.object(id);
+        if (preview && !preview->thumbnail.isNull()) {
+            return preview->thumbnail;
+        }
+        return QVariant();
+    }
+    case Qt::ToolTipRole: {
+        const DraftInfo info = d->library->draft(id);
+        QString tip = info.modified.toString(Qt::DefaultLocaleShortDate);
+        if (!info.tags.isEmpty()) {
+            tip += QLatin1Char('\n') + info.tags.join(QLatin1String(", "));
+        }
+        return tip;
+    }
+    case DraftIdRole:
+        return id;
+    case TitleRole:
+        return d->library->draft(id).title;
+    case ModifiedRole:
+        return d->library->draft(id).modified;
+    case TagsRole:
+        return d->library->draft(id).tags;
+    default:
+        return QVariant();
+    }
+}
+
+/*!
+  \reimp
+ */
+bool LibraryModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && d->fetched < d->ids.size();
+}
+
+/*!
+  \reimp
+ */
+void LibraryModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid()) {
+        return;
+    }
+    const int count = qMin(FETCH_SIZE, d->ids.size() - d->fetched);
+    if (count <= 0) {
+        return;
+    }
+    beginInsertRows(QModelIndex(), d->fetched, d->fetched + count - 1);
+    d->fetched += count;
+    endInsertRows();
+}
+
+/*!
+  Sets the order of the drafts to \a order.
+ */
+void LibraryModel::setSortOrder(DraftLibrary::SortOrder order)
+{
+    if (d->order != order) {
+        d->order = order;
+        refresh();
+    }
+}
+
+/*!
+  Returns the order of the drafts.
+ */
+DraftLibrary::SortOrder LibraryModel::sortOrder() const
+{
+    return d->order;
+}
+
+/*!
+  Searches drafts with \a index instead of matching titles only.
+ */
+void LibraryModel::setSearchIndex(SearchIndex *index)
+{
+    d->searchIndex = index;
+    if (!d->filter.isEmpty()) {
+        refresh();
+    }
+}
+
+/*!
+  Shows only drafts matching \a filter: drafts found by it as a search
+  query, see SearchIndex::search(), and drafts with all of its words in
+  the title. Words starting with '#' name tags the drafts must have.
+ */
+void LibraryModel::setFilter(const QString &filter)
+{
+    if (d->filter != filter) {
+        d->filter = filter;
+        refresh();
+    }
+}
+
+/*!
+  Returns the filter.
+ */
+QString LibraryModel::filter() const
+{
+    return d->filter;
+}
+
+/*!
+  Returns the id of the draft at \a index, or 0 if there is none.
+ */
+quint32 LibraryModel::draftId(const QModelIndex &index) const
+{
+    if (!index.isValid() || index.row() >= d->fetched) {
+        return 0;
+    }
+    return d->ids.at(index.row());
+}
+
+/*!
+  Reads the ids from the library index again. As many rows as before are
+  shown, so views keep their scroll position.
+ */
+void LibraryModel::refresh()
+{
+    beginResetModel();
+    ++d->generation;
+    d->queue.clear();
+    d->pending.clear();
+    d->ids = d->library->isOpen() ? d->filteredIds() : QVector<quint32>();
+    d->fetched = qMin(qMax(d->fetched, FETCH_SIZE), d->ids.size());
+    endResetModel();
+}
+
+/*!
+  Updates the model after draft \a id has been saved or removed.
+ */
+void LibraryModel::draftChanged(quint32 id)
+{
+    d->previews.remove(id);
+    refresh();
+}
+
+/*!
+  Filters again after drafts were added to the search index.
+ */
+void LibraryModel::searchIndexChanged()
+{
+    if (!d->filter.isEmpty()) {
+        refresh();
+    }
+}
+
+/*!
+  Updates the model once after the drafts \a ids have been saved or
+  removed together.
+ */
+void LibraryModel::draftsChanged(const QList<quint32> &ids)
+{
+    foreach (quint32 id, ids) {
+        d->previews.remove(id);
+    }
+    refresh();
+}
+
+}
+
+#include "librarymodel.moc"
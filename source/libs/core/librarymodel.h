@@ -0,0 +1,78 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef LIBRARYMODEL_H
+#define LIBRARYMODEL_H
+
+#include <QAbstractListModel>
+
+#include <DPointer>
+#include <DraftLibrary>
+#include <Global>
+
+namespace GOW
+{
+
+class SearchIndex;
+
+class LIBRARY_EXPORT LibraryModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    enum Role {
+        DraftIdRole = Qt::UserRole + 1,
+        TitleRole,
+        ExcerptRole,
+        ModifiedRole,
+        TagsRole
+    };
+
+    explicit LibraryModel(DraftLibrary *library, QObject *parent = 0);
+    ~LibraryModel();
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+
+    void setSortOrder(DraftLibrary::SortOrder order);
+    DraftLibrary::SortOrder sortOrder() const;
+
+    void setSearchIndex(SearchIndex *index);
+
+    void setFilter(const QString &filter);
+    QString filter() const;
+
+    quint32 draftId(const QModelIndex &index) const;
+
+public slots:
+    void refresh();
+    void draftChanged(quint32 id);
+    void draftsChanged(const QList<quint32> &ids);
+    void searchIndexChanged();
+
+private:
+    D_POINTER
+}; // end of class GOW::LibraryModel
+
+} // end of namespace GOW
+
+#endif // LIBRARYMODEL_H
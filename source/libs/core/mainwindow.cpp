@@ -21,24 +21,70 @@
 
 #include <QAction>
 #include <QApplication>
+#include <QBuffer>
+#include <QCloseEvent>
 #include <QDebug>
+#include <QDir>
+#include <QEvent>
+#include <QFile>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QLabel>
 #include <QLineEdit>
 #include <QMenu>
 #include <QMenuBar>
+#include <QMessageBox>
 #include <QStatusBar>
+#include <QTextDocument>
+#include <QTimer>
 #include <QToolBar>
 #include <QVBoxLayout>
+#if QT_VERSION >= 0x050000
+#include <QSaveFile>
+#endif
+
+#include <BlogClient>
+#include <BlogSync>
+#include <DraftFormat>
+#include <DraftLibrary>
+#include <MediaPipeline>
+#include <Outbox>
+#include <SearchIndex>
 
+#include "autosavejournal.h"
 #include "colorbutton.h"
+#include "fontcache.h"
 #include "fontchooser.h"
 #include "fontsizechooser.h"
+#include "htmlsynchronizer.h"
+#include "iconprovider.h"
+#include "librarydialog.h"
+#include "librarydock.h"
+#include "librarymodel.h"
 #include "mainwindow.h"
 #include "previewer.h"
+#include "publishdialog.h"
 #include "sourceeditor.h"
+#include "startuptracer.h"
 #include "visualeditor.h"
+#include "windowmanager.h"
 
 namespace GOW {
 
+// Toolbar state follows the cursor at most once per frame.
+static const int FORMAT_SYNC_INTERVAL = 16;
+
+// Outbox messages which are not errors go away after this long.
+static const int STATUS_MESSAGE_TIMEOUT = 5000;
+
+// Autosave journals name library drafts by this prefix and the draft id.
+static const char * const DRAFT_LOCATION_PREFIX = "draft:";
+
+static QString draftLocation(quint32 id)
+{
+    return QLatin1String(DRAFT_LOCATION_PREFIX) + QString::number(id);
+}
+
 #define currentEditor (dynamic_cast<GOW::Editor *>(editorTabs->currentWidget()))
 
 class MainWindow::Private : public QObject
@@ -50,14 +96,33 @@ public:
 
     void setupMenus();
     void setupToolBars();
+    void setupEditToolBar();
     void setupStatusBar();
     void setupEditors();
+    void setupLibraryDock();
+
+    Previewer *ensurePreviewer();
+    SourceEditor *ensureSourceEditor();
+
+    bool eventFilter(QObject *watched, QEvent *event);
+
+    bool maybeSave();
+    bool loadDocument(const QString &name);
+    bool writeDocument(const QString &name);
+    bool loadDraft(quint32 id);
+    bool writeDraft();
+    void setLocation(const QString &name, quint32 id);
+
+    QString fileName;
+    quint32 draftId;
 
     QAction *newDocAction;
     QAction *openDocAction;
     QAction *closeDocAction;
     QAction *saveAction;
     QAction *saveAsAction;
+    QAction *publishAction;
+    QAction *syncAction;
     QAction *exitAction;
 
     QAction *undoAction;
@@ -81,6 +146,13 @@ public:
     QAction *helpContentAction;
     QAction *aboutAction;
 
+    QMenu *fileMenu;
+    QMenu *editMenu;
+    QMenu *formatMenu;
+    QMenu *helpMenu;
+    QToolBar *formatBar;
+    QToolBar *editBar;
+
     FontChooser *fontChooser;
     FontSizeChooser *fontSizeChooser;
     ColorButton *textColorButton;
@@ -91,8 +163,34 @@ public:
     VisualEditor *visualEditor;
     SourceEditor *sourceEditor;
     Previewer *previewer;
+    LibraryDock *libraryDock;
+    QLabel *outboxLabel;
+    QString publishingTitle;
+    HtmlSynchronizer *htmlSynchronizer;
+    AutosaveJournal *autosave;
+    int previewTab;
+    int sourceTab;
+
+    bool firstPaintSeen;
+    bool firstKeySeen;
+    int deferredStep;
+
+    QTimer *formatSyncTimer;
+    QTextCharFormat pendingFormat;
+    QTextCharFormat shownFormat;
+    Qt::Alignment shownAlignment;
+    bool formatShown;
 
 private slots:
+    void newDocument();
+    void openDocument();
+    bool saveDocument();
+    bool saveDocumentAs();
+    void publishDocument();
+    void syncFromBlog();
+    void titleEdited();
+    void draftActivated(quint32 id);
+
     void textBold();
     void textItalic();
     void textStrikeOut();
@@ -105,26 +203,86 @@ private slots:
     void fontFamilyActivated(const QString &family);
     void fontSizeActivated(int size);
 
+    void editorTabChanged(int index);
+
+    void outboxChanged();
+    void outboxSending(quint32 id, const QString &title);
+    void outboxUploadProgress(quint32 id, int uploaded, int total);
+    void outboxPublished(quint32 id);
+    void outboxRetryScheduled(quint32 id, const QDateTime &when, const QString &message);
+    void outboxFailed(quint32 id, const QString &message);
+    void syncFinished(bool ok, const QString &message);
+
+    void syncFormatState();
+    void formatStateInvalidated();
+
+    void populateMenus();
+    void deferredSetupStep();
+
 private:
     void createActions();
+    void finishStartupTrace();
+    void replaceTab(int index, QWidget *widget);
     void alignmentChanged(Qt::Alignment align);
     void fontChanged(const QFont &font);
 }; // end of class GOW::MainWindow::Private
 
 MainWindow::Private::Private(MainWindow *q_ptr) :
     QObject(q_ptr),
-    q(q_ptr)
+    q(q_ptr),
+    draftId(0),
+    fileMenu(0),
+    editBar(0),
+    sourceEditor(0),
+    previewer(0),
+    libraryDock(0),
+    outboxLabel(0),
+    firstPaintSeen(false),
+    firstKeySeen(false),
+    deferredStep(0),
+    formatShown(false)
 {
+    formatSyncTimer = new QTimer(this);
+    formatSyncTimer->setSingleShot(true);
+    formatSyncTimer->setInterval(FORMAT_SYNC_INTERVAL);
+    connect(formatSyncTimer, SIGNAL(timeout()), this, SLOT(syncFormatState()));
 }
 
+/*
+    Only the menu titles are created at startup. The menus are filled when
+    one of them is about to show for the first time, or during idle time
+    after the first paint.
+ */
 void MainWindow::Private::setupMenus()
 {
+    TRACE_SCOPE("setupMenus");
     createActions();
 
     QMenuBar *bar = q->menuBar();
+    fileMenu = new QMenu(tr("&File"), q);
+    bar->addMenu(fileMenu);
+    editMenu = new QMenu(tr("&Edit"), q);
+    bar->addMenu(editMenu);
+    formatMenu = new QMenu(tr("F&ormat"), q);
+    bar->addMenu(formatMenu);
+    bar->addSeparator();
+    helpMenu = new QMenu(tr("&Help"), q);
+    bar->addMenu(helpMenu);
+
+    connect(fileMenu, SIGNAL(aboutToShow()), this, SLOT(populateMenus()));
+    connect(editMenu, SIGNAL(aboutToShow()), this, SLOT(populateMenus()));
+    connect(formatMenu, SIGNAL(aboutToShow()), this, SLOT(populateMenus()));
+    connect(helpMenu, SIGNAL(aboutToShow()), this, SLOT(populateMenus()));
+}
+
+void MainWindow::Private::populateMenus()
+{
+    if (!fileMenu->isEmpty()) {
+        return;
+    }
+    TRACE_SCOPE("populateMenus");
 
     // Menu File
-    QMenu *fileMenu = new QMenu(tr("&File"), q);
     fileMenu->addAction(newDocAction);
     fileMenu->addAction(openDocAction);
     fileMenu->addAction(closeDocAction);
@@ -132,21 +290,20 @@ void MainWindow::Private::setupMenus()
     fileMenu->addAction(saveAction);
     fileMenu->addAction(saveAsAction);
     fileMenu->addSeparator();
+    fileMenu->addAction(publishAction);
+    fileMenu->addAction(syncAction);
+    fileMenu->addSeparator();
     fileMenu->addAction(exitAction);
-    bar->addMenu(fileMenu);
 
     // Menu Edit
-    QMenu *editMenu = new QMenu(tr("&Edit"), q);
     editMenu->addAction(undoAction);
     editMenu->addAction(redoAction);
     editMenu->addSeparator();
     editMenu->addAction(cutAction);
     editMenu->addAction(copyAction);
     editMenu->addAction(pasteAction);
-    bar->addMenu(editMenu);
 
     // Menu format
-    QMenu *formatMenu = new QMenu(tr("F&ormat"), q);
     formatMenu->addAction(textBoldAction);
     formatMenu->addAction(textItalicAction);
     formatMenu->addAction(textUnderlineAction);
@@ -168,28 +325,18 @@ void MainWindow::Private::setupMenus()
     }
     alignMenu->addAction(alignJustifyAction);
     formatMenu->addMenu(alignMenu);
-    bar->addMenu(formatMenu);
 
-    bar->addSeparator();
     // Menu Help
-    QMenu *helpMenu = new QMenu(tr("&Help"), q);
     helpMenu->addAction(helpContentAction);
     helpMenu->addAction(aboutAction);
-    bar->addMenu(helpMenu);
 }
 
+static const int SPACING_WIDTH = 4;
+
 void MainWindow::Private::setupToolBars()
 {
-    const int SPACING_WIDTH = 4;
-
-    QToolBar *editBar = new QToolBar(tr("Edit"), q);
-    editBar->addAction(newDocAction);
-    editBar->layout()->setSpacing(SPACING_WIDTH);
-    editBar->addAction(undoAction);
-    editBar->addAction(redoAction);
-    q->addToolBar(Qt::TopToolBarArea, editBar);
-
-    QToolBar *formatBar = new QToolBar(tr("Format"), q);
+    TRACE_SCOPE("setupToolBars");
+    formatBar = new QToolBar(tr("Format"), q);
     formatBar->layout()->setSpacing(SPACING_WIDTH);
 //    m_headingList = new Widgets::HeadingComboBox(this);
 //    formatBar->addWidget(m_headingList);
@@ -201,20 +348,22 @@ void MainWindow::Private::setupToolBars()
     formatBar->addWidget(fontChooser);
     connect(fontChooser, SIGNAL(fontFamilyActivated(QString)),
             this, SLOT(fontFamilyActivated(QString)));
+    connect(FontCache::instance(), SIGNAL(familiesChanged()),
+            this, SLOT(formatStateInvalidated()));
     fontSizeChooser = new FontSizeChooser(q);
     formatBar->addWidget(fontSizeChooser);
     connect(fontSizeChooser, SIGNAL(fontSizeActivated(int)),
             this, SLOT(fontSizeActivated(int)));
     textColorButton = new ColorButton(q);
     textColorButton->setStandardColors();
-    textColorButton->setTipIcon(QIcon(":/image/text_color"));
+    textColorButton->setTipIcon(IconProvider::icon("text_color"));
     textColorButton->setToolTip(tr("Text Color"));
     formatBar->addWidget(textColorButton);
 //    m_textColorAction->setIcon(m_textColorButton->icon());
     textBackgroundColorButton = new ColorButton(q);
     textBackgroundColorButton->setStandardColors();
     textBackgroundColorButton->setCurrentColor(Qt::white);
-    textBackgroundColorButton->setTipIcon(QIcon(":/image/text_background_color"));
+    textBackgroundColorButton->setTipIcon(IconProvider::icon("text_background_color"));
     textBackgroundColorButton->setToolTip(tr("Text Background Color"));
     formatBar->addWidget(textBackgroundColorButton);
 //    m_textBackgroundColorAction->setIcon(m_textBackgroundColorButton->icon());
@@ -232,34 +381,73 @@ void MainWindow::Private::setupToolBars()
     q->addToolBar(Qt::TopToolBarArea, formatBar);
 }
 
+void MainWindow::Private::setupEditToolBar()
+{
+    TRACE_SCOPE("setupEditToolBar");
+    editBar = new QToolBar(tr("Edit"), q);
+    editBar->addAction(newDocAction);
+    editBar->layout()->setSpacing(SPACING_WIDTH);
+    editBar->addAction(undoAction);
+    editBar->addAction(redoAction);
+    q->insertToolBar(formatBar, editBar);
+}
+
+/*
+    Opening the outbox starts sending what was left in it, so this waits
+    for the deferred setup as well.
+ */
 void MainWindow::Private::setupStatusBar()
 {
     QStatusBar *bar = q->statusBar();
     bar->showMessage(tr("Ready."));
+    outboxLabel = new QLabel(q);
+    bar->addPermanentWidget(outboxLabel);
+    Outbox *outbox = WindowManager::instance()->outbox();
+    connect(outbox, SIGNAL(itemsChanged()), this, SLOT(outboxChanged()));
+    connect(outbox, SIGNAL(sending(quint32,QString)), this, SLOT(outboxSending(quint32,QString)));
+    connect(outbox, SIGNAL(uploadProgress(quint32,int,int)),
+            this, SLOT(outboxUploadProgress(quint32,int,int)));
+    connect(outbox, SIGNAL(published(quint32,QString)), this, SLOT(outboxPublished(quint32)));
+    connect(outbox, SIGNAL(retryScheduled(quint32,QDateTime,QString)),
+            this, SLOT(outboxRetryScheduled(quint32,QDateTime,QString)));
+    connect(outbox, SIGNAL(failed(quint32,QString)), this, SLOT(outboxFailed(quint32,QString)));
+    outboxChanged();
+    connect(WindowManager::instance()->blogSync(), SIGNAL(finished(bool,QString)),
+            this, SLOT(syncFinished(bool,QString)));
 }
 
 void MainWindow::Private::setupEditors()
 {
+    TRACE_SCOPE("setupEditors");
     editorTabs = new QTabWidget(q);
 #ifndef Q_OS_MAC
     editorTabs->setTabPosition(QTabWidget::South);
 #endif
 
     visualEditor = new VisualEditor(editorTabs);
-    visualEditor->setStyleSheet("border: 0");
+    visualEditor->setFrameShape(QFrame::NoFrame);
     editorTabs->addTab(visualEditor, tr("Visual"));
     connect(visualEditor, SIGNAL(cursorPositionChanged()),
             this, SLOT(cursorPositionChanged()));
     connect(visualEditor, SIGNAL(currentCharFormatChanged(QTextCharFormat)),
             this, SLOT(currentCharFormatChanged(QTextCharFormat)));
-
-    previewer = new Previewer(editorTabs);
-    previewer->setStyleSheet("border: 0");
-    editorTabs->addTab(previewer, tr("Preview"));
-
-    sourceEditor = new SourceEditor(editorTabs);
-    sourceEditor->setStyleSheet("border: 0");
-    editorTabs->addTab(sourceEditor, tr("Source"));
+    pendingFormat = visualEditor->currentCharFormat();
+    visualEditor->installEventFilter(this);
+    visualEditor->viewport()->installEventFilter(this);
+
+    // The other tabs get their widgets on first activation or when idle.
+    previewTab = editorTabs->addTab(new QWidget(editorTabs), tr("Preview"));
+    sourceTab = editorTabs->addTab(new QWidget(editorTabs), tr("Source"));
+
+    htmlSynchronizer = new HtmlSynchronizer(visualEditor->document(), this);
+    connect(editorTabs, SIGNAL(currentChanged(int)),
+            this, SLOT(editorTabChanged(int)));
+    connect(visualEditor->document(), SIGNAL(modificationChanged(bool)),
+            q, SLOT(setWindowModified(bool)));
+    connect(visualEditor->document(), SIGNAL(modificationChanged(bool)),
+            saveAction, SLOT(setEnabled(bool)));
+    autosave = new AutosaveJournal(visualEditor->document(), this);
+    autosave->start(QString(), QString(), false);
 
     titleEditor = new QLineEdit(q);
     titleEditor->setFixedHeight(40);
@@ -269,6 +457,8 @@ void MainWindow::Private::setupEditors()
     titleEditor->setStyleSheet("border:2px solid gray;"
                                "border-radius: 10px;"
                                "padding:0 8px;");
+    connect(titleEditor, SIGNAL(textEdited(QString)), this, SLOT(titleEdited()));
+    connect(titleEditor, SIGNAL(textChanged(QString)), autosave, SLOT(setTitle(QString)));
 
     QWidget *editorArea = new QWidget(q);
     QVBoxLayout *editorAreaLayout = new QVBoxLayout(editorArea);
@@ -278,6 +468,443 @@ void MainWindow::Private::setupEditors()
     q->setCentralWidget(editorArea);
 }
 
+/*
+    The dock reads the library index, so it is only built after the first
+    paint.
+ */
+void MainWindow::Private::setupLibraryDock()
+{
+    TRACE_SCOPE("setupLibraryDock");
+    WindowManager *manager = WindowManager::instance();
+    libraryDock = new LibraryDock(manager->library(), q);
+    libraryDock->model()->setSearchIndex(manager->searchIndex());
+    connect(libraryDock, SIGNAL(draftActivated(quint32)), this, SLOT(draftActivated(quint32)));
+    connect(manager, SIGNAL(draftChanged(quint32)),
+            libraryDock->model(), SLOT(draftChanged(quint32)));
+    connect(manager, SIGNAL(draftsChanged(QList<quint32>)),
+            libraryDock->model(), SLOT(draftsChanged(QList<quint32>)));
+    connect(manager, SIGNAL(searchIndexChanged()), libraryDock->model(), SLOT(searchIndexChanged()));
+    q->addDockWidget(Qt::LeftDockWidgetArea, libraryDock);
+}
+
+Previewer *MainWindow::Private::ensurePreviewer()
+{
+    if (previewer) {
+        return previewer;
+    }
+    TRACE_SCOPE("ensurePreviewer");
+    previewer = new Previewer(editorTabs);
+    previewer->setFrameShape(QFrame::NoFrame);
+    previewer->setTitle(titleEditor->text());
+    previewer->setSynchronizer(htmlSynchronizer);
+    connect(visualEditor->document(), SIGNAL(contentsChanged()),
+            previewer, SLOT(invalidate()));
+    connect(titleEditor, SIGNAL(textChanged(QString)),
+            previewer, SLOT(setTitle(QString)));
+    replaceTab(previewTab, previewer);
+    return previewer;
+}
+
+SourceEditor *MainWindow::Private::ensureSourceEditor()
+{
+    if (sourceEditor) {
+        return sourceEditor;
+    }
+    TRACE_SCOPE("ensureSourceEditor");
+    sourceEditor = new SourceEditor(editorTabs);
+    sourceEditor->setFrameShape(QFrame::NoFrame);
+    htmlSynchronizer->setSourceDocument(sourceEditor->document());
+    replaceTab(sourceTab, sourceEditor);
+    return sourceEditor;
+}
+
+/*
+    Swaps the placeholder of the tab at \a index for \a widget without
+    reporting a tab change.
+ */
+void MainWindow::Private::replaceTab(int index, QWidget *widget)
+{
+    QWidget *placeholder = editorTabs->widget(index);
+    const QString label = editorTabs->tabText(index);
+    const bool current = editorTabs->currentIndex() == index;
+    editorTabs->blockSignals(true);
+    editorTabs->removeTab(index);
+    editorTabs->insertTab(index, widget, label);
+    if (current) {
+        editorTabs->setCurrentIndex(index);
+    }
+    editorTabs->blockSignals(false);
+    placeholder->deleteLater();
+}
+
+/*
+    Watches the visual editor until it has been painted and typed into for
+    the first time. The first paint starts the deferred setup.
+ */
+bool MainWindow::Private::eventFilter(QObject *watched, QEvent *event)
+{
+    if (!firstPaintSeen && event->type() == QEvent::Paint && watched == visualEditor->viewport()) {
+        firstPaintSeen = true;
+        StartupTracer::instant("first paint");
+        QTimer::singleShot(0, this, SLOT(deferredSetupStep()));
+    } else if (!firstKeySeen && event->type() == QEvent::KeyPress && watched == visualEditor) {
+        firstKeySeen = true;
+        StartupTracer::instant("first keystroke");
+        finishStartupTrace();
+    }
+    if (firstPaintSeen && firstKeySeen) {
+        visualEditor->removeEventFilter(this);
+        visualEditor->viewport()->removeEventFilter(this);
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+/*
+    Builds one of the parts left out at startup and yields to the event
+    loop before the next one, so input is never held up for long.
+ */
+void MainWindow::Private::deferredSetupStep()
+{
+    switch (deferredStep++) {
+    case 0:
+        populateMenus();
+        break;
+    case 1:
+        setupEditToolBar();
+        setupStatusBar();
+        setupLibraryDock();
+        break;
+    case 2:
+        ensureSourceEditor();
+        break;
+    case 3:
+        ensurePreviewer();
+        finishStartupTrace();
+        return;
+    default:
+        return;
+    }
+    QTimer::singleShot(0, this, SLOT(deferredSetupStep()));
+}
+
+/*
+    Startup is over once the deferred setup is done and the first key has
+    been typed; main() writes the trace on exit otherwise.
+ */
+void MainWindow::Private::finishStartupTrace()
+{
+    if (firstKeySeen && deferredStep > 3) {
+        StartupTracer::finish();
+    }
+}
+
+/*
+    Asks whether changes to the current post should be saved. Returns false
+    if the user cancelled or saving failed.
+ */
+bool MainWindow::Private::maybeSave()
+{
+    if (!visualEditor->document()->isModified()) {
+        return true;
+    }
+    const QMessageBox::StandardButton button =
+            QMessageBox::warning(q, tr("OrbitsWriter"),
+                                 tr("The post has been modified.\nDo you want to save your changes?"),
+                                 QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel);
+    if (button == QMessageBox::Save) {
+        return saveDocument();
+    }
+    return button == QMessageBox::Discard;
+}
+
+/*
+    Drafts are read straight into the visual document as a single edit, so
+    the synchronizer and the previewer see one change only.
+ */
+bool MainWindow::Private::loadDocument(const QString &name)
+{
+    TRACE_SCOPE("loadDocument");
+    QFile file(name);
+    QString title;
+    QString error;
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+    } else {
+        // The loaded draft is the base of a new journal.
+        const int revision = visualEditor->document()->revision();
+        autosave->pause();
+        if (DraftFormat::read(&file, visualEditor->document(), &title, &error)) {
+            titleEditor->setText(title);
+            visualEditor->moveCursor(QTextCursor::Start);
+            setLocation(name, 0);
+            autosave->start(name, title, true);
+            return true;
+        }
+        if (visualEditor->document()->revision() == revision) {
+            autosave->resume();
+        } else {
+            titleEditor->clear();
+            setLocation(QString(), 0);
+            autosave->start(QString(), QString(), false);
+        }
+    }
+    QMessageBox::warning(q, tr("Open Post"), tr("Cannot open %1:\n%2")
+                         .arg(QDir::toNativeSeparators(name), error));
+    return false;
+}
+
+/*
+    A journal cannot start from a library draft the way it starts from a
+    file, so it starts from a snapshot instead: the draft just read.
+ */
+bool MainWindow::Private::loadDraft(quint32 id)
+{
+    DraftLibrary *library = WindowManager::instance()->library();
+    const int revision = visualEditor->document()->revision();
+    autosave->pause();
+    QByteArray data = library->draftData(id);
+    QString error = library->errorString();
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    if (!data.isEmpty() && DraftFormat::read(&buffer, visualEditor->document(), 0, &error)) {
+        const QString title = library->draft(id).title;
+        titleEditor->setText(title);
+        visualEditor->moveCursor(QTextCursor::Start);
+        setLocation(QString(), id);
+        autosave->start(draftLocation(id), title, false);
+        autosave->compact(data);
+        return true;
+    }
+    if (visualEditor->document()->revision() == revision) {
+        autosave->resume();
+    } else {
+        titleEditor->clear();
+        setLocation(QString(), 0);
+        autosave->start(QString(), QString(), false);
+    }
+    QMessageBox::warning(q, tr("Open Post"), tr("Cannot open the draft:\n%1").arg(error));
+    return false;
+}
+
+/*
+    Only the pages of this draft and its index entry are written; all
+    other drafts in the library stay untouched.
+ */
+bool MainWindow::Private::writeDraft()
+{
+    DraftLibrary *library = WindowManager::instance()->library();
+    const QString title = titleEditor->text();
+    // A recovered draft may have been removed meanwhile; it is added again.
+    const DraftInfo current = library->draft(draftId);
+    // Serialized once, for the library and the autosave snapshot.
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QString error;
+    quint32 id = 0;
+    if (DraftFormat::write(&buffer, visualEditor->document(), title, DraftFormat::NoOptions, &error)) {
+        id = library->save(current.id, data, title, current.tags);
+        error = library->errorString();
+    }
+    if (id == 0) {
+        QMessageBox::warning(q, tr("Save Post"), tr("Cannot save the draft:\n%1").arg(error));
+        return false;
+    }
+    visualEditor->document()->setModified(false);
+    setLocation(QString(), id);
+    autosave->start(draftLocation(id), title, false);
+    autosave->compact(data);
+    // Only this draft is indexed again, as a small new index segment.
+    SearchIndex *index = WindowManager::instance()->searchIndex();
+    if (index->isOpen()) {
+        index->update(id, title + QLatin1Char('\n') + visualEditor->document()->toPlainText());
+        index->commit();
+    }
+    WindowManager::instance()->notifyDraftChanged(id);
+    return true;
+}
+
+bool MainWindow::Private::writeDocument(const QString &name)
+{
+#if QT_VERSION >= 0x050000
+    QSaveFile file(name);
+#else
+    QFile file(name);
+#endif
+    QString error;
+    bool ok = file.open(QIODevice::WriteOnly);
+    if (ok) {
+        ok = DraftFormat::write(&file, visualEditor->document(), titleEditor->text(),
+                                DraftFormat::NoOptions, &error);
+    } else {
+        error = file.errorString();
+    }
+#if QT_VERSION >= 0x050000
+    if (ok && !file.commit()) {
+        ok = false;
+        error = file.errorString();
+    }
+#endif
+    if (!ok) {
+        QMessageBox::warning(q, tr("Save Post"), tr("Cannot save %1:\n%2")
+                             .arg(QDir::toNativeSeparators(name), error));
+        return false;
+    }
+    visualEditor->document()->setModified(false);
+    setLocation(name, 0);
+    autosave->start(name, titleEditor->text(), true);
+    return true;
+}
+
+/*
+    The post is either the draft file \a name or the library draft \a id;
+    a new post has neither.
+ */
+void MainWindow::Private::setLocation(const QString &name, quint32 id)
+{
+    fileName = name;
+    draftId = id;
+    if (!name.isEmpty()) {
+        q->setWindowTitle(tr("%1 [*] - OrbitsWriter").arg(QFileInfo(name).fileName()));
+    } else if (id != 0 && !titleEditor->text().isEmpty()) {
+        q->setWindowTitle(tr("%1 [*] - OrbitsWriter").arg(titleEditor->text()));
+    } else {
+        q->setWindowTitle(tr("OrbitsWriter [*]"));
+    }
+}
+
+void MainWindow::Private::newDocument()
+{
+    if (!maybeSave()) {
+        return;
+    }
+    autosave->pause();
+    visualEditor->document()->clear();
+    visualEditor->document()->setModified(false);
+    titleEditor->clear();
+    setLocation(QString(), 0);
+    autosave->start(QString(), QString(), false);
+}
+
+void MainWindow::Private::openDocument()
+{
+    if (!maybeSave()) {
+        return;
+    }
+    LibraryDialog dialog(WindowManager::instance()->library(), q);
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+    if (!dialog.isFileRequested()) {
+        if (dialog.selectedDraft() != 0) {
+            loadDraft(dialog.selectedDraft());
+        }
+        return;
+    }
+    const QString name = QFileDialog::getOpenFileName(q, tr("Open Post"), QString(),
+            tr("Drafts (*.%1)").arg(QLatin1String(DraftFormat::suffix())));
+    if (!name.isEmpty()) {
+        loadDocument(name);
+    }
+}
+
+/*
+    New posts go to the draft library; posts opened from a draft file are
+    saved back to it.
+ */
+bool MainWindow::Private::saveDocument()
+{
+    if (fileName.isEmpty()) {
+        return writeDraft();
+    }
+    return writeDocument(fileName);
+}
+
+bool MainWindow::Private::saveDocumentAs()
+{
+    QString name = QFileDialog::getSaveFileName(q, tr("Save Post"), fileName,
+            tr("Drafts (*.%1)").arg(QLatin1String(DraftFormat::suffix())));
+    if (name.isEmpty()) {
+        return false;
+    }
+    if (QFileInfo(name).suffix().isEmpty()) {
+        name += QLatin1Char('.') + QLatin1String(DraftFormat::suffix());
+    }
+    return writeDocument(name);
+}
+
+/*
+    The post only goes into the outbox here; sending it is up to the
+    outbox, so this never waits for the network. A library draft is saved
+    first, so publishing it again later updates the same post.
+ */
+void MainWindow::Private::publishDocument()
+{
+    WindowManager *manager = WindowManager::instance();
+    PublishDialog dialog(manager->blogAccount(), q);
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+    manager->setBlogAccount(dialog.account());
+    if (fileName.isEmpty() && (draftId == 0 || visualEditor->document()->isModified()) && !writeDraft()) {
+        return;
+    }
+    BlogPost post;
+    post.title = titleEditor->text();
+    post.content = htmlSynchronizer->html();
+    if (draftId != 0) {
+        post.categories = manager->library()->draft(draftId).tags;
+    }
+    Outbox *outbox = manager->outbox();
+    const QDateTime scheduled = dialog.scheduledTime();
+    if (!outbox->isOpen()
+            || outbox->enqueue(post, MediaPipeline::images(visualEditor->document()), draftId, scheduled) == 0) {
+        QMessageBox::warning(q, tr("Publish Post"), tr("Cannot add the post to the outbox:\n%1")
+                             .arg(outbox->errorString()));
+        return;
+    }
+    if (scheduled.isValid()) {
+        q->statusBar()->showMessage(tr("\"%1\" will be published at %2.")
+                                    .arg(post.title, scheduled.toString(Qt::DefaultLocaleShortDate)),
+                                    STATUS_MESSAGE_TIMEOUT);
+    }
+}
+
+/*
+    Posts changed on the blog go into the library in the background; only
+    what changed since the last sync is downloaded.
+ */
+void MainWindow::Private::syncFromBlog()
+{
+    WindowManager *manager = WindowManager::instance();
+    if (!manager->blogAccount().isValid()) {
+        QMessageBox::information(q, tr("Sync from Blog"),
+                                 tr("Set up the blog account by publishing a post first."));
+        return;
+    }
+    BlogSync *sync = manager->blogSync();
+    if (sync->isRunning()) {
+        return;
+    }
+    q->statusBar()->showMessage(tr("Syncing with the blog..."));
+    sync->sync();
+}
+
+void MainWindow::Private::titleEdited()
+{
+    visualEditor->document()->setModified(true);
+}
+
+void MainWindow::Private::draftActivated(quint32 id)
+{
+    if (id == draftId && fileName.isEmpty()) {
+        return;
+    }
+    if (maybeSave()) {
+        loadDraft(id);
+    }
+}
+
 #define FORMAT_FUNC(ACTION) \
     void MainWindow::Private::ACTION() \
     { \
@@ -302,129 +929,151 @@ void MainWindow::Private::textAlign(QAction *action)
     }
 }
 
+/*
+    Cursor and format changes only record the latest state. The toolbar is
+    brought up to date once they settle, see syncFormatState().
+ */
 void MainWindow::Private::cursorPositionChanged()
 {
-    alignmentChanged(visualEditor->alignment());
+    if (!formatSyncTimer->isActive()) {
+        formatSyncTimer->start();
+    }
 }
 
 void MainWindow::Private::createActions()
 {
-    newDocAction = new QAction(QIcon::fromTheme("document-new", QIcon(":/image/doc_new")), tr("&New"), this);
+    TRACE_SCOPE("createActions");
+    newDocAction = new QAction(IconProvider::icon("document-new", "doc_new"), tr("&New"), this);
     newDocAction->setShortcut(QKeySequence::New);
     newDocAction->setStatusTip(tr("Create a new post."));
+    connect(newDocAction, SIGNAL(triggered()), this, SLOT(newDocument()));
 
-    openDocAction = new QAction(QIcon::fromTheme("document-open", QIcon(":/image/doc_open")), tr("&Open..."), this);
+    openDocAction = new QAction(IconProvider::icon("document-open", "doc_open"), tr("&Open..."), this);
     openDocAction->setShortcut(QKeySequence::Open);
     openDocAction->setStatusTip(tr("Open a post."));
+    connect(openDocAction, SIGNAL(triggered()), this, SLOT(openDocument()));
 
-    closeDocAction = new QAction(QIcon::fromTheme("document-close", QIcon(":/image/doc_close")), tr("&Close..."), this);
+    closeDocAction = new QAction(IconProvider::icon("document-close", "doc_close"), tr("&Close..."), this);
     closeDocAction->setShortcut(QKeySequence::Close);
     closeDocAction->setStatusTip(tr("Close a post."));
+    connect(closeDocAction, SIGNAL(triggered()), this, SLOT(newDocument()));
 
-    saveAction = new QAction(QIcon::fromTheme("document-save", QIcon(":/image/doc_save")), tr("Save"), this);
+    saveAction = new QAction(IconProvider::icon("document-save", "doc_save"), tr("Save"), this);
     saveAction->setEnabled(false);
     saveAction->setShortcut(QKeySequence::Save);
     saveAction->setStatusTip(tr("Save the post."));
+    connect(saveAction, SIGNAL(triggered()), this, SLOT(saveDocument()));
 
-    saveAsAction = new QAction(QIcon::fromTheme("document-save-as", QIcon(":/image/doc_save_as")), tr("Save As"), this);
+    saveAsAction = new QAction(IconProvider::icon("document-save-as", "doc_save_as"), tr("Save As"), this);
     saveAsAction->setShortcut(QKeySequence::SaveAs);
     saveAsAction->setStatusTip(tr("Save the post as another one."));
+    connect(saveAsAction, SIGNAL(triggered()), this, SLOT(saveDocumentAs()));
 
-    exitAction = new QAction(QIcon::fromTheme("application-exit", QIcon(":/image/app_exit")), tr("E&xit"), this);
+    publishAction = new QAction(tr("&Publish..."), this);
+    publishAction->setShortcut(tr("Ctrl+Shift+P"));
+    publishAction->setStatusTip(tr("Publish the post to the blog."));
+    connect(publishAction, SIGNAL(triggered()), this, SLOT(publishDocument()));
+
+    syncAction = new QAction(tr("S&ync from Blog"), this);
+    syncAction->setStatusTip(tr("Bring posts changed on the blog into the library."));
+    connect(syncAction, SIGNAL(triggered()), this, SLOT(syncFromBlog()));
+
+    exitAction = new QAction(IconProvider::icon("application-exit", "app_exit"), tr("E&xit"), this);
     exitAction->setMenuRole(QAction::QuitRole);
     exitAction->setShortcut(tr("Ctrl+Q"));
     exitAction->setStatusTip(tr("Exit OrbitsWriter."));
+    connect(exitAction, SIGNAL(triggered()), WindowManager::instance(), SLOT(quit()));
 
-    undoAction = new QAction(QIcon::fromTheme("edit-undo", QIcon(":/image/undo")), tr("Undo"), this);
+    undoAction = new QAction(IconProvider::icon("edit-undo", "undo"), tr("Undo"), this);
     undoAction->setShortcut(QKeySequence::Undo);
     undoAction->setStatusTip(tr("Undo."));
     undoAction->setEnabled(false);
 
-    redoAction = new QAction(QIcon::fromTheme("edit-redo", QIcon(":/image/redo")), tr("Redo"), this);
+    redoAction = new QAction(IconProvider::icon("edit-redo", "redo"), tr("Redo"), this);
     redoAction->setShortcut(QKeySequence::Redo);
     redoAction->setStatusTip(tr("Redo."));
     redoAction->setEnabled(false);
 
-    cutAction = new QAction(QIcon::fromTheme("edit-cut", QIcon(":/image/cut")), tr("Cut"), this);
+    cutAction = new QAction(IconProvider::icon("edit-cut", "cut"), tr("Cut"), this);
     cutAction->setShortcut(QKeySequence::Cut);
     cutAction->setStatusTip(tr("Cut."));
     cutAction->setEnabled(false);
 
-    copyAction = new QAction(QIcon::fromTheme("edit-copy", QIcon(":/image/copy")), tr("Copy"), this);
+    copyAction = new QAction(IconProvider::icon("edit-copy", "copy"), tr("Copy"), this);
     copyAction->setShortcut(QKeySequence::Copy);
     copyAction->setStatusTip(tr("Copy."));
     copyAction->setEnabled(false);
 
-    pasteAction = new QAction(QIcon::fromTheme("edit-paste", QIcon(":/image/paste")), tr("Paste"), this);
+    pasteAction = new QAction(IconProvider::icon("edit-paste", "paste"), tr("Paste"), this);
     pasteAction->setShortcut(QKeySequence::Paste);
     pasteAction->setStatusTip(tr("Paste."));
     pasteAction->setEnabled(false);
 
-    textBoldAction = new QAction(QIcon::fromTheme("format-text-bold", QIcon(":/image/bold")), tr("Bold"), this);
+    textBoldAction = new QAction(IconProvider::icon("format-text-bold", "bold"), tr("Bold"), this);
     textBoldAction->setShortcut(Qt::CTRL + Qt::Key_B);
     textBoldAction->setStatusTip(tr("Set text bold."));
     textBoldAction->setCheckable(true);
     connect(textBoldAction, SIGNAL(triggered()), this, SLOT(textBold()));
 
-    textItalicAction = new QAction(QIcon::fromTheme("format-text-italic", QIcon(":/image/italic")), tr("Italic"), this);
+    textItalicAction = new QAction(IconProvider::icon("format-text-italic", "italic"), tr("Italic"), this);
     textItalicAction->setShortcut(Qt::CTRL + Qt::Key_I);
     textItalicAction->setStatusTip(tr("Set text italic."));
     textItalicAction->setCheckable(true);
     connect(textItalicAction, SIGNAL(triggered()), this, SLOT(textItalic()));
 
-    textUnderlineAction = new QAction(QIcon::fromTheme("format-text-underline", QIcon(":/image/underline")), tr("Underline"), this);
+    textUnderlineAction = new QAction(IconProvider::icon("format-text-underline", "underline"), tr("Underline"), this);
     textUnderlineAction->setShortcut(Qt::CTRL + Qt::Key_U);
     textUnderlineAction->setStatusTip(tr("Add underline."));
     textUnderlineAction->setCheckable(true);
     connect(textUnderlineAction, SIGNAL(triggered()), this, SLOT(textUnderline()));
 
-    textStrikeOutAction = new QAction(QIcon::fromTheme("format-text-strikethrough", QIcon(":/image/strike")), tr("Strike"), this);
+    textStrikeOutAction = new QAction(IconProvider::icon("format-text-strikethrough", "strike"), tr("Strike"), this);
     textStrikeOutAction->setShortcut(Qt::CTRL + Qt::Key_D);
     textStrikeOutAction->setStatusTip(tr("Strike out."));
     textStrikeOutAction->setCheckable(true);
     connect(textStrikeOutAction, SIGNAL(triggered()), this, SLOT(textStrikeOut()));
 
-    textFontAction = new QAction(QIcon(":/image/font"), tr("Font..."), this);
+    textFontAction = new QAction(IconProvider::icon("font"), tr("Font..."), this);
     textFontAction->setStatusTip(tr("Set font."));
 
-    textColorAction = new QAction(QIcon(":/image/text_color"), tr("Text Color..."), this);
+    textColorAction = new QAction(IconProvider::icon("text_color"), tr("Text Color..."), this);
     textColorAction->setStatusTip(tr("Text Color."));
 
-    textBackgroundColorAction = new QAction(QIcon(":/image/text_background_color"), tr("Text Background Color..."), this);
+    textBackgroundColorAction = new QAction(IconProvider::icon("text_background_color"), tr("Text Background Color..."), this);
     textBackgroundColorAction->setStatusTip(tr("Text background color."));
 
     QActionGroup *alignGroup = new QActionGroup(this);
     connect(alignGroup, SIGNAL(triggered(QAction*)), this, SLOT(textAlign(QAction*)));
-    alignCenterAction = new QAction(QIcon::fromTheme("format-justify-center", QIcon(":/image/align_center")), tr("Center"), this);
+    alignCenterAction = new QAction(IconProvider::icon("format-justify-center", "align_center"), tr("Center"), this);
     alignCenterAction->setStatusTip(tr("Justify center."));
     alignCenterAction->setShortcut(Qt::CTRL + Qt::Key_E);
     alignCenterAction->setCheckable(true);
     alignCenterAction->setActionGroup(alignGroup);
 
-    alignJustifyAction = new QAction(QIcon::fromTheme("format-justify-fill", QIcon(":/image/align_fill")), tr("Fill"), this);
+    alignJustifyAction = new QAction(IconProvider::icon("format-justify-fill", "align_fill"), tr("Fill"), this);
     alignJustifyAction->setStatusTip(tr("Justify fill."));
     alignJustifyAction->setShortcut(Qt::CTRL + Qt::Key_F);
     alignJustifyAction->setCheckable(true);
     alignJustifyAction->setChecked(true);
     alignJustifyAction->setActionGroup(alignGroup);
 
-    alignLeftAction = new QAction(QIcon::fromTheme("format-justify-left", QIcon(":/image/align_left")), tr("Left"), this);
+    alignLeftAction = new QAction(IconProvider::icon("format-justify-left", "align_left"), tr("Left"), this);
     alignLeftAction->setStatusTip(tr("Justify left."));
     alignLeftAction->setShortcut(Qt::CTRL + Qt::Key_L);
     alignLeftAction->setCheckable(true);
     alignLeftAction->setActionGroup(alignGroup);
 
-    alignRightAction = new QAction(QIcon::fromTheme("format-justify-right", QIcon(":/image/align_right")), tr("Right"), this);
+    alignRightAction = new QAction(IconProvider::icon("format-justify-right", "align_right"), tr("Right"), this);
     alignRightAction->setStatusTip(tr("Justify Right."));
     alignRightAction->setShortcut(Qt::CTRL + Qt::Key_R);
     alignRightAction->setCheckable(true);
     alignRightAction->setActionGroup(alignGroup);
 
-    helpContentAction = new QAction(QIcon::fromTheme("help-contents", QIcon(":/image/help")), tr("Help"), this);
+    helpContentAction = new QAction(IconProvider::icon("help-contents", "help"), tr("Help"), this);
     helpContentAction->setShortcut(QKeySequence::HelpContents);
     helpContentAction->setStatusTip(tr("Open help contents."));
 
-    aboutAction = new QAction(QIcon::fromTheme("help-about", QIcon(":/image/about")), tr("About"), this);
+    aboutAction = new QAction(IconProvider::icon("help-about", "about"), tr("About"), this);
     aboutAction->setMenuRole(QAction::AboutRole);
     aboutAction->setStatusTip(tr("About OrbitsWriter."));
 }
@@ -444,8 +1093,14 @@ void MainWindow::Private::alignmentChanged(Qt::Alignment align)
 
 void MainWindow::Private::fontChanged(const QFont &font)
 {
-    fontChooser->setCurrentIndex(fontChooser->findData(QFontInfo(font).family()));
-    fontSizeChooser->setCurrentIndex(fontSizeChooser->findData(QString::number(font.pointSize())));
+    const int familyIndex = fontChooser->indexOfFamily(QFontInfo(font).family());
+    if (fontChooser->currentIndex() != familyIndex) {
+        fontChooser->setCurrentIndex(familyIndex);
+    }
+    const int sizeIndex = fontSizeChooser->indexOfSize(font.pointSize());
+    if (fontSizeChooser->currentIndex() != sizeIndex) {
+        fontSizeChooser->setCurrentIndex(sizeIndex);
+    }
     textBoldAction->setChecked(font.bold());
     textItalicAction->setChecked(font.italic());
     textStrikeOutAction->setChecked(font.strikeOut());
@@ -454,7 +1109,39 @@ void MainWindow::Private::fontChanged(const QFont &font)
 
 void MainWindow::Private::currentCharFormatChanged(const QTextCharFormat &format)
 {
-    fontChanged(format.font());
+    pendingFormat = format;
+    if (!formatSyncTimer->isActive()) {
+        formatSyncTimer->start();
+    }
+}
+
+/*
+    Pushes the latest cursor state to the toolbar. Nothing is touched
+    unless the format or the alignment differs from what is shown.
+ */
+void MainWindow::Private::syncFormatState()
+{
+    const Qt::Alignment alignment = visualEditor->alignment();
+    if (!formatShown || alignment != shownAlignment) {
+        alignmentChanged(alignment);
+        shownAlignment = alignment;
+    }
+    if (!formatShown || pendingFormat != shownFormat) {
+        fontChanged(pendingFormat.font());
+        shownFormat = pendingFormat;
+    }
+    formatShown = true;
+}
+
+/*
+    The toolbar items were rebuilt, so the shown state is unknown.
+ */
+void MainWindow::Private::formatStateInvalidated()
+{
+    formatShown = false;
+    if (!formatSyncTimer->isActive()) {
+        formatSyncTimer->start();
+    }
 }
 
 void MainWindow::Private::fontFamilyActivated(const QString &family)
@@ -467,6 +1154,81 @@ void MainWindow::Private::fontSizeActivated(int size)
     currentEditor->textFontSize(size);
 }
 
+void MainWindow::Private::editorTabChanged(int index)
+{
+    if (index == sourceTab) {
+        ensureSourceEditor();
+        htmlSynchronizer->syncSource();
+        return;
+    }
+    if (index == previewTab) {
+        ensurePreviewer();
+    }
+    htmlSynchronizer->syncVisual();
+}
+
+void MainWindow::Private::outboxChanged()
+{
+    Outbox *outbox = WindowManager::instance()->outbox();
+    const int pending = outbox->pendingCount();
+    const int failed = outbox->items().count() - pending;
+    if (failed > 0) {
+        outboxLabel->setText(tr("Outbox: %1 waiting, %2 failed").arg(pending).arg(failed));
+    } else {
+        outboxLabel->setText(tr("Outbox: %1 waiting").arg(pending));
+    }
+    outboxLabel->setVisible(pending + failed > 0);
+}
+
+void MainWindow::Private::outboxSending(quint32, const QString &title)
+{
+    publishingTitle = title;
+    q->statusBar()->showMessage(tr("Publishing \"%1\"...").arg(title));
+}
+
+void MainWindow::Private::outboxUploadProgress(quint32, int uploaded, int total)
+{
+    q->statusBar()->showMessage(tr("Publishing \"%1\": %2 of %3 images uploaded...")
+                                .arg(publishingTitle).arg(uploaded).arg(total));
+}
+
+void MainWindow::Private::outboxPublished(quint32)
+{
+    q->statusBar()->showMessage(tr("Published \"%1\".").arg(publishingTitle), STATUS_MESSAGE_TIMEOUT);
+}
+
+void MainWindow::Private::outboxRetryScheduled(quint32, const QDateTime &when, const QString &message)
+{
+    q->statusBar()->showMessage(tr("Could not publish \"%1\" (%2). Trying again at %3.")
+                                .arg(publishingTitle, message,
+                                     when.time().toString(Qt::DefaultLocaleShortDate)));
+}
+
+void MainWindow::Private::outboxFailed(quint32, const QString &message)
+{
+    q->statusBar()->showMessage(tr("Publishing \"%1\" failed: %2").arg(publishingTitle, message));
+}
+
+/*
+    Drafts edited both here and on the blog are kept; the blog version of
+    each is in a new draft next to it.
+ */
+void MainWindow::Private::syncFinished(bool ok, const QString &message)
+{
+    if (!ok) {
+        q->statusBar()->showMessage(tr("Sync with the blog failed: %1").arg(message));
+        return;
+    }
+    const SyncStats stats = WindowManager::instance()->blogSync()->stats();
+    if (stats.conflicts > 0) {
+        q->statusBar()->showMessage(tr("Synced with the blog: %1 new, %2 updated, %3 edited on both "
+                                       "sides and added as copies.")
+                                    .arg(stats.created).arg(stats.updated).arg(stats.conflicts));
+    } else {
+        q->statusBar()->showMessage(tr("Synced with the blog: %1 new, %2 updated.")
+                                    .arg(stats.created).arg(stats.updated), STATUS_MESSAGE_TIMEOUT);
+    }
+}
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -476,9 +1238,9 @@ MainWindow::MainWindow(QWidget *parent) :
     setWindowIcon(QIcon(":/image/app_icon"));
     setUnifiedTitleAndToolBarOnMac(true);
 
+    // Everything else is built after the first paint, see deferredSetupStep().
     d->setupMenus();
     d->setupToolBars();
-    d->setupStatusBar();
     d->setupEditors();
     d->visualEditor->setFocus();
 }
@@ -487,6 +1249,76 @@ MainWindow::~MainWindow()
 {
 }
 
+/*!
+  Shows the post stored in the file \a fileName. Returns false, after
+  telling the user why, if the file cannot be read.
+ */
+bool MainWindow::openFile(const QString &fileName)
+{
+    return d->loadDocument(fileName);
+}
+
+/*!
+  Shows the UTF-8 encoded \a html as a new, unsaved post. The title of
+  the HTML document, if any, becomes the title of the post.
+ */
+void MainWindow::openHtml(const QByteArray &html)
+{
+    TRACE_SCOPE("openHtml");
+    QTextDocument *document = d->visualEditor->document();
+    d->autosave->pause();
+    // Decoded straight from the bytes; html may wrap shared memory.
+    document->setHtml(QString::fromUtf8(html.constData(), html.size()));
+    const QString title = document->metaInformation(QTextDocument::DocumentTitle);
+    d->titleEditor->setText(title);
+    d->visualEditor->moveCursor(QTextCursor::Start);
+    d->setLocation(QString(), 0);
+    document->setModified(true);
+    d->autosave->start(QString(), title, false);
+    d->autosave->compactHtml(html);
+}
+
+/*!
+  Shows the post recorded in the autosave \a session, which is removed
+  once the post is journaled by this window. Returns false if the
+  session holds nothing to recover.
+ */
+bool MainWindow::recoverSession(const QString &session)
+{
+    QTextDocument *document = d->visualEditor->document();
+    QString name;
+    QString title;
+    d->autosave->pause();
+    if (!AutosaveJournal::recover(session, document, &name, &title)) {
+        d->autosave->resume();
+        return false;
+    }
+    d->titleEditor->setText(title);
+    if (name.startsWith(QLatin1String(DRAFT_LOCATION_PREFIX))) {
+        d->setLocation(QString(), name.mid(qstrlen(DRAFT_LOCATION_PREFIX)).toUInt());
+    } else {
+        d->setLocation(name, 0);
+    }
+    document->setModified(true);
+    d->autosave->start(name, title, false);
+    // The session goes once the snapshot built from it is in place.
+    d->autosave->compactSession(session);
+    return true;
+}
+
+/*!
+  \internal
+ */
+void MainWindow::closeEvent(QCloseEvent *event)
+{
+    if (d->maybeSave()) {
+        d->autosave->discard();
+        event->accept();
+    } else {
+        event->ignore();
+    }
+}
+
 }
 
 #include "mainwindow.moc"
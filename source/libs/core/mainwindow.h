@@ -35,11 +35,18 @@ class LIBRARY_EXPORT MainWindow : public QMainWindow
 public:
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
+
+    bool openFile(const QString &fileName);
+    void openHtml(const QByteArray &html);
+    bool recoverSession(const QString &session);
     
 signals:
     
 public slots:
 
+protected:
+    void closeEvent(QCloseEvent *event);
+
 private:
     D_POINTER
 };
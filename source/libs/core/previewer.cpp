@@ -19,14 +19,276 @@
  *
  *-------------------------------------------------*/
 
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QScrollBar>
+#include <QTextDocument>
+#include <QThread>
+#include <QTimer>
+#include <QtConcurrentRun>
+
+#include <HtmlWriter>
+
+#include "htmlsynchronizer.h"
 #include "previewer.h"
 
 namespace GOW
 {
 
+static const int DEFAULT_DELAY = 300;
+
+static const char * const PREVIEW_STYLE_SHEET =
+        "h1 { font-size: 24pt; margin-bottom: 12px; }"
+        "p { margin-top: 0; margin-bottom: 10px; }"
+        "img { margin: 4px; }";
+
+struct PreviewResult
+{
+    PreviewResult() : document(0), generation(0), renderTime(0) {}
+
+    QTextDocument *document;
+    int generation;
+    qint64 renderTime;
+};
+
+/*
+    Runs on a worker thread. The document is created without a parent and
+    handed over to the GUI thread once it is ready.
+*/
+static PreviewResult buildPreview(QString title, QString html, int generation,
+                                  QAtomicInt *latestGeneration, QThread *guiThread)
+{
+    PreviewResult result;
+    result.generation = generation;
+    // Superseded while waiting in the pool.
+    if (latestGeneration->fetchAndAddRelaxed(0) != generation) {
+        return result;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QTextDocument *document = new QTextDocument;
+    document->setDefaultStyleSheet(QLatin1String(PREVIEW_STYLE_SHEET));
+    if (title.isEmpty()) {
+        document->setHtml(html);
+    } else {
+        document->setHtml(QLatin1String("<h1>") + HtmlWriter::escape(title)
+                          + QLatin1String("</h1>\n") + html);
+    }
+    document->moveToThread(guiThread);
+    result.document = document;
+    result.renderTime = timer.elapsed();
+    return result;
+}
+
+class Previewer::Private : public QObject
+{
+    Q_OBJECT
+    Q_POINTER(Previewer)
+public:
+    Private(Previewer *q_ptr);
+    ~Private();
+
+    void swapDocument(QTextDocument *document);
+
+    HtmlSynchronizer *synchronizer;
+    QString title;
+    QTimer debounceTimer;
+    QFutureWatcher<PreviewResult> watcher;
+    QAtomicInt latestGeneration;
+    int generation;
+    int restoreScroll;
+    bool stale;
+    bool resultTaken;
+
+public slots:
+    void render();
+    void renderFinished();
+    void scrollRangeChanged(int min, int max);
+}; // end of class GOW::Previewer::Private
+
+Previewer::Private::Private(Previewer *q_ptr) :
+    QObject(q_ptr),
+    q(q_ptr),
+    synchronizer(0),
+    generation(0),
+    restoreScroll(-1),
+    stale(true),
+    resultTaken(true)
+{
+    debounceTimer.setSingleShot(true);
+    debounceTimer.setInterval(DEFAULT_DELAY);
+    connect(&debounceTimer, SIGNAL(timeout()), this, SLOT(render()));
+    connect(&watcher, SIGNAL(finished()), this, SLOT(renderFinished()));
+    connect(q->verticalScrollBar(), SIGNAL(rangeChanged(int,int)),
+            this, SLOT(scrollRangeChanged(int,int)));
+}
+
+Previewer::Private::~Private()
+{
+    latestGeneration.fetchAndStoreRelaxed(-1);
+    watcher.waitForFinished();
+    if (!resultTaken && watcher.future().resultCount() > 0) {
+        delete watcher.result().document;
+    }
+}
+
+/*
+    Starts a render of the current content unless one is running already;
+    in that case the running one is superseded and a new one is started as
+    soon as it finishes.
+*/
+void Previewer::Private::render()
+{
+    debounceTimer.stop();
+    if (!synchronizer) {
+        return;
+    }
+    ++generation;
+    latestGeneration.fetchAndStoreRelaxed(generation);
+    if (watcher.isRunning()) {
+        return;
+    }
+    stale = false;
+    resultTaken = false;
+    watcher.setFuture(QtConcurrent::run(buildPreview, title, synchronizer->html(), generation,
+                                        &latestGeneration, QCoreApplication::instance()->thread()));
+}
+
+void Previewer::Private::renderFinished()
+{
+    const PreviewResult result = watcher.result();
+    resultTaken = true;
+    if (result.generation != generation) {
+        delete result.document;
+        if (q->isVisible()) {
+            render();
+        } else {
+            stale = true;
+        }
+        return;
+    }
+    if (result.document) {
+        swapDocument(result.document);
+        emit q->previewUpdated(result.renderTime);
+    }
+}
+
+/*
+    Replaces the document in one step and keeps the scroll position. The
+    new document may not be laid out far enough yet, so the position is
+    applied again once the scroll range has grown.
+*/
+void Previewer::Private::swapDocument(QTextDocument *document)
+{
+    const int scroll = q->verticalScrollBar()->value();
+    QTextDocument *old = q->document();
+    document->setParent(q);
+    q->setDocument(document);
+    if (old->parent() == q) {
+        old->deleteLater();
+    }
+    restoreScroll = scroll;
+    scrollRangeChanged(q->verticalScrollBar()->minimum(), q->verticalScrollBar()->maximum());
+}
+
+void Previewer::Private::scrollRangeChanged(int, int max)
+{
+    if (restoreScroll >= 0 && max >= restoreScroll) {
+        q->verticalScrollBar()->setValue(restoreScroll);
+        restoreScroll = -1;
+    }
+}
+
+/*!
+  \class GOW::Previewer
+
+  Shows the post as it will be published.
+
+  Building the preview is expensive on large posts, so it never happens in
+  the GUI thread. Changes only restart a debounce timer; when it fires, the
+  HTML is taken from the HtmlSynchronizer and the preview document is built
+  on a worker thread. The finished document replaces the shown one in a
+  single swap which keeps the scroll position. A render superseded by newer
+  changes is dropped, and nothing is rendered while the previewer is hidden.
+ */
+
+/*!
+  Constructs a previewer with \a parent.
+ */
 Previewer::Previewer(QWidget *parent) :
-    QTextEdit(parent)
+    QTextEdit(parent),
+    d(this)
 {
+    setReadOnly(true);
 }
 
+/*!
+  Destructs the previewer. Waits for a running render to finish.
+ */
+Previewer::~Previewer()
+{
 }
+
+/*!
+  Sets \a synchronizer as the source of the post HTML.
+ */
+void Previewer::setSynchronizer(HtmlSynchronizer *synchronizer)
+{
+    d->synchronizer = synchronizer;
+    invalidate();
+}
+
+/*!
+  Sets the debounce delay to \a msecs milliseconds.
+ */
+void Previewer::setDelay(int msecs)
+{
+    d->debounceTimer.setInterval(msecs);
+}
+
+/*!
+  Returns the debounce delay in milliseconds.
+ */
+int Previewer::delay() const
+{
+    return d->debounceTimer.interval();
+}
+
+/*!
+  Marks the preview out of date. This is cheap enough to be called on
+  every keystroke.
+ */
+void Previewer::invalidate()
+{
+    d->stale = true;
+    if (isVisible()) {
+        d->debounceTimer.start();
+    }
+}
+
+/*!
+  Sets the post \a title shown on top of the preview.
+ */
+void Previewer::setTitle(const QString &title)
+{
+    d->title = title;
+    invalidate();
+}
+
+/*!
+  \internal
+ */
+void Previewer::showEvent(QShowEvent *e)
+{
+    QTextEdit::showEvent(e);
+    if (d->stale) {
+        d->render();
+    }
+}
+
+}
+
+#include "previewer.moc"
@@ -24,19 +24,38 @@
 
 #include <QTextEdit>
 
+#include <DPointer>
+#include <Global>
+
 namespace GOW
 {
 
-class Previewer : public QTextEdit
+class HtmlSynchronizer;
+
+class LIBRARY_EXPORT Previewer : public QTextEdit
 {
     Q_OBJECT
 public:
     explicit Previewer(QWidget *parent = 0);
-    
+    ~Previewer();
+
+    void setSynchronizer(HtmlSynchronizer *synchronizer);
+
+    void setDelay(int msecs);
+    int delay() const;
+
 signals:
-    
+    void previewUpdated(qint64 renderTime);
+
 public slots:
-    
+    void invalidate();
+    void setTitle(const QString &title);
+
+protected:
+    void showEvent(QShowEvent *e);
+
+private:
+    D_POINTER
 }; // end of class GOW::Previewer
 
 } // end of namespace GOW
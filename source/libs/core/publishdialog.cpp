@@ -0,0 +1,151 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QCheckBox>
+#include <QDateTimeEdit>
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QVBoxLayout>
+
+#include "publishdialog.h"
+
+namespace GOW
+{
+
+class PublishDialog::Private : public QObject
+{
+    Q_OBJECT
+    Q_POINTER(PublishDialog)
+public:
+    Private(PublishDialog *q_ptr, const BlogAccount &account);
+
+    QLineEdit *endpointEdit;
+    QLineEdit *blogIdEdit;
+    QLineEdit *userNameEdit;
+    QLineEdit *passwordEdit;
+    QCheckBox *rememberBox;
+    QCheckBox *scheduleBox;
+    QDateTimeEdit *scheduleEdit;
+    QPushButton *publishButton;
+
+public slots:
+    void validate();
+}; // end of class GOW::PublishDialog::Private
+
+PublishDialog::Private::Private(PublishDialog *q_ptr, const BlogAccount &account) :
+    QObject(q_ptr),
+    q(q_ptr)
+{
+    endpointEdit = new QLineEdit(account.endpoint.toString(), q);
+    endpointEdit->setPlaceholderText(QLatin1String("http://example.com/xmlrpc.php"));
+    blogIdEdit = new QLineEdit(account.blogId.isEmpty() ? QString::fromLatin1("1") : account.blogId, q);
+    userNameEdit = new QLineEdit(account.userName, q);
+    passwordEdit = new QLineEdit(account.password, q);
+    passwordEdit->setEchoMode(QLineEdit::Password);
+    rememberBox = new QCheckBox(tr("&Remember password"), q);
+    rememberBox->setChecked(account.rememberPassword);
+    rememberBox->setToolTip(tr("The password is stored unencrypted in the settings."));
+    scheduleBox = new QCheckBox(tr("&Schedule for"), q);
+    scheduleEdit = new QDateTimeEdit(QDateTime::currentDateTime().addSecs(60 * 60), q);
+    scheduleEdit->setCalendarPopup(true);
+    scheduleEdit->setMinimumDateTime(QDateTime::currentDateTime());
+    scheduleEdit->setEnabled(false);
+
+    QFormLayout *form = new QFormLayout;
+    form->addRow(tr("&Blog address:"), endpointEdit);
+    form->addRow(tr("Blog &ID:"), blogIdEdit);
+    form->addRow(tr("&User name:"), userNameEdit);
+    form->addRow(tr("&Password:"), passwordEdit);
+    form->addRow(QString(), rememberBox);
+    form->addRow(scheduleBox, scheduleEdit);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Cancel, Qt::Horizontal, q);
+    publishButton = buttons->addButton(tr("&Publish"), QDialogButtonBox::AcceptRole);
+    publishButton->setDefault(true);
+
+    QVBoxLayout *layout = new QVBoxLayout(q);
+    layout->addLayout(form);
+    layout->addWidget(buttons);
+
+    connect(buttons, SIGNAL(accepted()), q, SLOT(accept()));
+    connect(buttons, SIGNAL(rejected()), q, SLOT(reject()));
+    connect(scheduleBox, SIGNAL(toggled(bool)), scheduleEdit, SLOT(setEnabled(bool)));
+    connect(endpointEdit, SIGNAL(textChanged(QString)), this, SLOT(validate()));
+    connect(userNameEdit, SIGNAL(textChanged(QString)), this, SLOT(validate()));
+    validate();
+}
+
+void PublishDialog::Private::validate()
+{
+    const QUrl url(endpointEdit->text().trimmed());
+    publishButton->setEnabled(url.isValid() && !url.host().isEmpty()
+                              && !userNameEdit->text().trimmed().isEmpty());
+}
+
+/*!
+  \class GOW::PublishDialog
+
+  Asks for the blog to publish to and when. The post goes into the
+  outbox either way; the dialog never waits for the network.
+ */
+
+/*!
+  Constructs a dialog filled in with \a account with \a parent.
+ */
+PublishDialog::PublishDialog(const BlogAccount &account, QWidget *parent) :
+    QDialog(parent),
+    d(this, account)
+{
+    setWindowTitle(tr("Publish Post"));
+}
+
+PublishDialog::~PublishDialog()
+{
+}
+
+/*!
+  Returns the blog account as entered.
+ */
+BlogAccount PublishDialog::account() const
+{
+    BlogAccount account;
+    account.endpoint = QUrl(d->endpointEdit->text().trimmed());
+    account.blogId = d->blogIdEdit->text().trimmed();
+    account.userName = d->userNameEdit->text().trimmed();
+    account.password = d->passwordEdit->text();
+    account.rememberPassword = d->rememberBox->isChecked();
+    return account;
+}
+
+/*!
+  Returns the time to publish the post at, or an invalid time to publish
+  it at once.
+ */
+QDateTime PublishDialog::scheduledTime() const
+{
+    return d->scheduleBox->isChecked() ? d->scheduleEdit->dateTime() : QDateTime();
+}
+
+}
+
+#include "publishdialog.moc"
@@ -0,0 +1,130 @@
+#!/usr/bin/env python
+#
+# Packs the action icons into one atlas image, resources/icons.png.
+#
+# Run it from this directory after adding or changing an icon. The order
+# of ICONS must match ICON_ATLAS in ../iconprovider.cpp. Only zlib is
+# needed; the source icons must be 8 bit, non-interlaced RGBA or gray
+# with alpha PNGs.
+
+import struct
+import zlib
+
+CELL = 32
+COLUMNS = 8
+
+ICONS = [
+    ('about', 'about.png'),
+    ('align_center', 'align_center.png'),
+    ('align_fill', 'align_fill.png'),
+    ('align_left', 'align_left.png'),
+    ('align_right', 'align_right.png'),
+    ('app_exit', 'app_exit.png'),
+    ('bold', 'bold.png'),
+    ('copy', 'copy.png'),
+    ('cut', 'cut.png'),
+    ('doc_close', 'doc_close.png'),
+    ('doc_new', 'doc_new.png'),
+    ('doc_open', 'doc_open.png'),
+    ('doc_save', 'doc_save.png'),
+    ('doc_save_as', 'doc_save_as.png'),
+    ('font', 'font.png'),
+    ('help', 'help.png'),
+    ('italic', 'italic.png'),
+    ('paste', 'paste.png'),
+    ('plugins', 'plugin.png'),
+    ('redo', 'redo.png'),
+    ('settings', 'settings.png'),
+    ('strike', 'strike.png'),
+    ('text_background_color', 'paintcan.png'),
+    ('text_color', 'pencil.png'),
+    ('underline', 'underline.png'),
+    ('undo', 'undo.png'),
+]
+
+
+def paeth(a, b, c):
+    p = a + b - c
+    pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+    if pa <= pb and pa <= pc:
+        return a
+    if pb <= pc:
+        return b
+    return c
+
+
+def read_png(path):
+    data = open(path, 'rb').read()
+    if data[:8] != b'\x89PNG\r\n\x1a\n':
+        raise ValueError('%s: not a PNG file' % path)
+    pos = 8
+    idat = b''
+    width = height = channels = 0
+    while pos < len(data):
+        length, = struct.unpack('>I', data[pos:pos + 4])
+        kind = data[pos + 4:pos + 8]
+        body = data[pos + 8:pos + 8 + length]
+        pos += 12 + length
+        if kind == b'IHDR':
+            width, height, depth, color, _, _, interlace = struct.unpack('>IIBBBBB', body)
+            if depth != 8 or interlace != 0 or color not in (4, 6):
+                raise ValueError('%s: unsupported PNG format' % path)
+            channels = 4 if color == 6 else 2
+        elif kind == b'IDAT':
+            idat += body
+    raw = zlib.decompress(idat)
+    stride = width * channels
+    rows = []
+    prior = bytearray(stride)
+    pos = 0
+    for _ in range(height):
+        kind = raw[pos]
+        line = bytearray(raw[pos + 1:pos + 1 + stride])
+        pos += 1 + stride
+        for i in range(stride):
+            a = line[i - channels] if i >= channels else 0
+            b = prior[i]
+            c = prior[i - channels] if i >= channels else 0
+            if kind == 1:
+                line[i] = (line[i] + a) & 0xff
+            elif kind == 2:
+                line[i] = (line[i] + b) & 0xff
+            elif kind == 3:
+                line[i] = (line[i] + ((a + b) >> 1)) & 0xff
+            elif kind == 4:
+                line[i] = (line[i] + paeth(a, b, c)) & 0xff
+        rows.append(line)
+        prior = line
+    if channels == 2:
+        rows = [bytearray(b for i in range(0, stride, 2)
+                          for b in (row[i], row[i], row[i], row[i + 1])) for row in rows]
+    return width, height, rows
+
+
+def chunk(kind, body):
+    return (struct.pack('>I', len(body)) + kind + body
+            + struct.pack('>I', zlib.crc32(kind + body) & 0xffffffff))
+
+
+def main():
+    rows_count = (len(ICONS) + COLUMNS - 1) // COLUMNS
+    width, height = COLUMNS * CELL, rows_count * CELL
+    atlas = [bytearray(width * 4) for _ in range(height)]
+    for index, (name, path) in enumerate(ICONS):
+        w, h, rows = read_png(path)
+        if (w, h) != (CELL, CELL):
+            raise ValueError('%s: icons must be %dx%d' % (path, CELL, CELL))
+        x = (index % COLUMNS) * CELL * 4
+        y = (index // COLUMNS) * CELL
+        for r in range(CELL):
+            atlas[y + r][x:x + CELL * 4] = rows[r]
+    raw = b''.join(b'\x00' + bytes(row) for row in atlas)
+    png = (b'\x89PNG\r\n\x1a\n'
+           + chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 8, 6, 0, 0, 0))
+           + chunk(b'IDAT', zlib.compress(raw, 9))
+           + chunk(b'IEND', b''))
+    open('icons.png', 'wb').write(png)
+
+
+if __name__ == '__main__':
+    main()
@@ -27,6 +27,7 @@ namespace GOW
 SourceEditor::SourceEditor(QWidget *parent) :
     QTextEdit(parent)
 {
+    setAcceptRichText(false);
 }
 
 }
@@ -0,0 +1,186 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QVector>
+
+#include "startuptracer.h"
+
+namespace GOW
+{
+
+struct TraceEvent
+{
+    const char *name;
+    char phase;
+    qint64 timestamp;
+    quintptr thread;
+};
+
+/*
+    Started while the core library is being loaded, which is the earliest
+    point of the process the tracer can see. All timestamps count from it.
+*/
+struct TraceClock
+{
+    TraceClock() { timer.start(); }
+    QElapsedTimer timer;
+};
+
+static TraceClock traceClock;
+static QMutex traceMutex;
+static QVector<TraceEvent> traceEvents;
+static QString traceFileName;
+
+QAtomicInt StartupTracer::enabled;
+
+static void record(const char *name, char phase)
+{
+    TraceEvent event;
+    event.name = name;
+    event.phase = phase;
+    event.timestamp = traceClock.timer.nsecsElapsed() / 1000;
+    event.thread = quintptr(QThread::currentThreadId());
+    QMutexLocker locker(&traceMutex);
+    traceEvents.append(event);
+}
+
+static QByteArray jsonString(const char *text)
+{
+    QByteArray result("\"");
+    for (const char *c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            result += '\\';
+        }
+        result += *c;
+    }
+    result += '"';
+    return result;
+}
+
+/*!
+  \class GOW::StartupTracer
+
+  Records where launch time goes.
+
+  Tracing is off unless enable() is called, which main() does for the
+  \c --trace-startup command line option or the \c ORBITSWRITER_TRACE_STARTUP
+  environment variable. Phases are recorded with TRACE_SCOPE() and may
+  nest; while tracing is off a phase costs one atomic load of a flag.
+  finish() writes the phases as a Chrome trace-event JSON file, which can
+  be loaded in chrome://tracing or any viewer understanding that format.
+
+  Timestamps are microseconds since the core library was loaded, which is
+  recorded as the first event.
+ */
+
+/*!
+  Starts tracing. The trace is written to \a fileName by finish().
+ */
+void StartupTracer::enable(const QString &fileName)
+{
+    QMutexLocker locker(&traceMutex);
+    if (isEnabled()) {
+        return;
+    }
+    traceFileName = fileName;
+    traceEvents.reserve(256);
+    TraceEvent loaded;
+    loaded.name = "core library loaded";
+    loaded.phase = 'i';
+    loaded.timestamp = 0;
+    loaded.thread = quintptr(QThread::currentThreadId());
+    traceEvents.append(loaded);
+    enabled.fetchAndStoreRelease(1);
+}
+
+/*!
+  Marks the beginning of phase \a name. Prefer TRACE_SCOPE().
+ */
+void StartupTracer::begin(const char *name)
+{
+    if (isEnabled()) {
+        record(name, 'B');
+    }
+}
+
+/*!
+  Marks the end of phase \a name.
+ */
+void StartupTracer::end(const char *name)
+{
+    if (isEnabled()) {
+        record(name, 'E');
+    }
+}
+
+/*!
+  Records the point in time \a name, e.g. the first paint.
+ */
+void StartupTracer::instant(const char *name)
+{
+    if (isEnabled()) {
+        record(name, 'i');
+    }
+}
+
+/*!
+  Writes the trace and stops tracing. Returns false if tracing was off or
+  the file could not be written.
+ */
+bool StartupTracer::finish()
+{
+    QMutexLocker locker(&traceMutex);
+    if (!isEnabled()) {
+        return false;
+    }
+    enabled.fetchAndStoreRelease(0);
+
+    QFile file(traceFileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    file.write("{\"traceEvents\":[\n");
+    for (int i = 0; i < traceEvents.size(); ++i) {
+        const TraceEvent &event = traceEvents.at(i);
+        QByteArray line = "{\"name\":" + jsonString(event.name)
+                + ",\"cat\":\"startup\",\"ph\":\"" + event.phase
+                + "\",\"ts\":" + QByteArray::number(event.timestamp)
+                + ",\"pid\":" + pid
+                + ",\"tid\":" + QByteArray::number(quint64(event.thread));
+        if (event.phase == 'i') {
+            line += ",\"s\":\"p\"";
+        }
+        line += i + 1 < traceEvents.size() ? "},\n" : "}\n";
+        file.write(line);
+    }
+    file.write("],\"displayTimeUnit\":\"ms\"}\n");
+    traceEvents.clear();
+    return file.error() == QFile::NoError;
+}
+
+}
@@ -0,0 +1,91 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef STARTUPTRACER_H
+#define STARTUPTRACER_H
+
+#include <QAtomicInt>
+#include <QString>
+
+#include <Global>
+
+namespace GOW
+{
+
+class LIBRARY_EXPORT StartupTracer
+{
+public:
+    static void enable(const QString &fileName);
+    static bool isEnabled()
+    {
+        // Also read by worker threads, e.g. the one of the FontCache.
+#if QT_VERSION >= 0x050000
+        return enabled.loadAcquire() != 0;
+#else
+        return enabled.fetchAndAddAcquire(0) != 0;
+#endif
+    }
+
+    static void begin(const char *name);
+    static void end(const char *name);
+    static void instant(const char *name);
+
+    static bool finish();
+
+private:
+    static QAtomicInt enabled;
+}; // end of class GOW::StartupTracer
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name) :
+        m_name(StartupTracer::isEnabled() ? name : 0)
+    {
+        if (m_name) {
+            StartupTracer::begin(m_name);
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (m_name) {
+            StartupTracer::end(m_name);
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(TraceScope)
+    const char *m_name;
+}; // end of class GOW::TraceScope
+
+} // end of namespace GOW
+
+#define TRACE_CONCAT_(A, B) A##B
+#define TRACE_CONCAT(A, B) TRACE_CONCAT_(A, B)
+
+/*!
+  This macro records the rest of the enclosing scope as a startup phase
+  named \a NAME, which must be a string literal.
+ */
+#define TRACE_SCOPE(NAME) GOW::TraceScope TRACE_CONCAT(traceScope, __LINE__)(NAME)
+
+#endif // STARTUPTRACER_H
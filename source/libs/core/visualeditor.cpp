@@ -19,36 +19,226 @@
  *
  *-------------------------------------------------*/
 
+#include <QAbstractTextDocumentLayout>
+#include <QFile>
+#include <QHash>
+#include <QPainter>
+#include <QTextObjectInterface>
+#include <QUrl>
+
+#include "imagecache.h"
 #include "visualeditor.h"
 
 namespace GOW
 {
 
-class VisualEditor::Private : public QObject
+static const int PLACEHOLDER_SIZE = 32;
+static const QRgb PLACEHOLDER_FILL = 0xfff0f0f0;
+static const QRgb PLACEHOLDER_BORDER = 0xffc8c8c8;
+
+struct ImageEntry
+{
+    QByteArray data;
+    QString key;
+    QSize size;
+    QPixmap pixmap;
+};
+
+/*
+    The document of the visual editor. QTextDocument decodes every image
+    it loads at full size and keeps it that way; this one keeps images
+    encoded, as loaded, and leaves decoding to the ImageCache.
+ */
+class VisualDocument : public QTextDocument
+{
+public:
+    explicit VisualDocument(QObject *parent) : QTextDocument(parent) {}
+
+    void clear()
+    {
+        QTextDocument::clear();
+        images.clear();
+    }
+
+    /*
+        Returns the image \a name with the size read from its header. The
+        entry is renewed whenever the resource is replaced.
+     */
+    const ImageEntry &image(const QString &name)
+    {
+        const QVariant value = resource(QTextDocument::ImageResource, QUrl(name));
+        ImageEntry &entry = images[name];
+        if (value.type() == QVariant::ByteArray) {
+            const QByteArray data = value.toByteArray();
+            if (entry.key.isEmpty() || entry.data.constData() != data.constData()) {
+                entry.data = data;
+                entry.key = name + QLatin1Char('#') + QString::number(qHash(data), 16);
+                entry.size = ImageCache::imageSize(data);
+                entry.pixmap = QPixmap();
+            }
+        } else if (value.type() == QVariant::Pixmap || value.type() == QVariant::Image) {
+            // Added decoded already, there is nothing to save.
+            entry = ImageEntry();
+            entry.pixmap = value.type() == QVariant::Pixmap
+                    ? qvariant_cast<QPixmap>(value)
+                    : QPixmap::fromImage(qvariant_cast<QImage>(value));
+            entry.size = entry.pixmap.size();
+        } else {
+            entry = ImageEntry();
+        }
+        return entry;
+    }
+
+protected:
+    /*
+        Images are loaded as encoded data and added as resources, so they
+        are saved and published at full resolution.
+     */
+    QVariant loadResource(int type, const QUrl &name)
+    {
+        if (type != QTextDocument::ImageResource) {
+            return QTextDocument::loadResource(type, name);
+        }
+        QString fileName;
+        if (name.scheme() == QLatin1String("qrc")) {
+            fileName = QLatin1Char(':') + name.path();
+        } else if (name.scheme() == QLatin1String("file")) {
+            fileName = name.toLocalFile();
+        } else if (name.scheme().isEmpty()) {
+            fileName = name.path();
+        }
+        QFile file(fileName);
+        if (fileName.isEmpty() || !file.open(QIODevice::ReadOnly)) {
+            return QVariant();
+        }
+        const QByteArray data = file.readAll();
+        addResource(type, name, data);
+        return data;
+    }
+
+private:
+    QHash<QString, ImageEntry> images;
+};
+
+class VisualEditor::Private : public QObject, public QTextObjectInterface
 {
     Q_OBJECT
+    Q_INTERFACES(QTextObjectInterface)
 public:
     Private(VisualEditor *q_ptr) : QObject(q_ptr), q(q_ptr) {}
 
+    /*
+        Images are as large as given by their format or their header, but
+        never wider than the page.
+     */
+    QSizeF intrinsicSize(QTextDocument *doc, int, const QTextFormat &format)
+    {
+        const QTextImageFormat imageFormat = format.toImageFormat();
+        VisualDocument *document = dynamic_cast<VisualDocument *>(doc);
+        const QSize natural = document ? document->image(imageFormat.name()).size : QSize();
+        QSizeF size = natural.isEmpty() ? QSizeF(PLACEHOLDER_SIZE, PLACEHOLDER_SIZE) : QSizeF(natural);
+        const bool hasWidth = imageFormat.hasProperty(QTextFormat::ImageWidth) && imageFormat.width() > 0;
+        const bool hasHeight = imageFormat.hasProperty(QTextFormat::ImageHeight) && imageFormat.height() > 0;
+        if (hasWidth && hasHeight) {
+            size = QSizeF(imageFormat.width(), imageFormat.height());
+        } else if (hasWidth) {
+            size = QSizeF(imageFormat.width(), size.height() * imageFormat.width() / size.width());
+        } else if (hasHeight) {
+            size = QSizeF(size.width() * imageFormat.height() / size.height(), imageFormat.height());
+        }
+        const qreal maxWidth = doc->textWidth() - 2 * doc->documentMargin();
+        if (maxWidth > 0 && size.width() > maxWidth) {
+            size = QSizeF(maxWidth, size.height() * maxWidth / size.width());
+        }
+        return size;
+    }
+
+    /*
+        Draws the image at the size it is shown at, or a placeholder until
+        it has been decoded at that size.
+     */
+    void drawObject(QPainter *painter, const QRectF &rect, QTextDocument *doc, int,
+                    const QTextFormat &format)
+    {
+        VisualDocument *document = dynamic_cast<VisualDocument *>(doc);
+        QPixmap pixmap;
+        if (document) {
+            const ImageEntry &entry = document->image(format.toImageFormat().name());
+            pixmap = entry.pixmap;
+            if (pixmap.isNull() && !entry.data.isEmpty()) {
+                pixmap = ImageCache::instance()->pixmap(entry.key, entry.data,
+                                                        rect.toAlignedRect().size());
+            }
+        }
+        painter->save();
+        if (!pixmap.isNull()) {
+            painter->setRenderHint(QPainter::SmoothPixmapTransform, pixmap.size() != rect.size().toSize());
+            painter->drawPixmap(rect, pixmap, QRectF(pixmap.rect()));
+        } else {
+            painter->setPen(QColor(PLACEHOLDER_BORDER));
+            painter->setBrush(QColor(PLACEHOLDER_FILL));
+            painter->drawRect(rect.adjusted(0, 0, -1, -1));
+        }
+        painter->restore();
+    }
+
+    /*
+        The format is merged into the document once. QTextEdit's own
+        mergeCurrentCharFormat() would merge it into a selection a second
+        time, so it is only used to set the typing format.
+     */
     void mergeFormatOnWordOrSelection(const QTextCharFormat &format)
     {
         QTextCursor cursor = q->textCursor();
-        if (!cursor.hasSelection()) {
-            cursor.select(QTextCursor::WordUnderCursor);
+        if (cursor.hasSelection()) {
+            cursor.mergeCharFormat(format);
+            return;
+        }
+        cursor.select(QTextCursor::WordUnderCursor);
+        if (cursor.hasSelection()) {
+            cursor.mergeCharFormat(format);
         }
-        cursor.mergeCharFormat(format);
         q->mergeCurrentCharFormat(format);
     }
 
+    static Qt::Alignment alignmentFlags(TextAlignment alignment)
+    {
+        switch (alignment) {
+        case AlignCenter:
+            return Qt::AlignHCenter;
+        case AlignLeft:
+            return Qt::AlignLeft | Qt::AlignAbsolute;
+        case AlignRight:
+            return Qt::AlignRight | Qt::AlignAbsolute;
+        case AlignJustify:
+        default:
+            return Qt::AlignJustify;
+        }
+    }
+
 private:
     Q_POINTER(VisualEditor)
 }; // end of class GOW::VisualEditor::Private
 
 
+/*!
+  \class GOW::VisualEditor
+
+  The WYSIWYG editor of a post.
+
+  Images are drawn by the editor itself: they are laid out with the size
+  from their header and decoded asynchronously at the size they are shown
+  at, see ImageCache. Until then a placeholder is drawn. The document
+  keeps the encoded images only.
+ */
+
 VisualEditor::VisualEditor(QWidget *parent) :
     QTextEdit(parent), d(this)
 {
-
+    VisualDocument *document = new VisualDocument(this);
+    setDocument(document);
+    document->documentLayout()->registerHandler(QTextFormat::ImageObject, d.get());
+    connect(ImageCache::instance(), SIGNAL(imageReady(QString)), viewport(), SLOT(update()));
 }
 
 VisualEditor::~VisualEditor()
@@ -57,64 +247,84 @@ VisualEditor::~VisualEditor()
 
 void VisualEditor::textBold(bool bold)
 {
-    QTextCharFormat fmt;
-    fmt.setFontWeight(bold ? QFont::Bold : QFont::Normal);
-    d->mergeFormatOnWordOrSelection(fmt);
+    applyFormat(FormatChanges().setBold(bold));
 }
 
 void VisualEditor::textItalic(bool italic)
 {
-    QTextCharFormat fmt;
-    fmt.setFontItalic(italic);
-    d->mergeFormatOnWordOrSelection(fmt);
+    applyFormat(FormatChanges().setItalic(italic));
 }
 
 void VisualEditor::textUnderline(bool underline)
 {
-    QTextCharFormat fmt;
-    fmt.setFontUnderline(underline);
-    d->mergeFormatOnWordOrSelection(fmt);
+    applyFormat(FormatChanges().setUnderline(underline));
 }
 
 void VisualEditor::textStrikeOut(bool strike)
 {
-    QTextCharFormat fmt;
-    fmt.setFontStrikeOut(strike);
-    d->mergeFormatOnWordOrSelection(fmt);
+    applyFormat(FormatChanges().setStrikeOut(strike));
 }
 
 void VisualEditor::textAlign(TextAlignment alignment)
 {
-    switch (alignment) {
-    case AlignCenter:
-        setAlignment(Qt::AlignHCenter);
-        break;
-    case AlignJustify:
-        setAlignment(Qt::AlignJustify);
-        break;
-    case AlignLeft:
-        setAlignment(Qt::AlignLeft | Qt::AlignAbsolute);
-        break;
-    case AlignRight:
-        setAlignment(Qt::AlignRight | Qt::AlignAbsolute);
-        break;
-    }
+    setAlignment(Private::alignmentFlags(alignment));
 }
 
 void VisualEditor::textFontFamily(const QString &family)
 {
-    QTextCharFormat fmt;
-    fmt.setFontFamily(family);
-    d->mergeFormatOnWordOrSelection(fmt);
+    applyFormat(FormatChanges().setFontFamily(family));
 }
 
 void VisualEditor::textFontSize(int size)
 {
     if (size > 0) {
-        QTextCharFormat fmt;
-        fmt.setFontPointSize(size);
+        applyFormat(FormatChanges().setFontSize(size));
+    }
+}
+
+/*!
+  Applies \a changes in one edit block. All character attributes are
+  merged as one format in a single pass over the selection, so there is
+  one undo step and one layout invalidation regardless of how many
+  attributes change.
+ */
+void VisualEditor::applyFormat(const FormatChanges &changes)
+{
+    if (changes.isEmpty()) {
+        return;
+    }
+
+    QTextCharFormat fmt;
+    if (changes.has(FormatChanges::Bold)) {
+        fmt.setFontWeight(changes.bold() ? QFont::Bold : QFont::Normal);
+    }
+    if (changes.has(FormatChanges::Italic)) {
+        fmt.setFontItalic(changes.italic());
+    }
+    if (changes.has(FormatChanges::Underline)) {
+        fmt.setFontUnderline(changes.underline());
+    }
+    if (changes.has(FormatChanges::StrikeOut)) {
+        fmt.setFontStrikeOut(changes.strikeOut());
+    }
+    if (changes.has(FormatChanges::FontFamily)) {
+        fmt.setFontFamily(changes.fontFamily());
+    }
+    if (changes.has(FormatChanges::FontSize) && changes.fontSize() > 0) {
+        fmt.setFontPointSize(changes.fontSize());
+    }
+
+    QTextCursor cursor = textCursor();
+    cursor.beginEditBlock();
+    if (!fmt.properties().isEmpty()) {
         d->mergeFormatOnWordOrSelection(fmt);
     }
+    if (changes.has(FormatChanges::Alignment)) {
+        QTextBlockFormat blockFormat;
+        blockFormat.setAlignment(Private::alignmentFlags(changes.alignment()));
+        cursor.mergeBlockFormat(blockFormat);
+    }
+    cursor.endEditBlock();
 }
 
 }
@@ -26,11 +26,12 @@
 
 #include <DPointer>
 #include <Editor>
+#include <Global>
 
 namespace GOW
 {
 
-class VisualEditor : public QTextEdit, public Editor
+class LIBRARY_EXPORT VisualEditor : public QTextEdit, public Editor
 {
     Q_OBJECT
 public:
@@ -49,6 +50,8 @@ public slots:
     void textFontFamily(const QString &family);
     void textFontSize(int size);
 
+    void applyFormat(const FormatChanges &changes);
+
 private:
     D_POINTER
 }; // end of class GOW::VisualEditor
@@ -0,0 +1,477 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QApplication>
+#include <QBuffer>
+#include <QDir>
+#include <QEvent>
+#include <QFutureWatcher>
+#include <QMutex>
+#include <QPointer>
+#include <QSettings>
+#include <QTextDocument>
+#include <QTimer>
+#include <QtConcurrentRun>
+#if QT_VERSION >= 0x050000
+#include <QStandardPaths>
+#else
+#include <QDesktopServices>
+#endif
+
+#include <BlogClient>
+#include <BlogSync>
+#include <DraftFormat>
+#include <DraftLibrary>
+#include <Outbox>
+#include <SearchIndex>
+
+#include "autosavejournal.h"
+#include "mainwindow.h"
+#include "startuptracer.h"
+#include "windowmanager.h"
+
+namespace GOW
+{
+
+static const int SPARE_WINDOW_DELAY = 2000;
+static const int INDEX_BATCH_SIZE = 16;
+
+static const char * const BLOG_SETTINGS_GROUP = "Blog";
+
+static QString dataLocation()
+{
+#if QT_VERSION >= 0x050000
+    return QStandardPaths::writableLocation(QStandardPaths::DataLocation);
+#else
+    return QDesktopServices::storageLocation(QDesktopServices::DataLocation);
+#endif
+}
+
+struct IndexRequest
+{
+    IndexRequest() : id(0) {}
+
+    quint32 id;
+    QString title;
+    QString text;
+};
+
+/*
+    Runs on a worker thread, which reads the drafts as well. The text is
+    what MainWindow indexes when it saves a draft.
+ */
+static QList<IndexRequest> extractTexts(DraftReader reader, QList<IndexRequest> requests)
+{
+    for (int i = 0; i < requests.size(); ++i) {
+        IndexRequest &request = requests[i];
+        QByteArray data = reader.draftData(request.id);
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+        QTextDocument document;
+        if (DraftFormat::read(&buffer, &document, 0)) {
+            request.text = request.title + QLatin1Char('\n') + document.toPlainText();
+        }
+    }
+    return requests;
+}
+
+class WindowManager::Private : public QObject
+{
+    Q_OBJECT
+    Q_POINTER(WindowManager)
+public:
+    Private(WindowManager *q_ptr);
+
+    bool eventFilter(QObject *watched, QEvent *event);
+
+    QList<MainWindow *> windows;
+    QPointer<MainWindow> spareWindow;
+    DraftLibrary library;
+    SearchIndex searchIndex;
+    BlogClient blogClient;
+    Outbox outbox;
+    BlogSync blogSync;
+    bool resident;
+
+    QVector<quint32> unindexed;
+    QFutureWatcher<QList<IndexRequest> > indexWatcher;
+
+public slots:
+    void prepareSpareWindow();
+    void windowDestroyed(QObject *window);
+    void startIndexing();
+    void indexNextDrafts();
+    void draftsIndexed();
+}; // end of class GOW::WindowManager::Private
+
+WindowManager::Private::Private(WindowManager *q_ptr) :
+    QObject(q_ptr),
+    q(q_ptr),
+    outbox(&blogClient),
+    blogSync(&blogClient, &library),
+    resident(false)
+{
+    connect(&outbox, SIGNAL(postLinked(quint32,QString)), &blogSync, SLOT(linkDraft(quint32,QString)));
+    connect(&blogSync, SIGNAL(draftsChanged(QList<quint32>)), q, SIGNAL(draftsChanged(QList<quint32>)));
+    connect(&indexWatcher, SIGNAL(finished()), this, SLOT(draftsIndexed()));
+}
+
+/*
+    Builds the next window ahead of time while nothing else happens, so
+    the next launch only has to show it.
+ */
+void WindowManager::Private::prepareSpareWindow()
+{
+    if (!resident || spareWindow) {
+        return;
+    }
+    spareWindow = new MainWindow;
+    spareWindow->setAttribute(Qt::WA_DeleteOnClose);
+}
+
+void WindowManager::Private::windowDestroyed(QObject *window)
+{
+    for (int i = windows.count() - 1; i >= 0; --i) {
+        if (static_cast<QObject *>(windows.at(i)) == window) {
+            windows.removeAt(i);
+        }
+    }
+}
+
+/*
+    Drafts saved before the search index existed, or while it could not be
+    opened, are indexed now, a few at a time and decoded on a worker
+    thread. Until then the library finds them by their titles only.
+ */
+void WindowManager::Private::startIndexing()
+{
+    if (!searchIndex.isOpen() || !q->library()->isOpen()) {
+        return;
+    }
+    unindexed.clear();
+    foreach (quint32 id, library.draftIds(DraftLibrary::ByModified)) {
+        if (!searchIndex.contains(id)) {
+            unindexed << id;
+        }
+    }
+    indexNextDrafts();
+}
+
+void WindowManager::Private::indexNextDrafts()
+{
+    if (indexWatcher.isRunning() || unindexed.isEmpty()) {
+        return;
+    }
+    QList<IndexRequest> requests;
+    QList<quint32> ids;
+    while (!unindexed.isEmpty() && requests.size() < INDEX_BATCH_SIZE) {
+        IndexRequest request;
+        request.id = unindexed.first();
+        unindexed.remove(0);
+        request.title = library.draft(request.id).title;
+        requests << request;
+        ids << request.id;
+    }
+    indexWatcher.setFuture(QtConcurrent::run(extractTexts, library.beginRead(ids), requests));
+}
+
+void WindowManager::Private::draftsIndexed()
+{
+    library.endRead();
+    bool changed = false;
+    foreach (const IndexRequest &request, indexWatcher.result()) {
+        // Saved and indexed meanwhile, or removed; nothing to add then.
+        if (!request.text.isEmpty() && !searchIndex.contains(request.id)
+                && library.draft(request.id).id != 0) {
+            searchIndex.update(request.id, request.text);
+            changed = true;
+        }
+    }
+    if (changed && searchIndex.commit()) {
+        emit q->searchIndexChanged();
+    }
+    QTimer::singleShot(0, this, SLOT(indexNextDrafts()));
+}
+
+bool WindowManager::Private::eventFilter(QObject *watched, QEvent *event)
+{
+    if (event->type() == QEvent::Paint) {
+        StartupTracer::instant("window painted");
+        watched->removeEventFilter(this);
+        emit q->windowPainted();
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+/*!
+  \class GOW::WindowManager
+
+  Keeps track of all main windows of the process.
+
+  In resident mode the process stays alive after its last window has been
+  closed. A later launch only asks the running process for a new window,
+  which starts without initializing Qt, the fonts or the core library
+  again and shares the font, glyph and icon caches with all other windows.
+  To make that even faster, the next window is built while the process is
+  idle and shown when it is asked for.
+ */
+
+GET_INSTANCE(WindowManager)
+
+WindowManager::WindowManager() :
+    QObject(0),
+    d(this)
+{
+}
+
+WindowManager::~WindowManager()
+{
+}
+
+/*!
+  Sets whether the process stays alive after the last window has been
+  closed to \a resident.
+ */
+void WindowManager::setResident(bool resident)
+{
+    d->resident = resident;
+    qApp->setQuitOnLastWindowClosed(!resident);
+    if (!resident && d->spareWindow) {
+        delete d->spareWindow;
+    }
+}
+
+/*!
+  Returns true if the process stays alive after the last window has been
+  closed.
+ */
+bool WindowManager::isResident() const
+{
+    return d->resident;
+}
+
+/*!
+  Returns all open windows, oldest first.
+ */
+QList<MainWindow *> WindowManager::windows() const
+{
+    return d->windows;
+}
+
+/*!
+  Returns the draft library shared by all windows. It is opened on first
+  use; if that fails, it is tried again on the next call.
+ */
+DraftLibrary *WindowManager::library()
+{
+    if (!d->library.isOpen()) {
+        const QString dir = dataLocation();
+        QDir().mkpath(dir);
+        d->library.open(dir + QLatin1String("/drafts.owl"));
+    }
+    return &d->library;
+}
+
+/*!
+  Returns the full-text index of the draft library, opened on first use.
+  Drafts which are not in the index yet are added in the background then,
+  and searchIndexChanged() is emitted as they are.
+ */
+SearchIndex *WindowManager::searchIndex()
+{
+    if (!d->searchIndex.isOpen()) {
+        const QString dir = dataLocation();
+        QDir().mkpath(dir);
+        if (d->searchIndex.open(dir + QLatin1String("/search"))) {
+            QTimer::singleShot(0, d.get(), SLOT(startIndexing()));
+        }
+    }
+    return &d->searchIndex;
+}
+
+/*!
+  Tells all windows that draft \a id of the library was saved or removed.
+ */
+void WindowManager::notifyDraftChanged(quint32 id)
+{
+    emit draftChanged(id);
+}
+
+/*!
+  Returns the outbox of posts waiting to be published, which is kept next
+  to the draft library. It is opened on first use and from then on sends
+  its posts in the background.
+ */
+Outbox *WindowManager::outbox()
+{
+    if (!d->outbox.isOpen()) {
+        d->blogClient.setAccount(blogAccount());
+        d->outbox.open(dataLocation() + QLatin1String("/outbox"), dataLocation() + QLatin1String("/media"));
+    }
+    return &d->outbox;
+}
+
+/*!
+  Returns the blog account posts are published to. Unless the password is
+  remembered, it is the one entered in this session, if any.
+ */
+BlogAccount WindowManager::blogAccount() const
+{
+    QSettings settings;
+    settings.beginGroup(QLatin1String(BLOG_SETTINGS_GROUP));
+    BlogAccount account;
+    account.endpoint = settings.value(QLatin1String("endpoint")).toUrl();
+    account.blogId = settings.value(QLatin1String("blogId")).toString();
+    account.userName = settings.value(QLatin1String("userName")).toString();
+    // Passwords saved before this was a choice stay remembered.
+    account.rememberPassword = settings.value(QLatin1String("rememberPassword"),
+                                              settings.contains(QLatin1String("password"))).toBool();
+    account.password = account.rememberPassword ? settings.value(QLatin1String("password")).toString()
+                                                : d->blogClient.account().password;
+    return account;
+}
+
+/*!
+  Sets the blog \a account posts are published to, including those
+  already in the outbox.
+
+  The password is only written to the settings if the account asks to
+  remember it. The settings are not encrypted, so it is then stored in
+  clear text; otherwise it is kept in memory until the application quits.
+ */
+void WindowManager::setBlogAccount(const BlogAccount &account)
+{
+    QSettings settings;
+    settings.beginGroup(QLatin1String(BLOG_SETTINGS_GROUP));
+    settings.setValue(QLatin1String("endpoint"), account.endpoint);
+    settings.setValue(QLatin1String("blogId"), account.blogId);
+    settings.setValue(QLatin1String("userName"), account.userName);
+    settings.setValue(QLatin1String("rememberPassword"), account.rememberPassword);
+    if (account.rememberPassword) {
+        settings.setValue(QLatin1String("password"), account.password);
+    } else {
+        settings.remove(QLatin1String("password"));
+    }
+    d->blogClient.setAccount(account);
+}
+
+/*!
+  Returns the sync which brings posts changed on the blog into the draft
+  library. Its cache is opened on first use; posts published through the
+  outbox are taken as matching their drafts.
+ */
+BlogSync *WindowManager::blogSync()
+{
+    if (!d->blogSync.isOpen()) {
+        library();
+        d->blogSync.setSearchIndex(searchIndex());
+        d->blogSync.setKnownPosts(outbox()->remotePosts());
+        d->blogSync.open(dataLocation() + QLatin1String("/sync.cache"));
+    }
+    return &d->blogSync;
+}
+
+/*!
+  Shows a new main window and brings it to the front. The window is
+  deleted when it is closed.
+ */
+MainWindow *WindowManager::openWindow()
+{
+    MainWindow *window = d->spareWindow;
+    d->spareWindow = 0;
+    if (!window) {
+        TRACE_SCOPE("MainWindow");
+        window = new MainWindow;
+        window->setAttribute(Qt::WA_DeleteOnClose);
+    }
+    d->windows << window;
+    connect(window, SIGNAL(destroyed(QObject*)), d.get(), SLOT(windowDestroyed(QObject*)));
+    window->installEventFilter(d.get());
+    {
+        TRACE_SCOPE("showMaximized");
+        window->showMaximized();
+    }
+    window->raise();
+    window->activateWindow();
+    if (d->resident) {
+        QTimer::singleShot(SPARE_WINDOW_DELAY, d.get(), SLOT(prepareSpareWindow()));
+    }
+    return window;
+}
+
+/*!
+  Opens a new window for each of the \a files, or a single empty window
+  if \a files is empty. A window whose file cannot be read stays open
+  with an empty post.
+ */
+void WindowManager::openFiles(const QStringList &files)
+{
+    if (files.isEmpty()) {
+        openWindow();
+        return;
+    }
+    foreach (const QString &file, files) {
+        openWindow()->openFile(file);
+    }
+}
+
+/*!
+  Opens a new window showing the UTF-8 encoded \a html as an unsaved
+  post.
+ */
+void WindowManager::openHtml(const QByteArray &html)
+{
+    openWindow()->openHtml(html);
+}
+
+/*!
+  Opens a window for each post whose autosave journal was left behind by
+  a crash and replays the journal into it.
+ */
+void WindowManager::recoverSessions()
+{
+    foreach (const QString &session, AutosaveJournal::pendingSessions()) {
+        MainWindow *window = openWindow();
+        if (!window->recoverSession(session)) {
+            window->close();
+            AutosaveJournal::removeSession(session);
+        }
+    }
+}
+
+/*!
+  Closes all windows and quits, even in resident mode. Nothing happens if
+  a window refuses to close.
+ */
+void WindowManager::quit()
+{
+    foreach (MainWindow *window, d->windows) {
+        if (!window->close()) {
+            return;
+        }
+    }
+    delete d->spareWindow;
+    QCoreApplication::quit();
+}
+
+}
+
+#include "windowmanager.moc"
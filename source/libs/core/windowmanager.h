@@ -0,0 +1,84 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef WINDOWMANAGER_H
+#define WINDOWMANAGER_H
+
+#include <QList>
+#include <QObject>
+#include <QStringList>
+
+#include <DPointer>
+#include <Global>
+
+namespace GOW
+{
+
+struct BlogAccount;
+class BlogSync;
+class DraftLibrary;
+class Outbox;
+class SearchIndex;
+class MainWindow;
+
+class LIBRARY_EXPORT WindowManager : public QObject
+{
+    Q_OBJECT
+    DECLARE_SINGLETON(WindowManager)
+public:
+    ~WindowManager();
+
+    void setResident(bool resident);
+    bool isResident() const;
+
+    QList<MainWindow *> windows() const;
+
+    DraftLibrary *library();
+    SearchIndex *searchIndex();
+    void notifyDraftChanged(quint32 id);
+
+    Outbox *outbox();
+    BlogAccount blogAccount() const;
+    void setBlogAccount(const BlogAccount &account);
+    BlogSync *blogSync();
+
+signals:
+    void draftChanged(quint32 id);
+    void draftsChanged(const QList<quint32> &ids);
+    void searchIndexChanged();
+    void windowPainted();
+
+public slots:
+    MainWindow *openWindow();
+    void openFiles(const QStringList &files);
+    void openHtml(const QByteArray &html);
+    void recoverSessions();
+    void quit();
+
+private:
+    WindowManager();
+
+    D_POINTER
+}; // end of class GOW::WindowManager
+
+} // end of namespace GOW
+
+#endif // WINDOWMANAGER_H
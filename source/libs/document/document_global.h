@@ -0,0 +1,36 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef DOCUMENT_GLOBAL_H
+#define DOCUMENT_GLOBAL_H
+
+#include <QtGlobal>
+
+/*!
+  This macro can be used to expose classes within the document library.
+ */
+#ifdef DOCUMENT_LIBRARY
+#define DOCUMENT_EXPORT Q_DECL_EXPORT
+#else
+#define DOCUMENT_EXPORT Q_DECL_IMPORT
+#endif
+
+#endif // DOCUMENT_GLOBAL_H
@@ -0,0 +1,368 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QHash>
+#include <QImage>
+#include <QPair>
+#include <QPixmap>
+#include <QStringList>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextList>
+#include <QUrl>
+#include <QVariant>
+#include <QVector>
+
+#include "draftformat.h"
+
+namespace GOW
+{
+
+static const quint32 DRAFT_MAGIC = 0x4f574452; // "OWDR"
+static const quint32 DRAFT_VERSION = 1;
+static const quint32 COMPRESSED_CHUNKS = 0x1;
+static const int CHUNK_SIZE = 128 * 1024;
+static const QDataStream::Version STREAM_VERSION = QDataStream::Qt_4_8;
+
+typedef QPair<QString, QByteArray> Resource;
+typedef QPair<quint32, QByteArray> Chunk;
+
+/*
+    Collects the formats used by a document into a table without
+    duplicates. The format collection of the document holds formats
+    nobody uses any more, and its block formats are tied to list objects
+    by their object index, which means nothing outside the document.
+ */
+class FormatTable
+{
+public:
+    explicit FormatTable(const QTextDocument *document) :
+        documentFormats(document->allFormats()),
+        indices(documentFormats.size(), -1)
+    {
+    }
+
+    quint32 add(int documentIndex)
+    {
+        int &index = indices[documentIndex];
+        if (index < 0) {
+            QTextFormat format = documentFormats.at(documentIndex);
+            format.clearProperty(QTextFormat::ObjectIndex);
+            QByteArray key;
+            QDataStream ds(&key, QIODevice::WriteOnly);
+            ds.setVersion(STREAM_VERSION);
+            ds << format;
+            index = keys.value(key, -1);
+            if (index < 0) {
+                index = formats.size();
+                keys.insert(key, index);
+                formats << format;
+            }
+        }
+        return index;
+    }
+
+    QVector<QTextFormat> formats;
+
+private:
+    QVector<QTextFormat> documentFormats;
+    QVector<int> indices;
+    QHash<QByteArray, int> keys;
+};
+
+static bool fail(QString *errorString, const char *message)
+{
+    if (errorString) {
+        *errorString = QCoreApplication::translate("GOW::DraftFormat", message);
+    }
+    return false;
+}
+
+/*!
+  \class GOW::DraftFormat
+
+  Reads and writes drafts in the binary draft format.
+
+  The format stores a QTextDocument as it is instead of as HTML which has
+  to be parsed again on every load. After a versioned header and the
+  title, a draft holds a table of all char, block and list formats used
+  without duplicates, the list objects by their format, the images as
+  encoded bytes and finally the blocks. Each block refers to its formats
+  and its list by index, and carries its text as UTF-16 followed by the
+  runs of equally formatted text as length and format index. Blocks are
+  grouped into chunks of about 128 KB, which are compressed one by one if
+  Compress is set.
+
+  Only the text flow is kept; tables and frames are not supported since
+  the editor does not create them.
+ */
+
+/*!
+  Writes \a document with \a title to \a device. Returns false and sets
+  \a errorString if that fails.
+ */
+bool DraftFormat::write(QIODevice *device, const QTextDocument *document, const QString &title,
+                        Options options, QString *errorString)
+{
+    FormatTable formats(document);
+    QHash<QTextList *, qint32> lists;
+    QVector<quint32> listFormats;
+    QStringList imageNames;
+    QList<Chunk> chunks;
+
+    QBuffer chunk;
+    chunk.open(QIODevice::WriteOnly);
+    QDataStream cs(&chunk);
+    cs.setVersion(STREAM_VERSION);
+    quint32 chunkBlocks = 0;
+    QVector<quint32> runs;
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        qint32 listId = -1;
+        QTextList *list = block.textList();
+        if (list) {
+            listId = lists.value(list, -1);
+            if (listId < 0) {
+                listId = listFormats.size();
+                lists.insert(list, listId);
+                listFormats << formats.add(list->formatIndex());
+            }
+        }
+        runs.clear();
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment fragment = it.fragment();
+            runs << quint32(fragment.length()) << formats.add(fragment.charFormatIndex());
+            const QTextCharFormat format = fragment.charFormat();
+            if (format.isImageFormat() && !imageNames.contains(format.toImageFormat().name())) {
+                imageNames << format.toImageFormat().name();
+            }
+        }
+
+        cs << formats.add(block.blockFormatIndex()) << formats.add(block.charFormatIndex())
+           << listId << block.text() << quint32(runs.size() / 2);
+        for (int i = 0; i < runs.size(); ++i) {
+            cs << runs.at(i);
+        }
+        ++chunkBlocks;
+        if (chunk.size() >= CHUNK_SIZE || !block.next().isValid()) {
+            chunks << Chunk(chunkBlocks, options & Compress ? qCompress(chunk.data()) : chunk.data());
+            chunk.seek(0);
+            chunk.buffer().clear();
+            chunkBlocks = 0;
+        }
+    }
+
+    QList<Resource> resources;
+    foreach (const QString &name, imageNames) {
+        const QByteArray data = imageData(document, name);
+        if (!data.isEmpty()) {
+            resources << Resource(name, data);
+        }
+    }
+
+    QDataStream ds(device);
+    ds.setVersion(STREAM_VERSION);
+    ds << DRAFT_MAGIC << DRAFT_VERSION << quint32(options & Compress ? COMPRESSED_CHUNKS : 0) << title;
+    ds << quint32(formats.formats.size());
+    foreach (const QTextFormat &format, formats.formats) {
+        ds << format;
+    }
+    ds << quint32(listFormats.size());
+    foreach (quint32 format, listFormats) {
+        ds << format;
+    }
+    ds << quint32(resources.size());
+    foreach (const Resource &resource, resources) {
+        ds << resource.first << resource.second;
+    }
+    ds << quint32(chunks.size());
+    foreach (const Chunk &entry, chunks) {
+        ds << entry.first << entry.second;
+    }
+    if (ds.status() != QDataStream::Ok) {
+        return fail(errorString, "Cannot write the draft.");
+    }
+    return true;
+}
+
+/*!
+  Replaces the content of \a document with the draft read from \a device
+  and stores its title in \a title. The whole load is a single edit, so
+  the document reports it as one change and is not undoable. Returns false
+  and sets \a errorString if the draft cannot be read; \a document is
+  empty then.
+ */
+bool DraftFormat::read(QIODevice *device, QTextDocument *document, QString *title,
+                       QString *errorString)
+{
+    QDataStream ds(device);
+    ds.setVersion(STREAM_VERSION);
+    quint32 magic = 0;
+    quint32 version = 0;
+    ds >> magic >> version;
+    if (magic != DRAFT_MAGIC) {
+        return fail(errorString, "The file is not a draft.");
+    }
+    if (version > DRAFT_VERSION) {
+        return fail(errorString, "The draft was written by a newer version.");
+    }
+
+    quint32 flags = 0;
+    QString draftTitle;
+    ds >> flags >> draftTitle;
+    quint32 count = 0;
+    ds >> count;
+    QVector<QTextFormat> formats;
+    for (quint32 i = 0; i < count && ds.status() == QDataStream::Ok; ++i) {
+        QTextFormat format;
+        ds >> format;
+        formats << format;
+    }
+    ds >> count;
+    QVector<quint32> listFormats;
+    for (quint32 i = 0; i < count && ds.status() == QDataStream::Ok; ++i) {
+        quint32 format = 0;
+        ds >> format;
+        listFormats << (format < quint32(formats.size()) ? format : 0);
+    }
+    ds >> count;
+    QList<Resource> resources;
+    for (quint32 i = 0; i < count && ds.status() == QDataStream::Ok; ++i) {
+        Resource resource;
+        ds >> resource.first >> resource.second;
+        resources << resource;
+    }
+    if (ds.status() != QDataStream::Ok || formats.isEmpty()) {
+        return fail(errorString, "The draft is damaged.");
+    }
+
+    const bool undoRedo = document->isUndoRedoEnabled();
+    document->setUndoRedoEnabled(false);
+    document->clear();
+    foreach (const Resource &resource, resources) {
+        // Decoded when the image is shown first.
+        document->addResource(QTextDocument::ImageResource, QUrl(resource.first), resource.second);
+    }
+
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+    QVector<QTextList *> lists(listFormats.size(), 0);
+    const quint32 formatCount = formats.size();
+    bool firstBlock = true;
+    bool ok = true;
+    quint32 chunkCount = 0;
+    ds >> chunkCount;
+    for (quint32 c = 0; ok && c < chunkCount; ++c) {
+        quint32 blockCount = 0;
+        QByteArray data;
+        ds >> blockCount >> data;
+        if (flags & COMPRESSED_CHUNKS) {
+            data = qUncompress(data);
+        }
+        QDataStream cs(data);
+        cs.setVersion(STREAM_VERSION);
+        for (quint32 b = 0; ok && b < blockCount; ++b) {
+            quint32 blockFormat = 0;
+            quint32 charFormat = 0;
+            qint32 listId = -1;
+            QString text;
+            quint32 runCount = 0;
+            cs >> blockFormat >> charFormat >> listId >> text >> runCount;
+            if (cs.status() != QDataStream::Ok || blockFormat >= formatCount || charFormat >= formatCount) {
+                ok = false;
+                break;
+            }
+            if (firstBlock) {
+                cursor.setBlockFormat(formats.at(blockFormat).toBlockFormat());
+                cursor.setBlockCharFormat(formats.at(charFormat).toCharFormat());
+                firstBlock = false;
+            } else {
+                cursor.insertBlock(formats.at(blockFormat).toBlockFormat(),
+                                   formats.at(charFormat).toCharFormat());
+            }
+            if (listId >= 0 && listId < lists.size()) {
+                if (lists.at(listId)) {
+                    lists.at(listId)->add(cursor.block());
+                } else {
+                    lists[listId] = cursor.createList(formats.at(listFormats.at(listId)).toListFormat());
+                }
+            }
+            int position = 0;
+            for (quint32 r = 0; r < runCount; ++r) {
+                quint32 length = 0;
+                quint32 format = 0;
+                cs >> length >> format;
+                if (cs.status() != QDataStream::Ok || format >= formatCount
+                        || length > quint32(text.length() - position)) {
+                    ok = false;
+                    break;
+                }
+                cursor.insertText(text.mid(position, length), formats.at(format).toCharFormat());
+                position += length;
+            }
+        }
+    }
+    cursor.endEditBlock();
+    ok = ok && ds.status() == QDataStream::Ok;
+    if (!ok) {
+        document->clear();
+    }
+    document->setUndoRedoEnabled(undoRedo);
+    document->setModified(false);
+    if (!ok) {
+        return fail(errorString, "The draft is damaged.");
+    }
+    if (title) {
+        *title = draftTitle;
+    }
+    return true;
+}
+
+/*!
+  Returns the encoded image \a name of \a document, or an empty array if
+  the document cannot load it. Images which are only there decoded are
+  encoded as PNG.
+ */
+QByteArray DraftFormat::imageData(const QTextDocument *document, const QString &name)
+{
+    const QVariant resource = document->resource(QTextDocument::ImageResource, QUrl(name));
+    if (resource.type() == QVariant::ByteArray) {
+        return resource.toByteArray();
+    }
+    QImage image;
+    if (resource.type() == QVariant::Image) {
+        image = qvariant_cast<QImage>(resource);
+    } else if (resource.type() == QVariant::Pixmap) {
+        image = qvariant_cast<QPixmap>(resource).toImage();
+    }
+    QByteArray data;
+    if (!image.isNull()) {
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, "PNG");
+    }
+    return data;
+}
+
+}
@@ -0,0 +1,59 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef DRAFTFORMAT_H
+#define DRAFTFORMAT_H
+
+#include <QByteArray>
+#include <QString>
+
+#include "document_global.h"
+
+QT_FORWARD_DECLARE_CLASS(QIODevice)
+QT_FORWARD_DECLARE_CLASS(QTextDocument)
+
+namespace GOW
+{
+
+class DOCUMENT_EXPORT DraftFormat
+{
+public:
+    enum Option {
+        NoOptions = 0x0,
+        Compress = 0x1
+    };
+    Q_DECLARE_FLAGS(Options, Option)
+
+    static const char *suffix() { return "owd"; }
+
+    static bool write(QIODevice *device, const QTextDocument *document, const QString &title,
+                      Options options = NoOptions, QString *errorString = 0);
+    static bool read(QIODevice *device, QTextDocument *document, QString *title,
+                     QString *errorString = 0);
+
+    static QByteArray imageData(const QTextDocument *document, const QString &name);
+}; // end of class GOW::DraftFormat
+
+} // end of namespace GOW
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(GOW::DraftFormat::Options)
+
+#endif // DRAFTFORMAT_H
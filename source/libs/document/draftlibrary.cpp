@@ -0,0 +1,935 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QBitArray>
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QFileInfo>
+#include <QTextDocument>
+
+#include <algorithm>
+
+#if defined(Q_OS_UNIX)
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <io.h>
+#endif
+
+#include "draftformat.h"
+#include "draftlibrary.h"
+
+namespace GOW
+{
+
+static const quint32 LIBRARY_MAGIC = 0x4f574c42; // "OWLB"
+static const quint32 LIBRARY_VERSION = 2;
+static const quint32 PAGE_SIZE = 4096;
+static const int HEADER_SLOT_SIZE = 2048;
+static const quint32 ENTRIES_PER_CHUNK = 512;
+static const QDataStream::Version STREAM_VERSION = QDataStream::Qt_4_8;
+
+static QString libraryTr(const char *text)
+{
+    return QCoreApplication::translate("GOW::DraftLibrary", text);
+}
+
+/*
+    Makes everything written so far durable, so a header written after it
+    never points at pages which did not make it to disk.
+ */
+static bool syncFile(QFile *file)
+{
+    if (!file->flush()) {
+        return false;
+    }
+#if defined(Q_OS_UNIX)
+    return ::fsync(file->handle()) == 0;
+#elif defined(Q_OS_WIN)
+    return ::_commit(file->handle()) == 0;
+#else
+    return true;
+#endif
+}
+
+struct TitleLess
+{
+    explicit TitleLess(const QMap<quint32, DraftInfo> *drafts) : drafts(drafts) {}
+
+    bool operator()(quint32 a, quint32 b) const
+    {
+        const int result = QString::compare(drafts->value(a).title, drafts->value(b).title,
+                                            Qt::CaseInsensitive);
+        return result < 0 || (result == 0 && a < b);
+    }
+
+    const QMap<quint32, DraftInfo> *drafts;
+};
+
+struct ModifiedLater
+{
+    explicit ModifiedLater(const QMap<quint32, DraftInfo> *drafts) : drafts(drafts) {}
+
+    bool operator()(quint32 a, quint32 b) const
+    {
+        const QDateTime first = drafts->value(a).modified;
+        const QDateTime second = drafts->value(b).modified;
+        return first > second || (first == second && a < b);
+    }
+
+    const QMap<quint32, DraftInfo> *drafts;
+};
+
+/*!
+  \class GOW::DraftReader
+
+  Reads drafts of a DraftLibrary without the library, for example on a
+  worker thread while the library is used by the GUI. Readers are made by
+  DraftLibrary::beginRead().
+ */
+
+/*!
+  Returns draft \a id in the binary draft format, or an empty array if it
+  is not one of ids() or cannot be read.
+ */
+QByteArray DraftReader::draftData(quint32 id) const
+{
+    if (!m_extents.contains(id)) {
+        return QByteArray();
+    }
+    const QPair<qint64, quint32> extent = m_extents.value(id);
+    QFile file(m_fileName);
+    QByteArray data(extent.second, Qt::Uninitialized);
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(extent.first)
+            || file.read(data.data(), extent.second) != qint64(extent.second)) {
+        return QByteArray();
+    }
+    return data;
+}
+
+/*!
+  \class GOW::DraftLibrary
+
+  Keeps any number of drafts in a single file.
+
+  The file is a sequence of 4 KB pages. The first page holds two header
+  slots; the valid one with the higher generation is the current header.
+  It points at the directory, which lists the index chunks, and each chunk
+  holds the entries of up to 512 drafts: title, modification time, tags,
+  the blog post the draft was imported from and the pages of the draft
+  itself in the binary draft format. Opening a library reads the index
+  only, never a draft. A file of an older version gets all of its index
+  rewritten with the first update.
+
+  Nothing which is in use is ever overwritten. Saving a draft writes it,
+  its index chunk and the directory to free pages, makes them durable and
+  only then writes the other header slot. A crash at any point leaves
+  either the old or the new state. Pages which are no longer referenced
+  after a commit are reused by later writes, except while a DraftReader
+  may still read them.
+
+  Drafts can be listed by title or modification time, and looked up by
+  tag; these orders are kept in memory and built on first use.
+
+  Many updates at once, like those of a sync with the blog, can be made
+  in a batch, which writes every touched index chunk once and commits
+  once at the end.
+ */
+
+DraftLibrary::Header::Header() :
+    version(LIBRARY_VERSION),
+    generation(0),
+    pageCount(1),
+    nextId(1)
+{
+}
+
+/*!
+  Constructs a library which is not open.
+ */
+DraftLibrary::DraftLibrary() :
+    m_activeSlot(0),
+    m_readers(0),
+    m_batch(false),
+    m_batchFailed(false)
+{
+}
+
+/*!
+  Destructs the library.
+ */
+DraftLibrary::~DraftLibrary()
+{
+}
+
+/*!
+  Opens the library \a fileName and reads its index. The file is created
+  if it does not exist. Returns false and sets errorString() on failure.
+ */
+bool DraftLibrary::open(const QString &fileName)
+{
+    close();
+    m_file.setFileName(fileName);
+    const bool exists = QFileInfo(fileName).size() > 0;
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        return fail(m_file.errorString());
+    }
+    if (!exists) {
+        m_header = Header();
+        m_activeSlot = 1;
+        if (m_file.write(QByteArray(PAGE_SIZE, 0)) != qint64(PAGE_SIZE) || !commit()) {
+            const QString error = m_file.errorString();
+            close();
+            return fail(error);
+        }
+    }
+    if (!readHeader() || !readIndex()) {
+        const QString error = m_errorString;
+        close();
+        return fail(error);
+    }
+    return true;
+}
+
+/*!
+  Closes the library.
+ */
+void DraftLibrary::close()
+{
+    m_file.close();
+    m_header = Header();
+    m_drafts.clear();
+    m_draftExtents.clear();
+    m_chunks.clear();
+    m_freePages.clear();
+    m_releasedExtents.clear();
+    m_tagIndex.clear();
+    m_postIndex.clear();
+    m_byTitle.clear();
+    m_byModified.clear();
+    m_readers = 0;
+    m_batch = false;
+    m_batchFailed = false;
+    m_dirtyChunks.clear();
+}
+
+/*!
+  Returns true if the library is open.
+ */
+bool DraftLibrary::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+/*!
+  Returns the name of the library file.
+ */
+QString DraftLibrary::fileName() const
+{
+    return m_file.fileName();
+}
+
+/*!
+  Returns a description of the last error.
+ */
+QString DraftLibrary::errorString() const
+{
+    return m_errorString;
+}
+
+/*!
+  Returns the number of drafts.
+ */
+int DraftLibrary::count() const
+{
+    return m_drafts.size();
+}
+
+/*!
+  Returns the index entry of draft \a id.
+ */
+DraftInfo DraftLibrary::draft(quint32 id) const
+{
+    return m_drafts.value(id);
+}
+
+/*!
+  Returns the index entries of all drafts in \a order. ByModified lists
+  the latest draft first.
+ */
+QList<DraftInfo> DraftLibrary::drafts(SortOrder order) const
+{
+    if (order == ById) {
+        return m_drafts.values();
+    }
+    QList<DraftInfo> result;
+    result.reserve(m_drafts.size());
+    foreach (quint32 id, draftIds(order)) {
+        result << m_drafts.value(id);
+    }
+    return result;
+}
+
+/*!
+  Returns the ids of all drafts in \a order. The orders are kept until the
+  next change, so this is cheap enough for views which page through the
+  drafts.
+ */
+QVector<quint32> DraftLibrary::draftIds(SortOrder order) const
+{
+    if (order == ById) {
+        return m_drafts.keys().toVector();
+    }
+    QVector<quint32> &ids = order == ByTitle ? m_byTitle : m_byModified;
+    if (ids.size() != m_drafts.size()) {
+        ids = m_drafts.keys().toVector();
+        if (order == ByTitle) {
+            std::sort(ids.begin(), ids.end(), TitleLess(&m_drafts));
+        } else {
+            std::sort(ids.begin(), ids.end(), ModifiedLater(&m_drafts));
+        }
+    }
+    return ids;
+}
+
+/*!
+  Returns the index entries of all drafts tagged \a tag, by id.
+ */
+QList<DraftInfo> DraftLibrary::draftsWithTag(const QString &tag) const
+{
+    QList<quint32> ids = m_tagIndex.value(tag).toList();
+    std::sort(ids.begin(), ids.end());
+    QList<DraftInfo> result;
+    foreach (quint32 id, ids) {
+        result << m_drafts.value(id);
+    }
+    return result;
+}
+
+/*!
+  Returns all tags in use.
+ */
+QStringList DraftLibrary::tags() const
+{
+    QStringList result = m_tagIndex.keys();
+    result.sort();
+    return result;
+}
+
+/*!
+  Returns the draft imported from blog post \a postId, or 0 if there is
+  none.
+ */
+quint32 DraftLibrary::draftForPost(const QString &postId) const
+{
+    return m_postIndex.value(postId);
+}
+
+/*!
+  Replaces the content of \a document with draft \a id.
+ */
+bool DraftLibrary::load(quint32 id, QTextDocument *document)
+{
+    QByteArray data = draftData(id);
+    if (data.isEmpty()) {
+        return false;
+    }
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    return DraftFormat::read(&buffer, document, 0, &m_errorString);
+}
+
+/*!
+  Returns draft \a id in the binary draft format, or an empty array on
+  failure. This only reads the file; it can be decoded anywhere, for
+  example on a worker thread.
+ */
+QByteArray DraftLibrary::draftData(quint32 id)
+{
+    QByteArray data;
+    if (!m_draftExtents.contains(id)) {
+        fail(libraryTr("The draft does not exist."));
+    } else if (!readExtent(m_draftExtents.value(id), &data)) {
+        data.clear();
+    }
+    return data;
+}
+
+/*!
+  Returns a reader for drafts \a ids, which reads them through a file
+  handle of its own on any thread. Drafts which do not exist are left out.
+
+  The library goes on saving meanwhile, but until the matching endRead()
+  it does not reuse any free pages, so the pages of the reader are never
+  overwritten.
+ */
+DraftReader DraftLibrary::beginRead(const QList<quint32> &ids)
+{
+    ++m_readers;
+    // Drafts of an open batch may still be in the write buffer.
+    m_file.flush();
+    DraftReader reader;
+    reader.m_fileName = m_file.fileName();
+    foreach (quint32 id, ids) {
+        if (!m_draftExtents.contains(id)) {
+            continue;
+        }
+        const Extent extent = m_draftExtents.value(id);
+        if (extent.length <= extent.count * PAGE_SIZE && extent.page + extent.count <= m_header.pageCount) {
+            reader.m_extents.insert(id, qMakePair(qint64(extent.page) * PAGE_SIZE, extent.length));
+        }
+    }
+    return reader;
+}
+
+/*!
+  Tells the library that a reader from beginRead() is done.
+ */
+void DraftLibrary::endRead()
+{
+    if (m_readers > 0) {
+        --m_readers;
+    }
+}
+
+/*!
+  Stores \a document as draft \a id with \a title and \a tags, or as a
+  new draft if \a id is 0. The update is atomic. Returns the id of the
+  draft, or 0 on failure.
+ */
+quint32 DraftLibrary::save(quint32 id, const QTextDocument *document, const QString &title,
+                           const QStringList &tags)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    if (!DraftFormat::write(&buffer, document, title, DraftFormat::NoOptions, &m_errorString)) {
+        return 0;
+    }
+    return save(id, data, title, tags);
+}
+
+/*!
+  Stores \a data, a document already in the binary draft format, as draft
+  \a id with \a title and \a tags, or as a new draft if \a id is 0. The
+  update is atomic. Returns the id of the draft, or 0 on failure.
+ */
+quint32 DraftLibrary::save(quint32 id, const QByteArray &data, const QString &title,
+                           const QStringList &tags)
+{
+    if (!isOpen()) {
+        fail(libraryTr("The library is not open."));
+        return 0;
+    }
+    if (m_batchFailed) {
+        return 0;
+    }
+    if (id != 0 && !m_draftExtents.contains(id)) {
+        fail(libraryTr("The draft does not exist."));
+        return 0;
+    }
+
+    Extent extent;
+    if (!writeExtent(data, &extent)) {
+        rollback();
+        return 0;
+    }
+    DraftInfo info;
+    if (id == 0) {
+        id = m_header.nextId++;
+    } else {
+        info.postId = m_drafts.value(id).postId;
+        release(m_draftExtents.value(id));
+        unindexDraft(id);
+    }
+    info.id = id;
+    info.title = title;
+    info.modified = QDateTime::currentDateTime();
+    info.tags = tags;
+    info.size = data.size();
+    m_drafts.insert(id, info);
+    m_draftExtents.insert(id, extent);
+    indexDraft(info);
+
+    if (!finishUpdate(id)) {
+        rollback();
+        return 0;
+    }
+    return id;
+}
+
+/*!
+  Records that draft \a id was imported from blog post \a postId, which
+  may be empty. The draft itself is not written again. The update is
+  atomic.
+ */
+bool DraftLibrary::setPostId(quint32 id, const QString &postId)
+{
+    if (m_batchFailed) {
+        return false;
+    }
+    if (!m_drafts.contains(id)) {
+        return fail(libraryTr("The draft does not exist."));
+    }
+    unindexDraft(id);
+    DraftInfo &info = m_drafts[id];
+    info.postId = postId;
+    indexDraft(info);
+    if (!finishUpdate(id)) {
+        rollback();
+        return false;
+    }
+    return true;
+}
+
+/*!
+  Removes draft \a id. The update is atomic.
+ */
+bool DraftLibrary::remove(quint32 id)
+{
+    if (m_batchFailed) {
+        return false;
+    }
+    if (!m_draftExtents.contains(id)) {
+        return fail(libraryTr("The draft does not exist."));
+    }
+    release(m_draftExtents.take(id));
+    unindexDraft(id);
+    m_drafts.remove(id);
+    if (!finishUpdate(id)) {
+        rollback();
+        return false;
+    }
+    return true;
+}
+
+/*!
+  Starts a batch. Until commitBatch(), saved and removed drafts are only
+  written, and none of it is visible in the file; drafts and their ids
+  can be used as usual meanwhile.
+ */
+void DraftLibrary::beginBatch()
+{
+    m_batch = true;
+    m_batchFailed = false;
+    m_dirtyChunks.clear();
+}
+
+/*!
+  Makes all updates since beginBatch() durable in one commit. If any of
+  them failed, the whole batch is dropped and false is returned.
+ */
+bool DraftLibrary::commitBatch()
+{
+    const bool failed = m_batchFailed;
+    const QSet<quint32> chunks = m_dirtyChunks;
+    m_batch = false;
+    m_batchFailed = false;
+    m_dirtyChunks.clear();
+    if (failed) {
+        return false;
+    }
+    if (chunks.isEmpty()) {
+        return true;
+    }
+    if (!writeIndex(chunks) || !commit()) {
+        rollback();
+        return false;
+    }
+    return true;
+}
+
+/*!
+  Drops all updates since beginBatch().
+ */
+void DraftLibrary::abortBatch()
+{
+    if (!m_batch) {
+        return;
+    }
+    m_batch = false;
+    rollback();
+}
+
+QByteArray DraftLibrary::headerData(const Header &header)
+{
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    ds.setVersion(STREAM_VERSION);
+    ds << LIBRARY_MAGIC << header.version << header.generation << PAGE_SIZE
+       << header.pageCount << header.nextId
+       << header.directory.page << header.directory.count << header.directory.length;
+    ds << qChecksum(data.constData(), data.size());
+    data.resize(HEADER_SLOT_SIZE);
+    return data;
+}
+
+bool DraftLibrary::parseHeader(const QByteArray &data, Header *header)
+{
+    QDataStream ds(data);
+    ds.setVersion(STREAM_VERSION);
+    quint32 magic = 0;
+    quint32 pageSize = 0;
+    quint16 checksum = 0;
+    ds >> magic >> header->version >> header->generation >> pageSize >> header->pageCount >> header->nextId
+       >> header->directory.page >> header->directory.count >> header->directory.length;
+    const int length = ds.device()->pos();
+    ds >> checksum;
+    return ds.status() == QDataStream::Ok && magic == LIBRARY_MAGIC && header->version <= LIBRARY_VERSION
+            && pageSize == PAGE_SIZE && checksum == qChecksum(data.constData(), length);
+}
+
+bool DraftLibrary::readHeader()
+{
+    QByteArray page(PAGE_SIZE, 0);
+    if (!m_file.seek(0) || m_file.read(page.data(), PAGE_SIZE) != qint64(PAGE_SIZE)) {
+        return fail(libraryTr("The file is not a draft library."));
+    }
+    m_activeSlot = -1;
+    for (int slot = 0; slot < 2; ++slot) {
+        Header header;
+        if (parseHeader(page.mid(slot * HEADER_SLOT_SIZE, HEADER_SLOT_SIZE), &header)
+                && (m_activeSlot < 0 || header.generation > m_header.generation)) {
+            m_header = header;
+            m_activeSlot = slot;
+        }
+    }
+    if (m_activeSlot < 0) {
+        return fail(libraryTr("The file is not a draft library."));
+    }
+    return true;
+}
+
+/*
+    Reads the directory and all index chunks, and derives the free pages
+    from what they reference.
+ */
+bool DraftLibrary::readIndex()
+{
+    m_drafts.clear();
+    m_draftExtents.clear();
+    m_chunks.clear();
+    m_freePages.clear();
+    m_tagIndex.clear();
+    m_postIndex.clear();
+    m_byTitle.clear();
+    m_byModified.clear();
+
+    QBitArray used(m_header.pageCount);
+    used.setBit(0);
+    if (m_header.directory.count > 0) {
+        QByteArray data;
+        if (!readExtent(m_header.directory, &data)) {
+            return false;
+        }
+        QDataStream ds(data);
+        ds.setVersion(STREAM_VERSION);
+        quint32 chunkCount = 0;
+        ds >> chunkCount;
+        for (quint32 i = 0; i < chunkCount && ds.status() == QDataStream::Ok; ++i) {
+            quint32 chunk = 0;
+            Extent extent;
+            ds >> chunk >> extent.page >> extent.count >> extent.length;
+            m_chunks.insert(chunk, extent);
+        }
+        used.fill(true, m_header.directory.page, m_header.directory.page + m_header.directory.count);
+    }
+
+    for (QMap<quint32, Extent>::const_iterator it = m_chunks.constBegin(); it != m_chunks.constEnd(); ++it) {
+        QByteArray data;
+        if (!readExtent(it.value(), &data)) {
+            return false;
+        }
+        used.fill(true, it.value().page, it.value().page + it.value().count);
+        QDataStream ds(data);
+        ds.setVersion(STREAM_VERSION);
+        quint32 entryCount = 0;
+        ds >> entryCount;
+        for (quint32 i = 0; i < entryCount && ds.status() == QDataStream::Ok; ++i) {
+            DraftInfo info;
+            qint64 modified = 0;
+            Extent extent;
+            ds >> info.id >> info.title >> modified >> info.tags;
+            if (m_header.version >= 2) {
+                ds >> info.postId;
+            }
+            ds >> extent.page >> extent.count >> extent.length;
+            info.modified = QDateTime::fromMSecsSinceEpoch(modified);
+            info.size = extent.length;
+            if (extent.page + extent.count > m_header.pageCount) {
+                return fail(libraryTr("The library is damaged."));
+            }
+            m_drafts.insert(info.id, info);
+            m_draftExtents.insert(info.id, extent);
+            indexDraft(info);
+            used.fill(true, extent.page, extent.page + extent.count);
+        }
+        if (ds.status() != QDataStream::Ok) {
+            return fail(libraryTr("The library is damaged."));
+        }
+    }
+
+    for (int page = 1; page < used.size(); ++page) {
+        if (!used.testBit(page)) {
+            int end = page + 1;
+            while (end < used.size() && !used.testBit(end)) {
+                ++end;
+            }
+            m_freePages.insert(page, end - page);
+            page = end;
+        }
+    }
+    return true;
+}
+
+bool DraftLibrary::readExtent(const Extent &extent, QByteArray *data)
+{
+    if (extent.length > extent.count * PAGE_SIZE || extent.page + extent.count > m_header.pageCount) {
+        return fail(libraryTr("The library is damaged."));
+    }
+    *data = QByteArray(extent.length, Qt::Uninitialized);
+    if (!m_file.seek(qint64(extent.page) * PAGE_SIZE)
+            || m_file.read(data->data(), extent.length) != qint64(extent.length)) {
+        return fail(libraryTr("The library is damaged."));
+    }
+    return true;
+}
+
+/*
+    Writes data to pages which are not in use.
+ */
+bool DraftLibrary::writeExtent(const QByteArray &data, Extent *extent)
+{
+    extent->count = qMax<quint32>(1, (data.size() + PAGE_SIZE - 1) / PAGE_SIZE);
+    extent->page = allocate(extent->count);
+    extent->length = data.size();
+    if (!m_file.seek(qint64(extent->page) * PAGE_SIZE) || m_file.write(data) != data.size()) {
+        return fail(m_file.errorString());
+    }
+    return true;
+}
+
+bool DraftLibrary::writeChunk(quint32 chunk)
+{
+    const quint32 first = chunk * ENTRIES_PER_CHUNK;
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    ds.setVersion(STREAM_VERSION);
+    ds << quint32(0);
+    quint32 entryCount = 0;
+    QMap<quint32, DraftInfo>::const_iterator it = m_drafts.lowerBound(first);
+    for (; it != m_drafts.constEnd() && it.key() < first + ENTRIES_PER_CHUNK; ++it) {
+        const DraftInfo &info = it.value();
+        const Extent extent = m_draftExtents.value(info.id);
+        ds << info.id << info.title << qint64(info.modified.toMSecsSinceEpoch()) << info.tags
+           << info.postId << extent.page << extent.count << extent.length;
+        ++entryCount;
+    }
+
+    if (m_chunks.contains(chunk)) {
+        release(m_chunks.take(chunk));
+    }
+    if (entryCount == 0) {
+        return true;
+    }
+    ds.device()->seek(0);
+    ds << entryCount;
+    Extent extent;
+    if (!writeExtent(data, &extent)) {
+        return false;
+    }
+    m_chunks.insert(chunk, extent);
+    return true;
+}
+
+/*
+    Writes the index \a chunks and the directory. While the file is of an
+    older version, every chunk is written, so the new header never points
+    at chunks in the old format.
+ */
+bool DraftLibrary::writeIndex(QSet<quint32> chunks)
+{
+    if (m_header.version < LIBRARY_VERSION) {
+        foreach (quint32 chunk, m_chunks.keys()) {
+            chunks.insert(chunk);
+        }
+    }
+    foreach (quint32 chunk, chunks) {
+        if (!writeChunk(chunk)) {
+            return false;
+        }
+    }
+    return writeDirectory();
+}
+
+bool DraftLibrary::writeDirectory()
+{
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    ds.setVersion(STREAM_VERSION);
+    ds << quint32(m_chunks.size());
+    for (QMap<quint32, Extent>::const_iterator it = m_chunks.constBegin(); it != m_chunks.constEnd(); ++it) {
+        ds << it.key() << it.value().page << it.value().count << it.value().length;
+    }
+    release(m_header.directory);
+    return writeExtent(data, &m_header.directory);
+}
+
+/*
+    Switches to the new state by writing the header slot which is not in
+    use. Pages released by the update become free only now.
+ */
+bool DraftLibrary::commit()
+{
+    if (!syncFile(&m_file)) {
+        return fail(m_file.errorString());
+    }
+    Header header = m_header;
+    header.version = LIBRARY_VERSION;
+    ++header.generation;
+    const int slot = 1 - m_activeSlot;
+    if (!m_file.seek(slot * HEADER_SLOT_SIZE) || m_file.write(headerData(header)) != HEADER_SLOT_SIZE
+            || !syncFile(&m_file)) {
+        return fail(m_file.errorString());
+    }
+    m_header = header;
+    m_activeSlot = slot;
+    foreach (const Extent &extent, m_releasedExtents) {
+        addFree(extent.page, extent.count);
+    }
+    m_releasedExtents.clear();
+    return true;
+}
+
+/*
+    Writes the index chunk of draft \a id and commits, or leaves that to
+    commitBatch().
+ */
+bool DraftLibrary::finishUpdate(quint32 id)
+{
+    if (m_batch) {
+        m_dirtyChunks.insert(id / ENTRIES_PER_CHUNK);
+        return true;
+    }
+    return writeIndex(QSet<quint32>() << id / ENTRIES_PER_CHUNK) && commit();
+}
+
+/*
+    Returns to the state on disk after a failed update. In a batch, this
+    drops all of its updates, so the rest of the batch fails as well.
+ */
+void DraftLibrary::rollback()
+{
+    const QString error = m_errorString;
+    m_releasedExtents.clear();
+    m_batchFailed = m_batch;
+    m_dirtyChunks.clear();
+    if (!readHeader() || !readIndex()) {
+        close();
+    }
+    m_errorString = error;
+}
+
+/*
+    Takes the first free run of at least count pages, or appends pages.
+    Free pages may still be read by a DraftReader as long as there is one.
+ */
+quint32 DraftLibrary::allocate(quint32 count)
+{
+    for (QMap<quint32, quint32>::iterator it = m_freePages.begin();
+         m_readers == 0 && it != m_freePages.end(); ++it) {
+        if (it.value() >= count) {
+            const quint32 page = it.key();
+            const quint32 remaining = it.value() - count;
+            m_freePages.erase(it);
+            if (remaining > 0) {
+                m_freePages.insert(page + count, remaining);
+            }
+            return page;
+        }
+    }
+    const quint32 page = m_header.pageCount;
+    m_header.pageCount += count;
+    return page;
+}
+
+void DraftLibrary::release(const Extent &extent)
+{
+    if (extent.count > 0) {
+        m_releasedExtents << extent;
+    }
+}
+
+void DraftLibrary::addFree(quint32 page, quint32 count)
+{
+    QMap<quint32, quint32>::iterator next = m_freePages.lowerBound(page);
+    if (next != m_freePages.end() && page + count == next.key()) {
+        count += next.value();
+        next = m_freePages.erase(next);
+    }
+    if (next != m_freePages.begin()) {
+        QMap<quint32, quint32>::iterator previous = next - 1;
+        if (previous.key() + previous.value() == page) {
+            previous.value() += count;
+            return;
+        }
+    }
+    m_freePages.insert(page, count);
+}
+
+void DraftLibrary::indexDraft(const DraftInfo &info)
+{
+    foreach (const QString &tag, info.tags) {
+        m_tagIndex[tag].insert(info.id);
+    }
+    if (!info.postId.isEmpty()) {
+        m_postIndex.insert(info.postId, info.id);
+    }
+    m_byTitle.clear();
+    m_byModified.clear();
+}
+
+void DraftLibrary::unindexDraft(quint32 id)
+{
+    const DraftInfo info = m_drafts.value(id);
+    if (!info.postId.isEmpty() && m_postIndex.value(info.postId) == id) {
+        m_postIndex.remove(info.postId);
+    }
+    foreach (const QString &tag, info.tags) {
+        QHash<QString, QSet<quint32> >::iterator it = m_tagIndex.find(tag);
+        if (it != m_tagIndex.end()) {
+            it.value().remove(id);
+            if (it.value().isEmpty()) {
+                m_tagIndex.erase(it);
+            }
+        }
+    }
+    m_byTitle.clear();
+    m_byModified.clear();
+}
+
+bool DraftLibrary::fail(const QString &message)
+{
+    m_errorString = message;
+    return false;
+}
+
+}
@@ -0,0 +1,174 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef DRAFTLIBRARY_H
+#define DRAFTLIBRARY_H
+
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+#include "document_global.h"
+
+QT_FORWARD_DECLARE_CLASS(QTextDocument)
+
+namespace GOW
+{
+
+struct DraftInfo
+{
+    DraftInfo() : id(0), size(0) {}
+
+    quint32 id;
+    QString title;
+    QDateTime modified;
+    QStringList tags;
+    quint32 size;
+    QString postId; // of the blog post the draft was imported from
+};
+
+class DOCUMENT_EXPORT DraftReader
+{
+public:
+    QList<quint32> ids() const { return m_extents.keys(); }
+    QByteArray draftData(quint32 id) const;
+
+private:
+    friend class DraftLibrary;
+
+    QString m_fileName;
+    QHash<quint32, QPair<qint64, quint32> > m_extents; // file offset and length
+}; // end of class GOW::DraftReader
+
+class DOCUMENT_EXPORT DraftLibrary
+{
+public:
+    enum SortOrder {
+        ById,
+        ByTitle,
+        ByModified
+    };
+
+    DraftLibrary();
+    ~DraftLibrary();
+
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const;
+    QString fileName() const;
+    QString errorString() const;
+
+    int count() const;
+    DraftInfo draft(quint32 id) const;
+    QList<DraftInfo> drafts(SortOrder order = ById) const;
+    QVector<quint32> draftIds(SortOrder order = ById) const;
+    QList<DraftInfo> draftsWithTag(const QString &tag) const;
+    QStringList tags() const;
+    quint32 draftForPost(const QString &postId) const;
+
+    bool load(quint32 id, QTextDocument *document);
+    QByteArray draftData(quint32 id);
+    DraftReader beginRead(const QList<quint32> &ids);
+    void endRead();
+    quint32 save(quint32 id, const QTextDocument *document, const QString &title,
+                 const QStringList &tags = QStringList());
+    quint32 save(quint32 id, const QByteArray &data, const QString &title,
+                 const QStringList &tags = QStringList());
+    bool setPostId(quint32 id, const QString &postId);
+    bool remove(quint32 id);
+
+    void beginBatch();
+    bool commitBatch();
+    void abortBatch();
+
+private:
+    Q_DISABLE_COPY(DraftLibrary)
+
+    struct Extent
+    {
+        Extent() : page(0), count(0), length(0) {}
+
+        quint32 page;
+        quint32 count;
+        quint32 length;
+    };
+
+    struct Header
+    {
+        Header();
+
+        quint32 version;
+        quint64 generation;
+        quint32 pageCount;
+        quint32 nextId;
+        Extent directory;
+    };
+
+    static QByteArray headerData(const Header &header);
+    static bool parseHeader(const QByteArray &data, Header *header);
+
+    bool readHeader();
+    bool readIndex();
+    bool readExtent(const Extent &extent, QByteArray *data);
+    bool writeExtent(const QByteArray &data, Extent *extent);
+    bool writeChunk(quint32 chunk);
+    bool writeIndex(QSet<quint32> chunks);
+    bool writeDirectory();
+    bool commit();
+    bool finishUpdate(quint32 id);
+    void rollback();
+    quint32 allocate(quint32 count);
+    void release(const Extent &extent);
+    void addFree(quint32 page, quint32 count);
+    void indexDraft(const DraftInfo &info);
+    void unindexDraft(quint32 id);
+    bool fail(const QString &message);
+
+    QFile m_file;
+    QString m_errorString;
+    Header m_header;
+    int m_activeSlot;
+
+    QMap<quint32, DraftInfo> m_drafts;
+    QHash<quint32, Extent> m_draftExtents;
+    QMap<quint32, Extent> m_chunks;
+    QMap<quint32, quint32> m_freePages;     // first page -> page count
+    QList<Extent> m_releasedExtents;        // free after the next commit
+    QHash<QString, QSet<quint32> > m_tagIndex;
+    QHash<QString, quint32> m_postIndex;
+    mutable QVector<quint32> m_byTitle;
+    mutable QVector<quint32> m_byModified;
+
+    int m_readers;
+    bool m_batch;
+    bool m_batchFailed;
+    QSet<quint32> m_dirtyChunks;
+}; // end of class GOW::DraftLibrary
+
+} // end of namespace GOW
+
+#endif // DRAFTLIBRARY_H
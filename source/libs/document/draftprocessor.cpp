@@ -0,0 +1,191 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextBlock>
+#include <QTextCodec>
+#include <QTextDocument>
+#include <QUrl>
+#if QT_VERSION >= 0x050000
+#include <QSaveFile>
+#endif
+
+#include "draftprocessor.h"
+#include "htmlwriter.h"
+
+namespace GOW
+{
+
+/*
+    Reads \a fileName into \a html. Returns the number of bytes which could
+    not be decoded, or -1 if the file cannot be read.
+ */
+static int readDraft(const QString &fileName, QString *html, QStringList *issues)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        issues->append(QString::fromLatin1("cannot read: %1").arg(file.errorString()));
+        return -1;
+    }
+    const QByteArray data = file.readAll();
+    QTextCodec *codec = QTextCodec::codecForHtml(data, QTextCodec::codecForName("UTF-8"));
+    QTextCodec::ConverterState state;
+    *html = codec->toUnicode(data.constData(), data.size(), &state);
+    return state.invalidChars;
+}
+
+static bool writeFile(const QString &fileName, const QString &html, QStringList *issues)
+{
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+#if QT_VERSION >= 0x050000
+    QSaveFile file(fileName);
+#else
+    QFile file(fileName);
+#endif
+    const QByteArray data = html.toUtf8();
+    bool ok = file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+#if QT_VERSION >= 0x050000
+    ok = ok && file.commit();
+#endif
+    if (!ok) {
+        issues->append(QString::fromLatin1("cannot write %1: %2").arg(fileName, file.errorString()));
+    }
+    return ok;
+}
+
+static void validateDraft(const QTextDocument &document, const QString &normalized,
+                          const QString &baseDir, QStringList *issues)
+{
+    if (document.isEmpty()) {
+        issues->append(QLatin1String("draft is empty"));
+        return;
+    }
+    if (DraftProcessor::normalize(normalized) != normalized) {
+        issues->append(QLatin1String("content changes when it is read back"));
+    }
+    const QDir dir(baseDir);
+    for (QTextBlock block = document.begin(); block.isValid(); block = block.next()) {
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextCharFormat format = it.fragment().charFormat();
+            if (!format.isImageFormat()) {
+                continue;
+            }
+            const QString name = format.toImageFormat().name();
+            const QUrl url(name);
+            QString path;
+            if (url.scheme().isEmpty()) {
+                path = name;
+            } else if (url.scheme() == QLatin1String("file")) {
+                path = url.toLocalFile();
+            } else {
+                continue; // remote and embedded images are not checked
+            }
+            if (!QFileInfo(dir.absoluteFilePath(path)).exists()) {
+                issues->append(QString::fromLatin1("missing image: %1").arg(name));
+            }
+        }
+    }
+}
+
+/*!
+  \class GOW::DraftProcessor
+
+  Processes drafts stored as HTML files without any user interface.
+
+  Normalize rewrites a draft in the form HtmlWriter writes it, so equal
+  content is stored as equal HTML. Export writes the post HTML into the
+  export directory, keeping the path of the draft relative to the source
+  directory. Validate reports undecodable text, content which does not
+  survive being read back and missing local images.
+
+  The draft is parsed only once for all operations. process() does not
+  modify the processor and may be called from many threads at once.
+ */
+
+/*!
+  Constructs a processor applying \a operations to drafts below
+  \a sourceRoot. Exported files are written below \a exportRoot.
+ */
+DraftProcessor::DraftProcessor(Operations operations, const QString &sourceRoot,
+                               const QString &exportRoot) :
+    m_operations(operations),
+    m_sourceRoot(sourceRoot),
+    m_exportRoot(exportRoot)
+{
+}
+
+/*!
+  Applies all operations to the draft \a fileName. The result is ok if no
+  issues were found.
+ */
+DraftResult DraftProcessor::process(const QString &fileName) const
+{
+    QElapsedTimer timer;
+    timer.start();
+    DraftResult result;
+    result.fileName = fileName;
+
+    QString html;
+    const int invalidChars = readDraft(fileName, &html, &result.issues);
+    if (invalidChars >= 0) {
+        QTextDocument document;
+        document.setHtml(html);
+        const QString normalized = HtmlWriter::documentHtml(&document);
+        if (invalidChars > 0) {
+            // Rewriting would lose the undecodable bytes for good.
+            result.issues.append(QString::fromLatin1("%1 bytes cannot be decoded").arg(invalidChars));
+        } else if ((m_operations & Normalize) && normalized != html) {
+            writeFile(fileName, normalized, &result.issues);
+        }
+        if ((m_operations & Export) && !m_exportRoot.isEmpty()) {
+            writeFile(exportPath(fileName), normalized, &result.issues);
+        }
+        if (m_operations & Validate) {
+            validateDraft(document, normalized, QFileInfo(fileName).absolutePath(), &result.issues);
+        }
+    }
+
+    result.ok = result.issues.isEmpty();
+    result.elapsed = timer.nsecsElapsed() / 1000;
+    return result;
+}
+
+/*!
+  Returns \a html in the form HtmlWriter writes it.
+ */
+QString DraftProcessor::normalize(const QString &html)
+{
+    QTextDocument document;
+    document.setHtml(html);
+    return HtmlWriter::documentHtml(&document);
+}
+
+QString DraftProcessor::exportPath(const QString &fileName) const
+{
+    const QFileInfo relative(QDir(m_sourceRoot).relativeFilePath(fileName));
+    return QDir(m_exportRoot).filePath(relative.path() + QLatin1Char('/')
+                                       + relative.completeBaseName() + QLatin1String(".html"));
+}
+
+}
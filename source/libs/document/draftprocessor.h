@@ -0,0 +1,74 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef DRAFTPROCESSOR_H
+#define DRAFTPROCESSOR_H
+
+#include <QString>
+#include <QStringList>
+
+#include "document_global.h"
+
+namespace GOW
+{
+
+struct DraftResult
+{
+    DraftResult() : ok(false), elapsed(0) {}
+
+    QString fileName;
+    bool ok;
+    QStringList issues;
+    qint64 elapsed; // microseconds
+};
+
+class DOCUMENT_EXPORT DraftProcessor
+{
+public:
+    enum Operation {
+        Normalize = 0x1,
+        Export = 0x2,
+        Validate = 0x4
+    };
+    Q_DECLARE_FLAGS(Operations, Operation)
+
+    DraftProcessor(Operations operations, const QString &sourceRoot,
+                   const QString &exportRoot = QString());
+
+    Operations operations() const { return m_operations; }
+
+    DraftResult process(const QString &fileName) const;
+
+    static QString normalize(const QString &html);
+
+private:
+    QString exportPath(const QString &fileName) const;
+
+    Operations m_operations;
+    QString m_sourceRoot;
+    QString m_exportRoot;
+}; // end of class GOW::DraftProcessor
+
+} // end of namespace GOW
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(GOW::DraftProcessor::Operations)
+
+#endif // DRAFTPROCESSOR_H
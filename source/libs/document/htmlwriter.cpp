@@ -0,0 +1,226 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QStringList>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTextList>
+
+#include "htmlwriter.h"
+
+namespace GOW
+{
+
+static QString fragmentHtml(const QTextFragment &fragment, const QTextBlock &block)
+{
+    const QTextCharFormat format = fragment.charFormat();
+
+    if (format.isImageFormat()) {
+        const QTextImageFormat image = format.toImageFormat();
+        QString tag = QLatin1String("<img src=\"") + HtmlWriter::escape(image.name()) + QLatin1Char('"');
+        if (image.hasProperty(QTextFormat::ImageWidth)) {
+            tag += QString::fromLatin1(" width=\"%1\"").arg(qRound(image.width()));
+        }
+        if (image.hasProperty(QTextFormat::ImageHeight)) {
+            tag += QString::fromLatin1(" height=\"%1\"").arg(qRound(image.height()));
+        }
+        tag += QLatin1String(" />");
+        // Consecutive identical images share one fragment.
+        QString html;
+        for (int i = 0; i < fragment.length(); ++i) {
+            html += tag;
+        }
+        return html;
+    }
+
+    const QString text = fragment.text();
+    const bool atBlockStart = fragment.position() == block.position();
+    const bool atBlockEnd = fragment.position() + fragment.length() == block.position() + block.length() - 1;
+    QString html;
+    html.reserve(text.length() + 16);
+    for (int i = 0; i < text.length(); ++i) {
+        const QChar ch = text.at(i);
+        if (ch == QLatin1Char(' ')) {
+            // Keep runs of spaces and spaces at block edges, which HTML would collapse.
+            const bool keep = (i == 0 && atBlockStart)
+                    || (i > 0 && text.at(i - 1) == QLatin1Char(' '))
+                    || (i == text.length() - 1 && atBlockEnd);
+            html += keep ? QLatin1String("&nbsp;") : QLatin1String(" ");
+        } else if (ch == QChar::Nbsp) {
+            html += QLatin1String("&nbsp;");
+        } else if (ch == QChar::LineSeparator) {
+            html += QLatin1String("<br />");
+        } else if (ch == QLatin1Char('&')) {
+            html += QLatin1String("&amp;");
+        } else if (ch == QLatin1Char('<')) {
+            html += QLatin1String("&lt;");
+        } else if (ch == QLatin1Char('>')) {
+            html += QLatin1String("&gt;");
+        } else {
+            html += ch;
+        }
+    }
+
+    QStringList styles;
+    if (format.hasProperty(QTextFormat::FontFamily)) {
+        styles << QString::fromLatin1("font-family:'%1'").arg(format.fontFamily());
+    }
+    if (format.hasProperty(QTextFormat::FontPointSize)) {
+        styles << QString::fromLatin1("font-size:%1pt").arg(format.fontPointSize());
+    }
+    if (format.hasProperty(QTextFormat::ForegroundBrush)) {
+        styles << QString::fromLatin1("color:%1").arg(format.foreground().color().name());
+    }
+    if (format.hasProperty(QTextFormat::BackgroundBrush)) {
+        styles << QString::fromLatin1("background-color:%1").arg(format.background().color().name());
+    }
+    if (!styles.isEmpty()) {
+        html = QLatin1String("<span style=\"") + styles.join(QLatin1String(";"))
+                + QLatin1String(";\">") + html + QLatin1String("</span>");
+    }
+    if (format.fontStrikeOut()) {
+        html = QLatin1String("<s>") + html + QLatin1String("</s>");
+    }
+    if (format.fontUnderline() && !format.isAnchor()) {
+        html = QLatin1String("<u>") + html + QLatin1String("</u>");
+    }
+    if (format.fontItalic()) {
+        html = QLatin1String("<em>") + html + QLatin1String("</em>");
+    }
+    if (format.fontWeight() > QFont::Normal) {
+        html = QLatin1String("<strong>") + html + QLatin1String("</strong>");
+    }
+    if (format.isAnchor() && !format.anchorHref().isEmpty()) {
+        html = QLatin1String("<a href=\"") + HtmlWriter::escape(format.anchorHref())
+                + QLatin1String("\">") + html + QLatin1String("</a>");
+    }
+    return html;
+}
+
+static QString blockStyle(const QTextBlockFormat &format)
+{
+    if (!format.hasProperty(QTextFormat::BlockAlignment)) {
+        return QString();
+    }
+    const Qt::Alignment align = format.alignment();
+    if (align & Qt::AlignHCenter) {
+        return QLatin1String(" style=\"text-align:center;\"");
+    } else if (align & Qt::AlignRight) {
+        return QLatin1String(" style=\"text-align:right;\"");
+    } else if (align & Qt::AlignJustify) {
+        return QLatin1String(" style=\"text-align:justify;\"");
+    } else if (align & Qt::AlignLeft) {
+        return QLatin1String(" style=\"text-align:left;\"");
+    }
+    return QString();
+}
+
+/*!
+  \class GOW::HtmlWriter
+
+  Serializes text blocks into the HTML used as the post source.
+
+  Unlike QTextDocument::toHtml(), a single block can be written on its own,
+  so callers can keep the source of untouched blocks and re-serialize
+  only the blocks which changed. The output of a block does not depend on
+  any other block except for the list it belongs to: the first and the last
+  item of a list also carry the opening and closing list tags.
+ */
+
+/*!
+  Returns HTML of \a block without the trailing line break.
+ */
+QString HtmlWriter::blockHtml(const QTextBlock &block)
+{
+    QString html;
+    QString openTag;
+    QString closeTag;
+
+    QTextList *list = block.textList();
+    if (list) {
+        const QString listTag = list->format().style() <= QTextListFormat::ListDecimal
+                ? QLatin1String("ol") : QLatin1String("ul");
+        if (block.previous().textList() != list) {
+            html += QLatin1Char('<') + listTag + QLatin1Char('>');
+        }
+        openTag = QLatin1String("<li") + blockStyle(block.blockFormat()) + QLatin1Char('>');
+        closeTag = QLatin1String("</li>");
+        if (block.next().textList() != list) {
+            closeTag += QLatin1String("</") + listTag + QLatin1Char('>');
+        }
+    } else {
+        openTag = QLatin1String("<p") + blockStyle(block.blockFormat()) + QLatin1Char('>');
+        closeTag = QLatin1String("</p>");
+    }
+
+    html += openTag;
+    if (block.length() <= 1) {
+        html += QLatin1String("<br />");
+    } else {
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment fragment = it.fragment();
+            if (fragment.isValid()) {
+                html += fragmentHtml(fragment, block);
+            }
+        }
+    }
+    html += closeTag;
+    return html;
+}
+
+/*!
+  Returns HTML of the whole \a document, one block per line.
+ */
+QString HtmlWriter::documentHtml(const QTextDocument *document)
+{
+    QString html;
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        html += blockHtml(block);
+        html += QLatin1Char('\n');
+    }
+    return html;
+}
+
+/*!
+  Returns \a text with HTML special characters escaped.
+ */
+QString HtmlWriter::escape(const QString &text)
+{
+    QString result;
+    result.reserve(text.length());
+    for (int i = 0; i < text.length(); ++i) {
+        const QChar ch = text.at(i);
+        if (ch == QLatin1Char('&')) {
+            result += QLatin1String("&amp;");
+        } else if (ch == QLatin1Char('<')) {
+            result += QLatin1String("&lt;");
+        } else if (ch == QLatin1Char('>')) {
+            result += QLatin1String("&gt;");
+        } else if (ch == QLatin1Char('"')) {
+            result += QLatin1String("&quot;");
+        } else {
+            result += ch;
+        }
+    }
+    return result;
+}
+
+}
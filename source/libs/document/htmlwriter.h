@@ -0,0 +1,45 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef HTMLWRITER_H
+#define HTMLWRITER_H
+
+#include <QString>
+
+#include "document_global.h"
+
+QT_FORWARD_DECLARE_CLASS(QTextBlock)
+QT_FORWARD_DECLARE_CLASS(QTextDocument)
+
+namespace GOW
+{
+
+class DOCUMENT_EXPORT HtmlWriter
+{
+public:
+    static QString blockHtml(const QTextBlock &block);
+    static QString documentHtml(const QTextDocument *document);
+    static QString escape(const QString &text);
+}; // end of class GOW::HtmlWriter
+
+} // end of namespace GOW
+
+#endif // HTMLWRITER_H
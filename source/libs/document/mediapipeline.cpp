@@ -0,0 +1,415 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QImage>
+#include <QImageReader>
+#include <QRunnable>
+#include <QSet>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QVector>
+
+#include <algorithm>
+
+#include "draftformat.h"
+#include "mediapipeline.h"
+
+namespace GOW
+{
+
+static const quint32 CACHE_MAGIC = 0x4f574d43; // "OWMC"
+static const quint32 CACHE_VERSION = 1;
+static const QDataStream::Version STREAM_VERSION = QDataStream::Qt_4_8;
+static const int DEFAULT_QUALITY = 85;
+
+struct MediaSettings
+{
+    QString cacheRoot;
+    QList<int> widths; // ascending
+    int quality;
+};
+
+/*
+    The variants depend on the widths and the quality as much as on the
+    image, so both are part of the name. Entries made with other settings
+    are left alone and are found again when those settings come back.
+ */
+static QString cacheBase(const MediaSettings &settings, const QByteArray &hash)
+{
+    const QString name = QString::fromLatin1(hash);
+    QStringList widths;
+    foreach (int width, settings.widths) {
+        widths << QString::number(width);
+    }
+    return settings.cacheRoot + QLatin1Char('/') + name.left(2) + QLatin1Char('/') + name
+            + QLatin1Char('-') + widths.join(QLatin1String("_"))
+            + QLatin1String("-q") + QString::number(settings.quality);
+}
+
+/*
+    Writes next to the final name first, so the cache never holds half
+    written files under a name which is looked up.
+ */
+static bool writeFile(const QString &fileName, const QByteArray &data)
+{
+    const QString temporary = fileName + QLatin1String(".new");
+    QFile file(temporary);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) {
+        return false;
+    }
+    file.close();
+    QFile::remove(fileName);
+    return QFile::rename(temporary, fileName);
+}
+
+static bool readCacheInfo(const QString &base, MediaItem *item)
+{
+    QFile file(base + QLatin1String(".info"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream ds(&file);
+    ds.setVersion(STREAM_VERSION);
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 count = 0;
+    ds >> magic >> version >> item->size >> count;
+    if (magic != CACHE_MAGIC || version > CACHE_VERSION) {
+        return false;
+    }
+    const QString dir = QFileInfo(base).path() + QLatin1Char('/');
+    QList<MediaVariant> variants;
+    for (quint32 i = 0; i < count && ds.status() == QDataStream::Ok; ++i) {
+        MediaVariant variant;
+        qint32 width = 0;
+        qint32 height = 0;
+        ds >> width >> height >> variant.fileName >> variant.mimeType;
+        variant.width = width;
+        variant.height = height;
+        variant.fileName.prepend(dir);
+        if (!QFile::exists(variant.fileName)) {
+            return false;
+        }
+        variants << variant;
+    }
+    if (ds.status() != QDataStream::Ok || variants.isEmpty()) {
+        return false;
+    }
+    item->variants = variants;
+    return true;
+}
+
+static bool writeCacheInfo(const QString &base, const MediaItem &item)
+{
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    ds.setVersion(STREAM_VERSION);
+    ds << CACHE_MAGIC << CACHE_VERSION << item.size << quint32(item.variants.size());
+    foreach (const MediaVariant &variant, item.variants) {
+        ds << qint32(variant.width) << qint32(variant.height)
+           << QFileInfo(variant.fileName).fileName() << variant.mimeType;
+    }
+    return writeFile(base + QLatin1String(".info"), data);
+}
+
+/*
+    Runs on a worker thread. Images already in the cache are not decoded;
+    otherwise the image is scaled down from the widest variant to the
+    narrowest and each variant is encoded once. Animations are kept as
+    they are.
+ */
+static MediaItem processImage(const MediaSettings &settings, const MediaSource &source,
+                              const QByteArray &hash)
+{
+    MediaItem item;
+    item.name = source.first;
+    item.hash = hash;
+    const QString base = cacheBase(settings, hash);
+    if (readCacheInfo(base, &item)) {
+        item.cached = true;
+        return item;
+    }
+
+    QByteArray data = source.second;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer);
+    const QByteArray format = reader.format();
+    const bool animated = reader.supportsAnimation() && reader.imageCount() > 1;
+    QImage image = reader.read();
+    if (image.isNull()) {
+        item.error = reader.errorString();
+        return item;
+    }
+    item.size = image.size();
+    if (!QDir().mkpath(QFileInfo(base).path())) {
+        item.error = QString::fromLatin1("Cannot create %1").arg(QFileInfo(base).path());
+        return item;
+    }
+
+    if (animated) {
+        MediaVariant variant;
+        variant.width = image.width();
+        variant.height = image.height();
+        variant.fileName = base + QLatin1Char('.') + QString::fromLatin1(format);
+        variant.mimeType = QLatin1String("image/") + QString::fromLatin1(format);
+        if (!writeFile(variant.fileName, source.second)) {
+            item.error = QString::fromLatin1("Cannot write %1").arg(variant.fileName);
+            return item;
+        }
+        item.variants << variant;
+    } else {
+        const bool alpha = image.hasAlphaChannel();
+        const char *encoding = alpha ? "png" : "jpg";
+        const QString mimeType = QLatin1String(alpha ? "image/png" : "image/jpeg");
+        QList<int> targets;
+        foreach (int width, settings.widths) {
+            if (width < image.width()) {
+                targets << width;
+            }
+        }
+        const int widest = settings.widths.isEmpty() ? image.width()
+                                                     : qMin(image.width(), settings.widths.last());
+        if (targets.isEmpty() || targets.last() != widest) {
+            targets << widest;
+        }
+        for (int i = targets.size() - 1; i >= 0; --i) {
+            if (image.width() != targets.at(i)) {
+                image = image.scaledToWidth(targets.at(i), Qt::SmoothTransformation);
+            }
+            QByteArray encoded;
+            QBuffer output(&encoded);
+            output.open(QIODevice::WriteOnly);
+            MediaVariant variant;
+            variant.width = image.width();
+            variant.height = image.height();
+            variant.fileName = base + QLatin1Char('-') + QString::number(variant.width)
+                    + QLatin1Char('.') + QLatin1String(encoding);
+            variant.mimeType = mimeType;
+            if (!image.save(&output, encoding, alpha ? -1 : settings.quality)
+                    || !writeFile(variant.fileName, encoded)) {
+                item.error = QString::fromLatin1("Cannot write %1").arg(variant.fileName);
+                item.variants.clear();
+                return item;
+            }
+            item.variants.prepend(variant);
+        }
+    }
+    if (!writeCacheInfo(base, item)) {
+        item.error = QString::fromLatin1("Cannot write the cache entry of %1").arg(item.name);
+    }
+    return item;
+}
+
+class HashTask : public QRunnable
+{
+public:
+    HashTask(const QByteArray *data, QByteArray *hash) : m_data(data), m_hash(hash) {}
+
+    void run()
+    {
+        *m_hash = QCryptographicHash::hash(*m_data, QCryptographicHash::Sha1).toHex();
+    }
+
+private:
+    const QByteArray *m_data;
+    QByteArray *m_hash;
+};
+
+class ProcessTask : public QRunnable
+{
+public:
+    ProcessTask(const MediaSettings &settings, const MediaSource *source, const QByteArray &hash,
+                MediaItem *item) :
+        m_settings(settings), m_source(source), m_hash(hash), m_item(item) {}
+
+    void run()
+    {
+        *m_item = processImage(m_settings, *m_source, m_hash);
+    }
+
+private:
+    MediaSettings m_settings;
+    const MediaSource *m_source;
+    QByteArray m_hash;
+    MediaItem *m_item;
+};
+
+/*!
+  \class GOW::MediaPipeline
+
+  Prepares the images of a post for publishing.
+
+  Each image is scaled down to the configured widths() and encoded as
+  JPEG, or PNG if it has transparency, so the post can offer the variants
+  as a srcset. Images are hashed and processed on a pool of worker
+  threads. The variants are kept in a disk cache by the hash of the
+  original together with the widths and quality, so an image which was
+  processed with the same settings for any draft before, or occurs twice,
+  is never encoded again.
+ */
+
+/*!
+  Constructs a pipeline which keeps its variants in \a cacheRoot.
+ */
+MediaPipeline::MediaPipeline(const QString &cacheRoot) :
+    m_cacheRoot(cacheRoot),
+    m_quality(DEFAULT_QUALITY)
+{
+    m_widths << 480 << 960 << 1600;
+}
+
+/*!
+  Destructs the pipeline.
+ */
+MediaPipeline::~MediaPipeline()
+{
+    m_pool.waitForDone();
+}
+
+/*!
+  Sets the widths of the variants to \a widths. The widest one is the
+  maximum width of the blog; narrower images are not scaled up.
+ */
+void MediaPipeline::setWidths(const QList<int> &widths)
+{
+    m_widths = widths;
+    std::sort(m_widths.begin(), m_widths.end());
+}
+
+/*!
+  Sets the JPEG \a quality, from 0 to 100.
+ */
+void MediaPipeline::setQuality(int quality)
+{
+    m_quality = qBound(0, quality, 100);
+}
+
+/*!
+  Sets the number of worker threads to \a count.
+ */
+void MediaPipeline::setMaxThreadCount(int count)
+{
+    m_pool.setMaxThreadCount(qMax(1, count));
+}
+
+/*!
+  Returns the images of \a document by resource name, as encoded data.
+  The document is only read here, so this has to be called in its thread;
+  process() can then run anywhere.
+ */
+QList<MediaSource> MediaPipeline::images(const QTextDocument *document)
+{
+    QList<MediaSource> sources;
+    QSet<QString> names;
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextCharFormat format = it.fragment().charFormat();
+            if (!format.isImageFormat()) {
+                continue;
+            }
+            const QString name = format.toImageFormat().name();
+            if (names.contains(name)) {
+                continue;
+            }
+            names.insert(name);
+            const QByteArray data = DraftFormat::imageData(document, name);
+            if (!data.isEmpty()) {
+                sources << MediaSource(name, data);
+            }
+        }
+    }
+    return sources;
+}
+
+/*!
+  Processes \a sources and returns their variants in the same order.
+  This blocks until all images are done, so it belongs on a worker
+  thread; the work itself is spread over the pool.
+ */
+QList<MediaItem> MediaPipeline::process(const QList<MediaSource> &sources)
+{
+    QElapsedTimer timer;
+    timer.start();
+    MediaStats stats;
+    stats.images = sources.size();
+
+    QVector<QByteArray> hashes(sources.size());
+    for (int i = 0; i < sources.size(); ++i) {
+        m_pool.start(new HashTask(&sources.at(i).second, &hashes[i]));
+    }
+    m_pool.waitForDone();
+
+    MediaSettings settings;
+    settings.cacheRoot = m_cacheRoot;
+    settings.widths = m_widths;
+    settings.quality = m_quality;
+    QHash<QByteArray, int> first;
+    QVector<MediaItem> items(sources.size());
+    for (int i = 0; i < sources.size(); ++i) {
+        if (first.contains(hashes.at(i))) {
+            ++stats.duplicates;
+            continue;
+        }
+        first.insert(hashes.at(i), i);
+        m_pool.start(new ProcessTask(settings, &sources.at(i), hashes.at(i), &items[i]));
+    }
+    m_pool.waitForDone();
+
+    for (int i = 0; i < sources.size(); ++i) {
+        const int index = first.value(hashes.at(i));
+        if (index != i) {
+            items[i] = items.at(index);
+            items[i].name = sources.at(i).first;
+        } else if (items.at(i).cached) {
+            ++stats.cached;
+        } else if (items.at(i).isValid()) {
+            ++stats.encoded;
+        }
+    }
+    stats.elapsed = timer.nsecsElapsed() / 1000;
+    m_stats = stats;
+    return items.toList();
+}
+
+/*!
+  Returns the srcset attribute for the variants of \a item, which were
+  published at \a urls, in the order of MediaItem::variants.
+ */
+QString MediaPipeline::srcset(const MediaItem &item, const QStringList &urls)
+{
+    QStringList candidates;
+    for (int i = 0; i < item.variants.size() && i < urls.size(); ++i) {
+        candidates << urls.at(i) + QLatin1Char(' ') + QString::number(item.variants.at(i).width)
+                      + QLatin1Char('w');
+    }
+    return candidates.join(QLatin1String(", "));
+}
+
+}
@@ -0,0 +1,111 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef MEDIAPIPELINE_H
+#define MEDIAPIPELINE_H
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QSize>
+#include <QStringList>
+#include <QThreadPool>
+
+#include "document_global.h"
+
+QT_FORWARD_DECLARE_CLASS(QTextDocument)
+
+namespace GOW
+{
+
+typedef QPair<QString, QByteArray> MediaSource;
+
+struct MediaVariant
+{
+    MediaVariant() : width(0), height(0) {}
+
+    int width;
+    int height;
+    QString fileName;
+    QString mimeType;
+};
+
+struct MediaItem
+{
+    MediaItem() : cached(false) {}
+
+    bool isValid() const { return !variants.isEmpty(); }
+
+    QString name;
+    QByteArray hash; // SHA-1 of the original, hex encoded
+    QSize size;
+    QList<MediaVariant> variants; // narrowest first
+    bool cached;
+    QString error;
+};
+
+struct MediaStats
+{
+    MediaStats() : images(0), encoded(0), cached(0), duplicates(0), elapsed(0) {}
+
+    double imagesPerSecond() const { return elapsed > 0 ? images * 1000000.0 / elapsed : 0; }
+
+    int images;
+    int encoded;
+    int cached;
+    int duplicates;
+    qint64 elapsed; // microseconds
+};
+
+class DOCUMENT_EXPORT MediaPipeline
+{
+public:
+    explicit MediaPipeline(const QString &cacheRoot);
+    ~MediaPipeline();
+
+    void setWidths(const QList<int> &widths);
+    QList<int> widths() const { return m_widths; }
+
+    void setQuality(int quality);
+    int quality() const { return m_quality; }
+
+    void setMaxThreadCount(int count);
+
+    static QList<MediaSource> images(const QTextDocument *document);
+
+    QList<MediaItem> process(const QList<MediaSource> &sources);
+    MediaStats stats() const { return m_stats; }
+
+    static QString srcset(const MediaItem &item, const QStringList &urls);
+
+private:
+    Q_DISABLE_COPY(MediaPipeline)
+
+    QString m_cacheRoot;
+    QList<int> m_widths;
+    int m_quality;
+    QThreadPool m_pool;
+    MediaStats m_stats;
+}; // end of class GOW::MediaPipeline
+
+} // end of namespace GOW
+
+#endif // MEDIAPIPELINE_H
@@ -0,0 +1,869 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QPair>
+#include <QStringList>
+#if QT_VERSION >= 0x050000
+#include <QSaveFile>
+#endif
+
+#include <algorithm>
+
+#include "searchindex.h"
+
+namespace GOW
+{
+
+static const quint32 SEGMENT_MAGIC = 0x4f575358; // "OWSX"
+static const quint32 MANIFEST_MAGIC = 0x4f575349; // "OWSI"
+static const quint32 INDEX_VERSION = 1;
+static const QDataStream::Version STREAM_VERSION = QDataStream::Qt_4_8;
+static const int MAX_TERM_LENGTH = 64;
+static const int MAX_SEGMENTS = 8;
+static const int MERGE_COUNT = 4;
+static const int BUFFER_TOKEN_LIMIT = 4 * 1024 * 1024;
+
+typedef QMap<quint32, QVector<quint32> > Postings;
+
+struct SearchToken
+{
+    SearchToken() : position(0), prefix(false) {}
+    SearchToken(const QString &term, quint32 position) : term(term), position(position), prefix(false) {}
+
+    QString term;
+    quint32 position;
+    bool prefix;
+};
+
+struct TermEntry
+{
+    TermEntry() : offset(0), length(0) {}
+
+    QString term;
+    quint64 offset;
+    quint32 length;
+};
+
+struct TermLess
+{
+    bool operator()(const TermEntry &entry, const QString &term) const
+    {
+        return entry.term < term;
+    }
+};
+
+/*
+    An immutable part of the index on disk. Its term dictionary is kept in
+    memory; postings are read when a query needs them.
+ */
+struct SearchSegment
+{
+    SearchSegment() : id(0) {}
+
+    bool contains(quint32 document) const
+    {
+        return std::binary_search(documents.begin(), documents.end(), document);
+    }
+
+    int liveCount() const
+    {
+        return documents.size() - deleted.size();
+    }
+
+    QByteArray block(int index)
+    {
+        const TermEntry &entry = terms.at(index);
+        if (!file.seek(entry.offset)) {
+            return QByteArray();
+        }
+        return file.read(entry.length);
+    }
+
+    quint32 id;
+    QFile file;
+    QVector<quint32> documents;
+    QSet<quint32> deleted;
+    QVector<TermEntry> terms;
+};
+
+struct SmallerSegment
+{
+    bool operator()(const SearchSegment *a, const SearchSegment *b) const
+    {
+        return a->liveCount() < b->liveCount();
+    }
+};
+
+static bool isCjk(ushort c)
+{
+    return (c >= 0x3040 && c <= 0x30ff)     // Hiragana, Katakana
+            || (c >= 0x3400 && c <= 0x4dbf) // CJK Extension A
+            || (c >= 0x4e00 && c <= 0x9fff) // CJK Unified Ideographs
+            || (c >= 0xac00 && c <= 0xd7af) // Hangul Syllables
+            || (c >= 0xf900 && c <= 0xfaff); // CJK Compatibility Ideographs
+}
+
+/*
+    Latin text is split into case folded words. CJK text has no word
+    boundaries, so each run is split into overlapping bigrams, and its last
+    character is a term of its own; that way every character starts a term.
+
+    In a query the last character of a longer run is left out, since the
+    text may go on with a bigram where the query ends. A single character
+    is looked up as a prefix.
+ */
+static QVector<SearchToken> tokenize(const QString &text, bool query)
+{
+    QVector<SearchToken> tokens;
+    quint32 position = 0;
+    const int length = text.length();
+    int i = 0;
+    while (i < length) {
+        const QChar c = text.at(i);
+        if (isCjk(c.unicode())) {
+            int end = i + 1;
+            while (end < length && isCjk(text.at(end).unicode())) {
+                ++end;
+            }
+            for (int j = i; j < end; ++j) {
+                const bool last = j + 1 == end;
+                if (!last || !query || end - i == 1) {
+                    tokens << SearchToken(text.mid(j, last ? 1 : 2), position);
+                    tokens.last().prefix = query && last;
+                }
+                ++position;
+            }
+            i = end;
+        } else if (c.isLetterOrNumber()) {
+            int end = i + 1;
+            while (end < length && text.at(end).isLetterOrNumber() && !isCjk(text.at(end).unicode())) {
+                ++end;
+            }
+            tokens << SearchToken(text.mid(i, qMin(end - i, MAX_TERM_LENGTH)).toCaseFolded(), position++);
+            i = end;
+        } else {
+            ++i;
+        }
+    }
+    return tokens;
+}
+
+/*
+    Words are required terms, "quoted words" are phrases and a trailing '*'
+    makes a word a prefix. A word which is split into several terms, like
+    CJK text, is a phrase as well.
+ */
+static QList<QVector<SearchToken> > parseQuery(const QString &query)
+{
+    QList<QVector<SearchToken> > clauses;
+    const int length = query.length();
+    int i = 0;
+    while (i < length) {
+        if (query.at(i).isSpace()) {
+            ++i;
+            continue;
+        }
+        QString chunk;
+        bool prefix = false;
+        if (query.at(i) == QLatin1Char('"')) {
+            const int end = query.indexOf(QLatin1Char('"'), i + 1);
+            chunk = query.mid(i + 1, end < 0 ? -1 : end - i - 1);
+            i = end < 0 ? length : end + 1;
+        } else {
+            int end = i;
+            while (end < length && !query.at(end).isSpace()) {
+                ++end;
+            }
+            chunk = query.mid(i, end - i);
+            prefix = chunk.endsWith(QLatin1Char('*'));
+            i = end;
+        }
+        QVector<SearchToken> tokens = tokenize(chunk, true);
+        if (!tokens.isEmpty()) {
+            if (prefix) {
+                tokens.last().prefix = true;
+            }
+            clauses << tokens;
+        }
+    }
+    return clauses;
+}
+
+static void writeNumber(QByteArray *data, quint32 value)
+{
+    while (value >= 0x80) {
+        data->append(char(value | 0x80));
+        value >>= 7;
+    }
+    data->append(char(value));
+}
+
+static quint32 readNumber(const char *&p, const char *end)
+{
+    quint32 value = 0;
+    for (int shift = 0; p < end && shift < 35; shift += 7) {
+        const uchar byte = uchar(*p++);
+        value |= quint32(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    return value;
+}
+
+/*
+    Postings are stored as variable length numbers: the document count,
+    then per document the id delta, the position count and the position
+    deltas.
+ */
+static QByteArray encodePostings(const Postings &postings)
+{
+    QByteArray data;
+    writeNumber(&data, postings.size());
+    quint32 previous = 0;
+    for (Postings::const_iterator it = postings.constBegin(); it != postings.constEnd(); ++it) {
+        writeNumber(&data, it.key() - previous);
+        previous = it.key();
+        writeNumber(&data, it.value().size());
+        quint32 last = 0;
+        foreach (quint32 position, it.value()) {
+            writeNumber(&data, position - last);
+            last = position;
+        }
+    }
+    return data;
+}
+
+/*
+    Adds the postings of all documents in data which are not deleted.
+ */
+static void decodePostings(const QByteArray &data, const QSet<quint32> &deleted, Postings *postings)
+{
+    const char *p = data.constData();
+    const char *end = p + data.size();
+    quint32 document = 0;
+    const quint32 count = readNumber(p, end);
+    for (quint32 i = 0; i < count && p < end; ++i) {
+        document += readNumber(p, end);
+        const quint32 positionCount = readNumber(p, end);
+        const bool live = !deleted.contains(document);
+        QVector<quint32> *positions = live ? &(*postings)[document] : 0;
+        quint32 position = 0;
+        for (quint32 j = 0; j < positionCount && p < end; ++j) {
+            position += readNumber(p, end);
+            if (positions) {
+                positions->append(position);
+            }
+        }
+    }
+}
+
+static Postings termPostings(SearchSegment *segment, const SearchToken &token)
+{
+    Postings postings;
+    const QVector<TermEntry>::const_iterator begin = segment->terms.constBegin();
+    const QVector<TermEntry>::const_iterator end = segment->terms.constEnd();
+    QVector<TermEntry>::const_iterator it = std::lower_bound(begin, end, token.term, TermLess());
+    if (!token.prefix) {
+        if (it != end && it->term == token.term) {
+            decodePostings(segment->block(it - begin), segment->deleted, &postings);
+        }
+        return postings;
+    }
+    int terms = 0;
+    for (; it != end && it->term.startsWith(token.term); ++it) {
+        decodePostings(segment->block(it - begin), segment->deleted, &postings);
+        ++terms;
+    }
+    if (terms > 1) {
+        for (Postings::iterator p = postings.begin(); p != postings.end(); ++p) {
+            std::sort(p.value().begin(), p.value().end());
+        }
+    }
+    return postings;
+}
+
+/*
+    Returns the documents matching all tokens of clause at their relative
+    positions, with the number of matches.
+ */
+static QHash<quint32, int> matchClause(SearchSegment *segment, const QVector<SearchToken> &clause)
+{
+    QHash<quint32, int> matches;
+    QVector<Postings> lists;
+    foreach (const SearchToken &token, clause) {
+        lists << termPostings(segment, token);
+        if (lists.last().isEmpty()) {
+            return matches;
+        }
+    }
+    QVector<const QVector<quint32> *> positions(clause.size(), 0);
+    for (Postings::const_iterator it = lists.at(0).constBegin(); it != lists.at(0).constEnd(); ++it) {
+        bool all = true;
+        for (int i = 1; all && i < lists.size(); ++i) {
+            const Postings::const_iterator found = lists.at(i).constFind(it.key());
+            all = found != lists.at(i).constEnd();
+            if (all) {
+                positions[i] = &found.value();
+            }
+        }
+        if (!all) {
+            continue;
+        }
+        int count = 0;
+        foreach (quint32 start, it.value()) {
+            bool match = true;
+            for (int i = 1; match && i < clause.size(); ++i) {
+                const quint32 target = start + clause.at(i).position - clause.at(0).position;
+                match = std::binary_search(positions.at(i)->begin(), positions.at(i)->end(), target);
+            }
+            if (match) {
+                ++count;
+            }
+        }
+        if (count > 0) {
+            matches.insert(it.key(), count);
+        }
+    }
+    return matches;
+}
+
+/*
+    Writes a segment file: the sorted document ids, the postings blocks,
+    the term dictionary and finally the offset of the dictionary.
+ */
+class SegmentWriter
+{
+public:
+    explicit SegmentWriter(const QString &fileName) : m_file(fileName) {}
+
+    bool start(const QVector<quint32> &documents)
+    {
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return false;
+        }
+        m_stream.setDevice(&m_file);
+        m_stream.setVersion(STREAM_VERSION);
+        m_stream << SEGMENT_MAGIC << INDEX_VERSION << documents;
+        return m_stream.status() == QDataStream::Ok;
+    }
+
+    void addTerm(const QString &term, const QByteArray &block)
+    {
+        TermEntry entry;
+        entry.term = term;
+        entry.offset = m_file.pos();
+        entry.length = block.size();
+        m_stream.writeRawData(block.constData(), block.size());
+        m_terms << entry;
+    }
+
+    bool finish()
+    {
+        const quint64 dictionary = m_file.pos();
+        m_stream << quint32(m_terms.size());
+        foreach (const TermEntry &entry, m_terms) {
+            m_stream << entry.term << entry.offset << entry.length;
+        }
+        m_stream << dictionary;
+        const bool ok = m_stream.status() == QDataStream::Ok && m_file.flush();
+        m_file.close();
+        return ok;
+    }
+
+    QString errorString() const
+    {
+        return m_file.errorString();
+    }
+
+private:
+    QFile m_file;
+    QDataStream m_stream;
+    QVector<TermEntry> m_terms;
+};
+
+/*!
+  \class GOW::SearchIndex
+
+  An inverted index for full-text search over drafts, kept on disk.
+
+  Latin text is indexed by words and CJK text by character bigrams, each
+  with its positions, so queries can ask for words, prefixes and phrases
+  in both.
+
+  The index is a set of immutable segments. Updates are collected in
+  memory and commit() writes them as a new segment; older versions of
+  updated documents are only marked deleted. Once there are too many
+  segments, a commit merges the smallest ones, so the index is never
+  rebuilt as a whole. A manifest names the current segments and is
+  replaced atomically.
+ */
+
+/*!
+  Constructs an index which is not open.
+ */
+SearchIndex::SearchIndex() :
+    m_open(false),
+    m_nextSegment(1),
+    m_bufferTokens(0),
+    m_dirty(false)
+{
+}
+
+/*!
+  Destructs the index. Uncommitted updates are lost.
+ */
+SearchIndex::~SearchIndex()
+{
+    close();
+}
+
+/*!
+  Opens the index in the directory \a path, which is created if needed.
+ */
+bool SearchIndex::open(const QString &path)
+{
+    close();
+    if (!QDir().mkpath(path)) {
+        return fail(QString::fromLatin1("Cannot create %1").arg(path));
+    }
+    m_path = path;
+    QFile file(path + QLatin1String("/manifest"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        file.setFileName(path + QLatin1String("/manifest.new"));
+        file.open(QIODevice::ReadOnly);
+    }
+    QSet<quint32> listed;
+    if (file.isOpen()) {
+        QDataStream ds(&file);
+        ds.setVersion(STREAM_VERSION);
+        quint32 magic = 0;
+        quint32 version = 0;
+        quint32 count = 0;
+        ds >> magic >> version;
+        if (magic != MANIFEST_MAGIC || version > INDEX_VERSION) {
+            return fail(QString::fromLatin1("%1 is not a search index").arg(path));
+        }
+        ds >> m_nextSegment >> count;
+        for (quint32 i = 0; i < count && ds.status() == QDataStream::Ok; ++i) {
+            quint32 id = 0;
+            QSet<quint32> deleted;
+            ds >> id >> deleted;
+            // A damaged segment only loses its documents from the index.
+            SearchSegment *segment = readSegment(id);
+            if (segment) {
+                segment->deleted = deleted;
+                m_segments << segment;
+                listed.insert(id);
+            }
+        }
+    }
+    // Segments written by a commit which did not finish.
+    QDir dir(path);
+    foreach (const QString &name, dir.entryList(QStringList() << QLatin1String("segment-*"), QDir::Files)) {
+        if (!listed.contains(name.mid(8).toUInt(0, 16))) {
+            dir.remove(name);
+        }
+    }
+    m_open = true;
+    return true;
+}
+
+/*!
+  Closes the index. Uncommitted updates are lost.
+ */
+void SearchIndex::close()
+{
+    qDeleteAll(m_segments);
+    m_segments.clear();
+    m_buffer.clear();
+    m_bufferDocuments.clear();
+    m_bufferTokens = 0;
+    m_dirty = false;
+    m_nextSegment = 1;
+    m_open = false;
+}
+
+/*!
+  Returns true if the index is open.
+ */
+bool SearchIndex::isOpen() const
+{
+    return m_open;
+}
+
+/*!
+  Returns a description of the last error.
+ */
+QString SearchIndex::errorString() const
+{
+    return m_errorString;
+}
+
+/*!
+  Returns the number of indexed documents, including uncommitted ones.
+ */
+int SearchIndex::documentCount() const
+{
+    int count = m_bufferDocuments.size();
+    foreach (const SearchSegment *segment, m_segments) {
+        count += segment->liveCount();
+    }
+    return count;
+}
+
+/*!
+  Returns true if document \a id is indexed, including updates which are
+  not committed yet.
+ */
+bool SearchIndex::contains(quint32 id) const
+{
+    if (m_bufferDocuments.contains(id)) {
+        return true;
+    }
+    foreach (const SearchSegment *segment, m_segments) {
+        if (segment->contains(id) && !segment->deleted.contains(id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+  Replaces the indexed \a text of document \a id. The change is searchable
+  after the next commit().
+ */
+void SearchIndex::update(quint32 id, const QString &text)
+{
+    remove(id);
+    const QVector<SearchToken> tokens = tokenize(text, false);
+    foreach (const SearchToken &token, tokens) {
+        m_buffer[token.term][id].append(token.position);
+    }
+    m_bufferDocuments.insert(id);
+    m_bufferTokens += tokens.size();
+    m_dirty = true;
+    if (m_bufferTokens > BUFFER_TOKEN_LIMIT) {
+        commit();
+    }
+}
+
+/*!
+  Removes document \a id from the index with the next commit().
+ */
+void SearchIndex::remove(quint32 id)
+{
+    foreach (SearchSegment *segment, m_segments) {
+        if (segment->contains(id) && !segment->deleted.contains(id)) {
+            segment->deleted.insert(id);
+            m_dirty = true;
+        }
+    }
+    if (m_bufferDocuments.remove(id)) {
+        QMap<QString, PostingList>::iterator it = m_buffer.begin();
+        while (it != m_buffer.end()) {
+            it.value().remove(id);
+            it = it.value().isEmpty() ? m_buffer.erase(it) : it + 1;
+        }
+    }
+}
+
+/*!
+  Writes all updates to disk. Only the updated documents are written, as
+  a new segment; segments are merged once there are too many of them.
+ */
+bool SearchIndex::commit()
+{
+    if (!m_open) {
+        return fail(QLatin1String("The search index is not open"));
+    }
+    if (!m_dirty) {
+        return true;
+    }
+    if (!m_bufferDocuments.isEmpty()) {
+        SearchSegment *segment = writeBuffer();
+        if (!segment) {
+            return false;
+        }
+        m_segments << segment;
+        m_buffer.clear();
+        m_bufferDocuments.clear();
+        m_bufferTokens = 0;
+    }
+    QList<SearchSegment *> obsolete;
+    mergeIfNeeded(&obsolete);
+    if (!writeManifest()) {
+        qDeleteAll(obsolete);
+        return false;
+    }
+    foreach (SearchSegment *segment, obsolete) {
+        const QString path = segmentPath(segment->id);
+        delete segment;
+        QFile::remove(path);
+    }
+    m_dirty = false;
+    return true;
+}
+
+/*!
+  Returns the documents matching \a query, best first, at most \a limit
+  of them unless \a limit is negative.
+
+  The query is a list of words which must all occur. A word ending in '*'
+  matches all words it is a prefix of, and "quoted words" must occur in
+  this order. Updates are found once they are committed.
+ */
+QList<quint32> SearchIndex::search(const QString &query, int limit) const
+{
+    QList<quint32> result;
+    const QList<QVector<SearchToken> > clauses = parseQuery(query);
+    if (clauses.isEmpty()) {
+        return result;
+    }
+    QList<QPair<int, quint32> > hits;
+    foreach (SearchSegment *segment, m_segments) {
+        QHash<quint32, int> scores = matchClause(segment, clauses.first());
+        for (int i = 1; !scores.isEmpty() && i < clauses.size(); ++i) {
+            const QHash<quint32, int> matches = matchClause(segment, clauses.at(i));
+            QHash<quint32, int>::iterator it = scores.begin();
+            while (it != scores.end()) {
+                const QHash<quint32, int>::const_iterator found = matches.constFind(it.key());
+                if (found == matches.constEnd()) {
+                    it = scores.erase(it);
+                } else {
+                    it.value() += found.value();
+                    ++it;
+                }
+            }
+        }
+        for (QHash<quint32, int>::const_iterator it = scores.constBegin(); it != scores.constEnd(); ++it) {
+            hits << qMakePair(-it.value(), it.key());
+        }
+    }
+    std::sort(hits.begin(), hits.end());
+    const int count = limit < 0 ? hits.size() : qMin(limit, hits.size());
+    result.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        result << hits.at(i).second;
+    }
+    return result;
+}
+
+QString SearchIndex::segmentPath(quint32 id) const
+{
+    return m_path + QString::fromLatin1("/segment-%1").arg(id, 8, 16, QLatin1Char('0'));
+}
+
+SearchSegment *SearchIndex::readSegment(quint32 id)
+{
+    SearchSegment *segment = new SearchSegment;
+    segment->id = id;
+    segment->file.setFileName(segmentPath(id));
+    if (!segment->file.open(QIODevice::ReadOnly)) {
+        delete segment;
+        return 0;
+    }
+    const qint64 size = segment->file.size();
+    QDataStream ds(&segment->file);
+    ds.setVersion(STREAM_VERSION);
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint64 dictionary = 0;
+    quint32 count = 0;
+    ds >> magic >> version >> segment->documents;
+    if (magic != SEGMENT_MAGIC || version > INDEX_VERSION || size < 8 || !segment->file.seek(size - 8)) {
+        delete segment;
+        return 0;
+    }
+    ds >> dictionary;
+    if (dictionary >= quint64(size) || !segment->file.seek(dictionary)) {
+        delete segment;
+        return 0;
+    }
+    ds >> count;
+    if (count > quint64(size)) {
+        delete segment;
+        return 0;
+    }
+    segment->terms.resize(count);
+    for (quint32 i = 0; i < count && ds.status() == QDataStream::Ok; ++i) {
+        TermEntry &entry = segment->terms[i];
+        ds >> entry.term >> entry.offset >> entry.length;
+    }
+    if (ds.status() != QDataStream::Ok) {
+        delete segment;
+        return 0;
+    }
+    return segment;
+}
+
+SearchSegment *SearchIndex::writeBuffer()
+{
+    const quint32 id = m_nextSegment++;
+    QVector<quint32> documents = m_bufferDocuments.toList().toVector();
+    std::sort(documents.begin(), documents.end());
+    SegmentWriter writer(segmentPath(id));
+    if (!writer.start(documents)) {
+        fail(writer.errorString());
+        return 0;
+    }
+    for (QMap<QString, PostingList>::const_iterator it = m_buffer.constBegin(); it != m_buffer.constEnd(); ++it) {
+        writer.addTerm(it.key(), encodePostings(it.value()));
+    }
+    if (!writer.finish()) {
+        fail(writer.errorString());
+        return 0;
+    }
+    return readSegment(id);
+}
+
+/*
+    Merges segments term by term in dictionary order, leaving out deleted
+    documents. A document is live in one segment at most, so postings of
+    the same term never overlap.
+ */
+SearchSegment *SearchIndex::mergeSegments(const QList<SearchSegment *> &segments)
+{
+    QVector<quint32> documents;
+    foreach (const SearchSegment *segment, segments) {
+        foreach (quint32 document, segment->documents) {
+            if (!segment->deleted.contains(document)) {
+                documents << document;
+            }
+        }
+    }
+    std::sort(documents.begin(), documents.end());
+
+    const quint32 id = m_nextSegment++;
+    SegmentWriter writer(segmentPath(id));
+    if (!writer.start(documents)) {
+        fail(writer.errorString());
+        return 0;
+    }
+    QVector<int> cursors(segments.size(), 0);
+    forever {
+        QString term;
+        bool found = false;
+        for (int i = 0; i < segments.size(); ++i) {
+            if (cursors.at(i) < segments.at(i)->terms.size()) {
+                const QString &candidate = segments.at(i)->terms.at(cursors.at(i)).term;
+                if (!found || candidate < term) {
+                    term = candidate;
+                    found = true;
+                }
+            }
+        }
+        if (!found) {
+            break;
+        }
+        Postings postings;
+        for (int i = 0; i < segments.size(); ++i) {
+            SearchSegment *segment = segments.at(i);
+            if (cursors.at(i) < segment->terms.size() && segment->terms.at(cursors.at(i)).term == term) {
+                decodePostings(segment->block(cursors.at(i)), segment->deleted, &postings);
+                ++cursors[i];
+            }
+        }
+        if (!postings.isEmpty()) {
+            writer.addTerm(term, encodePostings(postings));
+        }
+    }
+    if (!writer.finish()) {
+        fail(writer.errorString());
+        return 0;
+    }
+    return readSegment(id);
+}
+
+/*
+    Drops segments without live documents and merges the smallest ones
+    while there are too many. Replaced segments are moved to obsolete;
+    their files are removed once the manifest no longer names them.
+ */
+void SearchIndex::mergeIfNeeded(QList<SearchSegment *> *obsolete)
+{
+    for (int i = m_segments.size() - 1; i >= 0; --i) {
+        if (m_segments.at(i)->liveCount() <= 0) {
+            *obsolete << m_segments.takeAt(i);
+        }
+    }
+    while (m_segments.size() > MAX_SEGMENTS) {
+        QList<SearchSegment *> parts = m_segments;
+        std::sort(parts.begin(), parts.end(), SmallerSegment());
+        parts = parts.mid(0, MERGE_COUNT);
+        SearchSegment *merged = mergeSegments(parts);
+        if (!merged) {
+            return;
+        }
+        foreach (SearchSegment *part, parts) {
+            m_segments.removeOne(part);
+            *obsolete << part;
+        }
+        m_segments << merged;
+    }
+}
+
+bool SearchIndex::writeManifest()
+{
+    const QString path = m_path + QLatin1String("/manifest");
+#if QT_VERSION >= 0x050000
+    QSaveFile file(path);
+#else
+    QFile file(path + QLatin1String(".new"));
+#endif
+    if (!file.open(QIODevice::WriteOnly)) {
+        return fail(file.errorString());
+    }
+    QDataStream ds(&file);
+    ds.setVersion(STREAM_VERSION);
+    ds << MANIFEST_MAGIC << INDEX_VERSION << m_nextSegment << quint32(m_segments.size());
+    foreach (const SearchSegment *segment, m_segments) {
+        ds << segment->id << segment->deleted;
+    }
+    if (ds.status() != QDataStream::Ok) {
+        return fail(file.errorString());
+    }
+#if QT_VERSION >= 0x050000
+    if (!file.commit()) {
+        return fail(file.errorString());
+    }
+#else
+    // open() falls back to manifest.new while there is no manifest.
+    file.close();
+    QFile::remove(path);
+    if (!QFile::rename(path + QLatin1String(".new"), path)) {
+        return fail(QString::fromLatin1("Cannot replace %1").arg(path));
+    }
+#endif
+    return true;
+}
+
+bool SearchIndex::fail(const QString &message)
+{
+    m_errorString = message;
+    return false;
+}
+
+}
@@ -0,0 +1,86 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QList>
+#include <QMap>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+#include "document_global.h"
+
+namespace GOW
+{
+
+struct SearchSegment;
+
+class DOCUMENT_EXPORT SearchIndex
+{
+public:
+    SearchIndex();
+    ~SearchIndex();
+
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const;
+    QString errorString() const;
+
+    int documentCount() const;
+    bool contains(quint32 id) const;
+
+    void update(quint32 id, const QString &text);
+    void remove(quint32 id);
+    bool commit();
+
+    QList<quint32> search(const QString &query, int limit = -1) const;
+
+private:
+    Q_DISABLE_COPY(SearchIndex)
+
+    typedef QMap<quint32, QVector<quint32> > PostingList;
+
+    QString segmentPath(quint32 id) const;
+    SearchSegment *readSegment(quint32 id);
+    SearchSegment *writeBuffer();
+    SearchSegment *mergeSegments(const QList<SearchSegment *> &segments);
+    bool writeManifest();
+    void mergeIfNeeded(QList<SearchSegment *> *obsolete);
+    bool fail(const QString &message);
+
+    QString m_path;
+    QString m_errorString;
+    bool m_open;
+    quint32 m_nextSegment;
+    QList<SearchSegment *> m_segments;
+
+    // Updates since the last commit, term -> document -> positions.
+    QMap<QString, PostingList> m_buffer;
+    QSet<quint32> m_bufferDocuments;
+    int m_bufferTokens;
+    bool m_dirty;
+}; // end of class GOW::SearchIndex
+
+} // end of namespace GOW
+
+#endif // SEARCHINDEX_H
@@ -30,7 +30,13 @@
 #include "qtlocalpeer.h"
 
 #include <QCoreApplication>
+#include <QDataStream>
+#include <QDebug>
+#include <QEventLoop>
+#include <QSharedMemory>
 #include <QTime>
+#include <QTimer>
+#include <QtEndian>
 
 #if defined(Q_OS_WIN)
 #include <QLibrary>
@@ -40,7 +46,6 @@ static PProcessIdToSessionId pProcessIdToSessionId = 0;
 #endif
 
 #if defined(Q_OS_UNIX)
-#include <time.h>
 #include <unistd.h>
 #endif
 
@@ -48,8 +53,77 @@ namespace Extern {
 
 const char *QtLocalPeer::ack = "ack";
 
+/*
+    A frame is a quint32 size followed by that many bytes. Frames of this
+    version start with FRAME_MAGIC and an entry count. Each entry is a kind
+    byte followed by
+    - MessageEntry: a quint32 size and the UTF-8 bytes of a message,
+    - PayloadEntry: a quint32 size and the payload bytes,
+    - SharedPayloadEntry: the quint32 payload size, a quint32 size and the
+      UTF-8 key of the shared memory segment holding the payload,
+    all big endian. Anything else is a frame of an older sender holding a
+    single UTF-8 message.
+*/
+static const quint32 FRAME_MAGIC = 0x51744c50; // "QtLP"
+static const quint32 MAX_FRAME_SIZE = 64 * 1024 * 1024;
+static const int SHARED_PAYLOAD_SIZE = 64 * 1024;
+static const int RETRY_INTERVAL = 10;
+
+enum EntryKind {
+    MessageEntry = 0,
+    PayloadEntry = 1,
+    SharedPayloadEntry = 2
+};
+
+static bool unpackFrame(const QByteArray &frame, QStringList *messages, QList<QtLocalPayload> *payloads)
+{
+    const uchar *data = reinterpret_cast<const uchar *>(frame.constData());
+    const quint32 size = frame.size();
+    if (size < 8 || qFromBigEndian<quint32>(data) != FRAME_MAGIC) {
+        messages->append(QString::fromUtf8(frame.constData(), frame.size()));
+        return true;
+    }
+    const quint32 count = qFromBigEndian<quint32>(data + 4);
+    quint32 pos = 8;
+    for (quint32 i = 0; i < count; ++i) {
+        if (size - pos < 5)
+            return false;
+        const quint8 kind = data[pos];
+        quint32 length = qFromBigEndian<quint32>(data + pos + 1);
+        pos += 5;
+        if (kind == SharedPayloadEntry) {
+            const quint32 payloadSize = length;
+            if (size - pos < 4)
+                return false;
+            length = qFromBigEndian<quint32>(data + pos);
+            pos += 4;
+            if (size - pos < length)
+                return false;
+            const QString key = QString::fromUtf8(frame.constData() + pos, length);
+            QSharedPointer<QSharedMemory> segment(new QSharedMemory(key));
+            if (!segment->attach(QSharedMemory::ReadOnly) || quint32(segment->size()) < payloadSize) {
+                qWarning() << "QtLocalPeer: Cannot attach to payload" << key << segment->errorString();
+                return false;
+            }
+            payloads->append(QtLocalPayload(segment, payloadSize));
+        } else {
+            if (size - pos < length)
+                return false;
+            if (kind == MessageEntry)
+                messages->append(QString::fromUtf8(frame.constData() + pos, length));
+            else if (kind == PayloadEntry)
+                payloads->append(QtLocalPayload(frame, pos, length));
+            else
+                return false;
+        }
+        pos += length;
+    }
+    return true;
+}
+
 QtLocalPeer::QtLocalPeer(QObject *parent, const QString &appId)
-    : QObject(parent), id(appId)
+    : QObject(parent), id(appId), sendSocket(0), sendTimeout(0), sendConnected(false),
+      nextFrame(1), sendingFrame(0)
 {
     if (id.isEmpty())
         id = QCoreApplication::applicationFilePath();  //### On win, check if this returns .../argv[0] without casefolding; .\MYAPP == .\myapp on Win
@@ -101,72 +175,288 @@ bool QtLocalPeer::isClient()
 
 bool QtLocalPeer::sendMessage(const QString &message, int timeout)
 {
-    if (!isClient())
+    return sendMessages(QStringList(message), timeout);
+}
+
+/*
+    Blocking variant of postMessages(), for a launching process which has
+    nothing else to do until the running instance took its messages.
+*/
+bool QtLocalPeer::sendMessages(const QStringList &messages, int timeout)
+{
+    if (!startSending(timeout))
         return false;
+    outgoing += messages;
+    return waitForFrame(nextFrame);
+}
 
-    QLocalSocket socket;
-    bool connOk = false;
-    for (int i = 0; i < 2; i++) {
-        // Try twice, in case the other instance is just starting up
-        socket.connectToServer(socketName);
-        connOk = socket.waitForConnected(timeout/2);
-        if (connOk || i)
-            break;
-        int ms = 250;
-#if defined(Q_OS_WIN)
-        Sleep(DWORD(ms));
-#else
-        struct timespec ts = { ms / 1000, (ms % 1000) * 1000 * 1000 };
-        nanosleep(&ts, NULL);
-#endif
-    }
-    if (!connOk)
+/*
+    Sends all \a messages to the running instance in a single frame and
+    returns at once. messagesSent() tells whether the running instance
+    acknowledged them within \a timeout milliseconds, or at all if
+    \a timeout is negative. While it is still starting up, connecting is
+    retried every few milliseconds.
+*/
+void QtLocalPeer::postMessages(const QStringList &messages, int timeout)
+{
+    if (!startSending(timeout))
+        return;
+    outgoing += messages;
+}
+
+/*
+    Blocking variant of postPayload().
+*/
+bool QtLocalPeer::sendPayload(const QByteArray &payload, int timeout)
+{
+    if (!startSending(timeout))
         return false;
+    outgoingPayloads << payload;
+    return waitForFrame(nextFrame);
+}
 
-    QByteArray uMsg(message.toUtf8());
-    QDataStream ds(&socket);
-    ds.writeBytes(uMsg.constData(), uMsg.size());
-    bool res = socket.waitForBytesWritten(timeout);
-    res &= socket.waitForReadyRead(timeout); // wait for ack
-    res &= (socket.read(qstrlen(ack)) == ack);
-    return res;
+/*
+    Waits until \a frame has been acknowledged or has failed. Frames posted
+    earlier may still be in flight; their results are not this one's.
+*/
+bool QtLocalPeer::waitForFrame(quint32 frame)
+{
+    awaitedFrames.insert(frame);
+    QEventLoop loop;
+    connect(this, SIGNAL(messagesSent(bool)), &loop, SLOT(quit()));
+    while (!frameResults.contains(frame))
+        loop.exec();
+    awaitedFrames.remove(frame);
+    return frameResults.take(frame);
 }
 
-void QtLocalPeer::receiveConnection()
+/*
+    Sends \a payload to the running instance, which gets it as a
+    payloadReceived(). Payloads of SHARED_PAYLOAD_SIZE bytes or more are
+    put into a shared memory segment and only its key is sent.
+*/
+void QtLocalPeer::postPayload(const QByteArray &payload, int timeout)
 {
-    QLocalSocket* socket = server->nextPendingConnection();
-    if (!socket)
+    if (!startSending(timeout))
+        return;
+    outgoingPayloads << payload;
+}
+
+/*
+    Starts a connection unless one is in progress already; anything queued
+    before it is established goes out in the same frame.
+*/
+bool QtLocalPeer::startSending(int timeout)
+{
+    if (!isClient()) {
+        emit messagesSent(false);
+        return false;
+    }
+    if (!sendSocket) {
+        sendTimeout = timeout;
+        sendTimer.start();
+        // Connecting is finished from the event loop at the earliest.
+        QTimer::singleShot(0, this, SLOT(connectToPeer()));
+        sendSocket = new QLocalSocket(this);
+        connect(sendSocket, SIGNAL(connected()), SLOT(senderConnected()));
+        connect(sendSocket, SIGNAL(readyRead()), SLOT(senderReadyRead()));
+        connect(sendSocket, SIGNAL(error(QLocalSocket::LocalSocketError)), SLOT(senderError()));
+    }
+    return true;
+}
+
+QByteArray QtLocalPeer::packFrame()
+{
+    QByteArray body;
+    QDataStream ds(&body, QIODevice::WriteOnly);
+    ds << FRAME_MAGIC << quint32(outgoing.size() + outgoingPayloads.size());
+    foreach (const QString &message, outgoing) {
+        const QByteArray uMsg = message.toUtf8();
+        ds << quint8(MessageEntry);
+        ds.writeBytes(uMsg.constData(), uMsg.size());
+    }
+    foreach (const QByteArray &payload, outgoingPayloads) {
+        QSharedMemory *segment = payload.size() >= SHARED_PAYLOAD_SIZE ? createSegment(payload) : 0;
+        if (segment) {
+            const QByteArray key = segment->key().toUtf8();
+            ds << quint8(SharedPayloadEntry) << quint32(payload.size());
+            ds.writeBytes(key.constData(), key.size());
+        } else {
+            ds << quint8(PayloadEntry);
+            ds.writeBytes(payload.constData(), payload.size());
+        }
+    }
+    outgoing.clear();
+    outgoingPayloads.clear();
+    sendingFrame = nextFrame++;
+
+    QByteArray frame;
+    QDataStream fs(&frame, QIODevice::WriteOnly);
+    fs.writeBytes(body.constData(), body.size());
+    return frame;
+}
+
+QSharedMemory *QtLocalPeer::createSegment(const QByteArray &payload)
+{
+    static int serial = 0;
+    const QString key = socketName + QLatin1String("-payload-")
+            + QString::number(QCoreApplication::applicationPid()) + QLatin1Char('-')
+            + QString::number(++serial);
+    QSharedMemory *segment = new QSharedMemory(key, this);
+    if (!segment->create(payload.size())) {
+        qWarning() << "QtLocalPeer: Cannot create payload segment" << segment->errorString();
+        delete segment;
+        return 0;
+    }
+    memcpy(segment->data(), payload.constData(), payload.size());
+    sendSegments << segment;
+    return segment;
+}
+
+void QtLocalPeer::connectToPeer()
+{
+    if (!sendSocket)
+        return;
+    sendConnected = false;
+    sendSocket->connectToServer(socketName);
+}
+
+void QtLocalPeer::senderConnected()
+{
+    sendConnected = true;
+    sendSocket->write(packFrame());
+    // A negative timeout waits forever.
+    if (sendTimeout >= 0)
+        QTimer::singleShot(qMax(0, int(sendTimeout - sendTimer.elapsed())), this, SLOT(senderTimedOut()));
+}
+
+void QtLocalPeer::senderReadyRead()
+{
+    if (sendSocket->bytesAvailable() < qstrlen(ack))
         return;
+    finishSending(sendSocket->read(qstrlen(ack)) == ack);
+}
 
-    // Why doesn't Qt have a blocking stream that takes care of this shait???
-    while (socket->bytesAvailable() < static_cast<int>(sizeof(quint32)))
-        socket->waitForReadyRead();
-    QDataStream ds(socket);
-    QByteArray uMsg;
-    quint32 remaining;
-    ds >> remaining;
-    uMsg.resize(remaining);
-    int got = 0;
-    char* uMsgBuf = uMsg.data();
-    //qDebug() << "RCV: remaining" << remaining;
-    do {
-        got = ds.readRawData(uMsgBuf, remaining);
-        remaining -= got;
-        uMsgBuf += got;
-        //qDebug() << "RCV: got" << got << "remaining" << remaining;
-    } while (remaining && got >= 0 && socket->waitForReadyRead(2000));
-    //### error check: got<0
-    if (got < 0) {
-        qWarning() << "QtLocalPeer: Message reception failed" << socket->errorString();
-        delete socket;
+void QtLocalPeer::senderError()
+{
+    if (!sendSocket)
+        return;
+    if (!sendConnected && (sendTimeout < 0 || sendTimer.elapsed() + RETRY_INTERVAL < sendTimeout)) {
+        // The running instance holds the lock but does not listen yet.
+        sendSocket->abort();
+        QTimer::singleShot(RETRY_INTERVAL, this, SLOT(connectToPeer()));
         return;
     }
-    // ### async this
-    QString message = QString::fromUtf8(uMsg.constData(), uMsg.size());
-    socket->write(ack, qstrlen(ack));
-    socket->waitForBytesWritten(1000);
-    delete socket;
-    emit messageReceived(message); // ##(might take a long time to return)
+    finishSending(false);
+}
+
+void QtLocalPeer::senderTimedOut()
+{
+    // Ignore timers of earlier sends.
+    if (sendSocket && sendConnected && sendTimeout >= 0 && sendTimer.elapsed() >= sendTimeout)
+        finishSending(false);
+}
+
+void QtLocalPeer::finishSending(bool ok)
+{
+    sendSocket->disconnect(this);
+    sendSocket->abort();
+    sendSocket->deleteLater();
+    sendSocket = 0;
+    qDeleteAll(sendSegments);
+    sendSegments.clear();
+    if (awaitedFrames.contains(sendingFrame))
+        frameResults.insert(sendingFrame, ok);
+    sendingFrame = 0;
+    if (!ok) {
+        // Whatever was queued behind fails as well.
+        if (awaitedFrames.contains(nextFrame))
+            frameResults.insert(nextFrame, false);
+        if (!outgoing.isEmpty() || !outgoingPayloads.isEmpty())
+            ++nextFrame;
+        outgoing.clear();
+        outgoingPayloads.clear();
+    }
+    emit messagesSent(ok);
+    if (!outgoing.isEmpty() || !outgoingPayloads.isEmpty())
+        startSending(sendTimeout);
+}
+
+void QtLocalPeer::receiveConnection()
+{
+    while (QLocalSocket *socket = server->nextPendingConnection()) {
+        frameSizes.insert(socket, 0);
+        connect(socket, SIGNAL(readyRead()), SLOT(readFrames()));
+        connect(socket, SIGNAL(disconnected()), SLOT(receiverDisconnected()));
+        // Data may have arrived together with the connection.
+        if (socket->bytesAvailable() > 0)
+            QMetaObject::invokeMethod(this, "readFrames", Qt::QueuedConnection);
+    }
+}
+
+/*
+    Event driven receiver. Each connection is either waiting for the size
+    of a frame or for the frame itself; nothing here ever waits for data.
+*/
+void QtLocalPeer::readFrames()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    QList<QLocalSocket *> sockets;
+    if (socket)
+        sockets << socket;
+    else
+        sockets = frameSizes.keys();
+
+    foreach (socket, sockets) {
+        forever {
+            quint32 &size = frameSizes[socket];
+            if (size == 0) {
+                if (socket->bytesAvailable() < qint64(sizeof(quint32)))
+                    break;
+                QDataStream ds(socket);
+                ds >> size;
+                if (size == 0 || size > MAX_FRAME_SIZE) {
+                    qWarning() << "QtLocalPeer: Invalid message size" << size;
+                    frameSizes.remove(socket);
+                    socket->abort();
+                    socket->deleteLater();
+                    break;
+                }
+            }
+            if (socket->bytesAvailable() < size)
+                break;
+
+            const QByteArray frame = socket->read(size);
+            size = 0;
+            QStringList messages;
+            QList<QtLocalPayload> payloads;
+            if (!unpackFrame(frame, &messages, &payloads)) {
+                qWarning() << "QtLocalPeer: Malformed message frame";
+                frameSizes.remove(socket);
+                socket->abort();
+                socket->deleteLater();
+                break;
+            }
+            // Acknowledge before handling, which may take a while.
+            socket->write(ack, qstrlen(ack));
+            socket->flush();
+            foreach (const QString &message, messages)
+                emit messageReceived(message);
+            if (!messages.isEmpty() || payloads.isEmpty())
+                emit messagesReceived(messages);
+            foreach (const QtLocalPayload &payload, payloads)
+                emit payloadReceived(payload);
+        }
+    }
+}
+
+void QtLocalPeer::receiverDisconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    if (!socket)
+        return;
+    frameSizes.remove(socket);
+    socket->deleteLater();
 }
 
 } // namespace Extern
@@ -29,12 +29,54 @@
 
 #include "qtlockedfile.h"
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QLocalServer>
 #include <QLocalSocket>
 #include <QDir>
+#include <QMetaType>
+#include <QSharedMemory>
+#include <QSharedPointer>
+#include <QSet>
+#include <QStringList>
 
 namespace Extern {
 
+/*
+    Bytes handed over by another instance. Large payloads stay in the
+    shared memory segment they were passed in and small ones in the frame
+    they arrived with; constData() points right into either, so content
+    can be parsed in place. The data is valid as long as any copy of the
+    payload exists.
+*/
+class QtLocalPayload
+{
+public:
+    QtLocalPayload() : ptr(0), length(0) {}
+    QtLocalPayload(const QByteArray &buffer, int offset, int size)
+        : buffer(buffer), ptr(buffer.constData() + offset), length(size) {}
+    QtLocalPayload(const QSharedPointer<QSharedMemory> &memory, int size)
+        : memory(memory), ptr(static_cast<const char *>(memory->constData())), length(size) {}
+
+    bool isNull() const
+        { return ptr == 0; }
+    bool isShared() const
+        { return !memory.isNull(); }
+    const char *constData() const
+        { return ptr; }
+    int size() const
+        { return length; }
+    // Wraps the data without copying it.
+    QByteArray data() const
+        { return QByteArray::fromRawData(ptr, length); }
+
+private:
+    QSharedPointer<QSharedMemory> memory;
+    QByteArray buffer;
+    const char *ptr;
+    int length;
+};
+
 class QtLocalPeer : public QObject
 {
     Q_OBJECT
@@ -43,15 +85,31 @@ public:
     explicit QtLocalPeer(QObject *parent = 0, const QString &appId = QString());
     bool isClient();
     bool sendMessage(const QString &message, int timeout);
+    bool sendMessages(const QStringList &messages, int timeout);
+    void postMessages(const QStringList &messages, int timeout);
+    bool sendPayload(const QByteArray &payload, int timeout);
+    void postPayload(const QByteArray &payload, int timeout);
     QString applicationId() const
         { return id; }
 
 Q_SIGNALS:
     void messageReceived(const QString &message);
+    void messagesReceived(const QStringList &messages);
+    void payloadReceived(const QtLocalPayload &payload);
+    void messagesSent(bool ok);
 
 protected Q_SLOTS:
     void receiveConnection();
 
+private Q_SLOTS:
+    void readFrames();
+    void receiverDisconnected();
+    void connectToPeer();
+    void senderConnected();
+    void senderReadyRead();
+    void senderError();
+    void senderTimedOut();
+
 protected:
     QString id;
     QString socketName;
@@ -59,7 +117,36 @@ protected:
     QtLockedFile lockFile;
 
 private:
+    bool startSending(int timeout);
+    bool waitForFrame(quint32 frame);
+    QByteArray packFrame();
+    QSharedMemory *createSegment(const QByteArray &payload);
+    void finishSending(bool ok);
+
     static const char* ack;
+
+    // Receiver: expected frame size per connection, 0 while the size
+    // itself has not arrived yet.
+    QHash<QLocalSocket *, quint32> frameSizes;
+
+    // Sender: at most one connection at a time; messages posted meanwhile
+    // go out together in the next frame.
+    QLocalSocket *sendSocket;
+    QStringList outgoing;
+    QList<QByteArray> outgoingPayloads;
+    // Kept until the receiver acknowledged, i.e. attached to them.
+    QList<QSharedMemory *> sendSegments;
+    QElapsedTimer sendTimer;
+    int sendTimeout;
+    bool sendConnected;
+    // Frames are numbered from 1; outgoing is what goes into nextFrame.
+    quint32 nextFrame;
+    quint32 sendingFrame;
+    // Results of frames a blocking send waits for.
+    QHash<quint32, bool> frameResults;
+    QSet<quint32> awaitedFrames;
 };
 
 } // namespace Extern
+
+Q_DECLARE_METATYPE(Extern::QtLocalPayload)
@@ -40,8 +40,13 @@ void QtSingleApplication::sysInit(const QString &appId)
     actWin = 0;
     firstPeer = new QtLocalPeer(this, appId);
     connect(firstPeer, SIGNAL(messageReceived(QString)), SIGNAL(messageReceived(QString)));
+    connect(firstPeer, SIGNAL(messagesReceived(QStringList)), SIGNAL(messagesReceived(QStringList)));
+    connect(firstPeer, SIGNAL(messagesSent(bool)), SIGNAL(messagesSent(bool)));
+    connect(firstPeer, SIGNAL(payloadReceived(QtLocalPayload)), SIGNAL(payloadReceived(QtLocalPayload)));
     pidPeer = new QtLocalPeer(this, appId + QLatin1Char('-') + QString::number(QCoreApplication::applicationPid(), 10));
     connect(pidPeer, SIGNAL(messageReceived(QString)), SIGNAL(messageReceived(QString)));
+    connect(pidPeer, SIGNAL(messagesReceived(QStringList)), SIGNAL(messagesReceived(QStringList)));
+    connect(pidPeer, SIGNAL(payloadReceived(QtLocalPayload)), SIGNAL(payloadReceived(QtLocalPayload)));
 }
 
 
@@ -93,6 +98,43 @@ bool QtSingleApplication::sendMessage(const QString &message, int timeout, qint6
     return peer.sendMessage(message, timeout);
 }
 
+/*
+    Sends all \a messages to the running instance in one go and waits for
+    it to acknowledge them.
+*/
+bool QtSingleApplication::sendMessages(const QStringList &messages, int timeout)
+{
+    return firstPeer->sendMessages(messages, timeout);
+}
+
+/*
+    Like sendMessages(), but returns at once; messagesSent() reports the
+    result.
+*/
+void QtSingleApplication::postMessages(const QStringList &messages, int timeout)
+{
+    firstPeer->postMessages(messages, timeout);
+}
+
+/*
+    Hands \a payload over to the running instance and waits for it to
+    acknowledge. Large payloads are passed in shared memory, so the running
+    instance can read them without them being copied through the socket.
+*/
+bool QtSingleApplication::sendPayload(const QByteArray &payload, int timeout)
+{
+    return firstPeer->sendPayload(payload, timeout);
+}
+
+/*
+    Like sendPayload(), but returns at once; messagesSent() reports the
+    result.
+*/
+void QtSingleApplication::postPayload(const QByteArray &payload, int timeout)
+{
+    firstPeer->postPayload(payload, timeout);
+}
+
 QString QtSingleApplication::id() const
 {
     return firstPeer->applicationId();
@@ -107,11 +149,11 @@ void QtSingleApplication::setActivationWindow(QWidget *aw, bool activateOnMessag
 {
     actWin = aw;
     if (activateOnMessage) {
-        connect(firstPeer, SIGNAL(messageReceived(QString)), this, SLOT(activateWindow()));
-        connect(pidPeer, SIGNAL(messageReceived(QString)), this, SLOT(activateWindow()));
+        connect(firstPeer, SIGNAL(messagesReceived(QStringList)), this, SLOT(activateWindow()));
+        connect(pidPeer, SIGNAL(messagesReceived(QStringList)), this, SLOT(activateWindow()));
     } else {
-        disconnect(firstPeer, SIGNAL(messageReceived(QString)), this, SLOT(activateWindow()));
-        disconnect(pidPeer, SIGNAL(messageReceived(QString)), this, SLOT(activateWindow()));
+        disconnect(firstPeer, SIGNAL(messagesReceived(QStringList)), this, SLOT(activateWindow()));
+        disconnect(pidPeer, SIGNAL(messagesReceived(QStringList)), this, SLOT(activateWindow()));
     }
 }
 
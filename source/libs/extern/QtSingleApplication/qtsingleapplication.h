@@ -28,10 +28,12 @@
 ****************************************************************************/
 
 #include <QApplication>
+#include <QStringList>
 
 namespace Extern {
 
 class QtLocalPeer;
+class QtLocalPayload;
 
 class QtSingleApplication : public QApplication
 {
@@ -53,6 +55,10 @@ public:
 
 public Q_SLOTS:
     bool sendMessage(const QString &message, int timeout = 5000, qint64 pid = -1);
+    bool sendMessages(const QStringList &messages, int timeout = 5000);
+    void postMessages(const QStringList &messages, int timeout = 5000);
+    bool sendPayload(const QByteArray &payload, int timeout = 5000);
+    void postPayload(const QByteArray &payload, int timeout = 5000);
     void activateWindow();
 
 //Obsolete methods:
@@ -62,6 +68,9 @@ public:
 
 Q_SIGNALS:
     void messageReceived(const QString &message);
+    void messagesReceived(const QStringList &messages);
+    void messagesSent(bool ok);
+    void payloadReceived(const QtLocalPayload &payload);
     void fileOpenRequest(const QString &file);
 
 private:
@@ -22,4 +22,6 @@
 TEMPLATE = subdirs
 CONFIG  += ordered
 SUBDIRS  = \
+    document \
+    blog \
     core
@@ -24,4 +24,5 @@ CONFIG  += ordered
 SUBDIRS  = \
     libs \
     application \
+    tools \
     plugins
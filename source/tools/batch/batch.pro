@@ -0,0 +1,40 @@
+#-------------------------------------------------
+#
+# OrbitsWriter - an Offline Blog Writer
+#
+# Copyright (C) 2012 devbean@galaxyworld.org
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+#-------------------------------------------------
+
+include(../../../OrbitsWriter.pri)
+
+TEMPLATE = app
+TARGET   = orbitswriter-batch
+DESTDIR  = $$APPLICATION_BIN_PATH
+CONFIG  += console
+CONFIG  -= app_bundle
+
+include(../../rpath.pri)
+include(../../libs/document/document.pri)
+
+# Headless, so neither widgets nor the core library are linked.
+QT       = core gui
+
+SOURCES += \
+    main.cpp
+
+target.path  = /bin
+INSTALLS    += target
@@ -0,0 +1,235 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutex>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#if QT_VERSION >= 0x050000
+#include <QGuiApplication>
+#else
+#include <QApplication>
+#endif
+
+#include <algorithm>
+
+#include <DraftProcessor>
+
+static const int SLOWEST_REPORTED = 5;
+static const int QUEUED_PER_THREAD = 4;
+
+static QTextStream &output()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+static void usage()
+{
+    output() << "Usage: orbitswriter-batch [options] <directory|file>...\n"
+                "\n"
+                "Processes all drafts (*.html, *.htm) below the given directories.\n"
+                "\n"
+                "  --normalize        rewrite drafts in normalized form\n"
+                "  --export=DIR       write the post HTML of every draft below DIR\n"
+                "  --validate         report problems (default if nothing else is given)\n"
+                "  --jobs=N, -j N     number of worker threads (default: all cores)\n"
+                "  --quiet            report failed drafts only\n";
+    output().flush();
+}
+
+static void report(const GOW::DraftResult &result, bool quiet)
+{
+    if (quiet && result.ok) {
+        return;
+    }
+    static QMutex mutex;
+    QMutexLocker locker(&mutex);
+    QTextStream &stream = output();
+    stream << QString::fromLatin1("%1 ms  %2  %3\n")
+              .arg(result.elapsed / 1000.0, 9, 'f', 2)
+              .arg(QLatin1String(result.ok ? "ok  " : "FAIL"))
+              .arg(QDir::toNativeSeparators(result.fileName));
+    foreach (const QString &issue, result.issues) {
+        stream << "              " << issue << '\n';
+    }
+    stream.flush();
+}
+
+/*
+    Processes one draft. The semaphore bounds the number of queued tasks,
+    so the pool never holds more than a few drafts per thread at once.
+ */
+class DraftTask : public QRunnable
+{
+public:
+    DraftTask(const GOW::DraftProcessor *processor, const QString &fileName,
+              GOW::DraftResult *result, QSemaphore *queueSlots, bool quiet) :
+        m_processor(processor),
+        m_fileName(fileName),
+        m_result(result),
+        m_slots(queueSlots),
+        m_quiet(quiet)
+    {
+    }
+
+    void run()
+    {
+        *m_result = m_processor->process(m_fileName);
+        report(*m_result, m_quiet);
+        m_slots->release();
+    }
+
+private:
+    const GOW::DraftProcessor *m_processor;
+    QString m_fileName;
+    GOW::DraftResult *m_result;
+    QSemaphore *m_slots;
+    bool m_quiet;
+};
+
+static bool slowerThan(const GOW::DraftResult *a, const GOW::DraftResult *b)
+{
+    return a->elapsed > b->elapsed;
+}
+
+int main(int argc, char **argv)
+{
+#if QT_VERSION >= 0x050000
+    // Text documents need a platform plugin for fonts; this one needs no display.
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty()) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+#else
+    QApplication app(argc, argv, false);
+#endif
+
+    GOW::DraftProcessor::Operations operations = 0;
+    QString exportRoot;
+    int jobs = QThread::idealThreadCount();
+    bool quiet = false;
+    QStringList paths;
+    const QStringList arguments = app.arguments();
+    for (int i = 1; i < arguments.count(); ++i) {
+        const QString argument = arguments.at(i);
+        if (argument == QLatin1String("--normalize")) {
+            operations |= GOW::DraftProcessor::Normalize;
+        } else if (argument == QLatin1String("--validate")) {
+            operations |= GOW::DraftProcessor::Validate;
+        } else if (argument.startsWith(QLatin1String("--export="))) {
+            operations |= GOW::DraftProcessor::Export;
+            exportRoot = QDir(argument.mid(9)).absolutePath();
+        } else if (argument.startsWith(QLatin1String("--jobs="))) {
+            jobs = argument.mid(7).toInt();
+        } else if (argument == QLatin1String("-j") && i + 1 < arguments.count()) {
+            jobs = arguments.at(++i).toInt();
+        } else if (argument == QLatin1String("--quiet")) {
+            quiet = true;
+        } else if (argument.startsWith(QLatin1Char('-'))) {
+            usage();
+            return argument == QLatin1String("--help") ? 0 : 2;
+        } else {
+            paths << argument;
+        }
+    }
+    if (paths.isEmpty() || jobs < 1) {
+        usage();
+        return 2;
+    }
+    if (!operations) {
+        operations = GOW::DraftProcessor::Validate;
+    }
+
+    // One processor per root, so exported files keep their relative paths.
+    QList<GOW::DraftProcessor> processors;
+    QVector<int> processorOfFile;
+    QStringList files;
+    foreach (const QString &path, paths) {
+        const QFileInfo info(path);
+        if (info.isFile()) {
+            processors << GOW::DraftProcessor(operations, info.absolutePath(), exportRoot);
+            files << info.absoluteFilePath();
+            processorOfFile << processors.count() - 1;
+            continue;
+        }
+        processors << GOW::DraftProcessor(operations, info.absoluteFilePath(), exportRoot);
+        QStringList found;
+        QDirIterator it(info.absoluteFilePath(), QStringList() << QLatin1String("*.html") << QLatin1String("*.htm"),
+                        QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            found << it.next();
+        }
+        found.sort();
+        files << found;
+        processorOfFile.insert(processorOfFile.count(), found.count(), processors.count() - 1);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QVector<GOW::DraftResult> results(files.count());
+    QThreadPool pool;
+    pool.setMaxThreadCount(jobs);
+    QSemaphore queueSlots(jobs * QUEUED_PER_THREAD);
+    for (int i = 0; i < files.count(); ++i) {
+        queueSlots.acquire();
+        pool.start(new DraftTask(&processors.at(processorOfFile.at(i)), files.at(i),
+                                 &results[i], &queueSlots, quiet));
+    }
+    pool.waitForDone();
+    const qint64 wallTime = timer.elapsed();
+
+    int failed = 0;
+    qint64 busyTime = 0;
+    QVector<const GOW::DraftResult *> slowest;
+    for (int i = 0; i < results.count(); ++i) {
+        failed += results.at(i).ok ? 0 : 1;
+        busyTime += results.at(i).elapsed;
+        slowest << &results.at(i);
+    }
+    std::sort(slowest.begin(), slowest.end(), slowerThan);
+    slowest.resize(qMin(slowest.count(), SLOWEST_REPORTED));
+
+    QTextStream &stream = output();
+    stream << QString::fromLatin1("\n%1 drafts, %2 failed, %3 s with %4 threads (%5 drafts/s, %6 ms per draft)\n")
+              .arg(results.count()).arg(failed)
+              .arg(wallTime / 1000.0, 0, 'f', 2).arg(jobs)
+              .arg(wallTime > 0 ? results.count() * 1000.0 / wallTime : 0.0, 0, 'f', 1)
+              .arg(results.isEmpty() ? 0.0 : busyTime / 1000.0 / results.count(), 0, 'f', 2);
+    if (!slowest.isEmpty()) {
+        stream << "slowest:\n";
+        foreach (const GOW::DraftResult *result, slowest) {
+            stream << QString::fromLatin1("%1 ms  %2\n")
+                      .arg(result->elapsed / 1000.0, 9, 'f', 2)
+                      .arg(QDir::toNativeSeparators(result->fileName));
+        }
+    }
+    stream.flush();
+    return failed > 0 ? 1 : 0;
+}
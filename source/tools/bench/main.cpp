@@ -0,0 +1,1734 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2013 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QAbstractTextDocumentLayout>
+#include <QApplication>
+#include <QBuffer>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFontDatabase>
+#include <QHBoxLayout>
+#include <QImageWriter>
+#include <QListView>
+#include <QPainter>
+#include <QProcess>
+#include <QScrollBar>
+#include <QStringList>
+#include <QStyledItemDelegate>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextList>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <DraftFormat>
+#include <DraftLibrary>
+#include <SearchIndex>
+#include <qtlocalpeer.h>
+
+#include "autosavejournal.h"
+#include "colorbutton.h"
+#include "fontchooser.h"
+#include "htmlsynchronizer.h"
+#include "imagecache.h"
+#include "legacycolorbutton.h"
+#include "librarydock.h"
+#include "librarymodel.h"
+#include "previewer.h"
+#include "visualeditor.h"
+
+using GOW::DraftFormat;
+using GOW::DraftLibrary;
+using GOW::FormatChanges;
+using GOW::SearchIndex;
+using Extern::QtLocalPayload;
+using Extern::QtLocalPeer;
+
+static const int MEGABYTE = 1024 * 1024;
+// What a single event loop tick of the editor may cost.
+static const qint64 TICK_TARGET = 1000;
+// Frames of plain messages cannot be larger than this.
+static const int MAX_MESSAGE_SIZE = 64 * MEGABYTE;
+// A later launch should have its window painted within this, in milliseconds.
+static const qint64 LAUNCH_TARGET = 100;
+// The running instance prepares its spare window this long after a window opened.
+static const int SPARE_WINDOW_WAIT = 3000;
+
+static QTextStream &output()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+static void usage()
+{
+    output() << "Usage: orbitswriter-bench [options]\n"
+                "\n"
+                "Times the hot paths of OrbitsWriter on generated content.\n"
+                "\n"
+                "  --payload[=MB,...]  hand payloads of MB megabytes (default: 1,10,100)\n"
+                "                      to another process, in shared memory and the way\n"
+                "                      plain messages go, and scan them in place\n"
+                "  --handoff[=N]       hand N file names to another process the way a\n"
+                "                      later launch does (default: 10)\n"
+                "  --second-launch[=N] start OrbitsWriter and launch it N more times\n"
+                "                      (default: 10), timing each window from main()\n"
+                "  --draft-load[=MB,...]\n"
+                "                      load posts of MB megabytes (default: 5) from the\n"
+                "                      draft format, plain and compressed, and from HTML\n"
+                "  --sync[=KB,...]     switch to the source tab and back after a one\n"
+                "                      character edit, on posts of KB kilobytes\n"
+                "                      (default: 10,5120)\n"
+                "  --preview[=KB,...]  type into posts of KB kilobytes (default: 10,1024)\n"
+                "                      with the preview shown and rebuilt as it goes\n"
+                "  --format[=KB,...]   apply bold, italic, underline and a font size to\n"
+                "                      selections of KB kilobytes (default: 1,100,5120)\n"
+                "  --font-popup[=N]    open the font chooser popup with at least N\n"
+                "                      families (default: 600)\n"
+                "  --color-popup[=N]   open the popups of N color buttons, against the\n"
+                "                      previous color button (default: 20)\n"
+                "  --autosave[=MB,...] time the autosave journal on posts of MB megabytes\n"
+                "                      (default: 5): keystrokes, flushes and compaction\n"
+                "  --library[=N]       create a library of N drafts (default: 100000),\n"
+                "                      open it and scroll through it in the library dock\n"
+                "  --images[=N]        scroll through a post with N photos and a very\n"
+                "                      tall image (default: 50), reporting memory\n"
+                "  --search[=MB]       index MB megabytes of English and Chinese drafts\n"
+                "                      (default: 1024) and time queries\n"
+                "  --runs=N            repetitions of each measurement (default: 5)\n";
+    output().flush();
+}
+
+static QVector<int> sizeList(const QString &value, const char *defaults)
+{
+    QVector<int> sizes;
+    foreach (const QString &size, (value.isEmpty() ? QString::fromLatin1(defaults) : value)
+             .split(QLatin1Char(','), QString::SkipEmptyParts)) {
+        sizes << size.toInt();
+    }
+    return sizes;
+}
+
+static qint64 median(QVector<qint64> samples)
+{
+    if (samples.isEmpty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples.at(samples.count() / 2);
+}
+
+static QString milliseconds(qint64 microseconds)
+{
+    return QString::fromLatin1("%1 ms").arg(microseconds / 1000.0, 0, 'f', 2);
+}
+
+static QString throughput(qint64 bytes, qint64 microseconds)
+{
+    return QString::fromLatin1("%1 MB/s")
+            .arg(microseconds > 0 ? bytes * 1000000.0 / microseconds / MEGABYTE : 0.0, 0, 'f', 0);
+}
+
+/*
+    HTML of about size bytes, the way a piped in post looks.
+ */
+static QByteArray testHtml(int size)
+{
+    static const char PARAGRAPH[] =
+            "<p>Lorem ipsum dolor sit amet, <b>consectetur</b> adipiscing elit, sed do "
+            "eiusmod tempor incididunt ut labore et <i>dolore magna</i> aliqua.</p>\n";
+    QByteArray html;
+    html.reserve(size + int(sizeof(PARAGRAPH)));
+    html += "<html><head><title>Benchmark</title></head><body>\n";
+    while (html.size() < size) {
+        html += PARAGRAPH;
+    }
+    html.resize(size);
+    return html;
+}
+
+/*
+    The receiving side of the payload benchmark. Each payload is scanned
+    for tags where it lies, as a parser working in place would.
+ */
+class PayloadReceiver : public QObject
+{
+    Q_OBJECT
+public:
+    PayloadReceiver() : m_scanTime(0), m_tags(0), m_received(0) {}
+
+    qint64 scanTime() const { return m_scanTime; }
+    int tags() const { return m_tags; }
+    qint64 received() const { return m_received; }
+
+public slots:
+    void payloadReceived(const QtLocalPayload &payload)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        const char *data = payload.constData();
+        const char *end = data + payload.size();
+        int tags = 0;
+        while ((data = static_cast<const char *>(memchr(data, '<', end - data))) != 0) {
+            ++tags;
+            ++data;
+        }
+        m_scanTime = timer.nsecsElapsed() / 1000;
+        m_tags = tags;
+        m_received = payload.size();
+    }
+
+    void messageReceived(const QString &message)
+    {
+        m_received = message.size();
+    }
+
+private:
+    qint64 m_scanTime;
+    int m_tags;
+    qint64 m_received;
+};
+
+/*
+    Runs in the child process: sends one payload of size bytes and prints
+    the microseconds until the receiver acknowledged it.
+ */
+static int sendPayload(const QString &id, int size, bool asMessage)
+{
+    const QByteArray html = testHtml(size);
+    QtLocalPeer peer(0, id);
+    QElapsedTimer timer;
+    timer.start();
+    // A message has to be decoded first; that is part of its cost.
+    const bool ok = asMessage ? peer.sendMessage(QString::fromUtf8(html.constData(), html.size()), -1)
+                              : peer.sendPayload(html, -1);
+    output() << timer.nsecsElapsed() / 1000 << '\n';
+    output().flush();
+    return ok ? 0 : 1;
+}
+
+static qint64 runSender(const QString &id, int size, bool asMessage)
+{
+    QStringList arguments;
+    arguments << QString::fromLatin1("--send-payload=%1").arg(size)
+              << QLatin1String("--peer=") + id;
+    if (asMessage) {
+        arguments << QLatin1String("--as-message");
+    }
+    QProcess sender;
+    QEventLoop loop;
+    QObject::connect(&sender, SIGNAL(finished(int,QProcess::ExitStatus)), &loop, SLOT(quit()));
+    QObject::connect(&sender, SIGNAL(error(QProcess::ProcessError)), &loop, SLOT(quit()));
+    sender.start(QCoreApplication::applicationFilePath(), arguments);
+    // The receiving peer needs the event loop while the sender runs.
+    loop.exec();
+    if (sender.exitStatus() != QProcess::NormalExit || sender.exitCode() != 0) {
+        return -1;
+    }
+    return sender.readAllStandardOutput().trimmed().toLongLong();
+}
+
+/*
+    Hands HTML payloads from a second process to this one, once through
+    the shared memory payload path and once as a plain message, which is
+    how a large post had to travel before.
+ */
+static int runPayloadBenchmark(const QVector<int> &sizes, int runs)
+{
+    const QString id = QString::fromLatin1("orbitswriter-bench-%1").arg(QCoreApplication::applicationPid());
+    QtLocalPeer peer(0, id);
+    if (peer.isClient()) {
+        output() << "Cannot listen for payloads\n";
+        return 2;
+    }
+    PayloadReceiver receiver;
+    QObject::connect(&peer, SIGNAL(payloadReceived(QtLocalPayload)), &receiver, SLOT(payloadReceived(QtLocalPayload)));
+    QObject::connect(&peer, SIGNAL(messageReceived(QString)), &receiver, SLOT(messageReceived(QString)));
+
+    QTextStream &stream = output();
+    bool ok = true;
+    foreach (int megabytes, sizes) {
+        const int size = megabytes * MEGABYTE;
+        QVector<qint64> shared;
+        QVector<qint64> scans;
+        QVector<qint64> messages;
+        for (int i = 0; i < runs && ok; ++i) {
+            const qint64 elapsed = runSender(id, size, false);
+            ok = elapsed >= 0 && receiver.received() == size;
+            shared << elapsed;
+            scans << receiver.scanTime();
+            if (ok && size < MAX_MESSAGE_SIZE) {
+                const qint64 elapsed = runSender(id, size, true);
+                ok = elapsed >= 0 && receiver.received() == size;
+                messages << elapsed;
+            }
+        }
+        if (!ok) {
+            stream << megabytes << " MB: sending failed\n";
+            break;
+        }
+        stream << QString::fromLatin1("%1 MB: shared %2 (%3), scanned in place in %4 (%5 tags)")
+                  .arg(megabytes, 3).arg(milliseconds(median(shared)))
+                  .arg(throughput(size, median(shared)))
+                  .arg(milliseconds(median(scans))).arg(receiver.tags());
+        if (messages.isEmpty()) {
+            stream << "; too large for a message\n";
+        } else {
+            stream << QString::fromLatin1("; as a message %1 (%2)\n")
+                      .arg(milliseconds(median(messages))).arg(throughput(size, median(messages)));
+        }
+        stream.flush();
+    }
+    return ok ? 0 : 1;
+}
+
+/*
+    The receiving side of the handoff benchmark.
+ */
+class HandoffReceiver : public QObject
+{
+    Q_OBJECT
+public:
+    HandoffReceiver() : m_messages(0) {}
+
+    int messages() const { return m_messages; }
+    void reset() { m_messages = 0; }
+
+public slots:
+    void messagesReceived(const QStringList &messages)
+    {
+        m_messages += messages.count();
+    }
+
+private:
+    int m_messages;
+};
+
+/*
+    Runs in the child process: posts a message, lets its frame go out and
+    then sends count file names the blocking way, as main() does. Prints
+    the microseconds the blocking send took; it must not return before
+    its own frame, the second one, has been acknowledged.
+ */
+static int sendMessages(const QString &id, int count)
+{
+    QtLocalPeer peer(0, id);
+    peer.postMessages(QStringList(QLatin1String("first frame")), -1);
+    QCoreApplication::processEvents();
+    QStringList files;
+    for (int i = 0; i < count; ++i) {
+        files << QString::fromLatin1("/tmp/post-%1.html").arg(i);
+    }
+    QElapsedTimer timer;
+    timer.start();
+    const bool ok = peer.sendMessages(files, 5000);
+    output() << timer.nsecsElapsed() / 1000 << '\n';
+    output().flush();
+    return ok ? 0 : 1;
+}
+
+/*
+    Launches processes which hand count file names over to this one and
+    times them from start to exit, which is what a later launch costs
+    before the running instance opens its windows.
+ */
+static int runHandoffBenchmark(int count, int runs)
+{
+    const QString id = QString::fromLatin1("orbitswriter-bench-%1").arg(QCoreApplication::applicationPid());
+    QtLocalPeer peer(0, id);
+    if (peer.isClient()) {
+        output() << "Cannot listen for messages\n";
+        return 2;
+    }
+    HandoffReceiver receiver;
+    QObject::connect(&peer, SIGNAL(messagesReceived(QStringList)), &receiver, SLOT(messagesReceived(QStringList)));
+
+    QTextStream &stream = output();
+    QVector<qint64> sends;
+    QVector<qint64> processes;
+    QStringList arguments;
+    arguments << QString::fromLatin1("--send-messages=%1").arg(count)
+              << QLatin1String("--peer=") + id;
+    for (int i = 0; i < runs; ++i) {
+        receiver.reset();
+        QProcess sender;
+        QEventLoop loop;
+        QObject::connect(&sender, SIGNAL(finished(int,QProcess::ExitStatus)), &loop, SLOT(quit()));
+        QObject::connect(&sender, SIGNAL(error(QProcess::ProcessError)), &loop, SLOT(quit()));
+        QElapsedTimer timer;
+        timer.start();
+        sender.start(QCoreApplication::applicationFilePath(), arguments);
+        loop.exec();
+        processes << timer.nsecsElapsed() / 1000;
+        if (sender.exitStatus() != QProcess::NormalExit || sender.exitCode() != 0) {
+            stream << "sending failed\n";
+            return 1;
+        }
+        // The ack goes out before the messages are emitted here, so both
+        // frames have arrived once the sender quit.
+        if (receiver.messages() != count + 1) {
+            stream << QString::fromLatin1("the sender quit after %1 of %2 messages\n")
+                      .arg(receiver.messages()).arg(count + 1);
+            return 1;
+        }
+        sends << sender.readAllStandardOutput().trimmed().toLongLong();
+    }
+    stream << QString::fromLatin1("%1 files: sent in %2, launching process ran %3\n")
+              .arg(count).arg(milliseconds(median(sends))).arg(milliseconds(median(processes)));
+    return 0;
+}
+
+static QString applicationPath()
+{
+#ifdef Q_OS_MAC
+    return QCoreApplication::applicationDirPath() + QLatin1String("/OrbitsWriter.app/Contents/MacOS/OrbitsWriter");
+#else
+    return QCoreApplication::applicationDirPath() + QLatin1String("/OrbitsWriter");
+#endif
+}
+
+static void wait(int msecs)
+{
+    QEventLoop loop;
+    QTimer::singleShot(msecs, &loop, SLOT(quit()));
+    loop.exec();
+}
+
+/*
+    Milliseconds from the main() of a launch until the running instance
+    painted its window, as printed with --report-launches, or -1.
+ */
+static qint64 readLaunch(QProcess *server)
+{
+    while (!server->canReadLine()) {
+        if (!server->waitForReadyRead(30000)) {
+            return -1;
+        }
+    }
+    const QByteArray line = server->readLine().trimmed();
+    if (!line.startsWith("window painted ")) {
+        return -1;
+    }
+    return line.mid(qstrlen("window painted ")).split(' ').first().toLongLong();
+}
+
+/*
+    Starts OrbitsWriter and launches it again count times. Each later
+    launch hands its arguments to the running instance and quits; the
+    time that counts is the one from its main() until the window the
+    running instance opened for it has been painted. Both instances have
+    to share the real settings and drafts of the user, so no other
+    OrbitsWriter may run.
+ */
+static int runSecondLaunchBenchmark(int count)
+{
+    QTextStream &stream = output();
+    QProcess server;
+    server.start(applicationPath(), QStringList(QLatin1String("--report-launches")));
+    if (!server.waitForStarted()) {
+        stream << "Cannot start " << applicationPath() << '\n';
+        return 2;
+    }
+    const qint64 first = readLaunch(&server);
+    if (first < 0) {
+        stream << (server.state() == QProcess::NotRunning
+                   ? "OrbitsWriter quit at once; is another instance running?\n"
+                   : "OrbitsWriter did not report its window\n");
+        server.kill();
+        server.waitForFinished();
+        return 2;
+    }
+    stream << QString::fromLatin1("first launch: %1 ms\n").arg(first);
+    stream.flush();
+
+    bool ok = true;
+    QVector<qint64> windows;
+    QVector<qint64> processes;
+    for (int i = 0; i < count && ok; ++i) {
+        // The spare window of the previous launch has to be ready.
+        wait(SPARE_WINDOW_WAIT);
+        QProcess client;
+        QElapsedTimer timer;
+        timer.start();
+        client.start(applicationPath(), QStringList());
+        ok = client.waitForFinished() && client.exitCode() == 0;
+        processes << timer.elapsed();
+        const qint64 window = ok ? readLaunch(&server) : -1;
+        ok = ok && window >= 0;
+        windows << window;
+    }
+    server.terminate();
+    if (!server.waitForFinished(5000)) {
+        server.kill();
+        server.waitForFinished();
+    }
+    if (!ok) {
+        stream << "a later launch failed\n";
+        return 1;
+    }
+    std::sort(windows.begin(), windows.end());
+    stream << QString::fromLatin1("later launches: window painted after %1 ms (median), %2 ms (worst), "
+                                  "target %3 ms; launching process ran %4 ms\n")
+              .arg(median(windows)).arg(windows.last()).arg(LAUNCH_TARGET).arg(median(processes));
+    return median(windows) <= LAUNCH_TARGET ? 0 : 1;
+}
+
+/*
+    Loads a post of each size from HTML, the way drafts were stored
+    before, and from the binary draft format.
+ */
+static int runDraftLoadBenchmark(const QVector<int> &sizes, int runs)
+{
+    QTextStream &stream = output();
+    foreach (int megabytes, sizes) {
+        const QString html = QString::fromUtf8(testHtml(megabytes * MEGABYTE));
+        QVector<qint64> fromHtml;
+        QTextDocument document;
+        for (int i = 0; i < runs; ++i) {
+            QElapsedTimer timer;
+            timer.start();
+            document.setHtml(html);
+            fromHtml << timer.nsecsElapsed() / 1000;
+        }
+
+        stream << QString::fromLatin1("%1 MB, %2 blocks: setHtml %3")
+                  .arg(megabytes, 3).arg(document.blockCount()).arg(milliseconds(median(fromHtml)));
+        for (int compress = 0; compress < 2; ++compress) {
+            QByteArray draft;
+            QBuffer buffer(&draft);
+            buffer.open(QIODevice::WriteOnly);
+            if (!DraftFormat::write(&buffer, &document, QLatin1String("Benchmark"),
+                                    compress ? DraftFormat::Compress : DraftFormat::NoOptions)) {
+                stream << "\nCannot write the draft\n";
+                return 1;
+            }
+            buffer.close();
+            QVector<qint64> fromDraft;
+            for (int i = 0; i < runs; ++i) {
+                QTextDocument loaded;
+                buffer.open(QIODevice::ReadOnly);
+                QElapsedTimer timer;
+                timer.start();
+                const bool ok = DraftFormat::read(&buffer, &loaded, 0);
+                fromDraft << timer.nsecsElapsed() / 1000;
+                buffer.close();
+                if (!ok || loaded.blockCount() != document.blockCount()) {
+                    stream << "\nCannot read the draft back\n";
+                    return 1;
+                }
+            }
+            stream << QString::fromLatin1(", %1 %2 (%3 KB)")
+                      .arg(QLatin1String(compress ? "compressed" : "draft"))
+                      .arg(milliseconds(median(fromDraft))).arg(draft.size() / 1024);
+        }
+        stream << '\n';
+        stream.flush();
+    }
+    return 0;
+}
+
+static const int SEARCH_VOCABULARY = 20000;
+// CJK text is drawn from this many ideographs, starting at U+4E00.
+static const int SEARCH_IDEOGRAPHS = 3000;
+static const int SEARCH_WORDS_PER_DRAFT = 2000;
+static const int SEARCH_BATCH_SIZE = 100;
+static const int SEARCH_QUERY_REPEATS = 20;
+// Queries should be answered within this, in milliseconds.
+static const qint64 SEARCH_TARGET = 50;
+
+static QString searchWord(int index)
+{
+    static const char * const SYLLABLES[] = {
+        "ka", "lo", "mi", "ne", "su", "ta", "ri", "po", "ve", "du", "sha", "qui", "bre", "ton", "gal", "zen"
+    };
+    QString word;
+    do {
+        word += QLatin1String(SYLLABLES[index % 16]);
+        index /= 16;
+    } while (index > 0);
+    return word;
+}
+
+/*
+    Words and ideographs are drawn so that a few are very common and most
+    are rare, as in real text. Every third sentence is Chinese.
+ */
+static QString searchText(int words)
+{
+    QString text;
+    for (int i = 0; i < words; ++i) {
+        const double random = double(qrand()) / RAND_MAX;
+        if (i / 12 % 3 == 2) {
+            text += QChar(ushort(0x4e00 + int(std::pow(random, 3) * (SEARCH_IDEOGRAPHS - 1))));
+            if (i % 12 == 11) {
+                text += QChar(ushort(0x3002));
+                text += QLatin1Char('\n');
+            }
+            continue;
+        }
+        text += searchWord(int(std::pow(random, 4) * (SEARCH_VOCABULARY - 1)));
+        text += i % 12 == 11 ? QLatin1String(".\n") : QLatin1String(" ");
+    }
+    return text;
+}
+
+/*
+    The text of draft id. It is generated again whenever it is needed, so
+    a large corpus does not have to be held in memory.
+ */
+static QString draftText(quint32 id)
+{
+    qsrand(id);
+    return QString::fromLatin1("Draft %1\n").arg(id) + searchText(SEARCH_WORDS_PER_DRAFT);
+}
+
+static void removeIndex(const QString &path)
+{
+    QDir dir(path);
+    foreach (const QString &file, dir.entryList(QDir::Files)) {
+        dir.remove(file);
+    }
+    QDir().rmdir(path);
+}
+
+/*
+    Indexes drafts of mixed English and Chinese text up to megabytes of
+    UTF-8 in batches, the way a sync adds them, then times saving a single
+    draft and typical queries, Latin and CJK.
+ */
+static int runSearchBenchmark(int megabytes, int runs)
+{
+    QTextStream &stream = output();
+    const QString path = QDir::temp().filePath(QString::fromLatin1("orbitswriter-bench-search-%1")
+                                               .arg(QCoreApplication::applicationPid()));
+    removeIndex(path);
+
+    int result = 0;
+    int draftCount = 0;
+    {
+        SearchIndex index;
+        if (!index.open(path)) {
+            stream << "Cannot open the index: " << index.errorString() << '\n';
+            return 1;
+        }
+        qint64 bytes = 0;
+        qint64 generating = 0;
+        QElapsedTimer timer;
+        QElapsedTimer total;
+        total.start();
+        while (bytes < qint64(megabytes) * MEGABYTE) {
+            timer.start();
+            const QString text = draftText(quint32(++draftCount));
+            bytes += text.toUtf8().size();
+            generating += timer.nsecsElapsed() / 1000;
+            index.update(quint32(draftCount), text);
+            if (draftCount % SEARCH_BATCH_SIZE == 0) {
+                index.commit();
+            }
+        }
+        index.commit();
+        const qint64 elapsed = total.nsecsElapsed() / 1000 - generating;
+        stream << QString::fromLatin1("indexed %1 drafts, %2 MB of text, in %3: %4 drafts/s, %5\n")
+                  .arg(index.documentCount()).arg(bytes / MEGABYTE).arg(milliseconds(elapsed))
+                  .arg(elapsed > 0 ? draftCount * 1000000.0 / elapsed : 0.0, 0, 'f', 0)
+                  .arg(throughput(bytes, elapsed));
+
+        QVector<qint64> saves;
+        qsrand(uint(draftCount));
+        QVector<quint32> ids;
+        for (int i = 0; i < runs; ++i) {
+            ids << quint32(qrand() % draftCount + 1);
+        }
+        foreach (quint32 id, ids) {
+            const QString text = draftText(id) + QLatin1String(" edited");
+            timer.start();
+            index.update(id, text);
+            index.commit();
+            saves << timer.nsecsElapsed() / 1000;
+        }
+        stream << "one draft saved: " << milliseconds(median(saves)) << '\n';
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    SearchIndex index;
+    if (!index.open(path)) {
+        stream << "Cannot open the index again: " << index.errorString() << '\n';
+        removeIndex(path);
+        return 1;
+    }
+    stream << "opened in " << milliseconds(timer.nsecsElapsed() / 1000) << '\n';
+
+    // Phrases are taken from the first draft, so they must be found.
+    const QString first = draftText(1);
+    const QStringList firstWords = first.section(QLatin1Char('\n'), 1, 1).split(QLatin1Char(' '));
+    QString chinese;
+    foreach (const QString &line, first.split(QLatin1Char('\n'))) {
+        if (!line.isEmpty() && line.at(0).unicode() >= 0x4e00) {
+            chinese = line;
+            break;
+        }
+    }
+    const QString quote(QLatin1Char('"'));
+    const QString ideograph(QChar(ushort(0x4e00)));
+    QStringList phrases;
+    phrases << quote + firstWords.at(0) + QLatin1Char(' ') + firstWords.at(1) + quote
+            << quote + chinese.mid(2, 4) + quote
+            << chinese.mid(5, 3);
+    QStringList queries;
+    queries << searchWord(0)
+            << searchWord(SEARCH_VOCABULARY / 2)
+            << searchWord(1) + QLatin1Char(' ') + searchWord(SEARCH_VOCABULARY / 3)
+            << searchWord(20).left(3) + QLatin1Char('*')
+            << phrases
+            << ideograph
+            << ideograph + QChar(ushort(0x4e01)) + QLatin1Char('*')
+            << searchWord(2) + QLatin1Char(' ') + chinese.mid(0, 2);
+    foreach (const QString &query, queries) {
+        QVector<qint64> latencies;
+        int hits = 0;
+        for (int i = 0; i < runs * SEARCH_QUERY_REPEATS; ++i) {
+            timer.start();
+            hits = index.search(query, 50).size();
+            latencies << timer.nsecsElapsed() / 1000;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        const qint64 p95 = latencies.at(latencies.size() * 95 / 100);
+        stream << QString::fromLatin1("%1: %2 hits, p50 %3, p95 %4%5\n")
+                  .arg(query, -28).arg(hits, 2)
+                  .arg(milliseconds(latencies.at(latencies.size() / 2))).arg(milliseconds(p95))
+                  .arg(QLatin1String(p95 > SEARCH_TARGET * 1000 ? " (over the 50 ms target)" : ""));
+        if (hits == 0 && phrases.contains(query)) {
+            result = 1;
+        }
+    }
+    index.close();
+    removeIndex(path);
+    return result;
+}
+
+/*
+    What switching to the source tab and back costs after a one character
+    edit, against serializing the whole post as the source tab did first.
+ */
+static int runSyncBenchmark(const QVector<int> &sizes, int runs)
+{
+    QTextStream &stream = output();
+    foreach (int kilobytes, sizes) {
+        QTextDocument visual;
+        visual.setHtml(QString::fromUtf8(testHtml(kilobytes * 1024)));
+        QTextDocument source;
+        GOW::HtmlSynchronizer synchronizer(&visual);
+        synchronizer.setSourceDocument(&source);
+        QElapsedTimer timer;
+        timer.start();
+        synchronizer.syncSource();
+        const qint64 first = timer.nsecsElapsed() / 1000;
+
+        QVector<qint64> toSource;
+        QVector<qint64> toVisual;
+        QVector<qint64> full;
+        QTextCursor cursor(&visual);
+        qsrand(1);
+        for (int i = 0; i < runs; ++i) {
+            cursor.setPosition(qrand() % (visual.characterCount() - 1));
+            cursor.insertText(QLatin1String("x"));
+            timer.start();
+            synchronizer.syncSource();
+            toSource << timer.nsecsElapsed() / 1000;
+            timer.start();
+            synchronizer.syncVisual();
+            toVisual << timer.nsecsElapsed() / 1000;
+            timer.start();
+            const QString html = visual.toHtml();
+            full << timer.nsecsElapsed() / 1000;
+            Q_UNUSED(html)
+        }
+        if (source.toPlainText() != synchronizer.html()) {
+            stream << "The source is out of sync\n";
+            return 1;
+        }
+        stream << QString::fromLatin1("%1 KB, %2 blocks: first sync %3; after an edit to source %4, "
+                                      "back %5; toHtml() %6\n")
+                  .arg(kilobytes, 5).arg(visual.blockCount()).arg(milliseconds(first))
+                  .arg(milliseconds(median(toSource))).arg(milliseconds(median(toVisual)))
+                  .arg(milliseconds(median(full)));
+        stream.flush();
+    }
+    return 0;
+}
+
+/*
+    Counts how often a document reports a change.
+ */
+class ChangeCounter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ChangeCounter(QTextDocument *document) : m_count(0)
+    {
+        connect(document, SIGNAL(contentsChange(int,int,int)), this, SLOT(count()));
+    }
+
+    int take() { const int count = m_count; m_count = 0; return count; }
+
+private slots:
+    void count() { ++m_count; }
+
+private:
+    int m_count;
+}; // end of class ChangeCounter
+
+/*
+    Undoes everything after \a steps, so every run formats the same text.
+ */
+static void undoTo(QTextDocument *document, int steps)
+{
+    while (document->availableUndoSteps() > steps) {
+        document->undo();
+    }
+}
+
+/*
+    What formatting a selection with four attributes costs in one batch,
+    against one slot call per attribute as the toolbar used to do. Both
+    include laying the document out again.
+ */
+static int runFormatBenchmark(const QVector<int> &sizes, int runs)
+{
+    QTextStream &stream = output();
+    foreach (int kilobytes, sizes) {
+        const int length = kilobytes * 1024;
+        GOW::VisualEditor editor;
+        QTextDocument *document = editor.document();
+        // Markup takes about a third of the test HTML.
+        editor.setHtml(QString::fromUtf8(testHtml(length * 2)));
+        QTextCursor cursor(document);
+        cursor.setPosition(qMin(length, document->characterCount() - 1), QTextCursor::KeepAnchor);
+        editor.setTextCursor(cursor);
+        const int steps = document->availableUndoSteps();
+        ChangeCounter counter(document);
+
+        QVector<qint64> batch;
+        QVector<qint64> single;
+        int batchChanges = 0;
+        int singleChanges = 0;
+        int batchSteps = 0;
+        int singleSteps = 0;
+        QElapsedTimer timer;
+        for (int i = 0; i < runs; ++i) {
+            timer.start();
+            editor.applyFormat(FormatChanges().setBold(true).setItalic(true)
+                               .setUnderline(true).setFontSize(16));
+            document->documentLayout()->documentSize();
+            batch << timer.nsecsElapsed() / 1000;
+            batchChanges = counter.take();
+            batchSteps = document->availableUndoSteps() - steps;
+            undoTo(document, steps);
+            counter.take();
+
+            timer.start();
+            editor.textBold(true);
+            editor.textItalic(true);
+            editor.textUnderline(true);
+            editor.textFontSize(16);
+            document->documentLayout()->documentSize();
+            single << timer.nsecsElapsed() / 1000;
+            singleChanges = counter.take();
+            singleSteps = document->availableUndoSteps() - steps;
+            undoTo(document, steps);
+            counter.take();
+        }
+        stream << QString::fromLatin1("%1 KB: batch %2 (%3 changes, %4 undo steps); "
+                                      "one call per attribute %5 (%6 changes, %7 undo steps)\n")
+                  .arg(kilobytes, 5).arg(milliseconds(median(batch))).arg(batchChanges).arg(batchSteps)
+                  .arg(milliseconds(median(single))).arg(singleChanges).arg(singleSteps);
+        stream.flush();
+    }
+    return 0;
+}
+
+/*
+    The font chooser delegate before previews were cached: every row builds
+    a QFont and shapes its text again whenever it is sized or painted.
+ */
+class LegacyFontDelegate : public QStyledItemDelegate
+{
+public:
+    explicit LegacyFontDelegate(QComboBox *parent) : QStyledItemDelegate(parent) {}
+
+protected:
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+    {
+        const QPalette palette = qobject_cast<QComboBox *>(parent())->palette();
+        painter->save();
+        if (option.state.testFlag(QStyle::State_MouseOver)) {
+            painter->fillRect(option.rect, palette.highlight());
+            painter->setPen(palette.highlightedText().color());
+        }
+        QFont font = index.model()->data(index, Qt::UserRole).value<QFont>();
+        font.setPointSize(16);
+        painter->setFont(font);
+        painter->drawText(option.rect.adjusted(3, 0, 0, 0), Qt::AlignVCenter,
+                          index.model()->data(index).toString());
+        painter->restore();
+    }
+
+    QSize sizeHint(const QStyleOptionViewItem &, const QModelIndex &index) const
+    {
+        const QFontMetrics metrics(index.model()->data(index, Qt::UserRole).value<QFont>());
+        return QSize(metrics.width(index.model()->data(index).toString()), metrics.height() + 6);
+    }
+}; // end of class LegacyFontDelegate
+
+/*
+    Microseconds it takes to open the popup of \a chooser and paint it.
+ */
+static qint64 openPopup(QComboBox *chooser)
+{
+    QElapsedTimer timer;
+    timer.start();
+    chooser->showPopup();
+    chooser->view()->viewport()->repaint();
+    const qint64 elapsed = timer.nsecsElapsed() / 1000;
+    chooser->hidePopup();
+    QApplication::processEvents();
+    return elapsed;
+}
+
+/*
+    What opening the font chooser costs with many families installed, the
+    first time and again later, against the delegate used before. Missing
+    families are made up from the installed ones; they are matched to a
+    fallback font, which is what an unknown family costs.
+ */
+static int runFontPopupBenchmark(int count, int runs)
+{
+    QStringList families = QFontDatabase().families();
+    const int installed = families.size();
+    for (int i = 0; families.size() < count; ++i) {
+        families << QString::fromLatin1("%1 %2").arg(installed > 0 ? families.at(i % installed)
+                                                                   : QString::fromLatin1("Family"))
+                                                 .arg(i / qMax(installed, 1) + 2);
+    }
+
+    QTextStream &stream = output();
+    for (int legacy = 0; legacy < 2; ++legacy) {
+        GOW::FontChooser chooser;
+        if (legacy) {
+            chooser.setItemDelegate(new LegacyFontDelegate(&chooser));
+        }
+        chooser.clear();
+        foreach (const QString &family, families) {
+            chooser.addItem(family, family);
+        }
+        chooser.show();
+        QApplication::processEvents();
+
+        const qint64 first = openPopup(&chooser);
+        QVector<qint64> times;
+        for (int i = 0; i < runs; ++i) {
+            // Start from the middle, as after picking a family there.
+            chooser.setCurrentIndex(i % 2 ? families.size() / 2 : 0);
+            times << openPopup(&chooser);
+        }
+        stream << QString::fromLatin1("%1, %2 families (%3 installed): first open %4, then %5\n")
+                  .arg(legacy ? "one QFont per row " : "cached previews   ")
+                  .arg(families.size()).arg(installed)
+                  .arg(milliseconds(first)).arg(milliseconds(median(times)));
+        stream.flush();
+    }
+    return 0;
+}
+
+/*
+    Resident memory of this process in kilobytes, assuming 4 KB pages, or
+    -1 where /proc is not available.
+ */
+static qint64 residentKilobytes()
+{
+    QFile statm(QLatin1String("/proc/self/statm"));
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    return fields.size() > 1 ? fields.at(1).toLongLong() * 4 : -1;
+}
+
+/*
+    The popup window of a color button.
+ */
+static QWidget *popupOf(QWidget *button)
+{
+    foreach (QWidget *child, button->findChildren<QWidget *>()) {
+        if (child->isWindow()) {
+            return child;
+        }
+    }
+    return 0;
+}
+
+/*
+    Microseconds it takes to show the popup of \a button and paint it.
+ */
+static qint64 openColorPopup(QPushButton *button)
+{
+    QElapsedTimer timer;
+    timer.start();
+    button->setChecked(true);
+    QWidget *popup = popupOf(button);
+    popup->repaint();
+    const qint64 elapsed = timer.nsecsElapsed() / 1000;
+    popup->hide();
+    QApplication::processEvents();
+    return elapsed;
+}
+
+/*
+    Opens the popups of \a count buttons filled with the standard colors,
+    as the format toolbar does, and reports time, memory and widgets.
+ */
+template <typename Button>
+static void runColorPopups(const char *name, int count, int runs)
+{
+    QVector<qint64> first;
+    QVector<qint64> later;
+    int widgets = 0;
+    const qint64 before = residentKilobytes();
+    QList<Button *> buttons;
+    for (int i = 0; i < count; ++i) {
+        Button *button = new Button;
+        button->setStandardColors();
+        button->show();
+        buttons << button;
+    }
+    QApplication::processEvents();
+    foreach (Button *button, buttons) {
+        first << openColorPopup(button);
+        widgets = popupOf(button)->findChildren<QWidget *>().size() + 1;
+    }
+    const qint64 after = residentKilobytes();
+    for (int i = 0; i < runs; ++i) {
+        later << openColorPopup(buttons.at(i % buttons.size()));
+    }
+    QString memory = QString::fromLatin1("n/a");
+    if (before >= 0 && after >= 0) {
+        memory = QString::fromLatin1("%1 KB").arg((after - before) / count);
+    }
+    output() << QString::fromLatin1("%1: first open %2, then %3; %4 widgets and %5 per button\n")
+                .arg(QLatin1String(name)).arg(milliseconds(median(first))).arg(milliseconds(median(later)))
+                .arg(widgets).arg(memory);
+    output().flush();
+    qDeleteAll(buttons);
+}
+
+/*
+    What the color button popup costs against the one with a widget per
+    swatch. The new button runs first and pays for warming up shared state.
+ */
+static int runColorPopupBenchmark(int count, int runs)
+{
+    runColorPopups<GOW::ColorButton>("painted grid     ", count, runs);
+    runColorPopups<Legacy::ColorButton>("widget per swatch", count, runs);
+    return 0;
+}
+
+static QString tickCost(qint64 microseconds)
+{
+    return milliseconds(microseconds)
+            + QLatin1String(microseconds > TICK_TARGET ? " (over the 1 ms target)" : "");
+}
+
+/*
+    Waits for the snapshot written on a worker thread and delivers its
+    result to the journal.
+ */
+static void waitForSnapshot()
+{
+    QThreadPool::globalInstance()->waitForDone();
+    QCoreApplication::processEvents();
+}
+
+/*
+    Whether the block formats and lists of two documents agree.
+ */
+static bool sameBlocks(const QTextDocument &a, const QTextDocument &b)
+{
+    if (a.toPlainText() != b.toPlainText()) {
+        return false;
+    }
+    for (QTextBlock x = a.begin(), y = b.begin(); x.isValid() && y.isValid(); x = x.next(), y = y.next()) {
+        if (x.blockFormat().alignment() != y.blockFormat().alignment()
+                || !x.textList() != !y.textList()
+                || (x.textList() && x.textList()->format().style() != y.textList()->format().style())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+    Times what the journal costs the GUI thread on a large post: each
+    keystroke, each flush of the timer and the start of a compaction,
+    replaying the journal and from a draft at hand. Compactions are also
+    started amid the keystrokes, as a journal growing past its limit
+    does, and paragraphs are aligned and turned into lists; the post
+    recovered from the journal at the end has to match.
+ */
+static int runAutosaveBenchmark(const QVector<int> &sizes, int runs)
+{
+    static const int KEYSTROKES = 1000;
+    static const int KEYSTROKES_PER_FLUSH = 20;
+    static const int FLUSHES_PER_COMPACTION = 10;
+    static const int KEYSTROKES_PER_ALIGNMENT = 100;
+    static const int KEYSTROKES_PER_LIST = 250;
+    QTextStream &stream = output();
+    foreach (int megabytes, sizes) {
+        QTextDocument document;
+        document.setHtml(QString::fromUtf8(testHtml(megabytes * MEGABYTE)));
+        QByteArray draft;
+        QBuffer buffer(&draft);
+        buffer.open(QIODevice::WriteOnly);
+        DraftFormat::write(&buffer, &document, QLatin1String("Benchmark"));
+        GOW::AutosaveJournal journal(&document);
+        journal.start(QString(), QLatin1String("Benchmark"), false);
+        journal.compact(draft);
+        waitForSnapshot();
+
+        QElapsedTimer timer;
+        QElapsedTimer background;
+        QVector<qint64> replays;
+        QVector<qint64> replayed;
+        QVector<qint64> drafts;
+        for (int i = 0; i < runs; ++i) {
+            background.start();
+            timer.start();
+            journal.compact();
+            replays << timer.nsecsElapsed() / 1000;
+            waitForSnapshot();
+            replayed << background.nsecsElapsed() / 1000;
+            timer.start();
+            journal.compact(draft);
+            drafts << timer.nsecsElapsed() / 1000;
+            waitForSnapshot();
+        }
+
+        QVector<qint64> keystrokes[2];
+        QVector<qint64> flushes;
+        QTextCursor cursor(&document);
+        qsrand(1);
+        for (int recording = 0; recording < 2; ++recording) {
+            if (recording) {
+                // What was typed while paused goes into the snapshot.
+                QByteArray current;
+                QBuffer buffer(&current);
+                buffer.open(QIODevice::WriteOnly);
+                DraftFormat::write(&buffer, &document, QLatin1String("Benchmark"));
+                journal.resume();
+                journal.compact(current);
+                waitForSnapshot();
+            } else {
+                journal.pause();
+            }
+            for (int i = 0; i < KEYSTROKES; ++i) {
+                cursor.setPosition(qrand() % (document.characterCount() - 1));
+                timer.start();
+                cursor.insertText(QLatin1String("x"));
+                keystrokes[recording] << timer.nsecsElapsed() / 1000;
+                if (!recording) {
+                    continue;
+                }
+                if (i % KEYSTROKES_PER_ALIGNMENT == 0) {
+                    QTextBlockFormat format = cursor.blockFormat();
+                    format.setAlignment(Qt::AlignRight);
+                    cursor.setBlockFormat(format);
+                }
+                if (i % KEYSTROKES_PER_LIST == 0) {
+                    cursor.createList(QTextListFormat::ListDecimal);
+                }
+                if (i % KEYSTROKES_PER_FLUSH == KEYSTROKES_PER_FLUSH - 1) {
+                    timer.start();
+                    journal.flush();
+                    if (flushes.size() % FLUSHES_PER_COMPACTION == FLUSHES_PER_COMPACTION - 1) {
+                        journal.compact();
+                    }
+                    flushes << timer.nsecsElapsed() / 1000;
+                    // Lets finished compactions clean up, as the event loop would.
+                    QCoreApplication::processEvents();
+                }
+            }
+        }
+        journal.flush();
+        waitForSnapshot();
+        QTextDocument recovered;
+        QString fileName;
+        QString title;
+        const bool recovers = GOW::AutosaveJournal::recover(journal.session(), &recovered, &fileName, &title)
+                && sameBlocks(document, recovered);
+        journal.discard();
+
+        std::sort(keystrokes[1].begin(), keystrokes[1].end());
+        std::sort(flushes.begin(), flushes.end());
+        stream << megabytes << " MB, " << document.blockCount() << " blocks\n";
+        stream << "    compaction by replaying the journal: " << tickCost(median(replays))
+               << ", " << milliseconds(median(replayed)) << " in the background\n";
+        stream << "    compaction from a draft: " << tickCost(median(drafts)) << '\n';
+        stream << "    keystroke: " << milliseconds(median(keystrokes[0])) << " without the journal, "
+               << milliseconds(median(keystrokes[1])) << " with it, p99 "
+               << tickCost(keystrokes[1].at(keystrokes[1].size() * 99 / 100)) << '\n';
+        stream << "    flush of " << KEYSTROKES_PER_FLUSH << " keystrokes, a compaction every "
+               << FLUSHES_PER_COMPACTION << ": " << tickCost(median(flushes)) << ", p99 "
+               << tickCost(flushes.at(flushes.size() * 99 / 100)) << '\n';
+        stream.flush();
+        if (!recovers) {
+            stream << "    the recovered post differs\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+    Counts the previews swapped in.
+ */
+class PreviewCounter : public QObject
+{
+    Q_OBJECT
+public:
+    PreviewCounter() : m_count(0) {}
+
+    int count() const { return m_count; }
+
+public slots:
+    void previewUpdated(qint64) { ++m_count; }
+
+private:
+    int m_count;
+}; // end of class PreviewCounter
+
+/*
+    Types into the visual editor while the previewer next to it is shown
+    and wired up the way the main window does it. Keystrokes come in
+    bursts with pauses longer than the debounce delay, so previews are
+    rebuilt as the user goes. The latency of a keystroke includes how late
+    it was handled, which is where taking the HTML and swapping the new
+    preview document in show up.
+ */
+static int runPreviewBenchmark(const QVector<int> &sizes, int runs)
+{
+    static const int KEYSTROKES_PER_BURST = 10;
+    static const int KEYSTROKE_INTERVAL = 50;
+    QTextStream &stream = output();
+    foreach (int kilobytes, sizes) {
+        QWidget window;
+        QHBoxLayout *layout = new QHBoxLayout(&window);
+        GOW::VisualEditor *editor = new GOW::VisualEditor(&window);
+        GOW::Previewer *previewer = new GOW::Previewer(&window);
+        layout->addWidget(editor);
+        layout->addWidget(previewer);
+        editor->setHtml(QString::fromUtf8(testHtml(kilobytes * 1024)));
+        GOW::HtmlSynchronizer synchronizer(editor->document());
+        previewer->setSynchronizer(&synchronizer);
+        QObject::connect(editor->document(), SIGNAL(contentsChanged()), previewer, SLOT(invalidate()));
+        PreviewCounter counter;
+        QObject::connect(previewer, SIGNAL(previewUpdated(qint64)), &counter, SLOT(previewUpdated(qint64)));
+        window.resize(1600, 900);
+        window.show();
+        for (int waited = 0; counter.count() == 0 && waited < 60000; waited += 100) {
+            wait(100);
+        }
+
+        QTextDocument *document = editor->document();
+        QTextCursor cursor(document);
+        qsrand(1);
+        QVector<qint64> html;
+        QElapsedTimer timer;
+        for (int i = 0; i < runs; ++i) {
+            cursor.setPosition(qrand() % (document->characterCount() - 1));
+            cursor.insertText(QLatin1String("x"));
+            timer.start();
+            const QString content = synchronizer.html();
+            html << timer.nsecsElapsed() / 1000;
+            Q_UNUSED(content)
+        }
+
+        const int previews = counter.count();
+        const int bursts = qMax(runs, 5);
+        QVector<qint64> keystrokes;
+        QElapsedTimer clock;
+        clock.start();
+        qint64 due = 0;
+        for (int burst = 0; burst < bursts; ++burst) {
+            for (int i = 0; i < KEYSTROKES_PER_BURST; ++i) {
+                due += KEYSTROKE_INTERVAL;
+                wait(int(qMax(qint64(0), due - clock.elapsed())));
+                const qint64 late = qMax(qint64(0), clock.nsecsElapsed() / 1000 - due * 1000);
+                cursor.setPosition(qrand() % (document->characterCount() - 1));
+                timer.start();
+                cursor.insertText(QLatin1String("x"));
+                QCoreApplication::processEvents();
+                keystrokes << late + timer.nsecsElapsed() / 1000;
+            }
+            // Long enough for the debounced preview to be built and swapped in.
+            due += previewer->delay() + 2 * KEYSTROKE_INTERVAL;
+            wait(int(qMax(qint64(0), due - clock.elapsed())));
+        }
+
+        std::sort(keystrokes.begin(), keystrokes.end());
+        stream << QString::fromLatin1("%1 KB: html() %2; keystroke %3, p99 %4, worst %5; %6 previews built\n")
+                  .arg(kilobytes, 5).arg(tickCost(median(html)))
+                  .arg(milliseconds(median(keystrokes)))
+                  .arg(tickCost(keystrokes.at(keystrokes.size() * 99 / 100)))
+                  .arg(milliseconds(keystrokes.last())).arg(counter.count() - previews);
+        stream.flush();
+    }
+    return 0;
+}
+
+/*
+    Creates a library of count drafts in one batch, then times opening
+    it and sorting it by title, and scrolling the library dock through
+    all of it, which fetches the rows page by page. Memory is sampled
+    while scrolling; it should not grow with the rows fetched.
+ */
+static int runLibraryBenchmark(int count, int runs)
+{
+    QTextStream &stream = output();
+    const QString path = QDir::temp().filePath(QString::fromLatin1("orbitswriter-bench-library-%1.owl")
+                                               .arg(QCoreApplication::applicationPid()));
+    QFile::remove(path);
+    QTextDocument post;
+    post.setHtml(QString::fromUtf8(testHtml(4096)));
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    DraftFormat::write(&buffer, &post, QLatin1String("Benchmark"));
+
+    QElapsedTimer timer;
+    {
+        DraftLibrary library;
+        if (!library.open(path)) {
+            stream << "Cannot create the library: " << library.errorString() << '\n';
+            return 1;
+        }
+        qsrand(1);
+        timer.start();
+        library.beginBatch();
+        for (int i = 0; i < count; ++i) {
+            const QString title = searchWord(qrand() % SEARCH_VOCABULARY) + QLatin1Char(' ')
+                    + searchWord(qrand() % SEARCH_VOCABULARY);
+            library.save(0, data, title, QStringList(searchWord(i % 50)));
+        }
+        if (!library.commitBatch()) {
+            stream << "Cannot save the drafts: " << library.errorString() << '\n';
+            QFile::remove(path);
+            return 1;
+        }
+        stream << QString::fromLatin1("%1 drafts saved in one batch in %2, %3 MB\n")
+                  .arg(count).arg(milliseconds(timer.nsecsElapsed() / 1000))
+                  .arg(QFileInfo(path).size() / MEGABYTE);
+    }
+
+    QVector<qint64> opens;
+    QVector<qint64> sorts;
+    for (int i = 0; i < runs; ++i) {
+        DraftLibrary library;
+        timer.start();
+        library.open(path);
+        opens << timer.nsecsElapsed() / 1000;
+        timer.start();
+        const QVector<quint32> ids = library.draftIds(DraftLibrary::ByTitle);
+        sorts << timer.nsecsElapsed() / 1000;
+        Q_UNUSED(ids)
+    }
+    stream << "opened in " << milliseconds(median(opens)) << ", sorted by title in "
+           << milliseconds(median(sorts)) << '\n';
+
+    int result = 0;
+    {
+        DraftLibrary library;
+        library.open(path);
+        const qint64 before = residentKilobytes();
+        GOW::LibraryDock dock(&library);
+        dock.model()->setSortOrder(DraftLibrary::ByTitle);
+        dock.resize(400, 900);
+        dock.show();
+        QApplication::processEvents();
+        QListView *view = dock.findChild<QListView *>();
+        const qint64 first = residentKilobytes();
+        qint64 peak = first;
+        QVector<qint64> pages;
+        while (view->model()->rowCount() < count) {
+            const int rows = view->model()->rowCount();
+            timer.start();
+            // Scrolled to the bottom, the view fetches the next page.
+            view->scrollToBottom();
+            QApplication::processEvents();
+            pages << timer.nsecsElapsed() / 1000;
+            peak = qMax(peak, residentKilobytes());
+            if (view->model()->rowCount() == rows) {
+                stream << "the view stopped fetching at " << rows << " rows\n";
+                result = 1;
+                break;
+            }
+        }
+        // The excerpts of the last rows are loaded in the background.
+        wait(500);
+        const qint64 last = residentKilobytes();
+        std::sort(pages.begin(), pages.end());
+        stream << QString::fromLatin1("scrolled through %1 pages: %2 per page, worst %3\n")
+                  .arg(pages.size()).arg(milliseconds(median(pages)))
+                  .arg(milliseconds(pages.isEmpty() ? 0 : pages.last()));
+        stream << QString::fromLatin1("resident: %1 MB before the dock, %2 MB with the first page, "
+                                      "%3 MB at most, %4 MB at the end\n")
+                  .arg(before / 1024).arg(first / 1024).arg(peak / 1024).arg(last / 1024);
+    }
+    QFile::remove(path);
+    return result;
+}
+
+/*
+    Counts the images the cache reports ready.
+ */
+class ReadyCounter : public QObject
+{
+    Q_OBJECT
+public:
+    ReadyCounter() : m_count(0)
+    {
+        connect(GOW::ImageCache::instance(), SIGNAL(imageReady(QString)), this, SLOT(count()));
+    }
+
+    int take() { const int count = m_count; m_count = 0; return count; }
+
+private slots:
+    void count() { ++m_count; }
+
+private:
+    int m_count;
+}; // end of class ReadyCounter
+
+/*
+    A JPEG of size, or a PNG where there is no JPEG writer.
+ */
+static QByteArray testImage(const QSize &size)
+{
+    QImage image(size, QImage::Format_RGB32);
+    QPainter painter(&image);
+    QLinearGradient gradient(0, 0, size.width(), size.height());
+    gradient.setColorAt(0, Qt::darkBlue);
+    gradient.setColorAt(1, Qt::yellow);
+    painter.fillRect(image.rect(), gradient);
+    painter.end();
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QImageWriter writer(&buffer, "jpg");
+    if (!writer.write(image)) {
+        data.clear();
+        buffer.seek(0);
+        image.save(&buffer, "png");
+    }
+    return data;
+}
+
+/*
+    Lets the decoding threads and the editor finish. Returns false if the
+    cache keeps reporting images ready, as it does when the visible ones
+    evict each other.
+ */
+static bool settle()
+{
+    static const int QUIET = 200;
+    static const int LIMIT = 10000;
+    ReadyCounter counter;
+    for (int waited = 0; waited < LIMIT; waited += QUIET) {
+        wait(QUIET);
+        if (counter.take() == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    Scrolls the visual editor through a post of count 12 megapixel photos
+    and one image too tall for the budget of the image cache, and reports
+    how much memory it takes at most and whether the cache settles on
+    every page.
+ */
+static int runImageBenchmark(int count)
+{
+    QTextStream &stream = output();
+    const QString dir = QDir::tempPath() + QString::fromLatin1("/orbitswriter-bench-%1")
+            .arg(QCoreApplication::applicationPid());
+    QDir().mkpath(dir);
+    const QByteArray photo = testImage(QSize(4000, 3000));
+    const QByteArray tall = testImage(QSize(1000, 30000));
+    QString html;
+    for (int i = 0; i < count; ++i) {
+        const QString name = QString::fromLatin1("%1/photo-%2.jpg").arg(dir).arg(i);
+        QFile file(name);
+        file.open(QIODevice::WriteOnly);
+        file.write(photo);
+        html += QString::fromLatin1("<p>Photo %1</p><p><img src=\"%2\"></p>\n").arg(i).arg(name);
+        if (i == count / 2) {
+            QFile file(dir + QLatin1String("/tall.jpg"));
+            file.open(QIODevice::WriteOnly);
+            file.write(tall);
+            html += QString::fromLatin1("<p><img src=\"%1/tall.jpg\"></p>\n").arg(dir);
+        }
+    }
+
+    const qint64 before = residentKilobytes();
+    qint64 peak = before;
+    int pages = 0;
+    int unsettled = 0;
+    QElapsedTimer timer;
+    timer.start();
+    {
+        GOW::VisualEditor editor;
+        editor.resize(1000, 800);
+        editor.show();
+        editor.setHtml(html);
+        QScrollBar *scrollBar = editor.verticalScrollBar();
+        for (int position = 0; ; position += scrollBar->pageStep()) {
+            scrollBar->setValue(position);
+            ++pages;
+            if (!settle()) {
+                ++unsettled;
+            }
+            peak = qMax(peak, residentKilobytes());
+            if (position >= scrollBar->maximum()) {
+                break;
+            }
+        }
+    }
+    const qint64 elapsed = timer.nsecsElapsed() / 1000;
+    GOW::ImageCache::instance()->clear();
+    foreach (const QString &file, QDir(dir).entryList(QDir::Files)) {
+        QFile::remove(dir + QLatin1Char('/') + file);
+    }
+    QDir().rmdir(dir);
+
+    stream << QString::fromLatin1("%1 photos of %2 KB, %3 pages: peak %4 MB resident (%5 MB before), "
+                                  "cache budget %6 MB, scrolled through in %7\n")
+              .arg(count).arg(photo.size() / 1024).arg(pages)
+              .arg(peak / 1024).arg(before / 1024)
+              .arg(GOW::ImageCache::instance()->maxCost() / 1024).arg(milliseconds(elapsed));
+    if (unsettled > 0) {
+        stream << unsettled << " pages kept decoding\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+#if QT_VERSION >= 0x050000
+    // Nothing is shown; widgets are only measured.
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty()) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+#endif
+    QApplication app(argc, argv);
+
+    int runs = 5;
+    bool payload = false;
+    int launches = -1;
+    QString payloadSizes;
+    bool draftLoad = false;
+    QString draftLoadSizes;
+    int searchMegabytes = -1;
+    int images = -1;
+    int libraryDrafts = -1;
+    bool autosave = false;
+    QString autosaveSizes;
+    int fontFamilies = -1;
+    int colorButtons = -1;
+    bool preview = false;
+    QString previewSizes;
+    bool format = false;
+    QString formatSizes;
+    bool sync = false;
+    QString syncSizes;
+    int sendSize = -1;
+    int sendCount = -1;
+    int handoffFiles = -1;
+    QString peerId;
+    bool asMessage = false;
+    const QStringList arguments = app.arguments();
+    for (int i = 1; i < arguments.count(); ++i) {
+        const QString argument = arguments.at(i);
+        const QString value = argument.section(QLatin1Char('='), 1);
+        if (argument == QLatin1String("--payload") || argument.startsWith(QLatin1String("--payload="))) {
+            payload = true;
+            payloadSizes = value;
+        } else if (argument == QLatin1String("--handoff")) {
+            handoffFiles = 10;
+        } else if (argument.startsWith(QLatin1String("--handoff="))) {
+            handoffFiles = value.toInt();
+        } else if (argument == QLatin1String("--second-launch")) {
+            launches = 10;
+        } else if (argument.startsWith(QLatin1String("--second-launch="))) {
+            launches = value.toInt();
+        } else if (argument == QLatin1String("--draft-load") || argument.startsWith(QLatin1String("--draft-load="))) {
+            draftLoad = true;
+            draftLoadSizes = value;
+        } else if (argument == QLatin1String("--font-popup")) {
+            fontFamilies = 600;
+        } else if (argument.startsWith(QLatin1String("--font-popup="))) {
+            fontFamilies = value.toInt();
+        } else if (argument == QLatin1String("--color-popup")) {
+            colorButtons = 20;
+        } else if (argument.startsWith(QLatin1String("--color-popup="))) {
+            colorButtons = value.toInt();
+        } else if (argument == QLatin1String("--preview") || argument.startsWith(QLatin1String("--preview="))) {
+            preview = true;
+            previewSizes = value;
+        } else if (argument == QLatin1String("--format") || argument.startsWith(QLatin1String("--format="))) {
+            format = true;
+            formatSizes = value;
+        } else if (argument == QLatin1String("--sync") || argument.startsWith(QLatin1String("--sync="))) {
+            sync = true;
+            syncSizes = value;
+        } else if (argument == QLatin1String("--autosave") || argument.startsWith(QLatin1String("--autosave="))) {
+            autosave = true;
+            autosaveSizes = value;
+        } else if (argument == QLatin1String("--library")) {
+            libraryDrafts = 100000;
+        } else if (argument.startsWith(QLatin1String("--library="))) {
+            libraryDrafts = value.toInt();
+        } else if (argument == QLatin1String("--images")) {
+            images = 50;
+        } else if (argument.startsWith(QLatin1String("--images="))) {
+            images = value.toInt();
+        } else if (argument == QLatin1String("--search")) {
+            searchMegabytes = 1024;
+        } else if (argument.startsWith(QLatin1String("--search="))) {
+            searchMegabytes = value.toInt();
+        } else if (argument.startsWith(QLatin1String("--runs="))) {
+            runs = qMax(1, value.toInt());
+        } else if (argument.startsWith(QLatin1String("--send-payload="))) {
+            sendSize = value.toInt();
+        } else if (argument.startsWith(QLatin1String("--send-messages="))) {
+            sendCount = value.toInt();
+        } else if (argument.startsWith(QLatin1String("--peer="))) {
+            peerId = value;
+        } else if (argument == QLatin1String("--as-message")) {
+            asMessage = true;
+        } else {
+            usage();
+            return argument == QLatin1String("--help") ? 0 : 2;
+        }
+    }
+
+    if (sendSize >= 0) {
+        return sendPayload(peerId, sendSize, asMessage);
+    }
+    if (sendCount >= 0) {
+        return sendMessages(peerId, sendCount);
+    }
+    int result = 0;
+    bool ran = false;
+    if (payload) {
+        ran = true;
+        output() << "Payloads\n";
+        result |= runPayloadBenchmark(sizeList(payloadSizes, "1,10,100"), runs);
+    }
+    if (handoffFiles >= 0) {
+        ran = true;
+        output() << "Handoff\n";
+        result |= runHandoffBenchmark(handoffFiles, runs);
+    }
+    if (launches > 0) {
+        ran = true;
+        output() << "Second launch\n";
+        result |= runSecondLaunchBenchmark(launches);
+    }
+    if (draftLoad) {
+        ran = true;
+        output() << "Draft load\n";
+        result |= runDraftLoadBenchmark(sizeList(draftLoadSizes, "5"), runs);
+    }
+    if (fontFamilies > 0) {
+        ran = true;
+        output() << "Font chooser popup\n";
+        result |= runFontPopupBenchmark(fontFamilies, runs);
+    }
+    if (colorButtons > 0) {
+        ran = true;
+        output() << "Color button popup\n";
+        result |= runColorPopupBenchmark(colorButtons, runs);
+    }
+    if (preview) {
+        ran = true;
+        output() << "Preview\n";
+        result |= runPreviewBenchmark(sizeList(previewSizes, "10,1024"), runs);
+    }
+    if (format) {
+        ran = true;
+        output() << "Batch formatting\n";
+        result |= runFormatBenchmark(sizeList(formatSizes, "1,100,5120"), runs);
+    }
+    if (sync) {
+        ran = true;
+        output() << "Tab switch\n";
+        result |= runSyncBenchmark(sizeList(syncSizes, "10,5120"), runs);
+    }
+    if (autosave) {
+        ran = true;
+        output() << "Autosave\n";
+        result |= runAutosaveBenchmark(sizeList(autosaveSizes, "5"), runs);
+    }
+    if (libraryDrafts > 0) {
+        ran = true;
+        output() << "Library\n";
+        result |= runLibraryBenchmark(libraryDrafts, runs);
+    }
+    if (images > 0) {
+        ran = true;
+        output() << "Images\n";
+        result |= runImageBenchmark(images);
+    }
+    if (searchMegabytes > 0) {
+        ran = true;
+        output() << "Search\n";
+        result |= runSearchBenchmark(searchMegabytes, runs);
+    }
+    if (!ran) {
+        usage();
+        return 2;
+    }
+    return result;
+}
+
+#include "main.moc"
@@ -0,0 +1,383 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2013 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QBuffer>
+#include <QHash>
+#include <QImage>
+#include <QPainter>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextList>
+#include <QtTest>
+#if QT_VERSION >= 0x050000
+#include <QGuiApplication>
+#else
+#include <QApplication>
+#endif
+
+#include <DraftFormat>
+
+using GOW::DraftFormat;
+
+static QTextFormat withoutObject(QTextFormat format)
+{
+    format.clearProperty(QTextFormat::ObjectIndex);
+    return format;
+}
+
+/*
+    Compares text, formats and lists of both documents block by block and
+    run by run. List objects only have to correspond, not to be equal.
+ */
+static void compareDocuments(const QTextDocument *expected, const QTextDocument *actual)
+{
+    QCOMPARE(actual->blockCount(), expected->blockCount());
+    QHash<QTextList *, QTextList *> lists;
+    QTextBlock a = actual->begin();
+    for (QTextBlock e = expected->begin(); e.isValid(); e = e.next(), a = a.next()) {
+        QCOMPARE(a.text(), e.text());
+        QCOMPARE(withoutObject(a.blockFormat()), withoutObject(e.blockFormat()));
+        QCOMPARE(withoutObject(a.charFormat()), withoutObject(e.charFormat()));
+        QCOMPARE(a.textList() != 0, e.textList() != 0);
+        if (e.textList()) {
+            QTextList *&list = lists[e.textList()];
+            if (!list) {
+                list = a.textList();
+            }
+            QVERIFY(a.textList() == list);
+            QCOMPARE(withoutObject(a.textList()->format()), withoutObject(e.textList()->format()));
+            QCOMPARE(a.textList()->itemNumber(a), e.textList()->itemNumber(e));
+        }
+        QTextBlock::iterator ai = a.begin();
+        for (QTextBlock::iterator ei = e.begin(); !ei.atEnd(); ++ei, ++ai) {
+            QVERIFY(!ai.atEnd());
+            QCOMPARE(ai.fragment().text(), ei.fragment().text());
+            QCOMPARE(ai.fragment().charFormat(), ei.fragment().charFormat());
+        }
+        QVERIFY(ai.atEnd());
+    }
+}
+
+static bool roundTrip(const QTextDocument *document, QTextDocument *result, QString *title = 0,
+                      DraftFormat::Options options = DraftFormat::NoOptions, QByteArray *draft = 0)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    if (!DraftFormat::write(&buffer, document, QLatin1String("Round trip"), options)) {
+        return false;
+    }
+    buffer.close();
+    buffer.open(QIODevice::ReadOnly);
+    QString readTitle;
+    const bool ok = DraftFormat::read(&buffer, result, &readTitle);
+    if (title) {
+        *title = readTitle;
+    }
+    if (draft) {
+        *draft = data;
+    }
+    return ok;
+}
+
+static QImage testImage(const QColor &color)
+{
+    QImage image(64, 48, QImage::Format_ARGB32);
+    image.fill(color.rgba());
+    QPainter painter(&image);
+    painter.fillRect(8, 8, 24, 16, Qt::black);
+    return image;
+}
+
+class DraftFormatTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void title();
+    void charFormats();
+    void blockFormats();
+    void lists();
+    void images();
+    void emptyBlocks_data();
+    void emptyBlocks();
+    void chunks_data();
+    void chunks();
+    void damaged();
+};
+
+void DraftFormatTest::title()
+{
+    QTextDocument document;
+    document.setPlainText(QLatin1String("Body"));
+    QTextDocument result;
+    QString title;
+    QVERIFY(roundTrip(&document, &result, &title));
+    QCOMPARE(title, QString::fromLatin1("Round trip"));
+    QVERIFY(!result.isModified());
+    QVERIFY(!result.isUndoAvailable());
+}
+
+void DraftFormatTest::charFormats()
+{
+    QTextDocument document;
+    QTextCursor cursor(&document);
+    cursor.insertText(QLatin1String("plain "));
+    QTextCharFormat format;
+    format.setFontWeight(QFont::Bold);
+    cursor.insertText(QLatin1String("bold "), format);
+    format.setFontItalic(true);
+    format.setFontUnderline(true);
+    cursor.insertText(QLatin1String("bold italic underlined "), format);
+    format = QTextCharFormat();
+    format.setFontStrikeOut(true);
+    format.setForeground(QColor(200, 30, 40));
+    format.setBackground(QColor(250, 240, 120));
+    cursor.insertText(QLatin1String("colored "), format);
+    format = QTextCharFormat();
+    format.setFontFamily(QLatin1String("Courier New"));
+    format.setFontPointSize(17.5);
+    format.setVerticalAlignment(QTextCharFormat::AlignSuperScript);
+    cursor.insertText(QLatin1String("font "), format);
+    format = QTextCharFormat();
+    format.setAnchor(true);
+    format.setAnchorHref(QLatin1String("http://www.galaxyworld.org/"));
+    cursor.insertText(QLatin1String("link"), format);
+    cursor.insertText(QString::fromUtf8(" \xe4\xb8\xad\xe6\x96\x87 \xf0\x9f\x98\x80"));
+
+    QTextDocument result;
+    QVERIFY(roundTrip(&document, &result));
+    compareDocuments(&document, &result);
+}
+
+void DraftFormatTest::blockFormats()
+{
+    QTextDocument document;
+    QTextCursor cursor(&document);
+    QTextBlockFormat format;
+    format.setAlignment(Qt::AlignHCenter);
+    cursor.setBlockFormat(format);
+    cursor.insertText(QLatin1String("centered"));
+    format.setAlignment(Qt::AlignRight);
+    format.setTopMargin(12);
+    format.setBottomMargin(6);
+    cursor.insertBlock(format);
+    cursor.insertText(QLatin1String("right with margins"));
+    format = QTextBlockFormat();
+    format.setAlignment(Qt::AlignJustify);
+    format.setIndent(2);
+    format.setTextIndent(20);
+    format.setBackground(QColor(230, 230, 255));
+    QTextCharFormat blockChar;
+    blockChar.setFontPointSize(24);
+    blockChar.setFontWeight(QFont::Bold);
+    cursor.insertBlock(format, blockChar);
+    cursor.insertText(QLatin1String("justified and indented, with a block char format"));
+
+    QTextDocument result;
+    QVERIFY(roundTrip(&document, &result));
+    compareDocuments(&document, &result);
+}
+
+void DraftFormatTest::lists()
+{
+    QTextDocument document;
+    QTextCursor cursor(&document);
+    cursor.insertText(QLatin1String("before"));
+    cursor.insertBlock();
+    QTextList *bullets = cursor.createList(QTextListFormat::ListDisc);
+    cursor.insertText(QLatin1String("first"));
+    cursor.insertBlock();
+    cursor.insertText(QLatin1String("second"));
+    cursor.insertBlock();
+    QTextListFormat nested;
+    nested.setStyle(QTextListFormat::ListDecimal);
+    nested.setIndent(2);
+    cursor.createList(nested);
+    cursor.insertText(QLatin1String("nested one"));
+    cursor.insertBlock();
+    cursor.insertText(QLatin1String("nested two"));
+    cursor.insertBlock(QTextBlockFormat());
+    cursor.insertText(QLatin1String("between"));
+    // The same list continues after the paragraph.
+    cursor.insertBlock();
+    bullets->add(cursor.block());
+    cursor.insertText(QLatin1String("third"));
+    cursor.insertBlock(QTextBlockFormat());
+    QTextListFormat roman;
+    roman.setStyle(QTextListFormat::ListUpperRoman);
+    cursor.createList(roman);
+    cursor.insertText(QLatin1String("another list"));
+
+    QTextDocument result;
+    QVERIFY(roundTrip(&document, &result));
+    compareDocuments(&document, &result);
+}
+
+void DraftFormatTest::images()
+{
+    QTextDocument document;
+    document.addResource(QTextDocument::ImageResource, QUrl(QLatin1String("red.png")),
+                         testImage(Qt::red));
+    QByteArray encoded;
+    QBuffer buffer(&encoded);
+    buffer.open(QIODevice::WriteOnly);
+    testImage(Qt::blue).save(&buffer, "PNG");
+    document.addResource(QTextDocument::ImageResource, QUrl(QLatin1String("blue.png")), encoded);
+    // Never used in the text, so not written either.
+    document.addResource(QTextDocument::ImageResource, QUrl(QLatin1String("unused.png")),
+                         testImage(Qt::green));
+
+    QTextCursor cursor(&document);
+    cursor.insertText(QLatin1String("An image "));
+    QTextImageFormat image;
+    image.setName(QLatin1String("red.png"));
+    image.setWidth(32);
+    image.setHeight(24);
+    cursor.insertImage(image);
+    cursor.insertText(QLatin1String(" and another "));
+    image = QTextImageFormat();
+    image.setName(QLatin1String("blue.png"));
+    cursor.insertImage(image);
+    cursor.insertImage(image);
+
+    QTextDocument result;
+    QVERIFY(roundTrip(&document, &result));
+    compareDocuments(&document, &result);
+    QCOMPARE(DraftFormat::imageData(&result, QLatin1String("red.png")),
+             DraftFormat::imageData(&document, QLatin1String("red.png")));
+    QCOMPARE(DraftFormat::imageData(&result, QLatin1String("blue.png")), encoded);
+    QVERIFY(DraftFormat::imageData(&result, QLatin1String("unused.png")).isEmpty());
+    QImage decoded;
+    QVERIFY(decoded.loadFromData(DraftFormat::imageData(&result, QLatin1String("red.png"))));
+    QCOMPARE(decoded.size(), QSize(64, 48));
+}
+
+void DraftFormatTest::emptyBlocks_data()
+{
+    QTest::addColumn<QStringList>("blocks");
+    QTest::newRow("empty document") << (QStringList() << QString());
+    QTest::newRow("leading") << (QStringList() << QString() << QString() << QLatin1String("text"));
+    QTest::newRow("inner") << (QStringList() << QLatin1String("a") << QString() << QString()
+                               << QLatin1String("b"));
+    QTest::newRow("trailing") << (QStringList() << QLatin1String("text") << QString());
+    QTest::newRow("only empty") << (QStringList() << QString() << QString() << QString());
+}
+
+void DraftFormatTest::emptyBlocks()
+{
+    QFETCH(QStringList, blocks);
+    QTextDocument document;
+    QTextCursor cursor(&document);
+    QTextCharFormat bold;
+    bold.setFontWeight(QFont::Bold);
+    for (int i = 0; i < blocks.count(); ++i) {
+        if (i > 0) {
+            // Empty blocks keep the char format they were given.
+            cursor.insertBlock(QTextBlockFormat(), i % 2 ? bold : QTextCharFormat());
+        }
+        cursor.insertText(blocks.at(i));
+    }
+
+    QTextDocument result;
+    result.setPlainText(QLatin1String("replaced"));
+    QVERIFY(roundTrip(&document, &result));
+    compareDocuments(&document, &result);
+}
+
+void DraftFormatTest::chunks_data()
+{
+    QTest::addColumn<bool>("compress");
+    QTest::newRow("plain") << false;
+    QTest::newRow("compressed") << true;
+}
+
+void DraftFormatTest::chunks()
+{
+    QFETCH(bool, compress);
+    // Several chunks of about 128 KB, with formats changing across them.
+    QTextDocument document;
+    QTextCursor cursor(&document);
+    QTextCharFormat italic;
+    italic.setFontItalic(true);
+    const QString text = QLatin1String("Lorem ipsum dolor sit amet, consectetur adipiscing elit. ");
+    for (int i = 0; i < 6000; ++i) {
+        if (i > 0) {
+            cursor.insertBlock();
+        }
+        cursor.insertText(text);
+        cursor.insertText(QString::number(i), i % 3 ? QTextCharFormat() : italic);
+    }
+
+    QTextDocument result;
+    QByteArray draft;
+    QVERIFY(roundTrip(&document, &result, 0, compress ? DraftFormat::Compress : DraftFormat::NoOptions,
+                      &draft));
+    compareDocuments(&document, &result);
+    if (compress) {
+        // The text repeats, so it has to shrink a lot.
+        QVERIFY(draft.size() < document.characterCount() / 4);
+    } else {
+        QVERIFY(draft.size() > document.characterCount() * 2);
+    }
+}
+
+void DraftFormatTest::damaged()
+{
+    QTextDocument document;
+    document.setPlainText(QLatin1String("Some text which is cut off"));
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QVERIFY(DraftFormat::write(&buffer, &document, QLatin1String("Title")));
+    buffer.close();
+
+    data.chop(8);
+    buffer.open(QIODevice::ReadOnly);
+    QTextDocument result;
+    result.setPlainText(QLatin1String("replaced"));
+    QString error;
+    QVERIFY(!DraftFormat::read(&buffer, &result, 0, &error));
+    QVERIFY(!error.isEmpty());
+    QVERIFY(result.isEmpty());
+
+    QByteArray html("<html><body>not a draft</body></html>");
+    QBuffer other(&html);
+    other.open(QIODevice::ReadOnly);
+    QVERIFY(!DraftFormat::read(&other, &result, 0, &error));
+}
+
+int main(int argc, char **argv)
+{
+#if QT_VERSION >= 0x050000
+    // Images are painted; that needs no display.
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty()) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+#else
+    QApplication app(argc, argv, false);
+#endif
+    DraftFormatTest test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "main.moc"
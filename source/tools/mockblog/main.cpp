@@ -0,0 +1,443 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QBuffer>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QHash>
+#include <QImage>
+#include <QPainter>
+#include <QStringList>
+#include <QTextDocument>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#if QT_VERSION >= 0x050000
+#include <QGuiApplication>
+#else
+#include <QApplication>
+#endif
+
+#include <algorithm>
+
+#include <BlogClient>
+#include <BlogSync>
+#include <DraftLibrary>
+#include <MediaPipeline>
+
+#include "mockserver.h"
+
+static const int DEFAULT_PORT = 8080;
+static const int IMAGE_WIDTH = 1200;
+static const int IMAGE_HEIGHT = 800;
+static const int TOUCHED_POSTS = 25;
+static const int EDITED_DRAFTS = 5;
+
+static QTextStream &output()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+static void usage()
+{
+    output() << "Usage: orbitswriter-mockblog [options]\n"
+                "\n"
+                "Serves a MetaWeblog endpoint which keeps all posts in memory. The user\n"
+                "name and password are both \"admin\".\n"
+                "\n"
+                "  --port=N           port to listen on (default: 8080, 0 for any)\n"
+                "  --latency=MS       delay every response by MS milliseconds\n"
+                "  --fail-rate=P      answer a share P of the requests with 503\n"
+                "  --bench=N          publish N posts to the server and report throughput\n"
+                "  --images=K         images per post in the benchmark (default: 0)\n"
+                "  --uploads=C        concurrent media uploads in the benchmark (default: 4)\n"
+                "  --cache=DIR        media cache of the benchmark (default: in the temp dir)\n"
+                "  --sync-bench=N     sync a blog of N posts into a new draft library, then\n"
+                "                     again unchanged, after edits on the blog, and after\n"
+                "                     edits on both sides, and report time and bytes\n"
+                "  --page-size=P      posts per request in the sync benchmark (default: 50)\n";
+    output().flush();
+}
+
+/*
+    Publishes the posts through a BlogClient and records the time from
+    publish() to published() of each.
+ */
+class Benchmark : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Benchmark(GOW::BlogClient *client) : m_client(client), m_wallTime(0), m_failed(0)
+    {
+        connect(client, SIGNAL(published(int,QString)), this, SLOT(published(int)));
+        connect(client, SIGNAL(failed(int,QString,bool)), this, SLOT(failed(int,QString)));
+    }
+
+    void run(const QList<GOW::BlogPost> &posts, const QList<QList<GOW::MediaItem> > &media)
+    {
+        m_timer.start();
+        for (int i = 0; i < posts.count(); ++i) {
+            m_started.insert(m_client->publish(posts.at(i), media.at(i)), m_timer.nsecsElapsed());
+        }
+    }
+
+    qint64 elapsed() const { return m_wallTime; }
+    int failedCount() const { return m_failed; }
+    QVector<qint64> latencies() const { return m_latencies; }
+
+signals:
+    void finished();
+
+private slots:
+    void published(int job)
+    {
+        m_latencies << (m_timer.nsecsElapsed() - m_started.take(job)) / 1000;
+        checkFinished();
+    }
+
+    void failed(int job, const QString &message)
+    {
+        m_started.remove(job);
+        ++m_failed;
+        output() << "failed: " << message << '\n';
+        checkFinished();
+    }
+
+private:
+    void checkFinished()
+    {
+        if (m_started.isEmpty()) {
+            m_wallTime = m_timer.nsecsElapsed() / 1000;
+            emit finished();
+        }
+    }
+
+    GOW::BlogClient *m_client;
+    QElapsedTimer m_timer;
+    QHash<int, qint64> m_started;
+    QVector<qint64> m_latencies;
+    qint64 m_wallTime;
+    int m_failed;
+};
+
+/*
+    Runs one sync to its end.
+ */
+class SyncRun : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SyncRun(GOW::BlogSync *sync) : m_sync(sync), m_finished(false), m_ok(false)
+    {
+        connect(sync, SIGNAL(finished(bool,QString)), this, SLOT(finished(bool,QString)));
+    }
+
+    bool run()
+    {
+        m_finished = false;
+        QEventLoop loop;
+        connect(this, SIGNAL(done()), &loop, SLOT(quit()));
+        m_sync->sync();
+        if (!m_finished) {
+            loop.exec();
+        }
+        return m_ok;
+    }
+
+signals:
+    void done();
+
+private slots:
+    void finished(bool ok, const QString &message)
+    {
+        m_finished = true;
+        m_ok = ok;
+        if (!ok) {
+            output() << "failed: " << message << '\n';
+        }
+        emit done();
+    }
+
+private:
+    GOW::BlogSync *m_sync;
+    bool m_finished;
+    bool m_ok;
+};
+
+static QByteArray testImage(int index)
+{
+    QImage image(IMAGE_WIDTH, IMAGE_HEIGHT, QImage::Format_RGB32);
+    image.fill(QColor::fromHsv(index * 37 % 360, 160, 220).rgb());
+    QPainter painter(&image);
+    for (int i = 0; i < 24; ++i) {
+        painter.fillRect((index * 53 + i * 97) % IMAGE_WIDTH, i * IMAGE_HEIGHT / 24,
+                         IMAGE_WIDTH / 3, IMAGE_HEIGHT / 48, QColor::fromHsv((index + i * 29) % 360, 200, 160));
+    }
+    painter.end();
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, "PNG");
+    return data;
+}
+
+static qint64 percentile(const QVector<qint64> &sorted, int percent)
+{
+    if (sorted.isEmpty()) {
+        return 0;
+    }
+    return sorted.at(qMin(sorted.count() - 1, sorted.count() * percent / 100));
+}
+
+static GOW::BlogAccount benchmarkAccount(MockServer *server)
+{
+    GOW::BlogAccount account;
+    account.endpoint = QUrl(QString::fromLatin1("http://127.0.0.1:%1/xmlrpc.php").arg(server->serverPort()));
+    account.blogId = QLatin1String("1");
+    account.userName = QLatin1String("admin");
+    account.password = QLatin1String("admin");
+    return account;
+}
+
+static int runBenchmark(MockServer *server, int postCount, int imagesPerPost, int uploads,
+                        const QString &cacheRoot)
+{
+    QTextStream &stream = output();
+    QList<GOW::BlogPost> posts;
+    QList<QList<GOW::MediaItem> > media;
+    GOW::MediaPipeline pipeline(cacheRoot);
+    QElapsedTimer timer;
+    timer.start();
+    QString text;
+    for (int i = 0; i < 40; ++i) {
+        text += QLatin1String("Lorem ipsum dolor sit amet, consectetur adipiscing elit. ");
+    }
+    for (int i = 0; i < postCount; ++i) {
+        GOW::BlogPost post;
+        post.title = QString::fromLatin1("Benchmark post %1").arg(i + 1);
+        QList<GOW::MediaSource> sources;
+        for (int j = 0; j < imagesPerPost; ++j) {
+            const QString name = QString::fromLatin1("image-%1-%2.png").arg(i).arg(j);
+            sources << GOW::MediaSource(name, testImage(i * imagesPerPost + j));
+            post.content += QLatin1String("<p><img src=\"") + name + QLatin1String("\" /></p>\n");
+        }
+        post.content += QLatin1String("<p>") + text + QLatin1String("</p>\n");
+        posts << post;
+        media << pipeline.process(sources);
+    }
+    if (imagesPerPost > 0) {
+        stream << QString::fromLatin1("prepared %1 images in %2 s\n")
+                  .arg(postCount * imagesPerPost).arg(timer.elapsed() / 1000.0, 0, 'f', 2);
+        stream.flush();
+    }
+
+    GOW::BlogClient client;
+    client.setAccount(benchmarkAccount(server));
+    client.setMaxConcurrentUploads(uploads);
+    Benchmark benchmark(&client);
+    QEventLoop loop;
+    QObject::connect(&benchmark, SIGNAL(finished()), &loop, SLOT(quit()));
+    benchmark.run(posts, media);
+    if (postCount > 0) {
+        loop.exec();
+    }
+
+    QVector<qint64> latencies = benchmark.latencies();
+    std::sort(latencies.begin(), latencies.end());
+    const MockStats stats = server->stats();
+    const double seconds = benchmark.elapsed() / 1000000.0;
+    stream << QString::fromLatin1("%1 posts, %2 failed, %3 s (%4 posts/s)\n")
+              .arg(postCount).arg(benchmark.failedCount())
+              .arg(seconds, 0, 'f', 2).arg(seconds > 0 ? postCount / seconds : 0.0, 0, 'f', 1);
+    stream << QString::fromLatin1("latency: p50 %1 ms, p95 %2 ms, p99 %3 ms, max %4 ms\n")
+              .arg(percentile(latencies, 50) / 1000.0, 0, 'f', 2)
+              .arg(percentile(latencies, 95) / 1000.0, 0, 'f', 2)
+              .arg(percentile(latencies, 99) / 1000.0, 0, 'f', 2)
+              .arg(latencies.isEmpty() ? 0.0 : latencies.last() / 1000.0, 0, 'f', 2);
+    stream << QString::fromLatin1("server: %1 connections, %2 requests, %3 media objects, "
+                                  "%4 KB received, %5 KB sent\n")
+              .arg(stats.connections).arg(stats.requests).arg(stats.mediaObjects)
+              .arg(stats.bytesReceived / 1024).arg(stats.bytesSent / 1024);
+    stream.flush();
+    return benchmark.failedCount() > 0 ? 1 : 0;
+}
+
+static bool syncPass(const char *name, GOW::BlogSync *sync, MockServer *server)
+{
+    const MockStats before = server->stats();
+    SyncRun run(sync);
+    const bool ok = run.run();
+    const MockStats after = server->stats();
+    const GOW::SyncStats stats = sync->stats();
+    QTextStream &stream = output();
+    stream << QString::fromLatin1("%1: %2 s, %3 requests (%4 not modified), %5 posts received, "
+                                  "%6 created, %7 updated, %8 conflicts\n")
+              .arg(QLatin1String(name)).arg(stats.elapsed / 1000.0, 0, 'f', 3)
+              .arg(stats.pages).arg(stats.notModified).arg(stats.received)
+              .arg(stats.created).arg(stats.updated).arg(stats.conflicts);
+    stream << QString::fromLatin1("    %1 KB of responses; server sent %2 KB, received %3 KB\n")
+              .arg(stats.bytes / 1024.0, 0, 'f', 1)
+              .arg((after.bytesSent - before.bytesSent) / 1024.0, 0, 'f', 1)
+              .arg((after.bytesReceived - before.bytesReceived) / 1024.0, 0, 'f', 1);
+    stream.flush();
+    return ok;
+}
+
+/*
+    Syncs a blog of postCount posts into an empty library, then again
+    without changes, after posts changed on the blog, and after some of
+    those also changed in the library.
+ */
+static int runSyncBenchmark(MockServer *server, int postCount, int pageSize, const QString &dir)
+{
+    QDir().mkpath(dir);
+    const QString libraryFile = QDir(dir).filePath(QLatin1String("sync-bench.owl"));
+    const QString cacheFile = QDir(dir).filePath(QLatin1String("sync-bench.cache"));
+    QFile::remove(libraryFile);
+    QFile::remove(cacheFile);
+    QMetaObject::invokeMethod(server, "populate", Qt::BlockingQueuedConnection, Q_ARG(int, postCount));
+
+    GOW::DraftLibrary library;
+    if (!library.open(libraryFile)) {
+        output() << "Cannot open the library: " << library.errorString() << '\n';
+        return 2;
+    }
+    GOW::BlogClient client;
+    client.setAccount(benchmarkAccount(server));
+    GOW::BlogSync sync(&client, &library);
+    sync.setPageSize(pageSize);
+    if (!sync.open(cacheFile)) {
+        output() << "Cannot open the sync cache: " << sync.errorString() << '\n';
+        return 2;
+    }
+
+    bool ok = syncPass("full sync", &sync, server);
+    ok = ok && syncPass("unchanged", &sync, server);
+    QMetaObject::invokeMethod(server, "touch", Qt::BlockingQueuedConnection, Q_ARG(int, TOUCHED_POSTS));
+    ok = ok && syncPass("incremental", &sync, server);
+
+    // The drafts updated last are those of the touched posts.
+    const QVector<quint32> recent = library.draftIds(GOW::DraftLibrary::ByModified);
+    for (int i = 0; i < EDITED_DRAFTS && i < recent.count(); ++i) {
+        QTextDocument document;
+        const GOW::DraftInfo draft = library.draft(recent.at(i));
+        library.load(draft.id, &document);
+        library.save(draft.id, &document, draft.title, draft.tags);
+    }
+    QMetaObject::invokeMethod(server, "touch", Qt::BlockingQueuedConnection, Q_ARG(int, TOUCHED_POSTS));
+    ok = ok && syncPass("with local edits", &sync, server);
+    output() << library.count() << " drafts in the library\n";
+    output().flush();
+
+    library.close();
+    QFile::remove(libraryFile);
+    QFile::remove(cacheFile);
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+#if QT_VERSION >= 0x050000
+    // Images are painted for the benchmark; that needs no display.
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty()) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+#else
+    QApplication app(argc, argv, false);
+#endif
+
+    int port = -1;
+    int latency = 0;
+    double failureRate = 0;
+    int postCount = -1;
+    int imagesPerPost = 0;
+    int uploads = 4;
+    int syncPostCount = -1;
+    int pageSize = 50;
+    QString cacheRoot = QDir::temp().filePath(QLatin1String("orbitswriter-mockblog"));
+    const QStringList arguments = app.arguments();
+    for (int i = 1; i < arguments.count(); ++i) {
+        const QString argument = arguments.at(i);
+        const QString value = argument.section(QLatin1Char('='), 1);
+        if (argument.startsWith(QLatin1String("--port="))) {
+            port = value.toInt();
+        } else if (argument.startsWith(QLatin1String("--latency="))) {
+            latency = value.toInt();
+        } else if (argument.startsWith(QLatin1String("--fail-rate="))) {
+            failureRate = value.toDouble();
+        } else if (argument.startsWith(QLatin1String("--bench="))) {
+            postCount = value.toInt();
+        } else if (argument.startsWith(QLatin1String("--images="))) {
+            imagesPerPost = value.toInt();
+        } else if (argument.startsWith(QLatin1String("--uploads="))) {
+            uploads = value.toInt();
+        } else if (argument.startsWith(QLatin1String("--sync-bench="))) {
+            syncPostCount = value.toInt();
+        } else if (argument.startsWith(QLatin1String("--page-size="))) {
+            pageSize = value.toInt();
+        } else if (argument.startsWith(QLatin1String("--cache="))) {
+            cacheRoot = QDir(value).absolutePath();
+        } else {
+            usage();
+            return argument == QLatin1String("--help") ? 0 : 2;
+        }
+    }
+
+    MockServer server;
+    server.setLatency(latency);
+    server.setFailureRate(failureRate);
+    if (postCount < 0 && syncPostCount < 0) {
+        if (!server.start(quint16(port < 0 ? DEFAULT_PORT : port), false)) {
+            output() << "Cannot listen on port " << port << ": " << server.errorString() << '\n';
+            return 1;
+        }
+        output() << "Serving http://localhost:" << server.serverPort() << "/xmlrpc.php\n";
+        output().flush();
+        return app.exec();
+    }
+
+    // The server gets its own thread, so its work does not count as client latency.
+    QThread thread;
+    server.moveToThread(&thread);
+    thread.start();
+    bool listening = false;
+    QMetaObject::invokeMethod(&server, "start", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, listening),
+                              Q_ARG(quint16, quint16(qMax(0, port))), Q_ARG(bool, true));
+    int result = 2;
+    if (listening && syncPostCount >= 0) {
+        result = runSyncBenchmark(&server, syncPostCount, pageSize, cacheRoot);
+    } else if (listening) {
+        result = runBenchmark(&server, postCount, imagesPerPost, uploads, cacheRoot);
+    } else {
+        output() << "Cannot listen: " << server.errorString() << '\n';
+    }
+    QMetaObject::invokeMethod(&server, "stop", Qt::BlockingQueuedConnection);
+    thread.quit();
+    thread.wait();
+    return result;
+}
+
+#include "main.moc"
@@ -0,0 +1,530 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QHostAddress>
+#include <QMutexLocker>
+#include <QTcpSocket>
+
+#include <algorithm>
+
+#include "mockserver.h"
+
+static const char * const DATE_TIME_FORMAT = "yyyyMMddTHH:mm:ss";
+static const int FAULT_UNKNOWN_METHOD = -32601;
+static const int FAULT_ACCESS_DENIED = 403;
+static const int FAULT_NOT_FOUND = 404;
+static const int DEFAULT_PAGE_SIZE = 10;
+
+static const char * const CATEGORIES[] = { "Notes", "Travel", "Code", "Photos" };
+static const int CATEGORY_COUNT = 4;
+
+/*
+    Orders post ids by modification time, newest first, as WordPress does
+    for orderby post_modified.
+ */
+struct ModifiedLater
+{
+    explicit ModifiedLater(const QMap<int, MockPost> *posts) : posts(posts) {}
+
+    bool operator()(int a, int b) const
+    {
+        const QDateTime first = posts->value(a).modified;
+        const QDateTime second = posts->value(b).modified;
+        return first > second || (first == second && a > b);
+    }
+
+    const QMap<int, MockPost> *posts;
+};
+
+static QByteArray escape(const QString &text)
+{
+    QString result = text;
+    result.replace(QLatin1Char('&'), QLatin1String("&amp;"));
+    result.replace(QLatin1Char('<'), QLatin1String("&lt;"));
+    result.replace(QLatin1Char('>'), QLatin1String("&gt;"));
+    return result.toUtf8();
+}
+
+static void writeValue(QByteArray *xml, const QVariant &value)
+{
+    xml->append("<value>");
+    switch (value.type()) {
+    case QVariant::Bool:
+        xml->append(value.toBool() ? "<boolean>1</boolean>" : "<boolean>0</boolean>");
+        break;
+    case QVariant::Int:
+    case QVariant::LongLong:
+        xml->append("<int>" + QByteArray::number(value.toLongLong()) + "</int>");
+        break;
+    case QVariant::DateTime:
+        xml->append("<dateTime.iso8601>"
+                    + value.toDateTime().toString(QLatin1String(DATE_TIME_FORMAT)).toLatin1()
+                    + "</dateTime.iso8601>");
+        break;
+    case QVariant::List:
+    case QVariant::StringList:
+        xml->append("<array><data>");
+        foreach (const QVariant &item, value.toList()) {
+            writeValue(xml, item);
+        }
+        xml->append("</data></array>");
+        break;
+    case QVariant::Map: {
+        xml->append("<struct>");
+        const QVariantMap map = value.toMap();
+        for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it) {
+            xml->append("<member><name>" + escape(it.key()) + "</name>");
+            writeValue(xml, it.value());
+            xml->append("</member>");
+        }
+        xml->append("</struct>");
+        break;
+    }
+    default:
+        xml->append("<string>" + escape(value.toString()) + "</string>");
+        break;
+    }
+    xml->append("</value>");
+}
+
+MockServer::MockServer(QObject *parent) :
+    QTcpServer(parent),
+    m_userName(QLatin1String("admin")),
+    m_password(QLatin1String("admin")),
+    m_latency(0),
+    m_failureRate(0),
+    m_nextPost(1)
+{
+    m_delayTimer.setSingleShot(true);
+    connect(&m_delayTimer, SIGNAL(timeout()), this, SLOT(sendDelayed()));
+    connect(this, SIGNAL(newConnection()), this, SLOT(acceptConnections()));
+    m_clock.start();
+}
+
+void MockServer::setCredentials(const QString &userName, const QString &password)
+{
+    m_userName = userName;
+    m_password = password;
+}
+
+/*
+    Delays every response by \a msecs, as a network round trip would.
+ */
+void MockServer::setLatency(int msecs)
+{
+    m_latency = qMax(0, msecs);
+}
+
+/*
+    Answers the given share of requests with 503, for trying retries.
+ */
+void MockServer::setFailureRate(double rate)
+{
+    m_failureRate = qBound(0.0, rate, 1.0);
+}
+
+MockStats MockServer::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_stats;
+}
+
+bool MockServer::start(quint16 port, bool localOnly)
+{
+    return listen(localOnly ? QHostAddress(QHostAddress::LocalHost) : QHostAddress(QHostAddress::Any), port);
+}
+
+/*
+    Adds \a count published posts, modified a minute apart up to a minute
+    ago, as an existing blog would have.
+ */
+void MockServer::populate(int count)
+{
+    QString text;
+    for (int i = 0; i < 30; ++i) {
+        text += QLatin1String("Lorem ipsum dolor sit amet, consectetur adipiscing elit. ");
+    }
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    for (int i = 0; i < count; ++i) {
+        const int id = m_nextPost++;
+        MockPost &post = m_posts[id];
+        post.id = QString::number(id);
+        post.title = QString::fromLatin1("Post %1").arg(id);
+        post.description = QString::fromLatin1("<p>%1</p>\n<p>%2</p>\n").arg(post.title).arg(text);
+        post.categories << QLatin1String(CATEGORIES[id % CATEGORY_COUNT]);
+        post.modified = now.addSecs(-60 * (count - i));
+        post.dateCreated = post.modified;
+        post.publish = true;
+    }
+    m_byModified.clear();
+    QMutexLocker locker(&m_mutex);
+    m_stats.posts += count;
+}
+
+/*
+    Edits \a count posts spread evenly over the blog, the same ones on
+    every call, as if they were changed on the blog itself.
+ */
+void MockServer::touch(int count)
+{
+    if (m_posts.isEmpty() || count <= 0) {
+        return;
+    }
+    const QList<int> ids = m_posts.keys();
+    const int step = qMax(1, ids.count() / count);
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    for (int i = 0; i < count && i * step < ids.count(); ++i) {
+        MockPost &post = m_posts[ids.at(i * step)];
+        post.description += QString::fromLatin1("<p>Updated at %1.</p>\n").arg(now.toString(Qt::ISODate));
+        post.modified = now;
+    }
+    m_byModified.clear();
+}
+
+/*
+    Closes the server and all connections, and hands the server back to
+    the main thread if it was running in another one.
+ */
+void MockServer::stop()
+{
+    close();
+    foreach (QTcpSocket *socket, m_connections.keys()) {
+        socket->abort();
+        delete socket;
+    }
+    m_connections.clear();
+    m_delayed.clear();
+    moveToThread(QCoreApplication::instance()->thread());
+}
+
+void MockServer::acceptConnections()
+{
+    while (hasPendingConnections()) {
+        QTcpSocket *socket = nextPendingConnection();
+        m_connections.insert(socket, Connection());
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readRequests()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(dropConnection()));
+        QMutexLocker locker(&m_mutex);
+        ++m_stats.connections;
+    }
+}
+
+void MockServer::dropConnection()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    m_connections.remove(socket);
+    socket->deleteLater();
+}
+
+/*
+    Handles every complete request in the buffer; clients may send the
+    next request on a connection before the previous one is answered.
+ */
+void MockServer::readRequests()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!m_connections.contains(socket)) {
+        return;
+    }
+    Connection &connection = m_connections[socket];
+    const QByteArray data = socket->readAll();
+    connection.buffer += data;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stats.bytesReceived += data.size();
+    }
+    forever {
+        if (connection.bodySize < 0 && !readHeader(&connection)) {
+            return;
+        }
+        if (connection.buffer.size() < connection.bodySize) {
+            return;
+        }
+        const QByteArray body = connection.buffer.left(connection.bodySize);
+        connection.buffer.remove(0, connection.bodySize);
+        connection.bodySize = -1;
+        const bool close = !connection.keepAlive;
+        const QByteArray ifNoneMatch = connection.ifNoneMatch;
+        {
+            QMutexLocker locker(&m_mutex);
+            ++m_stats.requests;
+        }
+        if (connection.method != "POST") {
+            respond(socket, "405 Method Not Allowed", QByteArray(), close);
+        } else if (m_failureRate > 0 && qrand() < m_failureRate * RAND_MAX) {
+            QMutexLocker locker(&m_mutex);
+            ++m_stats.failures;
+            locker.unlock();
+            respond(socket, "503 Service Unavailable", QByteArray(), close);
+        } else {
+            const QByteArray response = handle(body);
+            const QByteArray etag = '"' + QCryptographicHash::hash(response, QCryptographicHash::Sha1)
+                    .toHex() + '"';
+            if (etag == ifNoneMatch) {
+                QMutexLocker locker(&m_mutex);
+                ++m_stats.notModified;
+                locker.unlock();
+                respond(socket, "304 Not Modified", QByteArray(), close, etag);
+            } else {
+                respond(socket, "200 OK", response, close, etag);
+            }
+        }
+        if (close) {
+            return;
+        }
+    }
+}
+
+bool MockServer::readHeader(Connection *connection)
+{
+    const int end = connection->buffer.indexOf("\r\n\r\n");
+    if (end < 0) {
+        return false;
+    }
+    const QList<QByteArray> lines = connection->buffer.left(end).split('\n');
+    connection->buffer.remove(0, end + 4);
+    const QList<QByteArray> request = lines.first().trimmed().split(' ');
+    connection->method = request.value(0);
+    connection->path = request.value(1);
+    connection->keepAlive = !request.value(2).endsWith("1.0");
+    connection->ifNoneMatch.clear();
+    connection->bodySize = 0;
+    for (int i = 1; i < lines.count(); ++i) {
+        const int colon = lines.at(i).indexOf(':');
+        const QByteArray name = lines.at(i).left(colon).trimmed().toLower();
+        const QByteArray value = lines.at(i).mid(colon + 1).trimmed();
+        if (name == "content-length") {
+            connection->bodySize = value.toLongLong();
+        } else if (name == "connection") {
+            connection->keepAlive = value.toLower() != "close";
+        } else if (name == "if-none-match") {
+            connection->ifNoneMatch = value;
+        }
+    }
+    return true;
+}
+
+QByteArray MockServer::handle(const QByteArray &body)
+{
+    QByteArray data = body;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    const GOW::XmlRpcCall call = GOW::XmlRpcCall::parse(&buffer);
+    int faultCode = 0;
+    QString faultString;
+    QVariant value;
+    if (!call.ok) {
+        faultCode = -32700;
+        faultString = call.errorString;
+    } else {
+        value = dispatch(call, &faultCode, &faultString);
+    }
+
+    QByteArray xml("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<methodResponse>");
+    if (faultCode != 0) {
+        QVariantMap fault;
+        fault.insert(QLatin1String("faultCode"), faultCode);
+        fault.insert(QLatin1String("faultString"), faultString);
+        xml.append("<fault>");
+        writeValue(&xml, fault);
+        xml.append("</fault>");
+    } else {
+        xml.append("<params><param>");
+        writeValue(&xml, value);
+        xml.append("</param></params>");
+    }
+    xml.append("</methodResponse>\n");
+    return xml;
+}
+
+QVariant MockServer::dispatch(const GOW::XmlRpcCall &call, int *faultCode, QString *faultString)
+{
+    if (call.params.value(1).toString() != m_userName || call.params.value(2).toString() != m_password) {
+        *faultCode = FAULT_ACCESS_DENIED;
+        *faultString = QLatin1String("Incorrect user name or password.");
+        return QVariant();
+    }
+
+    if (call.method == QLatin1String("metaWeblog.newMediaObject")) {
+        const QVariantMap file = call.params.value(3).toMap();
+        const QString name = file.value(QLatin1String("name")).toString();
+        const QString host = serverAddress() == QHostAddress(QHostAddress::Any)
+                ? QString::fromLatin1("localhost") : serverAddress().toString();
+        const QString url = QString::fromLatin1("http://%1:%2/media/%3")
+                .arg(host).arg(serverPort()).arg(name);
+        m_media.insert(name, url);
+        QMutexLocker locker(&m_mutex);
+        ++m_stats.mediaObjects;
+        locker.unlock();
+        QVariantMap result;
+        result.insert(QLatin1String("id"), name);
+        result.insert(QLatin1String("file"), name);
+        result.insert(QLatin1String("url"), url);
+        return result;
+    }
+
+    if (call.method == QLatin1String("metaWeblog.getRecentPosts")) {
+        QVariantList posts;
+        const int count = call.params.value(3).toInt();
+        QMap<int, MockPost>::const_iterator it = m_posts.constEnd();
+        while (it != m_posts.constBegin() && posts.count() < count) {
+            --it;
+            posts << postStruct(it.value());
+        }
+        return posts;
+    }
+
+    if (call.method == QLatin1String("wp.getPosts")) {
+        return getPosts(call.params.value(3).toMap());
+    }
+
+    const bool create = call.method == QLatin1String("metaWeblog.newPost");
+    const bool edit = call.method == QLatin1String("metaWeblog.editPost");
+    const bool get = call.method == QLatin1String("metaWeblog.getPost");
+    if (!create && !edit && !get) {
+        *faultCode = FAULT_UNKNOWN_METHOD;
+        *faultString = QString::fromLatin1("Unknown method %1.").arg(call.method);
+        return QVariant();
+    }
+    const int id = create ? m_nextPost++ : call.params.value(0).toInt();
+    if (!create && !m_posts.contains(id)) {
+        *faultCode = FAULT_NOT_FOUND;
+        *faultString = QLatin1String("Invalid post ID.");
+        return QVariant();
+    }
+    if (get) {
+        return postStruct(m_posts.value(id));
+    }
+
+    const QVariantMap content = call.params.value(3).toMap();
+    MockPost &post = m_posts[id];
+    post.id = QString::number(id);
+    post.title = content.value(QLatin1String("title")).toString();
+    post.description = content.value(QLatin1String("description")).toString();
+    post.categories = content.value(QLatin1String("categories")).toStringList();
+    post.dateCreated = content.value(QLatin1String("dateCreated")).toDateTime();
+    post.modified = QDateTime::currentDateTimeUtc();
+    if (!post.dateCreated.isValid()) {
+        post.dateCreated = post.modified;
+    }
+    post.customFields = content.value(QLatin1String("custom_fields")).toList();
+    post.publish = call.params.value(4).toBool();
+    m_byModified.clear();
+    if (create) {
+        QMutexLocker locker(&m_mutex);
+        ++m_stats.posts;
+        return post.id;
+    }
+    return true;
+}
+
+QVariant MockServer::postStruct(const MockPost &post) const
+{
+    QVariantMap result;
+    result.insert(QLatin1String("postid"), post.id);
+    result.insert(QLatin1String("title"), post.title);
+    result.insert(QLatin1String("description"), post.description);
+    result.insert(QLatin1String("categories"), post.categories);
+    result.insert(QLatin1String("dateCreated"), post.dateCreated);
+    result.insert(QLatin1String("post_status"), QLatin1String(post.publish ? "publish" : "draft"));
+    result.insert(QLatin1String("custom_fields"), post.customFields);
+    return result;
+}
+
+/*
+    Returns a page of posts in the order of the last modification, newest
+    first, whatever the filter asks for.
+ */
+QVariant MockServer::getPosts(const QVariantMap &filter)
+{
+    if (m_byModified.isEmpty() && !m_posts.isEmpty()) {
+        m_byModified = m_posts.keys();
+        std::sort(m_byModified.begin(), m_byModified.end(), ModifiedLater(&m_posts));
+    }
+    const int number = filter.contains(QLatin1String("number"))
+            ? filter.value(QLatin1String("number")).toInt() : DEFAULT_PAGE_SIZE;
+    const int offset = qMax(0, filter.value(QLatin1String("offset")).toInt());
+    QVariantList posts;
+    for (int i = offset; i < m_byModified.count() && i < offset + number; ++i) {
+        posts << wpPostStruct(m_posts.value(m_byModified.at(i)));
+    }
+    return posts;
+}
+
+QVariant MockServer::wpPostStruct(const MockPost &post) const
+{
+    QVariantList terms;
+    foreach (const QString &category, post.categories) {
+        QVariantMap term;
+        term.insert(QLatin1String("taxonomy"), QLatin1String("category"));
+        term.insert(QLatin1String("name"), category);
+        terms << term;
+    }
+    QVariantMap result;
+    result.insert(QLatin1String("post_id"), post.id);
+    result.insert(QLatin1String("post_title"), post.title);
+    result.insert(QLatin1String("post_content"), post.description);
+    result.insert(QLatin1String("post_modified_gmt"), post.modified);
+    result.insert(QLatin1String("terms"), terms);
+    return result;
+}
+
+void MockServer::respond(QTcpSocket *socket, const QByteArray &status, const QByteArray &body, bool close,
+                         const QByteArray &etag)
+{
+    Response response;
+    response.socket = socket;
+    response.close = close;
+    response.data = "HTTP/1.1 " + status + "\r\n"
+            "Content-Type: text/xml; charset=UTF-8\r\n"
+            "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+            + (etag.isEmpty() ? QByteArray() : "ETag: " + etag + "\r\n")
+            + (close ? "Connection: close\r\n" : "Connection: keep-alive\r\n")
+            + "\r\n" + body;
+    response.due = m_clock.elapsed() + m_latency;
+    m_delayed.enqueue(response);
+    sendDelayed();
+}
+
+void MockServer::sendDelayed()
+{
+    const qint64 now = m_clock.elapsed();
+    while (!m_delayed.isEmpty() && m_delayed.head().due <= now) {
+        const Response response = m_delayed.dequeue();
+        if (!response.socket) {
+            continue;
+        }
+        response.socket->write(response.data);
+        {
+            QMutexLocker locker(&m_mutex);
+            m_stats.bytesSent += response.data.size();
+        }
+        if (response.close) {
+            response.socket->disconnectFromHost();
+        }
+    }
+    if (!m_delayed.isEmpty()) {
+        m_delayTimer.start(int(qMax(qint64(0), m_delayed.head().due - now)));
+    }
+}
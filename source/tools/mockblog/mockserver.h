@@ -0,0 +1,146 @@
+/*-------------------------------------------------
+ *
+ * OrbitsWriter - An Offline Blog Writer
+ *
+ * Copyright (C) 2012 devbean@galaxyworld.org
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-------------------------------------------------*/
+
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QPointer>
+#include <QQueue>
+#include <QStringList>
+#include <QTcpServer>
+#include <QTimer>
+
+#include <XmlRpc>
+
+QT_FORWARD_DECLARE_CLASS(QTcpSocket)
+
+struct MockPost
+{
+    MockPost() : publish(false) {}
+
+    QString id;
+    QString title;
+    QString description;
+    QStringList categories;
+    QDateTime dateCreated;
+    QDateTime modified;
+    QVariantList customFields;
+    bool publish;
+};
+
+struct MockStats
+{
+    MockStats() : connections(0), requests(0), failures(0), posts(0), mediaObjects(0),
+        notModified(0), bytesReceived(0), bytesSent(0) {}
+
+    int connections;
+    int requests;
+    int failures;
+    int posts;
+    int mediaObjects;
+    int notModified;
+    qint64 bytesReceived;
+    qint64 bytesSent;
+};
+
+/*
+    A MetaWeblog endpoint which keeps everything in memory, so publishing
+    can be tried and measured without a network or a real blog. It speaks
+    HTTP/1.1 with keep-alive and accepts POSTs to any path. Responses carry
+    an ETag, and a request whose If-None-Match matches it is answered with
+    an empty 304.
+ */
+class MockServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    explicit MockServer(QObject *parent = 0);
+
+    void setCredentials(const QString &userName, const QString &password);
+    void setLatency(int msecs);
+    void setFailureRate(double rate);
+
+    MockStats stats() const;
+
+public slots:
+    bool start(quint16 port, bool localOnly);
+    void stop();
+    void populate(int count);
+    void touch(int count);
+
+private slots:
+    void acceptConnections();
+    void readRequests();
+    void dropConnection();
+    void sendDelayed();
+
+private:
+    struct Connection
+    {
+        Connection() : bodySize(-1), keepAlive(true) {}
+
+        QByteArray buffer;
+        QByteArray method;
+        QByteArray path;
+        QByteArray ifNoneMatch;
+        qint64 bodySize; // -1 while the header is incomplete
+        bool keepAlive;
+    };
+
+    struct Response
+    {
+        QPointer<QTcpSocket> socket;
+        QByteArray data;
+        qint64 due;
+        bool close;
+    };
+
+    bool readHeader(Connection *connection);
+    QByteArray handle(const QByteArray &body);
+    QVariant dispatch(const GOW::XmlRpcCall &call, int *faultCode, QString *faultString);
+    QVariant postStruct(const MockPost &post) const;
+    QVariant wpPostStruct(const MockPost &post) const;
+    QVariant getPosts(const QVariantMap &filter);
+    void respond(QTcpSocket *socket, const QByteArray &status, const QByteArray &body, bool close,
+                 const QByteArray &etag = QByteArray());
+
+    QString m_userName;
+    QString m_password;
+    int m_latency;
+    double m_failureRate;
+    QHash<QTcpSocket *, Connection> m_connections;
+    QQueue<Response> m_delayed; // the latency is fixed, so in order of due time
+    QTimer m_delayTimer;
+    QElapsedTimer m_clock;
+    QMap<int, MockPost> m_posts;
+    QList<int> m_byModified; // newest first; empty when out of date
+    int m_nextPost;
+    QHash<QString, QString> m_media; // name -> URL
+    mutable QMutex m_mutex;
+    MockStats m_stats;
+};
+
+#endif // MOCKSERVER_H